@@ -32,9 +32,7 @@ namespace LookingGlass.Framework.Parameters {
 public class AppParameters : IAppParameters, IParameterPersist {
 
 
-#pragma warning disable 0067    // disable unused event warning
     public event ParamValueModifiedCallback OnModifiedCallback;
-#pragma warning restore 0067
 
     protected paramErrorType paramErrorMethod = paramErrorType.eNullValue;
     public paramErrorType ParamErrorMethod {
@@ -151,24 +149,40 @@ public class AppParameters : IAppParameters, IParameterPersist {
         return false;
     }
 
+    // The parameter set that has the value fires its event too
     public void Update(string key, OMVSD.OSD value) {
-        UpdateSilent(key, value);
+        if (InternalUpdate(key, value, false)) {
+            if (OnModifiedCallback != null) OnModifiedCallback(this, key, value);
+        }
     }
 
     // Note that this does not do the update event thing
     public void UpdateSilent(string key, OMVSD.OSD value) {
+        InternalUpdate(key, value, true);
+    }
+
+    // updates the highest priority set that has the key. Returns true if one did.
+    private bool InternalUpdate(string key, OMVSD.OSD value, bool silent) {
+        ParameterSet pset = null;
         if (m_overrideParams.HasParameter(key)) {
-            m_overrideParams.Update(key, value);
-            return;
+            pset = m_overrideParams;
         }
         else if (m_userParams.HasParameter(key)) {
-            m_userParams.Update(key, value);
-            return;
+            pset = m_userParams;
         }
         else if (m_iniParams.HasParameter(key)) {
-            m_iniParams.Update(key, value);
-            return;
+            pset = m_iniParams;
+        }
+        if (pset == null) {
+            return false;
+        }
+        if (silent) {
+            pset.UpdateSilent(key, value);
+        }
+        else {
+            pset.Update(key, value);
         }
+        return true;
     }
 
     public OMVSD.OSD ParamValue(string key) {
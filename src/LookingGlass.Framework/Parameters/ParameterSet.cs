@@ -118,23 +118,21 @@ public class ParameterSet : IParameters, IDisplayable {
     }
 
     public void Add(string key, string value) {
-        string lkey = key.ToLower();
-        lock (m_params) {
-            if (m_params.ContainsKey(lkey)) {
-                m_params.Remove(lkey);
-            }
-            m_params.Add(lkey, new OMVSD.OSDString(value));
-        }
+        Add(key, new OMVSD.OSDString(value));
     }
 
+    // Listeners are told if the add replaces a value with a different one
     public void Add(string key, OMVSD.OSD value) {
         string lkey = key.ToLower();
+        bool changed = false;
         lock (m_params) {
             if (m_params.ContainsKey(lkey)) {
+                changed = m_params[lkey].AsString() != value.AsString();
                 m_params.Remove(lkey);
             }
             m_params.Add(lkey, value);
         }
+        if (changed && OnModifiedCallback != null) OnModifiedCallback(this, key, value);
     }
 
     /// <summary>
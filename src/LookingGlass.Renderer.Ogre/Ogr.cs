@@ -35,51 +35,6 @@ static class Ogr {
     public const int ResourceTypeMaterial = 3;  // material
     public const int ResourceTypeTransparentTexture = 4;  // texture with some transparancy
 
-    // offsets into statistics block
-    // Numbers coorespond to numbers in LookingGlassOgre/LookingGlassOgre.h
-    // culling and visibility
-    public const int StatVisibleToVisible = 2;
-    public const int StatInvisibleToVisible = 3;
-    public const int StatVisibleToInvisible = 4;
-    public const int StatInvisibleToInvisible = 5;
-    public const int StatCullMeshesLoaded = 6;
-    public const int StatCullTexturesLoaded = 7;
-    public const int StatCullMeshesUnloaded = 13;
-    public const int StatCullTexturesUnloaded = 14;
-    public const int StatCullMeshesQueuedToLoad = 15;
-    // between frame work
-    public const int StatBetweenFrameWorkItems = 1;
-    public const int StatBetweenFrameRefreshResource = 8;
-    public const int StatBetweenFrameRemoveSceneNode = 30;
-    public const int StatBetweenFrameCreateMaterialResource = 9;
-    public const int StatBetweenFrameCreateMeshResource = 10;
-    public const int StatBetweenFrameCreateMeshSceneNode = 11;
-    public const int StatBetweenFrameAddLoadedMesh = 29;
-    public const int StatBetweenFrameUpdateSceneNode = 12;
-    public const int StatBetweenFrameTotalProcessed = 16;
-    public const int StatBetweenFrameUnknownProcess = 17;
-    public const int StatBetweenFrameDiscardedDups = 21;
-    // general process work thread
-    public const int StatProcessAnyTimeWorkItems = 23;
-    public const int StatProcessAnyTimeTotalProcessed = 24;
-    public const int StatProcessAnyTimeDiscardedDups = 22;
-    // material processing queues
-    public const int StatMaterialUpdatesRemaining = 0;
-    // mesh processing queues
-    public const int StatMeshTrackerLoadQueued = 25;
-    public const int StatMeshTrackerUnloadQueued = 26;
-    public const int StatMeshTrackerSerializedQueued = 27;
-    public const int StatMeshTrackerTotalQueued = 28;
-    // misc info
-    public const int StatTotalFrames = 18;
-    public const int StatFramesPerSec = 19;
-    public const int StatLastFrameMs = 20;
-    public const int StatLockParity = 31;
-    public const int StatInOut = 32;
-
-    // the number of stat values (oversized for a fudge factor)
-    public const int StatSize = 40;
-
     // codes for level of details for the tracked regions
     public const int RegionRezCodeHigh = 0;
     public const int RegionRezCodeMed = 1;
@@ -115,6 +70,10 @@ static class Ogr {
     // Fetch a configuration parameter
     [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
     public static extern void SetFetchParameterCallback(FetchParameterCallback callback);
+    // Push a parameter value into the native parameter store
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern void UpdateParameter([MarshalAs(UnmanagedType.LPStr)]string paramName,
+                            [MarshalAs(UnmanagedType.LPStr)]string paramValue);
     
     // Log a debug message
     [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
@@ -136,9 +95,20 @@ static class Ogr {
     [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
     public static extern void SetBetweenFramesCallback(BetweenFramesCallback callback);
 
-    // A pinned statistics block that is updated by Ogre and displayed by LG
+    // Statistics kept by Ogre and displayed by LG. The values are described by a
+    // schema (see LookingGlassOgre/LGStats.cpp) so they are not numbered here.
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern void EnableStats(bool onOff);
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern int StatsSchemaVersion();
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern int StatsSchemaSize();
+    // returns the divisor for displaying the value or zero if there is no such entry
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern int StatsSchemaEntry(int index, StringBuilder name, int nameLen,
+            StringBuilder desc, int descLen);
     [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
-    public static extern void SetStatsBlock(IntPtr block);
+    public static extern int StatsSnapshot([MarshalAs(UnmanagedType.LPArray)] long[] values, int count);
 
     // =============================================================================
     [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
@@ -234,6 +204,29 @@ static class Ogr {
     public static extern bool UpdateAnimationBF(float prio,
             [MarshalAs(UnmanagedType.LPStr)]string sceneNodeName,
             float X, float Y, float Z, float rate);
+    // dead reckoning: the node keeps moving with the velocities until the next update.
+    // The timestamp is in seconds on any clock that's used for all updates.
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern void UpdateMotion(
+            [MarshalAs(UnmanagedType.LPStr)]string sceneNodeName,
+            float px, float py, float pz, float vx, float vy, float vz,
+            float ax, float ay, float az, float rw, float rx, float ry, float rz,
+            float wx, float wy, float wz, double timestamp);
+    // queue do-nothing work from some threads to measure the time to queue work
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern void BetweenFrameLoadTest(int threads, int items);
+    // write the frame phase trace to a Chrome trace-event file (if tracing is enabled)
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern bool DumpTrace();
+    // log the lock contention profile and return it (up to the capacity of 'buff')
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern int DumpLockProfile(StringBuilder buff, int buffLen, bool reset);
+    // start, change or (weight of zero) stop a skeletal animation on an entity
+    [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
+    public static extern void SetAvatarAnimation(
+            [MarshalAs(UnmanagedType.LPStr)]string entityName,
+            [MarshalAs(UnmanagedType.LPStr)]string animName,
+            float weight, float rate, int loop);
     // ======================================================================
     [DllImport("LookingGlassOgre", CallingConvention = CallingConvention.Cdecl), SuppressUnmanagedCodeSecurity]
     public static extern void AddRegionBF(float prio,
@@ -57,7 +57,11 @@ class RenderAvatar : IRenderEntity {
             parentSceneNodeName = EntityNameOgre.ConvertToOgreSceneNodeName(m_ent.RegionContext.Name);
 
             IWorldRenderConv wrc;
-            if (m_ent.TryGet<IWorldRenderConv>(out wrc)) {
+            if (m_defaultAvatarMesh != null && m_defaultAvatarMesh.Length > 0) {
+                // all the avatars are instances of the one mesh (and its skeleton)
+                entMeshName = EntityNameOgre.ConvertToOgreMeshName(new EntityName(m_defaultAvatarMesh));
+            }
+            else if (m_ent.TryGet<IWorldRenderConv>(out wrc)) {
                 entMeshName = EntityNameOgre.ConvertToOgreMeshName(m_ent.Name);
                 if (!wrc.CreateAvatarMeshResource(0f, m_ent, entMeshName.Name, m_ent.Name)) {
                     // something about this avatar can't be created yet. Try again later.
@@ -99,8 +99,8 @@ public class RendererOgre : ModuleBase, IRenderProvider {
 
     private RestHandler m_ogreStatsHandler;
     private ParameterSet m_ogreStats;
-    private int[] m_ogreStatsPinned;
-    private GCHandle m_ogreStatsHandle;
+    private long[] m_ogreStatsValues;
+    private int m_ogreStatsLastRead = 0;
 
     // ==========================================================================
     public RendererOgre() {
@@ -136,6 +136,10 @@ public class RendererOgre : ModuleBase, IRenderProvider {
                     "File that lists Ogre plugins to load");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.ResourcesFilename", "resources.cfg",
                     "File that lists the Ogre resources to load");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Headless", "false",
+                    "Run without a window or GPU. Nothing is drawn (used by the replay benchmark)");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Replay.Record", "",
+                    "If set, the file to record the calls into the renderer in for LookingGlassReplayBench");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.DefaultNumMipmaps", "2",
                     "Default number of mip maps created for a texture (usually 6)");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.CacheDir", Utilities.GetDefaultApplicationStorageDir(null),
@@ -152,6 +156,18 @@ public class RendererOgre : ModuleBase, IRenderProvider {
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.OceanMaterialName",
                     "LookingGlass/Ocean",
                     "The ogre name of the ocean texture");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Region.RebaseDistance", "4096",
+                    "Distance the focus region can be from the coordinate origin before the origin is moved");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Prefetch.Seconds", "3.0",
+                    "How far ahead (seconds) to predict camera movement for prefetching. Zero turns off prefetch");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Prefetch.Radius", "64",
+                    "Distance around the predicted camera position to prefetch");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Prefetch.MaxItems", "200",
+                    "Maximum number of queued work items to move forward on each prefetch");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Region.Proxy.Enable", "true",
+                    "Display distant (low and very low detail) regions as a baked terrain proxy");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Region.Proxy.TextureSize", "256",
+                    "Size of the texture baked for low detail region proxies (halved for very low)");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.DefaultMeshFilename", 
                     System.IO.Path.Combine(System.AppDomain.CurrentDomain.BaseDirectory, "./LookingGlassResources/LoadingShape.mesh"),
                     "Filename of the default shape found in the cache dir");
@@ -181,11 +197,59 @@ public class RendererOgre : ModuleBase, IRenderProvider {
                     "Cost of queued C++ work items to do between each frame");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.BetweenFrame.Costs.Total", "200",
                     "The total cost of C# operations to do between each frame");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.BetweenFrame.QueueSize", "4096",
+                    "Work items that can be waiting to be picked up by the frame thread before queuing slows down");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.AsyncLog", "true",
+                    "Queue C++ log messages and send them in batches from a background thread");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.LogDetail", "false",
+                    "Also log the C++ messages from the busy places (per work item, per scene node update)");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.LockProfile", "false",
+                    "Record how long each C++ lock is waited for and held (see ogreStats LockProfile)");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Trace.Enable", "false",
+                    "Record a timeline of the frame phases that can be written as a Chrome trace");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Trace.LongFrameMs", "250",
+                    "Write the trace when a frame takes longer than this (zero to only write when asked)");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Trace.Filename", "LookingGlassTrace",
+                    "Start of the trace file names. A number and '.json' are added");
 
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.SerializeMaterials", "false",
                     "Write out materials to files (replace with DB someday)");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.SerializeMeshes", "true",
                     "Write out meshes to files");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Placeholders.Enable", "true",
+                    "Missing meshes and textures share one loaded copy of the default mesh and texture");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.TextureDecode.Enable", "true",
+                    "Decode textures and build their mipmaps on worker threads and keep the result in the pack file");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.TextureDecode.Threads", "2",
+                    "Number of texture decoding threads");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.TextureStream.Enable", "true",
+                    "Load predecoded textures with just their small mip levels and add levels as they get bigger on the screen");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.TextureStream.InitialSize", "32",
+                    "Largest mip level loaded when a texture is first used");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.TextureStream.ReloadsPerFrame", "4",
+                    "Number of textures reloaded with a different mip level between frames");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.TextureStream.BudgetMB", "256",
+                    "Megabytes of streamed texture to try and stay under");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Atlas.Enable", "true",
+                    "Pack small prim textures into shared atlas pages so faces can share materials");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Atlas.PageSize", "1024",
+                    "Width and height of an atlas page");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Atlas.MinSize", "64",
+                    "Smallest texture put in the atlas");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Atlas.MaxSize", "256",
+                    "Largest texture put in the atlas");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Atlas.MaxPages", "16",
+                    "Most atlas pages to make");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.CacheMissingRecheckMS", "10000",
+                    "Milliseconds before looking again in the cache dir for a file that was missing");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.PackCache.Enable", "true",
+                    "Keep cached meshes and textures in one memory mapped pack file in the cache dir");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.PackCache.ImportLooseFiles", "true",
+                    "Copy individual cache files into the pack file when they are first read");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.PackCache.Compress", "true",
+                    "Compress meshes written to the pack file");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.PackCache.CompactMinimumMB", "64",
+                    "Megabytes of replaced entries in the pack file before it is compacted");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.ForceMeshRebuild", "false",
                     "True if to force the generation a mesh when first rendered (don't rely on cache)");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.PrebuildMesh", "true",
@@ -194,6 +258,36 @@ public class RendererOgre : ModuleBase, IRenderProvider {
                     "True if to share meshes with similar characteristics");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.UseShaders", "true",
                     "Whether to use the new technique of using GPU shaders");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Anim.Threads", "2",
+                    "Number of threads that help evaluate animations (0 for just the frame thread)");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Anim.ParallelMinimum", "512",
+                    "Animations are evaluated on the helper threads when there are at least this many");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Anim.MaxExtrapolation", "1.0",
+                    "Seconds past the last motion update that objects keep moving");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Anim.CorrectionTime", "0.3",
+                    "Seconds to blend out the difference when a motion update arrives");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Anim.SnapDistance", "4.0",
+                    "Motion corrections larger than this are not blended");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.HardwareSkinning", "true",
+                    "With the prim shader, blend avatar bones on the card");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.SharePoses", "true",
+                    "Far away avatars playing the same animations share one skeleton");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.NearDistance", "20",
+                    "Avatars closer than this are animated every frame");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.FarDistance", "60",
+                    "Avatars farther than this are animated every FarInterval frames");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.MidInterval", "2",
+                    "Frames between animation updates of avatars between near and far");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.FarInterval", "4",
+                    "Frames between animation updates of far avatars");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.HiddenInterval", "15",
+                    "Frames between animation updates of avatars not in view");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.Avatar.DefaultSkeleton", "",
+                    "Skeleton used by avatar meshes whose skeleton can't be found");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.UseUberShader", "true",
+                    "With shaders, prims share a few programs and get color and texture transform per renderable");
+        ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.InternMaterials", "true",
+                    "Faces with the same texture and material parameters share one material");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.CollectOgreStats", "true",
                     "Whether to collect detailed Ogre stats and make available to web");
         ModuleParams.AddDefaultParameter(m_moduleName + ".Ogre.ShouldQueueMeshOperations", "true",
@@ -275,116 +369,43 @@ public class RendererOgre : ModuleBase, IRenderProvider {
         m_restHandler = new RestHandler("/stats/" + m_moduleName + "/detailStats", m_stats);
 
         #region OGRE STATS
-        // Setup the shared piece of memory that Ogre can place statistics in
-        m_ogreStatsPinned = new int[Ogr.StatSize];
-        for (int ii = 0; ii < Ogr.StatSize; ii++) m_ogreStatsPinned[ii] = 0;
         if (ModuleParams.ParamBool("Renderer.Ogre.CollectOgreStats")) {
-            m_ogreStatsHandle = GCHandle.Alloc(m_ogreStatsPinned, GCHandleType.Pinned);
-            Ogr.SetStatsBlock(m_ogreStatsHandle.AddrOfPinnedObject());
-            // m_ogreStatsPinned = (int[])Marshal.AllocHGlobal(Ogr.StatSize * 4);
-            // Ogr.SetStatsBlock(m_ogreStatsPinned);
+            Ogr.EnableStats(true);
         }
 
         // Create a ParameterSet that can be read externally via REST/JSON
+        // Ogre describes its statistics with a schema. Each value in it becomes
+        // a parameter that reads the latest snapshot.
         m_ogreStats = new ParameterSet();
-        // add an initial parameter that calculates frames per sec
-        m_ogreStats.Add("FramesPerSecond",
-            delegate(string xx) {
-                // Ogre passed the number *1000 so  there can be some decimal points
-                float fps = (float)m_ogreStatsPinned[Ogr.StatFramesPerSec] / 1000f;
-                return new OMVSD.OSDString(fps.ToString());
-            }, "Frames per second"
-        );
-        m_ogreStats.Add("LastFrameMS", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatLastFrameMs].ToString()); },
-                "Milliseconds used rendering last frame");
-        m_ogreStats.Add("TotalFrames", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatTotalFrames].ToString()); },
-                "Number of frames rendered");
-        m_ogreStats.Add("VisibleToVisible", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatVisibleToVisible].ToString()); },
-                "Meshes at were visible that are still visible in last frame");
-        m_ogreStats.Add("InvisibleToVisible", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatInvisibleToVisible].ToString()); },
-                "Meshes that were invisible that are now visible in last frame");
-        m_ogreStats.Add("VisibleToInvisible", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatVisibleToInvisible].ToString()); },
-                "Meshes that were visible that are now invisible in last frame");
-        m_ogreStats.Add("InvisibleToInvisible", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatInvisibleToInvisible].ToString()); },
-                "Meshes that were invisible that are still invisible in last frame");
-        m_ogreStats.Add("CullMeshesLoaded", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatCullMeshesLoaded].ToString()); },
-                "Total meshes loaded due to unculling");
-        m_ogreStats.Add("CullTexturesLoaded", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatCullTexturesLoaded].ToString()); },
-                "Total textures loaded due to unculling");
-        m_ogreStats.Add("CullMeshesUnloaded", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatCullMeshesUnloaded].ToString()); },
-                "Total meshes unloaded due to culling");
-        m_ogreStats.Add("CullTexturesUnloaded", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatCullTexturesUnloaded].ToString()); },
-                "Total textures unloaded due to culling");
-        m_ogreStats.Add("CullMeshesQueuedToLoad", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatCullMeshesQueuedToLoad].ToString()); },
-                "Meshes currently queued to load due to unculling");
-        // between frame work
-        m_ogreStats.Add("BetweenFrameworkItems", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameWorkItems].ToString()); },
-                "Number of between frame work items waiting");
-        m_ogreStats.Add("BetweenFrameworkDiscardedDups", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameDiscardedDups].ToString()); },
-                "Between frame work requests which duplicated existing requests");
-        m_ogreStats.Add("TotalBetweenFrameRefreshResource", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameRefreshResource].ToString()); },
-                "Number of 'refresh resource' work items queued");
-        m_ogreStats.Add("TotalBetweenFrameRemoveSceneNode", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameRemoveSceneNode].ToString()); },
-                "Number of 'remove scene node' work items queued");
-        m_ogreStats.Add("TotalBetweenFrameCreateMaterialResource", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameCreateMaterialResource].ToString()); },
-                "Number of 'create material resource' work items queued");
-        m_ogreStats.Add("TotalBetweenFrameCreateMeshResource", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameCreateMeshResource].ToString()); },
-                "Number of 'create mesh resource' work items queued");
-        m_ogreStats.Add("TotalBetweenFrameCreateMeshScenenode", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameCreateMeshSceneNode].ToString()); },
-                "Number of 'create mesh scene node' work items queued");
-        m_ogreStats.Add("TotalBetweenFrameAddLoadedMesh", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameAddLoadedMesh].ToString()); },
-                "Number of 'add loaded mesh' work items queued");
-        m_ogreStats.Add("TotalBetweenframeupdatescenenode", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameUpdateSceneNode].ToString()); },
-                "Number of 'update scene node' work items queued");
-        m_ogreStats.Add("TotalBetweenFrameUnknownProcess", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameUnknownProcess].ToString()); },
-                "Number of work items with unknow process codes");
-        m_ogreStats.Add("TotalBetweenFrameTotalProcessed", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatBetweenFrameTotalProcessed].ToString()); },
-                "Total number of work items actually processed");
-        // material processing queues
-        m_ogreStats.Add("MaterialUpdatesRemaining", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatMaterialUpdatesRemaining].ToString()); },
-                "Number of material updates waiting");
-        // mesh processing queues
-        m_ogreStats.Add("MeshTrackerLoadQueued", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatMeshTrackerLoadQueued].ToString()); },
-                "Number of mesh loads queued");
-        m_ogreStats.Add("MeshTrackerUnloadQueued", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatMeshTrackerUnloadQueued].ToString()); },
-                "Number of mesh unloads queued");
-        m_ogreStats.Add("MeshTrackerSerializedQueued", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatMeshTrackerSerializedQueued].ToString()); },
-                "Number of mesh serializations queued");
-        m_ogreStats.Add("MeshTrackerTotalQueued", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatMeshTrackerTotalQueued].ToString()); },
-                "Total mesh tracker requests queued");
-        m_ogreStats.Add("LockParity", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatLockParity].ToString()); },
-                "Parity of LG locks");
-        m_ogreStats.Add("RoutineInOut", delegate(string xx) {
-                return new OMVSD.OSDString(m_ogreStatsPinned[Ogr.StatInOut].ToString()); },
-                "Entry and exit of routines");
+        m_ogreStats.Add("StatsSchemaVersion", delegate(string xx) {
+                return new OMVSD.OSDString(Ogr.StatsSchemaVersion().ToString()); },
+                "Version of the list of Ogre statistics");
+        int statCount = Ogr.StatsSchemaSize();
+        m_ogreStatsValues = new long[statCount];
+        StringBuilder statName = new StringBuilder(128);
+        StringBuilder statDesc = new StringBuilder(256);
+        for (int ii = 0; ii < statCount; ii++) {
+            int divisor = Ogr.StatsSchemaEntry(ii, statName, statName.Capacity, statDesc, statDesc.Capacity);
+            if (divisor == 0) continue;
+            int index = ii;     // each delegate needs its own copy
+            if (divisor == 1) {
+                m_ogreStats.Add(statName.ToString(), delegate(string xx) {
+                        return new OMVSD.OSDString(OgreStatValue(index).ToString()); },
+                        statDesc.ToString());
+            }
+            else {
+                // Ogre passed the number scaled up so there can be some decimal points
+                m_ogreStats.Add(statName.ToString(), delegate(string xx) {
+                        float val = (float)OgreStatValue(index) / (float)divisor;
+                        return new OMVSD.OSDString(val.ToString()); },
+                        statDesc.ToString());
+            }
+        }
+        m_ogreStats.Add("LockProfile", delegate(string xx) {
+                StringBuilder profile = new StringBuilder(16384);
+                Ogr.DumpLockProfile(profile, profile.Capacity, false);
+                return new OMVSD.OSDString(profile.ToString()); },
+                "Contention of each C++ lock if LockProfile is enabled");
 
         // make the values accessable from outside
         m_ogreStatsHandler = new RestHandler("/stats/" + m_moduleName + "/ogreStats", m_ogreStats);
@@ -421,6 +442,7 @@ public class RendererOgre : ModuleBase, IRenderProvider {
         // push the callback pointers into the LookingGlassOgre code
         fetchParameterCallbackHandle = new Ogr.FetchParameterCallback(GetAParameter);
         Ogr.SetFetchParameterCallback(fetchParameterCallbackHandle);
+        PushParameters();
         checkKeepRunningCallbackHandle = new Ogr.CheckKeepRunningCallback(CheckKeepRunning);
         Ogr.SetCheckKeepRunningCallback(checkKeepRunningCallbackHandle);
 
@@ -465,6 +487,17 @@ public class RendererOgre : ModuleBase, IRenderProvider {
         return;
     }
 
+    // A REST read fetches every value so only take a new snapshot if the last one is old
+    private long OgreStatValue(int index) {
+        lock (m_ogreStatsValues) {
+            if ((System.Environment.TickCount - m_ogreStatsLastRead) > 100) {
+                Ogr.StatsSnapshot(m_ogreStatsValues, m_ogreStatsValues.Length);
+                m_ogreStatsLastRead = System.Environment.TickCount;
+            }
+        }
+        return m_ogreStatsValues[index];
+    }
+
     // routine called from unmanaged code to log a message
     private void OgrLogger(string msg) {
         m_logOgre.Log(LogLevel.DOGREDETAIL, msg);
@@ -493,6 +526,31 @@ public class RendererOgre : ModuleBase, IRenderProvider {
         return ret;
     }
 
+    // The native code keeps its own copy of our parameters so it doesn't call
+    // back for them. Send them all now and then each one that changes.
+    private void PushParameters() {
+        string prefix = (m_moduleName + ".Ogre.").ToLower();
+        List<string> keys = new List<string>();
+        LGB.AppParams.DefaultParameters.ForEach(delegate(string k, OMVSD.OSD v) {
+            if (k.ToLower().StartsWith(prefix)) keys.Add(k);
+        });
+        foreach (string key in keys) {
+            Ogr.UpdateParameter(key, GetAParameter(key));
+        }
+        m_log.Log(LogLevel.DRENDERDETAIL, "PushParameters: pushed {0} parameters", keys.Count);
+        LGB.AppParams.DefaultParameters.OnModifiedCallback += ParameterModified;
+        LGB.AppParams.IniParameters.OnModifiedCallback += ParameterModified;
+        LGB.AppParams.UserParameters.OnModifiedCallback += ParameterModified;
+        LGB.AppParams.OverrideParameters.OnModifiedCallback += ParameterModified;
+    }
+
+    // The change could be hidden by a higher priority value so push what the value is now
+    private void ParameterModified(IParameters coll, string key, OMVSD.OSD value) {
+        if (key.ToLower().StartsWith((m_moduleName + ".Ogre.").ToLower())) {
+            Ogr.UpdateParameter(key, GetAParameter(key));
+        }
+    }
+
     // ==========================================================================
     // IModule.Start()
     override public void Start() {
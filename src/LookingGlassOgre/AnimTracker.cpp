@@ -23,68 +23,448 @@
 // #include "StdAfx.h"
 #include "LGOCommon.h"
 #include "LookingGlassOgre.h"
+#include "RendererOgre.h"
 #include "AnimTracker.h"
-#include "Animat.h"
-#include "AnimatFixedRotation.h"
-#include "AnimatPosition.h"
-#include "AnimatRotation.h"
+#include "LGTrace.h"
 
 namespace LG {
 AnimTracker* AnimTracker::m_instance = NULL;
 
+// remove an entry from a track array by moving the last entry into its place
+template<class T> static void SwapPop(std::vector<T>& vec, int index) {
+	if (index != (int)vec.size() - 1) {
+		vec[index] = vec.back();
+	}
+	vec.pop_back();
+}
+
+// evaluation is split into chunks of this many tracks
+static const int AnimChunkSize = 256;
+// how fast the clock offset is allowed to creep up (seconds per second)
+static const double AnimClockCreepRate = 0.001;
+
 AnimTracker::AnimTracker() {
 	m_animationsMutex = LGLOCK_ALLOCATE_MUTEX("AnimTracker");
+	m_workLock = LGLOCK_ALLOCATE_MUTEX("AnimTrackerWork");
+	m_timer = new Ogre::Timer();
+	m_applyOrderDirty = false;
+	m_workGeneration = 0;
+	m_workTime = 0.0;
+	m_workNow = 0.0;
+	m_workTracks = 0;
+	m_workChunks = 0;
+	m_nextChunk = 0;
+	m_chunksRemaining = 0;
+	m_keepProcessing = true;
+	m_maxExtrapolation = LG::GetParameterFloat("Renderer.Ogre.Anim.MaxExtrapolation");
+	float correctionTime = LG::GetParameterFloat("Renderer.Ogre.Anim.CorrectionTime");
+	m_correctionRate = correctionTime > 0.0 ? 1.0f / correctionTime : 1000.0f;
+	m_snapDistance = LG::GetParameterFloat("Renderer.Ogre.Anim.SnapDistance");
+	m_clockOffset = 0.0;
+	m_clockOffsetSet = false;
+	m_lastUpdateNow = 0.0;
+	m_parallelMinimum = LG::GetParameterInt("Renderer.Ogre.Anim.ParallelMinimum");
+	int threads = LG::GetParameterInt("Renderer.Ogre.Anim.Threads");
+	for (int ii = 0; ii < threads; ii++) {
+		m_threads.push_back(new LGLOCK_THREAD(&WorkerThreadRoutine, this));
+	}
 	LG::GetOgreRoot()->addFrameListener(this);
 };
 AnimTracker::~AnimTracker() {
+	Shutdown();
 	LG::GetOgreRoot()->removeFrameListener(this);
 };
 
+// SingletonInstance.Shutdown()
+void AnimTracker::Shutdown() {
+	LGLOCK_LOCK(m_workLock);
+	m_keepProcessing = false;
+	LGLOCK_NOTIFY_ALL(m_workLock);
+	LGLOCK_UNLOCK(m_workLock);
+	// wait for the workers to see it so they're not touching the tracks when we go away
+	while (!m_threads.empty()) {
+		LGLOCK_THREAD* worker = m_threads.front();
+		m_threads.pop_front();
+		worker->join();
+		delete worker;
+	}
+	return;
+}
+
 // Between frame, update all the animations
 bool AnimTracker::frameStarted(const Ogre::FrameEvent& evt) {
 	LG::StatIn(LG::InOutAnimTracker);
+	LGTRACE_SCOPE("AnimTracker");
 	LGLOCK_ALOCK animLock;	// a lock that will be released if we have an exception
 	animLock.Lock(m_animationsMutex);
+	try {
+		// evaluate: the tracks can't change while we hold the animation lock
+		unsigned long startTime = m_timer->getMicroseconds();
+		ResizeResults();
+		int tracks = (int)(m_spinNode.size() + m_moveNode.size() + m_turnNode.size() + m_motionNode.size());
+		if (m_threads.size() == 0 || tracks < m_parallelMinimum) {
+			m_workTime = evt.timeSinceLastFrame;
+			m_workNow = Now();
+			EvaluateRange(0, tracks);
+		}
+		else {
+			LGLOCK_LOCK(m_workLock);
+			m_workTime = evt.timeSinceLastFrame;
+			m_workNow = Now();
+			m_workTracks = tracks;
+			m_workChunks = (tracks + AnimChunkSize - 1) / AnimChunkSize;
+			m_nextChunk = 0;
+			m_chunksRemaining = m_workChunks;
+			m_workGeneration++;
+			LGLOCK_NOTIFY_ALL(m_workLock);
+			LGLOCK_UNLOCK(m_workLock);
+			EvaluateChunks();
+			LGLOCK_LOCK(m_workLock);
+			while (m_chunksRemaining > 0) {
+				LGLOCK_WAIT(m_workLock);
+			}
+			LGLOCK_UNLOCK(m_workLock);
+		}
+		unsigned long evalTime = m_timer->getMicroseconds();
+
+		// apply: only this thread touches the scene nodes
+		if (m_applyOrderDirty) {
+			BuildApplyOrder();
+		}
+		Apply();
+		RemoveFinished();
+		unsigned long applyTime = m_timer->getMicroseconds();
+
+		LG::SetStat(LG::StatAnimTracks, tracks);
+		LG::SetStat(LG::StatAnimEvaluateUs, (int)(evalTime - startTime));
+		LG::SetStat(LG::StatAnimApplyUs, (int)(applyTime - evalTime));
+	}
+	catch (...) {
+		LG::Log("AnimTracker::frameStarted EXCEPTION processing animations");
+	}
+	animLock.Unlock();
+	LG::StatOut(LG::InOutAnimTracker);
+	return true;
+}
+
+// The result arrays are scratch for the frame. Sized before the threads write into them.
+void AnimTracker::ResizeResults() {
+	m_spinStep.resize(m_spinNode.size());
+	m_movePos.resize(m_moveNode.size());
+	m_moveDone.resize(m_moveNode.size());
+	m_turnRot.resize(m_turnNode.size());
+	m_turnDone.resize(m_turnNode.size());
+	m_motionResultPos.resize(m_motionNode.size());
+	m_motionResultRot.resize(m_motionNode.size());
+}
+
+// Evaluate tracks [first, last) where the spins are numbered first, then the
+// moves, then the turns, then the motions. Only reads the track definitions and writes the
+// tracks' own results so ranges can be done in parallel.
+void AnimTracker::EvaluateRange(int first, int last) {
+	float dt = m_workTime;
+	int spins = (int)m_spinNode.size();
+	int moves = (int)m_moveNode.size();
+	int turns = (int)m_turnNode.size();
+	int ii;
+	for (ii = first; ii < last && ii < spins; ii++) {
+		float increment = fmod(Ogre::Math::TWO_PI * m_spinRate[ii] * dt, Ogre::Math::TWO_PI);
+		m_spinStep[ii].FromAngleAxis(Ogre::Radian(increment), m_spinAxis[ii]);
+	}
+	for (; ii < last && ii < spins + moves; ii++) {
+		int jj = ii - spins;
+		float progress = m_moveProgress[jj] + dt * m_moveRate[jj];
+		m_moveProgress[jj] = progress;
+		m_moveDone[jj] = progress > 1.0f;
+		m_movePos[jj] = m_moveFrom[jj] + m_moveDelta[jj] * (progress > 1.0f ? 1.0f : progress);
+	}
+	for (; ii < last && ii < spins + moves + turns; ii++) {
+		int jj = ii - spins - moves;
+		float progress = m_turnProgress[jj] + dt * m_turnRate[jj];
+		m_turnProgress[jj] = progress;
+		m_turnDone[jj] = progress > 1.0f;
+		if (progress > 1.0f) {
+			m_turnRot[jj] = m_turnTarget[jj];
+		}
+		else {
+			m_turnRot[jj] = Ogre::Quaternion::Slerp(progress, m_turnFrom[jj], m_turnTarget[jj], true);
+		}
+	}
+	for (; ii < last; ii++) {
+		int jj = ii - spins - moves - turns;
+		float blend = m_motionBlend[jj] + dt * m_correctionRate;
+		m_motionBlend[jj] = blend > 1.0f ? 1.0f : blend;
+		Extrapolate(jj, m_workNow, m_motionResultPos[jj], m_motionResultRot[jj]);
+	}
+}
+
+// seconds on our clock
+double AnimTracker::Now() {
+	return (double)m_timer->getMicroseconds() / 1000000.0;
+}
+
+// Where a motion track puts its node at a time. Includes what's left of the
+// last correction.
+void AnimTracker::Extrapolate(int track, double when, Ogre::Vector3& pos, Ogre::Quaternion& rot) {
+	float t = (float)(when - m_motionTime[track]);
+	if (t < 0.0f) t = 0.0f;
+	if (t > m_maxExtrapolation) t = m_maxExtrapolation;
+	pos = m_motionPos[track] + m_motionVel[track] * t + m_motionAcc[track] * (0.5f * t * t);
+	rot = m_motionRot[track];
+	Ogre::Vector3 axis = m_motionAngVel[track];
+	Ogre::Real rate = axis.normalise();
+	if (rate > 0.0) {
+		rot = Ogre::Quaternion(Ogre::Radian(rate * t), axis) * rot;
+	}
+	float remaining = 1.0f - m_motionBlend[track];
+	if (remaining > 0.0f) {
+		pos += m_motionErrPos[track] * remaining;
+		rot = Ogre::Quaternion::Slerp(remaining, Ogre::Quaternion::IDENTITY, m_motionErrRot[track], true) * rot;
+	}
+}
+
+// Take chunks until there are none left. Run by the workers and the frame thread.
+void AnimTracker::EvaluateChunks() {
+	while (true) {
+		LGLOCK_LOCK(m_workLock);
+		int chunk = m_nextChunk;
+		if (chunk >= m_workChunks) {
+			LGLOCK_UNLOCK(m_workLock);
+			return;
+		}
+		m_nextChunk++;
+		LGLOCK_UNLOCK(m_workLock);
 
-	std::list<Animat*>::iterator li;
-	for (li = m_animations.begin(); li != m_animations.end(); li++) {
+		int first = chunk * AnimChunkSize;
+		int last = first + AnimChunkSize;
+		if (last > m_workTracks) last = m_workTracks;
 		try {
-			if (!(*li)->Process(evt.timeSinceLastFrame)) {
-				m_removeAnimations.push_back(*li);
-			}
+			EvaluateRange(first, last);
 		}
 		catch (...) {
-			LG::Log("AnimTracker::frameStarted EXCEPTION calling Process on t=%d, s=%s", 
-				(*li)->AnimatType, (*li)->SceneNodeName.c_str());
+			LG::Log("AnimTracker::EvaluateChunks: exception evaluating tracks %d to %d", first, last);
+		}
+
+		LGLOCK_LOCK(m_workLock);
+		if (--m_chunksRemaining == 0) {
+			LGLOCK_NOTIFY_ALL(m_workLock);
+		}
+		LGLOCK_UNLOCK(m_workLock);
+	}
+}
+
+void AnimTracker::WorkerThreadRoutine(AnimTracker* inst) {
+	unsigned long seenGeneration = 0;
+	LGTRACE_THREAD("AnimWorker");
+	while (true) {
+		LGLOCK_LOCK(inst->m_workLock);
+		while (inst->m_keepProcessing && inst->m_workGeneration == seenGeneration) {
+			LGLOCK_WAIT(inst->m_workLock);
+		}
+		if (!inst->m_keepProcessing) {
+			LGLOCK_UNLOCK(inst->m_workLock);
+			return;
 		}
+		seenGeneration = inst->m_workGeneration;
+		LGLOCK_UNLOCK(inst->m_workLock);
+		LGTRACE_SCOPE("AnimEvaluate");
+		inst->EvaluateChunks();
 	}
+}
 
-	// if any of the animations asked to be removed, remove them now
-	// (done since we can't delete it out of the list while iterating to call Process())
-	EmptyRemoveAnimationList();
+bool AnimTracker::ApplyEntryLess(const ApplyEntry& a, const ApplyEntry& b) {
+	return a.node < b.node;
+}
 
-	animLock.Unlock();
-	LG::StatOut(LG::InOutAnimTracker);
-	return true;
+// Apply the results in scene node address order so nodes are touched in memory
+// order. Tracks whose node doesn't exist yet are left out and the order is
+// built again next frame.
+void AnimTracker::BuildApplyOrder() {
+	m_applyOrder.clear();
+	m_applyOrderDirty = false;
+	for (int typ = 1; typ < AnimatTypeCount; typ++) {
+		std::vector<int>* trackNodesP;
+		switch (typ) {
+			case AnimatTypeFixedRotation: trackNodesP = &m_spinNode; break;
+			case AnimatTypePosition: trackNodesP = &m_moveNode; break;
+			case AnimatTypeRotation: trackNodesP = &m_turnNode; break;
+			default: trackNodesP = &m_motionNode; break;
+		}
+		std::vector<int>& trackNodes = *trackNodesP;
+		for (int ii = 0; ii < (int)trackNodes.size(); ii++) {
+			AnimNode& anode = m_nodes[trackNodes[ii]];
+			if (!ResolveNode(anode)) {
+				m_applyOrderDirty = true;
+				continue;
+			}
+			ApplyEntry entry;
+			entry.node = anode.node;
+			entry.typ = typ;
+			entry.track = ii;
+			m_applyOrder.push_back(entry);
+		}
+	}
+	std::sort(m_applyOrder.begin(), m_applyOrder.end(), ApplyEntryLess);
+}
+
+void AnimTracker::Apply() {
+	std::vector<ApplyEntry>::iterator ai;
+	for (ai = m_applyOrder.begin(); ai != m_applyOrder.end(); ai++) {
+		switch (ai->typ) {
+			case AnimatTypeFixedRotation:
+				ai->node->setOrientation(m_spinStep[ai->track] * ai->node->getOrientation());
+				break;
+			case AnimatTypePosition:
+				ai->node->setPosition(m_movePos[ai->track]);
+				break;
+			case AnimatTypeRotation:
+				ai->node->setOrientation(m_turnRot[ai->track]);
+				break;
+			case AnimatTypeMotion:
+				ai->node->setPosition(m_motionResultPos[ai->track]);
+				ai->node->setOrientation(m_motionResultRot[ai->track]);
+				break;
+		}
+	}
+}
+
+// Done backwards so the track moved into a hole has already been checked
+void AnimTracker::RemoveFinished() {
+	for (int ii = (int)m_moveNode.size() - 1; ii >= 0; ii--) {
+		if (m_moveDone[ii]) {
+			RemoveTrack(AnimatTypePosition, ii);
+		}
+	}
+	for (int ii = (int)m_turnNode.size() - 1; ii >= 0; ii--) {
+		if (m_turnDone[ii]) {
+			RemoveTrack(AnimatTypeRotation, ii);
+		}
+	}
+}
+
+// Find the scene node the first time it's needed. Scene nodes are removed
+// through RendererOgre::RemoveSceneNode which removes their animations so the
+// pointer is good as long as the node has animations.
+bool AnimTracker::ResolveNode(AnimNode& anode) {
+	if (anode.node == NULL) {
+		Ogre::SceneManager* sceneMgr = LG::RendererOgre::Instance()->m_sceneMgr;
+		if (sceneMgr->hasSceneNode(anode.name)) {
+			anode.node = sceneMgr->getSceneNode(anode.name);
+		}
+	}
+	return anode.node != NULL;
+}
+
+// note: assumes the tracks are protected by the lock
+int AnimTracker::NodeSlot(const Ogre::String& sceneNodeName) {
+	AnimNodeHashMap::iterator ni = m_nodeIndex.find(sceneNodeName);
+	if (ni != m_nodeIndex.end()) {
+		return ni->second;
+	}
+	int slot;
+	if (m_freeNodes.size() > 0) {
+		slot = m_freeNodes.back();
+		m_freeNodes.pop_back();
+	}
+	else {
+		slot = (int)m_nodes.size();
+		m_nodes.push_back(AnimNode());
+	}
+	AnimNode& anode = m_nodes[slot];
+	anode.name = sceneNodeName;
+	anode.node = NULL;
+	for (int ii = 0; ii < AnimatTypeCount; ii++) {
+		anode.tracks[ii] = -1;
+	}
+	m_nodeIndex[sceneNodeName] = slot;
+	return slot;
+}
+
+// note: assumes the tracks are protected by the lock
+void AnimTracker::RemoveTrack(int typ, int track) {
+	int slot;
+	int moved;
+	switch (typ) {
+		case AnimatTypeFixedRotation:
+			slot = m_spinNode[track];
+			moved = m_spinNode.back();
+			SwapPop(m_spinNode, track);
+			SwapPop(m_spinAxis, track);
+			SwapPop(m_spinRate, track);
+			break;
+		case AnimatTypePosition:
+			slot = m_moveNode[track];
+			moved = m_moveNode.back();
+			SwapPop(m_moveNode, track);
+			SwapPop(m_moveFrom, track);
+			SwapPop(m_moveDelta, track);
+			SwapPop(m_moveRate, track);
+			SwapPop(m_moveProgress, track);
+			break;
+		case AnimatTypeRotation:
+			slot = m_turnNode[track];
+			moved = m_turnNode.back();
+			SwapPop(m_turnNode, track);
+			SwapPop(m_turnFrom, track);
+			SwapPop(m_turnTarget, track);
+			SwapPop(m_turnRate, track);
+			SwapPop(m_turnProgress, track);
+			break;
+		case AnimatTypeMotion:
+			slot = m_motionNode[track];
+			moved = m_motionNode.back();
+			SwapPop(m_motionNode, track);
+			SwapPop(m_motionPos, track);
+			SwapPop(m_motionVel, track);
+			SwapPop(m_motionAcc, track);
+			SwapPop(m_motionRot, track);
+			SwapPop(m_motionAngVel, track);
+			SwapPop(m_motionTime, track);
+			SwapPop(m_motionErrPos, track);
+			SwapPop(m_motionErrRot, track);
+			SwapPop(m_motionBlend, track);
+			break;
+		default:
+			return;
+	}
+	m_applyOrderDirty = true;
+	// the last track is now where the removed one was
+	m_nodes[moved].tracks[typ] = track;
+	m_nodes[slot].tracks[typ] = -1;
+	ReleaseNodeIfIdle(slot);
+}
+
+// If the node has no more animations, its slot can be reused
+void AnimTracker::ReleaseNodeIfIdle(int slot) {
+	AnimNode& anode = m_nodes[slot];
+	for (int ii = 0; ii < AnimatTypeCount; ii++) {
+		if (anode.tracks[ii] >= 0) return;
+	}
+	m_nodeIndex.erase(anode.name);
+	anode.name.clear();
+	anode.node = NULL;
+	m_freeNodes.push_back(slot);
+}
+
+// note: assumes the tracks are protected by the lock
+void AnimTracker::RemoveAnimationsLocked(const Ogre::String& sceneNodeName, int typ) {
+	AnimNodeHashMap::iterator ni = m_nodeIndex.find(sceneNodeName);
+	if (ni == m_nodeIndex.end()) {
+		return;
+	}
+	int slot = ni->second;
+	for (int ii = 1; ii < AnimatTypeCount; ii++) {
+		if ((typ == AnimatTypeAny || typ == ii) && m_nodes[slot].tracks[ii] >= 0) {
+			RemoveTrack(ii, m_nodes[slot].tracks[ii]);
+		}
+	}
 }
 
 // delete animations of a certain type for this scenenode
 void AnimTracker::RemoveAnimations(Ogre::String sceneNodeName, int typ) {
 	LGLOCK_ALOCK animLock;	// a lock that will be released if we have an exception
 	animLock.Lock(m_animationsMutex);
-
-	std::list<Animat*>::iterator li;
-	for (li = m_animations.begin(); li != m_animations.end(); li++) {
-		if ( !((*li)->SceneNodeName.empty()) ) {
-			if ((typ == AnimatTypeAny) || ((*li)->AnimatType == typ)) {
-				if ((*li)->SceneNodeName == sceneNodeName) {
-					// m_animations.erase(li);
-					m_removeAnimations.push_back(*li);
-				}
-			}
-		}
-	}
-	EmptyRemoveAnimationList();
+	RemoveAnimationsLocked(sceneNodeName, typ);
 	animLock.Unlock();
 }
 
@@ -93,27 +473,20 @@ void AnimTracker::RemoveAnimations(Ogre::String sceneNodeName) {
 	RemoveAnimations(sceneNodeName, AnimatTypeAny);
 }
 
-// note: assumes the list is protected by a lock
-void AnimTracker::EmptyRemoveAnimationList() {
-	std::list<Animat*>::iterator li;
-	for (li = m_removeAnimations.begin(); li != m_removeAnimations.end(); li++) {
-		Animat* anim = *li;
-		m_animations.remove(anim);
-		delete anim;
-	}
-	m_removeAnimations.clear();
-}
-
 // =======================================================================
 // Do a fixed rotation at some rate around some axis
 void AnimTracker::FixedRotationSceneNode(Ogre::String sceneNodeName, Ogre::Vector3 axis, float rate) {
 	LG::Log("AnimTracker::RotateSceneNode for %s", sceneNodeName.c_str());
 	LGLOCK_ALOCK animLock;	// a lock that will be released if we have an exception
-	// Remove any outstanding animations of this type on this scenenode
-	RemoveAnimations(sceneNodeName, AnimatTypeFixedRotation);
 	animLock.Lock(m_animationsMutex);
-	AnimatFixedRotation* anim = new AnimatFixedRotation(sceneNodeName, axis, rate);
-	m_animations.push_back((Animat*)anim);
+	// Remove any outstanding animations of this type on this scenenode
+	RemoveAnimationsLocked(sceneNodeName, AnimatTypeFixedRotation);
+	int slot = NodeSlot(sceneNodeName);
+	m_nodes[slot].tracks[AnimatTypeFixedRotation] = (int)m_spinNode.size();
+	m_spinNode.push_back(slot);
+	m_spinAxis.push_back(axis);
+	m_spinRate.push_back(rate);
+	m_applyOrderDirty = true;
 	animLock.Unlock();
 }
 
@@ -121,11 +494,25 @@ void AnimTracker::FixedRotationSceneNode(Ogre::String sceneNodeName, Ogre::Vecto
 void AnimTracker::MoveToPosition(Ogre::String sceneNodeName, Ogre::Vector3 newPos, float duration) {
 	// LG::Log("AnimTracker::MoveToPosition for %s, d=%f", sceneNodeName.c_str(), duration);
 	LGLOCK_ALOCK animLock;	// a lock that will be released if we have an exception
-	// Remove any outstanding animations of this type on this scenenode
-	RemoveAnimations(sceneNodeName, AnimatTypePosition);
 	animLock.Lock(m_animationsMutex);
-	AnimatPosition* anim = new AnimatPosition(sceneNodeName, newPos, duration);
-	m_animations.push_back((Animat*)anim);
+	// Remove any outstanding animations of this type on this scenenode
+	RemoveAnimationsLocked(sceneNodeName, AnimatTypePosition);
+	RemoveAnimationsLocked(sceneNodeName, AnimatTypeMotion);
+	int slot = NodeSlot(sceneNodeName);
+	if (!ResolveNode(m_nodes[slot])) {
+		// the move starts from where the node is
+		LG::Log("AnimTracker::MoveToPosition: no scene node %s", sceneNodeName.c_str());
+		ReleaseNodeIfIdle(slot);
+		return;
+	}
+	Ogre::Vector3 fromPos = m_nodes[slot].node->getPosition();
+	m_nodes[slot].tracks[AnimatTypePosition] = (int)m_moveNode.size();
+	m_moveNode.push_back(slot);
+	m_moveFrom.push_back(fromPos);
+	m_moveDelta.push_back(newPos - fromPos);
+	m_moveRate.push_back(duration > 0.0 ? 1.0f / duration : 2.0f);
+	m_moveProgress.push_back(0.0);
+	m_applyOrderDirty = true;
 	animLock.Unlock();
 }
 
@@ -133,12 +520,90 @@ void AnimTracker::MoveToPosition(Ogre::String sceneNodeName, Ogre::Vector3 newPo
 void AnimTracker::Rotate(Ogre::String sceneNodeName, Ogre::Quaternion newRot, float duration) {
 	// LG::Log("AnimTracker::MoveToPosition for %s, d=%f", sceneNodeName.c_str(), duration);
 	LGLOCK_ALOCK animLock;	// a lock that will be released if we have an exception
-	// Remove any outstanding animations of this type on this scenenode
-	RemoveAnimations(sceneNodeName, AnimatTypeRotation);
 	animLock.Lock(m_animationsMutex);
-	AnimatRotation* anim = new AnimatRotation(sceneNodeName, newRot, duration);
-	m_animations.push_back((Animat*)anim);
+	// Remove any outstanding animations of this type on this scenenode
+	RemoveAnimationsLocked(sceneNodeName, AnimatTypeRotation);
+	RemoveAnimationsLocked(sceneNodeName, AnimatTypeMotion);
+	int slot = NodeSlot(sceneNodeName);
+	if (!ResolveNode(m_nodes[slot])) {
+		// the rotation starts from the node's orientation
+		LG::Log("AnimTracker::Rotate: no scene node %s", sceneNodeName.c_str());
+		ReleaseNodeIfIdle(slot);
+		return;
+	}
+	m_nodes[slot].tracks[AnimatTypeRotation] = (int)m_turnNode.size();
+	m_turnNode.push_back(slot);
+	m_turnFrom.push_back(m_nodes[slot].node->getOrientation());
+	m_turnTarget.push_back(newRot);
+	m_turnRate.push_back(duration > 0.0 ? 1.0f / duration : 2.0f);
+	m_turnProgress.push_back(0.0);
+	m_applyOrderDirty = true;
 	animLock.Unlock();
 }
 
+// =======================================================================
+// Doesn't touch the scene node so it can be called from any thread. The node is
+// found when the results are first applied.
+void AnimTracker::UpdateMotion(Ogre::String sceneNodeName, Ogre::Vector3 pos, Ogre::Vector3 vel, 
+			Ogre::Vector3 acc, Ogre::Quaternion rot, Ogre::Vector3 angularVel, double timestamp) {
+	LGLOCK_ALOCK animLock;	// a lock that will be released if we have an exception
+	animLock.Lock(m_animationsMutex);
+	double now = Now();
+	// The caller's clock is different. The smallest difference seen is the one
+	// with the least delay. It's allowed to creep up slowly in case the clocks drift.
+	double offset = now - timestamp;
+	if (!m_clockOffsetSet || offset < m_clockOffset) {
+		m_clockOffset = offset;
+		m_clockOffsetSet = true;
+	}
+	else {
+		m_clockOffset += AnimClockCreepRate * (now - m_lastUpdateNow);
+	}
+	m_lastUpdateNow = now;
+	double updateTime = timestamp + m_clockOffset;
+
+	RemoveAnimationsLocked(sceneNodeName, AnimatTypePosition);
+	RemoveAnimationsLocked(sceneNodeName, AnimatTypeRotation);
+	int slot = NodeSlot(sceneNodeName);
+	int track = m_nodes[slot].tracks[AnimatTypeMotion];
+	if (track < 0) {
+		track = (int)m_motionNode.size();
+		m_nodes[slot].tracks[AnimatTypeMotion] = track;
+		m_motionNode.push_back(slot);
+		m_motionPos.push_back(pos);
+		m_motionVel.push_back(vel);
+		m_motionAcc.push_back(acc);
+		m_motionRot.push_back(rot);
+		m_motionAngVel.push_back(angularVel);
+		m_motionTime.push_back(updateTime);
+		m_motionErrPos.push_back(Ogre::Vector3::ZERO);
+		m_motionErrRot.push_back(Ogre::Quaternion::IDENTITY);
+		m_motionBlend.push_back(1.0);
+		m_applyOrderDirty = true;
+		return;
+	}
+	// where the node is being shown and where the update says it should be
+	Ogre::Vector3 shownPos;
+	Ogre::Quaternion shownRot;
+	Extrapolate(track, now, shownPos, shownRot);
+	m_motionPos[track] = pos;
+	m_motionVel[track] = vel;
+	m_motionAcc[track] = acc;
+	m_motionRot[track] = rot;
+	m_motionAngVel[track] = angularVel;
+	m_motionTime[track] = updateTime;
+	m_motionBlend[track] = 1.0;
+	Ogre::Vector3 newPos;
+	Ogre::Quaternion newRot;
+	Extrapolate(track, now, newPos, newRot);
+	Ogre::Vector3 errPos = shownPos - newPos;
+	if (errPos.length() > m_snapDistance) {
+		// too far off to slide there
+		return;
+	}
+	m_motionErrPos[track] = errPos;
+	m_motionErrRot[track] = shownRot * newRot.Inverse();
+	m_motionBlend[track] = 0.0;
+}
+
 }
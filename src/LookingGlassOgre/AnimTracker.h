@@ -24,16 +24,26 @@
 
 #include "LGOCommon.h"
 #include "SingletonInstance.h"
-#include "Animat.h"
 #include "LGLocking.h"
 
 namespace LG {
+#define AnimatTypeAny			0
+#define AnimatTypeFixedRotation 1
+#define AnimatTypeRotation		2
+#define AnimatTypePosition		3
+#define AnimatTypeMotion		4
+#define AnimatTypeCount			5
+
 	// Tracker for animations.
-	// Routine keeps a list of the animations that are in progress and, once
-	// a frame, calls their 'Process' routine. The animation's process routine
-	// could call the 'AnimationComplete' method if it is finished. This will
-	// delete the animation object after all the animations have been processed
-	// (ie, solve the animation deleting itself problem).
+	// Each kind of animation is a set of parallel arrays (one entry per track)
+	// which are run through once a frame. Tracks point to an entry for their
+	// scene node which remembers the node and which tracks it has so a node's
+	// animations are found without a search. Tracks are removed by moving the
+	// last track into the hole.
+	// A frame is done in two steps. The tracks are evaluated into result arrays
+	// by a pool of worker threads (and the frame thread) each taking chunks of
+	// tracks. Then the frame thread applies the results to the scene nodes in
+	// node address order.
 class AnimTracker : Ogre::FrameListener, public SingletonInstance {
 public:
 	AnimTracker();
@@ -52,12 +62,21 @@ public:
 	void MoveToPosition(Ogre::String sceneNodeName, Ogre::Vector3 newPos, float duration);
 	// schedule a rotation
 	void Rotate(Ogre::String sceneNodeName, Ogre::Quaternion newRot, float duration);
+	// Dead reckoning. The node moves from the position and orientation at the
+	// timestamp (seconds on the caller's clock) with the velocities and
+	// acceleration until the next update. The difference between where the
+	// node was shown and where the update says it is is blended out.
+	void UpdateMotion(Ogre::String sceneNodeName, Ogre::Vector3 pos, Ogre::Vector3 vel, Ogre::Vector3 acc,
+			Ogre::Quaternion rot, Ogre::Vector3 angularVel, double timestamp);
 
 	// remove all animations associated with a scene node
 	void RemoveAnimations(Ogre::String sceneNodeName);
 	// remove all animations associated with a scene node of a specific type
 	void RemoveAnimations(Ogre::String sceneNodeName, int typ);
 
+	// SingletonInstance.Shutdown()
+	void Shutdown();
+
 	// Ogre::FrameListener
 	bool frameStarted(const Ogre::FrameEvent&);
 
@@ -65,9 +84,99 @@ private:
 	static AnimTracker* m_instance;
 
 	LGLOCK_MUTEX m_animationsMutex;
-	std::list<Animat*> m_animations;
-	std::list<Animat*> m_removeAnimations;
 
-	void EmptyRemoveAnimationList();
+	// the scene nodes with animations. Slots are reused.
+	typedef struct {
+		Ogre::String name;
+		Ogre::SceneNode* node;			// NULL until the node is found
+		int tracks[AnimatTypeCount];	// index into the track arrays or -1
+	} AnimNode;
+	std::vector<AnimNode> m_nodes;
+	std::vector<int> m_freeNodes;
+	typedef std::map<Ogre::String, int> AnimNodeHashMap;
+	AnimNodeHashMap m_nodeIndex;
+
+	// fixed rotations
+	std::vector<int> m_spinNode;
+	std::vector<Ogre::Vector3> m_spinAxis;
+	std::vector<float> m_spinRate;			// rotations per second
+	std::vector<Ogre::Quaternion> m_spinStep;	// result: rotation for this frame
+
+	// moves to a position
+	std::vector<int> m_moveNode;
+	std::vector<Ogre::Vector3> m_moveFrom;
+	std::vector<Ogre::Vector3> m_moveDelta;
+	std::vector<float> m_moveRate;			// 1/duration
+	std::vector<float> m_moveProgress;		// 0..1
+	std::vector<Ogre::Vector3> m_movePos;	// result: position for this frame
+	std::vector<char> m_moveDone;			// result: reached the target
+
+	// rotations to an orientation
+	std::vector<int> m_turnNode;
+	std::vector<Ogre::Quaternion> m_turnFrom;
+	std::vector<Ogre::Quaternion> m_turnTarget;
+	std::vector<float> m_turnRate;			// 1/duration
+	std::vector<float> m_turnProgress;		// 0..1
+	std::vector<Ogre::Quaternion> m_turnRot;	// result: orientation for this frame
+	std::vector<char> m_turnDone;			// result: reached the target
+
+	// dead reckoning
+	std::vector<int> m_motionNode;
+	std::vector<Ogre::Vector3> m_motionPos;
+	std::vector<Ogre::Vector3> m_motionVel;
+	std::vector<Ogre::Vector3> m_motionAcc;
+	std::vector<Ogre::Quaternion> m_motionRot;
+	std::vector<Ogre::Vector3> m_motionAngVel;	// world axis times radians per second
+	std::vector<double> m_motionTime;			// local time of the update
+	std::vector<Ogre::Vector3> m_motionErrPos;	// correction being blended out
+	std::vector<Ogre::Quaternion> m_motionErrRot;
+	std::vector<float> m_motionBlend;			// 0..1 how much of the correction is gone
+	std::vector<Ogre::Vector3> m_motionResultPos;	// result: position for this frame
+	std::vector<Ogre::Quaternion> m_motionResultRot;	// result: orientation for this frame
+	float m_maxExtrapolation;		// seconds past an update the motion continues
+	float m_correctionRate;			// 1/seconds to blend out a correction
+	float m_snapDistance;			// corrections larger than this aren't blended
+	double m_clockOffset;			// local time minus caller's time
+	bool m_clockOffsetSet;
+	double m_lastUpdateNow;			// local time of the last motion update
+
+	// the order the results are applied in. Rebuilt when tracks change.
+	typedef struct {
+		Ogre::SceneNode* node;
+		int typ;
+		int track;
+	} ApplyEntry;
+	std::vector<ApplyEntry> m_applyOrder;
+	bool m_applyOrderDirty;
+	static bool ApplyEntryLess(const ApplyEntry&, const ApplyEntry&);
+
+	int NodeSlot(const Ogre::String&);
+	bool ResolveNode(AnimNode&);
+	void RemoveTrack(int, int);
+	void ReleaseNodeIfIdle(int);
+	void RemoveAnimationsLocked(const Ogre::String&, int);
+	void ResizeResults();
+	void EvaluateRange(int, int);
+	void BuildApplyOrder();
+	void Apply();
+	void RemoveFinished();
+	double Now();
+	void Extrapolate(int, double, Ogre::Vector3&, Ogre::Quaternion&);
+
+	// the evaluation is split into chunks of tracks that the threads take in turn
+	Ogre::Timer* m_timer;
+	int m_parallelMinimum;
+	LGLOCK_MUTEX m_workLock;
+	std::list<LGLOCK_THREAD*> m_threads;
+	unsigned long m_workGeneration;
+	float m_workTime;
+	double m_workNow;
+	int m_workTracks;
+	int m_workChunks;
+	int m_nextChunk;
+	int m_chunksRemaining;
+	bool m_keepProcessing;
+	void EvaluateChunks();
+	static void WorkerThreadRoutine(AnimTracker*);
 };
-}
\ No newline at end of file
+}
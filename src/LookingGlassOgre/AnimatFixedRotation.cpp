@@ -1,66 +0,0 @@
-/* Copyright (c) Robert Adams
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions are met:
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *     * The name of the copyright holder may not be used to endorse or promote products
- *       derived from this software without specific prior written permission.
- *
- * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
- * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
- * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
- * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
- * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
- * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
- * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
- * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
- * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-// #include "StdAfx.h"
-#include "Animat.h"
-#include "AnimatFixedRotation.h"
-#include "LookingGlassOgre.h"
-#include "RendererOgre.h"
-#include "AnimTracker.h"
-
-namespace LG {
-
-AnimatFixedRotation::AnimatFixedRotation() {
-	this->SceneNodeName.clear();
-};
-AnimatFixedRotation::AnimatFixedRotation(Ogre::String sNodeName, Ogre::Vector3 axis, float rotationsPerSecond) {
-	this->SceneNodeName = sNodeName;
-	this->AnimatType = AnimatTypeFixedRotation;
-
-	this->m_rotationScale = rotationsPerSecond;
-	this->m_rotationAxis = axis;
-	LG::Log("Animat::Rotation: setting rotation %f animation for %s", 
-				(double)this->m_rotationScale, this->SceneNodeName.c_str());
-	return;
-};
-AnimatFixedRotation::~AnimatFixedRotation() {
-};
-
-bool AnimatFixedRotation::Process(float timeSinceLastFrame) {
-	bool ret = true;
-	float nextStep = this->m_rotationScale * timeSinceLastFrame;
-	float nextIncrement = Ogre::Math::TWO_PI * nextStep;
-	while (nextIncrement >= Ogre::Math::TWO_PI) nextIncrement -= Ogre::Math::TWO_PI;
-	Ogre::Quaternion newRotation;
-	newRotation.FromAngleAxis(Ogre::Radian(nextIncrement), this->m_rotationAxis);
-	try {
-		Ogre::SceneNode* node = LG::RendererOgre::Instance()->m_sceneMgr->getSceneNode(this->SceneNodeName);
-		node->setOrientation(newRotation * node->getOrientation());
-	}
-	catch (...) {
-		LG::Log("Animat::Process: exception getting scene node");
-	}
-	return ret;
-} 
-
-
-}
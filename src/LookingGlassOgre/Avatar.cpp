@@ -25,10 +25,103 @@
 
 namespace LG {
 
-Avatar::Avatar() {
+Avatar::Avatar(Ogre::Entity* ent) {
+	m_entity = ent;
+	m_stateSet = NULL;
+	m_pending = 0.0;
+	m_phase = 0;
+	m_lod = AvatarLODNear;
+	m_pool = NULL;
 }
 
 Avatar::~Avatar() {
 }
 
+void Avatar::SetAnimation(const Ogre::String& animName, float weight, float rate, bool loop) {
+	std::vector<AvatarAnim>::iterator ai;
+	for (ai = m_anims.begin(); ai != m_anims.end(); ai++) {
+		if (ai->name == animName) {
+			if (weight <= 0.0) {
+				m_anims.erase(ai);
+			}
+			else {
+				ai->weight = weight;
+				ai->rate = rate;
+				ai->loop = loop;
+			}
+			return;
+		}
+	}
+	if (weight <= 0.0) {
+		return;
+	}
+	AvatarAnim anim;
+	anim.name = animName;
+	anim.weight = weight;
+	anim.rate = rate;
+	anim.loop = loop;
+	anim.time = 0.0;
+	anim.state = NULL;
+	m_anims.push_back(anim);
+}
+
+// The skeleton and the animations with their weights and rates to a tenth.
+// Where each animation is doesn't matter: a far away crowd all doing the same
+// thing at the same time doesn't look any different.
+Ogre::String Avatar::PoolKey() {
+	std::vector<Ogre::String> anims;
+	std::vector<AvatarAnim>::iterator ai;
+	for (ai = m_anims.begin(); ai != m_anims.end(); ai++) {
+		anims.push_back(ai->name 
+			+ ":" + Ogre::StringConverter::toString((int)(ai->weight * 10.0 + 0.5))
+			+ ":" + Ogre::StringConverter::toString((int)(ai->rate * 10.0 + 0.5))
+			+ (ai->loop ? ":L" : ":O"));
+	}
+	std::sort(anims.begin(), anims.end());
+	Ogre::String key = m_entity->getMesh()->getSkeletonName();
+	std::vector<Ogre::String>::iterator ki;
+	for (ki = anims.begin(); ki != anims.end(); ki++) {
+		key += "|" + *ki;
+	}
+	return key;
+}
+
+// Enable the animations (and only them) in the entity's state set. The entity
+// might not have some of them; they are skipped.
+void Avatar::ApplyAnimations(Ogre::Entity* ent, std::vector<AvatarAnim>& anims) {
+	Ogre::AnimationStateSet* states = ent->getAllAnimationStates();
+	std::vector<AvatarAnim>::iterator ai;
+	if (states == NULL) {
+		for (ai = anims.begin(); ai != anims.end(); ai++) {
+			ai->state = NULL;
+		}
+		return;
+	}
+	Ogre::AnimationStateIterator si = states->getAnimationStateIterator();
+	while (si.hasMoreElements()) {
+		si.getNext()->setEnabled(false);
+	}
+	for (ai = anims.begin(); ai != anims.end(); ai++) {
+		if (!states->hasAnimationState(ai->name)) {
+			ai->state = NULL;
+			continue;
+		}
+		ai->state = states->getAnimationState(ai->name);
+		ai->state->setLoop(ai->loop);
+		ai->state->setWeight(ai->weight);
+		ai->state->setTimePosition(ai->time);
+		ai->state->setEnabled(true);
+	}
+}
+
+void Avatar::AdvanceAnimations(std::vector<AvatarAnim>& anims, float seconds) {
+	std::vector<AvatarAnim>::iterator ai;
+	for (ai = anims.begin(); ai != anims.end(); ai++) {
+		if (ai->state != NULL) {
+			ai->state->addTime(seconds * ai->rate);
+			ai->time = ai->state->getTimePosition();
+		}
+	}
+}
+
 }
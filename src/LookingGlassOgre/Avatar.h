@@ -26,11 +26,58 @@
 #include "LookingGlassOgre.h"
 
 namespace LG {
+	// one skeletal animation playing on an avatar
+	typedef struct {
+		Ogre::String name;
+		float weight;
+		float rate;						// multiplies the speed of the animation
+		bool loop;
+		float time;						// where the animation is
+		Ogre::AnimationState* state;	// in the state set the animation was applied to
+	} AvatarAnim;
+
+	// Avatars far away that play the same animations share one skeleton instance.
+	// The skeleton belongs to an entity that is never displayed. Its animations
+	// are the ones advanced and the pose is computed once for all the members.
+	typedef struct {
+		Ogre::String key;
+		Ogre::Entity* owner;
+		std::vector<AvatarAnim> anims;
+		float pending;					// seconds not yet added to the animations
+		int phase;
+		int members;
+	} AvatarPool;
+
+#define AvatarLODNear	0
+#define AvatarLODMid	1
+#define AvatarLODFar	2
+#define AvatarLODHidden	3
+
+	// A skeletal entity and the animations it is playing. The animations are
+	// kept here so they can be put back on the entity when Ogre makes new
+	// animation states for it (the mesh was reloaded) or when it stops sharing
+	// a pool's skeleton.
 	class Avatar {
 	public:
-		Avatar();
+		Avatar(Ogre::Entity*);
 		~Avatar();
 
-	private:
+		Ogre::Entity* m_entity;
+		std::vector<AvatarAnim> m_anims;
+		Ogre::AnimationStateSet* m_stateSet;	// the entity's own states when they were applied
+		float m_pending;		// seconds not yet added to the animations
+		int m_phase;			// spreads out the updates of the slower avatars
+		int m_lod;				// AvatarLOD*
+		AvatarPool* m_pool;		// the pool whose skeleton is shared or NULL
+
+		// start, change or (weight of zero) stop an animation
+		void SetAnimation(const Ogre::String&, float, float, bool);
+		bool IsAnimated() { return !m_anims.empty(); }
+		// avatars with the same key can share a skeleton instance
+		Ogre::String PoolKey();
+
+		// set the entity's animation states to the animations
+		static void ApplyAnimations(Ogre::Entity*, std::vector<AvatarAnim>&);
+		static void AdvanceAnimations(std::vector<AvatarAnim>&, float);
 	};
 }
@@ -0,0 +1,382 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "LGOCommon.h"
+#include "LookingGlassOgre.h"
+#include "RendererOgre.h"
+#include "OLMaterialTracker.h"
+#include "AvatarTracker.h"
+#include "LGTrace.h"
+
+namespace LG {
+AvatarTracker* AvatarTracker::m_instance = NULL;
+
+AvatarTracker::AvatarTracker() {
+	m_requestLock = LGLOCK_ALLOCATE_MUTEX("AvatarTracker");
+	m_hardwareSkinning = LG::GetParameterBool("Renderer.Ogre.Avatar.HardwareSkinning");
+	m_sharePoses = LG::GetParameterBool("Renderer.Ogre.Avatar.SharePoses");
+	m_nearDistance = LG::GetParameterFloat("Renderer.Ogre.Avatar.NearDistance");
+	m_farDistance = LG::GetParameterFloat("Renderer.Ogre.Avatar.FarDistance");
+	m_midInterval = LG::GetParameterInt("Renderer.Ogre.Avatar.MidInterval");
+	m_farInterval = LG::GetParameterInt("Renderer.Ogre.Avatar.FarInterval");
+	m_hiddenInterval = LG::GetParameterInt("Renderer.Ogre.Avatar.HiddenInterval");
+	m_defaultSkeleton = LG::GetParameter("Renderer.Ogre.Avatar.DefaultSkeleton");
+	m_frameCount = 0;
+	m_nextPhase = 0;
+	m_poolSequence = 0;
+	LG::GetOgreRoot()->addFrameListener(this);
+}
+
+AvatarTracker::~AvatarTracker() {
+	LG::GetOgreRoot()->removeFrameListener(this);
+	LGLOCK_RELEASE_MUTEX(m_requestLock);
+}
+
+// SingletonInstance.Shutdown()
+// The pools' entities are destroyed while the scene manager is still around.
+void AvatarTracker::Shutdown() {
+	Ogre::SceneManager* sceneMgr = LG::RendererOgre::Instance()->m_sceneMgr;
+	std::vector<Avatar*>::iterator ai;
+	for (ai = m_avatars.begin(); ai != m_avatars.end(); ai++) {
+		delete *ai;
+	}
+	m_avatars.clear();
+	m_avatarIndex.clear();
+	AvatarPoolHashMap::iterator pi;
+	for (pi = m_pools.begin(); pi != m_pools.end(); pi++) {
+		if (sceneMgr != NULL) {
+			sceneMgr->destroyEntity(pi->second->owner);
+		}
+		delete pi->second;
+	}
+	m_pools.clear();
+	return;
+}
+
+// Called for every entity that's created. Skeletal ones and ones that have
+// been asked to animate become avatars.
+void AvatarTracker::EntityCreated(Ogre::Entity* ent) {
+	std::list<AnimRequest> waiting;
+	LGLOCK_LOCK(m_requestLock);
+	WaitingRequestHashMap::iterator wi = m_waiting.find(ent->getName());
+	if (wi != m_waiting.end()) {
+		waiting.swap(wi->second);
+		m_waiting.erase(wi);
+	}
+	LGLOCK_UNLOCK(m_requestLock);
+	if (!ent->hasSkeleton() && waiting.empty()) {
+		return;
+	}
+	Avatar* av = AddAvatar(ent);
+	std::list<AnimRequest>::iterator ri;
+	for (ri = waiting.begin(); ri != waiting.end(); ri++) {
+		ApplyRequest(av, *ri);
+	}
+}
+
+// Called before any entity is destroyed
+void AvatarTracker::EntityDestroyed(Ogre::MovableObject* obj) {
+	AvatarHashMap::iterator ai = m_avatarIndex.find((Ogre::Entity*)obj);
+	if (ai == m_avatarIndex.end()) {
+		return;
+	}
+	Avatar* av = ai->second;
+	m_avatarIndex.erase(ai);
+	if (av->m_pool != NULL) {
+		// Ogre takes the entity out of the sharing when it's destroyed
+		ReleasePool(av->m_pool);
+		av->m_pool = NULL;
+	}
+	std::vector<Avatar*>::iterator vi = std::find(m_avatars.begin(), m_avatars.end(), av);
+	if (vi != m_avatars.end()) {
+		*vi = m_avatars.back();
+		m_avatars.pop_back();
+	}
+	delete av;
+}
+
+// The avatars can only share skeleton instances if their meshes use the same
+// skeleton. Ogre loads each skeleton once. A skeleton that can't be found is
+// replaced by the default skeleton rather than each mesh loading without one.
+void AvatarTracker::SkeletonReferenced(Ogre::Mesh* mesh, Ogre::String* name) {
+	LGLOCK_ALOCK requestLock;
+	requestLock.Lock(m_requestLock);
+	SkeletonHashMap::iterator si = m_skeletons.find(*name);
+	if (si != m_skeletons.end()) {
+		*name = si->second;
+		return;
+	}
+	Ogre::String useName = *name;
+	if (m_defaultSkeleton.length() > 0
+			&& !Ogre::ResourceGroupManager::getSingleton().resourceExistsInAnyGroup(*name)) {
+		useName = m_defaultSkeleton;
+		LG::Log("AvatarTracker: skeleton %s of %s not found. Using %s", 
+			name->c_str(), mesh->getName().c_str(), useName.c_str());
+	}
+	else {
+		LG::Log("AvatarTracker: skeleton %s first used by %s", name->c_str(), mesh->getName().c_str());
+	}
+	m_skeletons.insert(std::pair<Ogre::String, Ogre::String>(*name, useName));
+	*name = useName;
+}
+
+void AvatarTracker::SetAnimation(const Ogre::String& entityName, const Ogre::String& animName,
+			float weight, float rate, bool loop) {
+	AnimRequest req;
+	req.entityName = entityName;
+	req.animName = animName;
+	req.weight = weight;
+	req.rate = rate;
+	req.loop = loop;
+	LGLOCK_LOCK(m_requestLock);
+	m_requests.push_back(req);
+	LGLOCK_UNLOCK(m_requestLock);
+}
+
+Avatar* AvatarTracker::AddAvatar(Ogre::Entity* ent) {
+	AvatarHashMap::iterator ai = m_avatarIndex.find(ent);
+	if (ai != m_avatarIndex.end()) {
+		return ai->second;
+	}
+	Avatar* av = new Avatar(ent);
+	av->m_phase = m_nextPhase++;
+	m_avatars.push_back(av);
+	m_avatarIndex.insert(std::pair<Ogre::Entity*, Avatar*>(ent, av));
+	return av;
+}
+
+// A pooled avatar leaves the pool to change what it's playing. It'll join
+// another pool the next frame if it's still far away.
+void AvatarTracker::ApplyRequest(Avatar* av, const AnimRequest& req) {
+	if (av->m_pool != NULL) {
+		LeavePool(av);
+	}
+	av->SetAnimation(req.animName, req.weight, req.rate, req.loop);
+	if (av->m_stateSet != NULL && av->m_stateSet == av->m_entity->getAllAnimationStates()) {
+		Avatar::ApplyAnimations(av->m_entity, av->m_anims);
+	}
+}
+
+void AvatarTracker::ProcessRequests() {
+	std::list<AnimRequest> requests;
+	LGLOCK_LOCK(m_requestLock);
+	requests.swap(m_requests);
+	LGLOCK_UNLOCK(m_requestLock);
+	Ogre::SceneManager* sceneMgr = LG::RendererOgre::Instance()->m_sceneMgr;
+	std::list<AnimRequest>::iterator ri;
+	for (ri = requests.begin(); ri != requests.end(); ri++) {
+		if (!sceneMgr->hasEntity(ri->entityName)) {
+			LGLOCK_LOCK(m_requestLock);
+			m_waiting[ri->entityName].push_back(*ri);
+			LGLOCK_UNLOCK(m_requestLock);
+			continue;
+		}
+		ApplyRequest(AddAvatar(sceneMgr->getEntity(ri->entityName)), *ri);
+	}
+}
+
+// Ogre made new animation states for the entity: it's new or its mesh was
+// reloaded. Any skeleton sharing is gone and so are the skinned materials.
+void AvatarTracker::PrepareAvatar(Avatar* av) {
+	Ogre::Entity* ent = av->m_entity;
+	if (av->m_pool != NULL) {
+		ReleasePool(av->m_pool);
+		av->m_pool = NULL;
+	}
+	if (m_hardwareSkinning) {
+		for (unsigned int ii = 0; ii < ent->getNumSubEntities(); ii++) {
+			Ogre::SubEntity* sub = ent->getSubEntity(ii);
+			Ogre::String skinned = LG::OLMaterialTracker::Instance()->SkinnedMaterialName(sub->getMaterialName());
+			if (skinned != sub->getMaterialName()) {
+				sub->setMaterialName(skinned);
+			}
+		}
+	}
+	Avatar::ApplyAnimations(ent, av->m_anims);
+	av->m_stateSet = ent->getAllAnimationStates();
+	av->m_pending = 0.0;
+}
+
+int AvatarTracker::CalculateLOD(Avatar* av, Ogre::Camera* cam) {
+	Ogre::SceneNode* node = av->m_entity->getParentSceneNode();
+	if (cam == NULL || node == NULL || !av->m_entity->isVisible()
+			|| !cam->isVisible(av->m_entity->getWorldBoundingBox(true))) {
+		return AvatarLODHidden;
+	}
+	float dist = cam->getDerivedPosition().distance(node->_getDerivedPosition());
+	if (dist < m_nearDistance) {
+		return AvatarLODNear;
+	}
+	if (dist < m_farDistance) {
+		return AvatarLODMid;
+	}
+	return AvatarLODFar;
+}
+
+// Share the skeleton of the pool for the avatar's animations. The pool's entity
+// is made from the first member's mesh and starts where its animations were.
+void AvatarTracker::JoinPool(Avatar* av) {
+	Ogre::String key = av->PoolKey();
+	AvatarPool* pool = NULL;
+	AvatarPoolHashMap::iterator pi = m_pools.find(key);
+	if (pi != m_pools.end()) {
+		pool = pi->second;
+	}
+	else {
+		Ogre::Entity* owner = NULL;
+		try {
+			owner = LG::RendererOgre::Instance()->m_sceneMgr->createEntity(
+					"LGAvatarPool/" + Ogre::StringConverter::toString(m_poolSequence++),
+					av->m_entity->getMesh()->getName());
+		}
+		catch (Ogre::Exception& e) {
+			LG::Log("AvatarTracker::JoinPool: could not make pool entity: %s", e.getDescription().c_str());
+			return;
+		}
+		// the owner is never displayed but the pose is computed the way its
+		// materials say so it gets the same ones as the members
+		for (unsigned int ii = 0; ii < owner->getNumSubEntities(); ii++) {
+			owner->getSubEntity(ii)->setMaterialName(av->m_entity->getSubEntity(ii)->getMaterialName());
+		}
+		pool = new AvatarPool;
+		pool->key = key;
+		pool->owner = owner;
+		pool->anims = av->m_anims;
+		pool->pending = 0.0;
+		pool->phase = m_nextPhase++;
+		pool->members = 0;
+		Avatar::ApplyAnimations(owner, pool->anims);
+		m_pools.insert(std::pair<Ogre::String, AvatarPool*>(key, pool));
+	}
+	try {
+		av->m_entity->shareSkeletonInstanceWith(pool->owner);
+	}
+	catch (Ogre::Exception& e) {
+		LG::Log("AvatarTracker::JoinPool: could not share skeleton: %s", e.getDescription().c_str());
+		if (pool->members == 0) {
+			pool->members = 1;
+			ReleasePool(pool);
+		}
+		return;
+	}
+	pool->members++;
+	av->m_pool = pool;
+}
+
+// The avatar gets its own skeleton again. Its animations carry on from where the
+// pool's were so there's no jump.
+void AvatarTracker::LeavePool(Avatar* av) {
+	AvatarPool* pool = av->m_pool;
+	av->m_pool = NULL;
+	if (av->m_entity->sharesSkeletonInstance()) {
+		av->m_entity->stopSharingSkeletonInstance();
+	}
+	std::vector<AvatarAnim>::iterator ai, pi;
+	for (ai = av->m_anims.begin(); ai != av->m_anims.end(); ai++) {
+		for (pi = pool->anims.begin(); pi != pool->anims.end(); pi++) {
+			if (ai->name == pi->name) {
+				ai->time = pi->time;
+				break;
+			}
+		}
+	}
+	Avatar::ApplyAnimations(av->m_entity, av->m_anims);
+	av->m_stateSet = av->m_entity->getAllAnimationStates();
+	av->m_pending = 0.0;
+	ReleasePool(pool);
+}
+
+// One less member. The last one out destroys the pool.
+void AvatarTracker::ReleasePool(AvatarPool* pool) {
+	if (--pool->members > 0) {
+		return;
+	}
+	m_pools.erase(pool->key);
+	LG::RendererOgre::Instance()->m_sceneMgr->destroyEntity(pool->owner);
+	delete pool;
+}
+
+// Ogre::FrameListener
+bool AvatarTracker::frameStarted(const Ogre::FrameEvent& evt) {
+	LGTRACE_SCOPE("AvatarTracker");
+	ProcessRequests();
+	if (m_avatars.empty()) {
+		return true;
+	}
+	m_frameCount++;
+	Ogre::Camera* cam = NULL;
+	if (LG::RendererOgre::Instance()->m_camera != NULL) {
+		cam = LG::RendererOgre::Instance()->m_camera->Cam;
+	}
+
+	AvatarPoolHashMap::iterator pi;
+	for (pi = m_pools.begin(); pi != m_pools.end(); pi++) {
+		AvatarPool* pool = pi->second;
+		pool->pending += evt.timeSinceLastFrame;
+		if (m_farInterval <= 1 || ((m_frameCount + pool->phase) % m_farInterval) == 0) {
+			Avatar::AdvanceAnimations(pool->anims, pool->pending);
+			pool->pending = 0.0;
+		}
+	}
+
+	for (unsigned int ii = 0; ii < m_avatars.size(); ii++) {
+		Avatar* av = m_avatars[ii];
+		Ogre::Entity* ent = av->m_entity;
+		if (!ent->hasSkeleton()) {
+			// the mesh might not be loaded yet
+			continue;
+		}
+		Ogre::AnimationStateSet* states = av->m_pool != NULL 
+					? av->m_pool->owner->getAllAnimationStates() : av->m_stateSet;
+		if (ent->getAllAnimationStates() != states) {
+			PrepareAvatar(av);
+		}
+		av->m_lod = CalculateLOD(av, cam);
+		if (av->m_pool == NULL && av->m_lod >= AvatarLODFar && m_sharePoses && av->IsAnimated()) {
+			JoinPool(av);
+		}
+		else if (av->m_pool != NULL && av->m_lod < AvatarLODFar) {
+			LeavePool(av);
+		}
+		if (av->m_pool != NULL) {
+			// the pool's animations are advanced for it
+			continue;
+		}
+		int interval = 1;
+		switch (av->m_lod) {
+			case AvatarLODMid: interval = m_midInterval; break;
+			case AvatarLODFar: interval = m_farInterval; break;
+			case AvatarLODHidden: interval = m_hiddenInterval; break;
+		}
+		av->m_pending += evt.timeSinceLastFrame;
+		if (interval <= 1 || ((m_frameCount + av->m_phase) % interval) == 0) {
+			Avatar::AdvanceAnimations(av->m_anims, av->m_pending);
+			av->m_pending = 0.0;
+		}
+	}
+	LG::SetStat(LG::StatAvatars, (int)m_avatars.size());
+	LG::SetStat(LG::StatAvatarPools, (int)m_pools.size());
+	return true;
+}
+
+}
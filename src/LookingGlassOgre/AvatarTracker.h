@@ -0,0 +1,119 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "SingletonInstance.h"
+#include "LGLocking.h"
+#include "Avatar.h"
+
+namespace LG {
+	// Tracker for the skeletal entities (avatars).
+	// All the avatar meshes refer to the same skeleton which is loaded once. With
+	// the prim shader, the faces of the avatars get skinned materials so the
+	// bones are blended on the card.
+	// The skeletal animations are advanced at a rate that depends on how far away
+	// the avatar is and whether it can be seen. An avatar's pose is only computed
+	// when its animation states change so the slower avatars cost less. Far away
+	// and hidden avatars playing the same animations share one skeleton instance
+	// (a pool) so the pose is computed once for all of them.
+class AvatarTracker : public Ogre::FrameListener, public SingletonInstance {
+public:
+	AvatarTracker();
+	~AvatarTracker();
+
+	static AvatarTracker* Instance() { 
+		if (LG::AvatarTracker::m_instance == NULL) {
+			LG::AvatarTracker::m_instance = new AvatarTracker();
+		}
+		return LG::AvatarTracker::m_instance; 
+	}
+
+	// SingletonInstance.Shutdown()
+	void Shutdown();
+
+	// an entity was just created or is about to be destroyed
+	void EntityCreated(Ogre::Entity*);
+	void EntityDestroyed(Ogre::MovableObject*);
+
+	// a mesh being loaded refers to a skeleton
+	void SkeletonReferenced(Ogre::Mesh*, Ogre::String*);
+
+	// Start, change or (weight of zero) stop a skeletal animation on an entity.
+	// Can be called from any thread. The change happens at the next frame.
+	void SetAnimation(const Ogre::String& entityName, const Ogre::String& animName,
+			float weight, float rate, bool loop);
+
+	// Ogre::FrameListener
+	bool frameStarted(const Ogre::FrameEvent&);
+
+private:
+	static AvatarTracker* m_instance;
+
+	bool m_hardwareSkinning;
+	bool m_sharePoses;
+	float m_nearDistance;
+	float m_farDistance;
+	int m_midInterval;		// frames between animation updates when in the middle distance
+	int m_farInterval;		// ... when far away
+	int m_hiddenInterval;	// ... when not in view
+	Ogre::String m_defaultSkeleton;
+
+	unsigned long m_frameCount;
+	int m_nextPhase;
+	int m_poolSequence;
+
+	std::vector<Avatar*> m_avatars;
+	typedef std::map<Ogre::Entity*, Avatar*> AvatarHashMap;
+	AvatarHashMap m_avatarIndex;
+	typedef std::map<Ogre::String, AvatarPool*> AvatarPoolHashMap;
+	AvatarPoolHashMap m_pools;
+
+	// animation changes wait here for the frame thread
+	typedef struct {
+		Ogre::String entityName;
+		Ogre::String animName;
+		float weight;
+		float rate;
+		bool loop;
+	} AnimRequest;
+	std::list<AnimRequest> m_requests;
+	// requests for entities that haven't been created yet
+	typedef std::map<Ogre::String, std::list<AnimRequest> > WaitingRequestHashMap;
+	WaitingRequestHashMap m_waiting;
+	LGLOCK_MUTEX m_requestLock;
+
+	// skeletons seen so far and replacements for the ones that couldn't be found
+	typedef std::map<Ogre::String, Ogre::String> SkeletonHashMap;
+	SkeletonHashMap m_skeletons;
+
+	Avatar* AddAvatar(Ogre::Entity*);
+	void ApplyRequest(Avatar*, const AnimRequest&);
+	void ProcessRequests();
+	void PrepareAvatar(Avatar*);
+	int CalculateLOD(Avatar*, Ogre::Camera*);
+	void JoinPool(Avatar*);
+	void LeavePool(Avatar*);
+	void ReleasePool(AvatarPool*);
+};
+}
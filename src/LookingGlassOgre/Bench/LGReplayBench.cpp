@@ -0,0 +1,418 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// Replays a recording made with Renderer.Ogre.Replay.Record against a headless
+// renderer and reports how long the calls and frames took.
+//    LookingGlassReplayBench [-r] [-v] [-d frames] [-c file.csv] [-p name=value]... recording
+//  -r  pace the calls as they were recorded. Otherwise they go as fast as they can
+//      with a frame wherever the viewer drew one.
+//  -d  after the recording, frames to run while the between frame queue drains (1000)
+//  -c  also write the results as CSV
+//  -p  set a parameter after the recorded ones (can be repeated)
+//  -v  log to stderr
+// The call times are the enqueue latency seen by the caller. The work is done in
+// the frames and shows up in the frame times and the statistics.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "LookingGlassOgre.h"
+#include "ProcessBetweenFrame.h"
+#include "LGLocking.h"
+#include "LGLog.h"
+#include "LGReplay.h"
+
+// The renderer's interface. The same one the managed code uses.
+extern "C" {
+void InitializeOgre();
+bool RenderOneFrame(bool, int);
+void SetFetchParameterCallback(LG::FetchParameterCallback*);
+void UpdateParameter(const char*, const char*);
+void SetDebugLogCallback(LG::DebugLogCallback*);
+void SetCheckKeepRunningCallback(LG::CheckKeepRunningCallback*);
+void SetRequestResourceCallback(LG::RequestResourceCallback*);
+void SetBetweenFramesCallback(LG::BetweenFramesCallback*);
+void EnableStats(bool);
+int StatsSchemaSize();
+int StatsSchemaEntry(int, char*, int, char*, int);
+int StatsSnapshot(Ogre::int64*, int);
+void UpdateCameraBF(double, double, double, float, float, float, float, float, float, float);
+void RefreshResourceBF(float, int, char*);
+void CreateMeshResourceBF(float, const char*, char*, const int*, const float*);
+void CreateMaterialResource2BF(float, const char*, char*, const float*);
+void CreateMaterialResource7BF(float, char*,
+			const char*, const char*, const char*, const char*, const char*, const char*, const char*,
+			char*, char*, char*, char*, char*, char*, char*, const float*);
+void AddRegionBF(float, const char*, double, double, double, const float, const float, const float);
+void UpdateTerrainBF(float, const char*, const int, const int, const float*);
+void SetFocusRegionBF(const char*);
+void SetRegionDetailBF(const char*, const LG::RegionRezCode);
+Ogre::SceneManager* GetSceneMgr();
+bool CreateMeshSceneNodeBF(float, Ogre::SceneManager*, char*, char*, char*, char*, bool, bool,
+			float, float, float, float, float, float, float, float, float, float);
+void UpdateSceneNodeBF(float, char*, bool, float, float, float, float, bool, float, float, float, float,
+			bool, float, float, float, float, float);
+void RemoveSceneNodeBF(float, char*);
+void UpdateAnimationBF(float, char*, float, float, float, float);
+void UpdateMotion(char*, float, float, float, float, float, float, float, float, float,
+			float, float, float, float, float, float, float, double);
+void SetAvatarAnimation(char*, char*, float, float, int);
+}
+
+// ================================================================
+// Callbacks. The parameters are all pushed so the fetch is only for ones nobody set.
+static int resourceRequests = 0;
+static int meshSceneNodeFailures = 0;
+
+static void BenchLog(const char* msg) {
+	fprintf(stderr, "%s\n", msg);
+}
+static const char* BenchFetchParameter(const char* name) {
+	return "";
+}
+static const bool BenchKeepRunning() {
+	return true;
+}
+static void BenchRequestResource(const char* resourceName, const char* contextName, int rType) {
+	// nothing will answer. The replayed calls have the resources the viewer sent.
+	resourceRequests++;
+}
+static bool BenchBetweenFrames() {
+	return true;
+}
+
+// ================================================================
+// Timings in microseconds
+class BenchTimes {
+public:
+	std::vector<Ogre::uint64> times;
+	Ogre::uint64 total;
+	BenchTimes() : total(0) {}
+	void Add(Ogre::uint64 us) { times.push_back(us); total += us; }
+	Ogre::uint64 Percentile(double pp) {
+		size_t ii = (size_t)(pp * times.size());
+		if (ii >= times.size()) ii = times.size() - 1;
+		return times[ii];
+	}
+	void Sort() { std::sort(times.begin(), times.end()); }
+};
+
+static void PrintTimes(FILE* csv, const char* name, BenchTimes& bt, double seconds) {
+	if (bt.times.empty()) return;
+	bt.Sort();
+	double mean = (double)bt.total / bt.times.size();
+	double rate = seconds > 0 ? bt.times.size() / seconds : 0.0;
+	printf("%-28s %8d %10.1f %9.1f %8llu %8llu %8llu %8llu\n", name, (int)bt.times.size(), rate, mean,
+			(unsigned long long)bt.Percentile(0.50), (unsigned long long)bt.Percentile(0.90),
+			(unsigned long long)bt.Percentile(0.99), (unsigned long long)bt.times.back());
+	if (csv != NULL) {
+		fprintf(csv, "%s,%d,%.1f,%.1f,%llu,%llu,%llu,%llu\n", name, (int)bt.times.size(), rate, mean,
+			(unsigned long long)bt.Percentile(0.50), (unsigned long long)bt.Percentile(0.90),
+			(unsigned long long)bt.Percentile(0.99), (unsigned long long)bt.times.back());
+	}
+}
+
+// ================================================================
+// Make the call a record was made from. Returns false if the record is not understood.
+static bool Dispatch(LG::ReplayReader& rr, BenchTimes* callTimes, BenchTimes& frameTimes) {
+	int cnt;
+	Ogre::uint64 start = LGLOCK_MICROSECONDS();
+	switch (rr.Code()) {
+		case LG::ReplayParameter: {
+			char* name = rr.Str();
+			char* value = rr.Str();
+			UpdateParameter(name, value);
+			break;
+		}
+		case LG::ReplayFrame:
+			RenderOneFrame(false, 0);
+			frameTimes.Add(LGLOCK_MICROSECONDS() - start);
+			return true;
+		case LG::ReplayUpdateCamera: {
+			double px = rr.Double(); double py = rr.Double(); double pz = rr.Double();
+			float dw = rr.Float(); float dx = rr.Float(); float dy = rr.Float(); float dz = rr.Float();
+			float nearClip = rr.Float(); float farClip = rr.Float(); float aspect = rr.Float();
+			start = LGLOCK_MICROSECONDS();
+			UpdateCameraBF(px, py, pz, dw, dx, dy, dz, nearClip, farClip, aspect);
+			break;
+		}
+		case LG::ReplayRefreshResource: {
+			float pri = rr.Float(); int rType = rr.Int(); char* name = rr.Str();
+			start = LGLOCK_MICROSECONDS();
+			RefreshResourceBF(pri, rType, name);
+			break;
+		}
+		case LG::ReplayCreateMeshResource: {
+			float pri = rr.Float(); char* meshName = rr.Str(); char* context = rr.Str();
+			const int* faceCounts = rr.Ints(cnt);
+			const float* faceVertices = rr.Floats(cnt);
+			if (rr.Bad() || faceCounts == NULL || faceVertices == NULL) return false;
+			start = LGLOCK_MICROSECONDS();
+			CreateMeshResourceBF(pri, meshName, context, faceCounts, faceVertices);
+			break;
+		}
+		case LG::ReplayCreateMaterialResource2: {
+			float pri = rr.Float(); char* matName = rr.Str(); char* textureName = rr.Str();
+			const float* parms = rr.Floats(cnt);
+			if (rr.Bad() || parms == NULL) return false;
+			start = LGLOCK_MICROSECONDS();
+			CreateMaterialResource2BF(pri, matName, textureName, parms);
+			break;
+		}
+		case LG::ReplayCreateMaterialResource7: {
+			float pri = rr.Float(); char* uniq = rr.Str();
+			char* mat[7]; char* tex[7];
+			for (int ii = 0; ii < 7; ii++) mat[ii] = rr.Str();
+			for (int ii = 0; ii < 7; ii++) tex[ii] = rr.Str();
+			const float* parms = rr.Floats(cnt);
+			if (rr.Bad() || parms == NULL) return false;
+			start = LGLOCK_MICROSECONDS();
+			CreateMaterialResource7BF(pri, uniq, mat[0], mat[1], mat[2], mat[3], mat[4], mat[5], mat[6],
+						tex[0], tex[1], tex[2], tex[3], tex[4], tex[5], tex[6], parms);
+			break;
+		}
+		case LG::ReplayAddRegion: {
+			float pri = rr.Float(); char* name = rr.Str();
+			double gx = rr.Double(); double gy = rr.Double(); double gz = rr.Double();
+			float sx = rr.Float(); float sy = rr.Float(); float water = rr.Float();
+			start = LGLOCK_MICROSECONDS();
+			AddRegionBF(pri, name, gx, gy, gz, sx, sy, water);
+			break;
+		}
+		case LG::ReplayUpdateTerrain: {
+			float pri = rr.Float(); char* name = rr.Str();
+			int width = rr.Int(); int length = rr.Int();
+			const float* heights = rr.Floats(cnt);
+			if (rr.Bad() || heights == NULL || cnt != width * length) return false;
+			start = LGLOCK_MICROSECONDS();
+			UpdateTerrainBF(pri, name, width, length, heights);
+			break;
+		}
+		case LG::ReplaySetFocusRegion: {
+			char* name = rr.Str();
+			start = LGLOCK_MICROSECONDS();
+			SetFocusRegionBF(name);
+			break;
+		}
+		case LG::ReplaySetRegionDetail: {
+			char* name = rr.Str(); int rez = rr.Int();
+			start = LGLOCK_MICROSECONDS();
+			SetRegionDetailBF(name, (LG::RegionRezCode)rez);
+			break;
+		}
+		case LG::ReplayCreateMeshSceneNode: {
+			float pri = rr.Float();
+			char* nodeName = rr.Str(); char* parentName = rr.Str();
+			char* entityName = rr.Str(); char* meshName = rr.Str();
+			bool inheritScale = rr.Bool(); bool inheritOrientation = rr.Bool();
+			float px = rr.Float(); float py = rr.Float(); float pz = rr.Float();
+			float sx = rr.Float(); float sy = rr.Float(); float sz = rr.Float();
+			float ow = rr.Float(); float ox = rr.Float(); float oy = rr.Float(); float oz = rr.Float();
+			start = LGLOCK_MICROSECONDS();
+			// the parent may not be there yet if it was made in a frame we have not run
+			if (!CreateMeshSceneNodeBF(pri, GetSceneMgr(), nodeName, parentName, entityName, meshName,
+						inheritScale, inheritOrientation, px, py, pz, sx, sy, sz, ow, ox, oy, oz)) {
+				meshSceneNodeFailures++;
+			}
+			break;
+		}
+		case LG::ReplayUpdateSceneNode: {
+			float pri = rr.Float(); char* name = rr.Str();
+			bool setPos = rr.Bool(); float px = rr.Float(); float py = rr.Float(); float pz = rr.Float(); float pd = rr.Float();
+			bool setScale = rr.Bool(); float sx = rr.Float(); float sy = rr.Float(); float sz = rr.Float(); float sd = rr.Float();
+			bool setRot = rr.Bool(); float ow = rr.Float(); float ox = rr.Float(); float oy = rr.Float(); float oz = rr.Float();
+			float od = rr.Float();
+			start = LGLOCK_MICROSECONDS();
+			UpdateSceneNodeBF(pri, name, setPos, px, py, pz, pd, setScale, sx, sy, sz, sd, setRot, ow, ox, oy, oz, od);
+			break;
+		}
+		case LG::ReplayRemoveSceneNode: {
+			float pri = rr.Float(); char* name = rr.Str();
+			start = LGLOCK_MICROSECONDS();
+			RemoveSceneNodeBF(pri, name);
+			break;
+		}
+		case LG::ReplayUpdateAnimation: {
+			float pri = rr.Float(); char* name = rr.Str();
+			float xx = rr.Float(); float yy = rr.Float(); float zz = rr.Float(); float rate = rr.Float();
+			start = LGLOCK_MICROSECONDS();
+			UpdateAnimationBF(pri, name, xx, yy, zz, rate);
+			break;
+		}
+		case LG::ReplayUpdateMotion: {
+			char* name = rr.Str();
+			float vv[16];
+			for (int ii = 0; ii < 16; ii++) vv[ii] = rr.Float();
+			double timestamp = rr.Double();
+			start = LGLOCK_MICROSECONDS();
+			UpdateMotion(name, vv[0], vv[1], vv[2], vv[3], vv[4], vv[5], vv[6], vv[7], vv[8],
+						vv[9], vv[10], vv[11], vv[12], vv[13], vv[14], vv[15], timestamp);
+			break;
+		}
+		case LG::ReplaySetAvatarAnimation: {
+			char* entityName = rr.Str(); char* animName = rr.Str();
+			float weight = rr.Float(); float rate = rr.Float(); int loop = rr.Int();
+			start = LGLOCK_MICROSECONDS();
+			SetAvatarAnimation(entityName, animName, weight, rate, loop);
+			break;
+		}
+		default:
+			return false;
+	}
+	if (rr.Bad()) return false;
+	callTimes[rr.Code()].Add(LGLOCK_MICROSECONDS() - start);
+	return true;
+}
+
+static void Usage() {
+	fprintf(stderr, "usage: LookingGlassReplayBench [-r] [-v] [-d frames] [-c file.csv] [-p name=value]... recording\n");
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	bool realTime = false;
+	bool verbose = false;
+	int drainFrames = 1000;
+	const char* csvName = NULL;
+	const char* replayName = NULL;
+	std::vector<std::pair<std::string, std::string> > overrides;
+	for (int ii = 1; ii < argc; ii++) {
+		if (strcmp(argv[ii], "-r") == 0) realTime = true;
+		else if (strcmp(argv[ii], "-v") == 0) verbose = true;
+		else if (strcmp(argv[ii], "-d") == 0 && ii + 1 < argc) drainFrames = atoi(argv[++ii]);
+		else if (strcmp(argv[ii], "-c") == 0 && ii + 1 < argc) csvName = argv[++ii];
+		else if (strcmp(argv[ii], "-p") == 0 && ii + 1 < argc) {
+			const char* eq = strchr(argv[++ii], '=');
+			if (eq == NULL) Usage();
+			overrides.push_back(std::make_pair(std::string(argv[ii], eq - argv[ii]), std::string(eq + 1)));
+		}
+		else if (argv[ii][0] == '-' || replayName != NULL) Usage();
+		else replayName = argv[ii];
+	}
+	if (replayName == NULL) Usage();
+
+	LG::ReplayReader rr;
+	if (!rr.Open(replayName)) {
+		fprintf(stderr, "LookingGlassReplayBench: cannot read recording '%s'\n", replayName);
+		return 1;
+	}
+
+	SetFetchParameterCallback(&BenchFetchParameter);
+	if (verbose) SetDebugLogCallback(&BenchLog);
+	SetCheckKeepRunningCallback(&BenchKeepRunning);
+	SetRequestResourceCallback(&BenchRequestResource);
+	SetBetweenFramesCallback(&BenchBetweenFrames);
+
+	// The recording starts with all the parameters the viewer had
+	bool more = rr.Next();
+	while (more && rr.Code() == LG::ReplayParameter) {
+		char* name = rr.Str();
+		char* value = rr.Str();
+		if (!rr.Bad()) UpdateParameter(name, value);
+		more = rr.Next();
+	}
+	// No window, GPU, plugins or recording. The shaders, shadows and region proxies
+	// need a real render system.
+	UpdateParameter("Renderer.Ogre.Headless", "true");
+	UpdateParameter("Renderer.Ogre.Replay.Record", "");
+	UpdateParameter("Renderer.Ogre.PluginFilename", "");
+	UpdateParameter("Renderer.Ogre.ExternalWindow.Handle", "");
+	UpdateParameter("Renderer.Ogre.ShadowTechnique", "none");
+	UpdateParameter("Renderer.Ogre.UseShaders", "false");
+	UpdateParameter("Renderer.Ogre.UseUberShader", "false");
+	UpdateParameter("Renderer.Ogre.Region.Proxy.Enable", "false");
+	for (size_t ii = 0; ii < overrides.size(); ii++) {
+		UpdateParameter(overrides[ii].first.c_str(), overrides[ii].second.c_str());
+	}
+	EnableStats(true);
+	InitializeOgre();
+	if (GetSceneMgr() == NULL) {
+		fprintf(stderr, "LookingGlassReplayBench: renderer did not initialize\n");
+		return 1;
+	}
+
+	BenchTimes callTimes[LG::ReplayCodeCount];
+	BenchTimes frameTimes;
+	BenchTimes drainTimes;
+	int badRecords = 0;
+	Ogre::uint64 firstTime = more ? rr.Time() : 0;
+	Ogre::uint64 startTime = LGLOCK_MICROSECONDS();
+	while (more) {
+		if (realTime) {
+			Ogre::uint64 due = startTime + (rr.Time() - firstTime);
+			Ogre::uint64 now = LGLOCK_MICROSECONDS();
+			if (due > now + 1000) {
+				LGLOCK_SLEEP((int)((due - now) / 1000));
+			}
+		}
+		if (!Dispatch(rr, callTimes, frameTimes)) badRecords++;
+		more = rr.Next();
+	}
+	Ogre::uint64 replayTime = LGLOCK_MICROSECONDS() - startTime;
+	rr.Close();
+
+	// run frames until everything queued has been done
+	while (LG::ProcessBetweenFrame::Instance()->HasWorkItems() && (int)drainTimes.times.size() < drainFrames) {
+		Ogre::uint64 start = LGLOCK_MICROSECONDS();
+		RenderOneFrame(false, 0);
+		drainTimes.Add(LGLOCK_MICROSECONDS() - start);
+	}
+	bool drained = !LG::ProcessBetweenFrame::Instance()->HasWorkItems();
+	Ogre::uint64 totalTime = LGLOCK_MICROSECONDS() - startTime;
+
+	FILE* csv = NULL;
+	if (csvName != NULL) {
+		csv = fopen(csvName, "w");
+		if (csv == NULL) fprintf(stderr, "LookingGlassReplayBench: cannot write '%s'\n", csvName);
+		else fprintf(csv, "name,count,persec,meanus,p50us,p90us,p99us,maxus\n");
+	}
+	double replaySeconds = replayTime / 1000000.0;
+	printf("replay %.3fs, drain %d frames%s, total %.3fs\n", replaySeconds, (int)drainTimes.times.size(),
+				drained ? "" : " (NOT DRAINED)", totalTime / 1000000.0);
+	printf("bad records %d, mesh scene nodes without parents %d, resource requests %d\n",
+				badRecords, meshSceneNodeFailures, resourceRequests);
+	printf("%-28s %8s %10s %9s %8s %8s %8s %8s\n", "call (us)", "count", "per sec", "mean", "p50", "p90", "p99", "max");
+	for (int ii = 0; ii < LG::ReplayCodeCount; ii++) {
+		PrintTimes(csv, LG::ReplayCodeName(ii), callTimes[ii], replaySeconds);
+	}
+	PrintTimes(csv, "Frame", frameTimes, replaySeconds);
+	PrintTimes(csv, "DrainFrame", drainTimes, (totalTime - replayTime) / 1000000.0);
+
+	// everything the renderer counted
+	int statCount = StatsSchemaSize();
+	std::vector<Ogre::int64> stats(statCount + 1);
+	statCount = StatsSnapshot(&stats[0], statCount);
+	printf("\n%-40s %14s\n", "statistic", "value");
+	for (int ii = 0; ii < statCount; ii++) {
+		char name[128], desc[256];
+		int divisor = StatsSchemaEntry(ii, name, sizeof(name), desc, sizeof(desc));
+		if (divisor <= 0) continue;
+		double value = (double)stats[ii] / divisor;
+		printf("%-40s %14.2f\n", name, value);
+		if (csv != NULL) fprintf(csv, "%s,,%.2f,,,,,\n", name, value);
+	}
+	if (csv != NULL) fclose(csv);
+	LG::LogShutdown();
+	return drained ? 0 : 3;
+}
@@ -42,6 +42,9 @@ LGCamera::LGCamera(Ogre::String nam, Ogre::SceneManager* mgr) {
 		LG::Log("RendererOgre::createCamera: CAMERA FAILED TO CREATE");
 	}
 	this->m_cameraAttached = false;
+	this->m_positionHistoryNext = 0;
+	this->m_positionHistoryCount = 0;
+	this->m_historyTimeKeeper = new Ogre::Timer();
 }
 
 LGCamera::~LGCamera() {
@@ -56,6 +59,7 @@ void LGCamera::updateCamera(double px, double py, double pz,
 	m_desiredPosition = LG::RegionTracker::Instance()->PositionCameraForFocusRegion(px, py, pz);
 	m_desiredCameraOrientation = Ogre::Quaternion(dw, dx, dy, dz);
 	m_desiredCameraOrientationProgress = 0.0;
+	RecordPosition(m_desiredPosition);
 	// to do slerped movement, comment the next lines and uncomment "XXXX" below
 	// this->setOrientation(Ogre::Quaternion(dw, dx, dy, dz));
 	// this->setPosition(m_desiredPosition);
@@ -69,9 +73,47 @@ void LGCamera::updateCamera(double px, double py, double pz,
 	}
 	*/
 	LG::RendererOgre::Instance()->m_visCalc->RecalculateVisibility();
+	LG::RegionTracker::Instance()->PredictAndPrefetch();
 	return;
 }
 
+// Remember where the camera was put for predicting where it's going
+void LGCamera::RecordPosition(Ogre::Vector3 pos) {
+	m_positionHistory[m_positionHistoryNext] = pos;
+	m_positionHistoryTime[m_positionHistoryNext] = m_historyTimeKeeper->getMilliseconds();
+	m_positionHistoryNext = (m_positionHistoryNext + 1) % LGCAMERA_HISTORY_SIZE;
+	if (m_positionHistoryCount < LGCAMERA_HISTORY_SIZE) m_positionHistoryCount++;
+}
+
+// Average velocity (units per second) over the remembered history.
+// Zero if we haven't moved recently.
+Ogre::Vector3 LGCamera::getVelocity() {
+	if (m_positionHistoryCount < 2) {
+		return Ogre::Vector3::ZERO;
+	}
+	int newest = (m_positionHistoryNext + LGCAMERA_HISTORY_SIZE - 1) % LGCAMERA_HISTORY_SIZE;
+	int oldest = (m_positionHistoryNext + LGCAMERA_HISTORY_SIZE - m_positionHistoryCount) % LGCAMERA_HISTORY_SIZE;
+	unsigned long now = m_historyTimeKeeper->getMilliseconds();
+	if ((now - m_positionHistoryTime[newest]) > 2000) {
+		// no updates for a while so we're not going anywhere
+		return Ogre::Vector3::ZERO;
+	}
+	float seconds = (float)(m_positionHistoryTime[newest] - m_positionHistoryTime[oldest]) / 1000.0f;
+	if (seconds <= 0.0f) {
+		return Ogre::Vector3::ZERO;
+	}
+	return (m_positionHistory[newest] - m_positionHistory[oldest]) / seconds;
+}
+
+float LGCamera::getSpeed() {
+	return getVelocity().length();
+}
+
+// Guess where the camera will be 'secondsAhead' from now if it keeps going the way it is
+Ogre::Vector3 LGCamera::PredictPosition(float secondsAhead) {
+	return m_desiredPosition + (getVelocity() * secondsAhead);
+}
+
 // called at the beginning of the frame so we can slrp the camera
 #define SECONDS_TO_SLERP 0.5f
 void LGCamera::AdvanceCamera(const Ogre::FrameEvent& evt) {
@@ -100,6 +142,15 @@ void LGCamera::AdvanceCamera(const Ogre::FrameEvent& evt) {
 	}
 }
 
+// The origin of the Ogre coordinate system was moved. Move the camera the other way
+// so the view doesn't jump while we wait for the next camera update.
+void LGCamera::RebaseOrigin(Ogre::Vector3 originMove) {
+	this->setPosition(this->getPosition() - originMove);
+	m_desiredPosition -= originMove;
+	for (int ii = 0; ii < LGCAMERA_HISTORY_SIZE; ii++) {
+		m_positionHistory[ii] -= originMove;
+	}
+}
 
 void LGCamera::setOrientation(Ogre::Quaternion qq) {
 	// Ogre::Quaternion orient = Ogre::Quaternion(Ogre::Radian(1.5707963), Ogre::Vector3(1.0, 0.0, 0.0));
@@ -37,6 +37,7 @@ namespace LG {
 			float dw, float dx, float dy, float dz,
 			float nearClip, float farClip, float aspect);
 		void AdvanceCamera(const Ogre::FrameEvent& evt);
+		void RebaseOrigin(Ogre::Vector3 originMove);
 
 		void setOrientation(Ogre::Quaternion qq);
 		void setOrientation(float ww, float xx, float yy, float zz);
@@ -56,6 +57,10 @@ namespace LG {
 
 		float getDistanceFromCamera(Ogre::Node* , Ogre::Vector3);
 
+		// where the camera is heading based on the recent camera updates
+		Ogre::Vector3 PredictPosition(float secondsAhead);
+		float getSpeed();
+
 		void CreateCameraArmature(const char* cameraSceneNodeName, float px, float py, float pz,
 					float sx, float sy, float sz, float ow, float ox, float oy, float oz);
 		bool AttachCamera(const char* parentNodeName, float offsetX, float offsetY, float offsetZ,
@@ -72,5 +77,15 @@ namespace LG {
 		Ogre::Vector3 m_desiredPosition;
 		float m_desiredCameraOrientationProgress;
 
+		// ring of the last few camera positions and when they were set
+		#define LGCAMERA_HISTORY_SIZE 8
+		Ogre::Vector3 m_positionHistory[LGCAMERA_HISTORY_SIZE];
+		unsigned long m_positionHistoryTime[LGCAMERA_HISTORY_SIZE];
+		int m_positionHistoryNext;
+		int m_positionHistoryCount;
+		Ogre::Timer* m_historyTimeKeeper;
+		void RecordPosition(Ogre::Vector3);
+		Ogre::Vector3 getVelocity();
+
 	};
 }
\ No newline at end of file
@@ -0,0 +1,160 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "LGCompress.h"
+
+namespace LG {
+
+static const int LZHashLog = 14;
+static const size_t LZMinMatch = 4;
+static const size_t LZLastLiterals = 5;	// the end of the block is always literals
+static const size_t LZMaxOffset = 65535;
+
+static inline Ogre::uint32 LZRead32(const unsigned char* pp) {
+	Ogre::uint32 val;
+	memcpy(&val, pp, sizeof(val));
+	return val;
+}
+
+static inline unsigned int LZHash(Ogre::uint32 seq) {
+	return (seq * 2654435761U) >> (32 - LZHashLog);
+}
+
+// Lengths of 15 or more overflow the token nibble into a run of bytes
+static inline unsigned char* LZWriteLength(unsigned char* op, size_t len) {
+	while (len >= 255) {
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (unsigned char)len;
+	return op;
+}
+
+static inline bool LZReadLength(const unsigned char*& ip, const unsigned char* iend, size_t& len) {
+	unsigned char bb;
+	do {
+		if (ip >= iend) return false;
+		bb = *ip++;
+		len += bb;
+	} while (bb == 255);
+	return true;
+}
+
+size_t LZCompressBound(size_t len) {
+	return len + (len / 255) + 16;
+}
+
+size_t LZCompress(const void* srcp, size_t srcLen, void* dstp, size_t dstCap) {
+	const unsigned char* src = (const unsigned char*)srcp;
+	const unsigned char* ip = src;
+	const unsigned char* anchor = src;
+	const unsigned char* iend = src + srcLen;
+	const unsigned char* matchLimit = (srcLen > LZLastLiterals) ? iend - LZLastLiterals : src;
+	unsigned char* dst = (unsigned char*)dstp;
+	unsigned char* op = dst;
+	unsigned char* oend = dst + dstCap;
+	std::vector<Ogre::uint32> table(1 << LZHashLog, 0);
+
+	while ((ip + LZMinMatch) <= matchLimit) {
+		Ogre::uint32 seq = LZRead32(ip);
+		unsigned int hh = LZHash(seq);
+		const unsigned char* ref = src + table[hh];
+		table[hh] = (Ogre::uint32)(ip - src);
+		if (ref >= ip || (size_t)(ip - ref) > LZMaxOffset || LZRead32(ref) != seq) {
+			ip++;
+			continue;
+		}
+		// found a match. See how far it goes.
+		const unsigned char* mp = ip + LZMinMatch;
+		const unsigned char* rp = ref + LZMinMatch;
+		while (mp < matchLimit && *mp == *rp) {
+			mp++;
+			rp++;
+		}
+		size_t litLen = ip - anchor;
+		size_t matchLen = (mp - ip) - LZMinMatch;
+		if ((size_t)(oend - op) < (1 + litLen + (litLen / 255) + 1 + 2 + (matchLen / 255) + 1)) {
+			return 0;
+		}
+		unsigned char* token = op++;
+		*token = (unsigned char)(((litLen >= 15) ? 15 : litLen) << 4);
+		if (litLen >= 15) op = LZWriteLength(op, litLen - 15);
+		memcpy(op, anchor, litLen);
+		op += litLen;
+		size_t offset = ip - ref;
+		*op++ = (unsigned char)(offset & 0xff);
+		*op++ = (unsigned char)(offset >> 8);
+		*token |= (unsigned char)((matchLen >= 15) ? 15 : matchLen);
+		if (matchLen >= 15) op = LZWriteLength(op, matchLen - 15);
+		ip = mp;
+		anchor = ip;
+	}
+
+	// whatever is left goes out as literals
+	size_t litLen = iend - anchor;
+	if ((size_t)(oend - op) < (1 + litLen + (litLen / 255) + 1)) {
+		return 0;
+	}
+	unsigned char* token = op++;
+	*token = (unsigned char)(((litLen >= 15) ? 15 : litLen) << 4);
+	if (litLen >= 15) op = LZWriteLength(op, litLen - 15);
+	memcpy(op, anchor, litLen);
+	op += litLen;
+	return op - dst;
+}
+
+bool LZDecompress(const void* srcp, size_t srcLen, void* dstp, size_t dstLen) {
+	const unsigned char* ip = (const unsigned char*)srcp;
+	const unsigned char* iend = ip + srcLen;
+	unsigned char* dst = (unsigned char*)dstp;
+	unsigned char* op = dst;
+	unsigned char* oend = dst + dstLen;
+
+	while (ip < iend) {
+		unsigned char token = *ip++;
+		size_t litLen = token >> 4;
+		if (litLen == 15 && !LZReadLength(ip, iend, litLen)) return false;
+		if (litLen > (size_t)(iend - ip) || litLen > (size_t)(oend - op)) return false;
+		memcpy(op, ip, litLen);
+		op += litLen;
+		ip += litLen;
+		if (ip >= iend) break;		// the last sequence has no match
+
+		if ((iend - ip) < 2) return false;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst)) return false;
+		size_t matchLen = token & 15;
+		if (matchLen == 15 && !LZReadLength(ip, iend, matchLen)) return false;
+		matchLen += LZMinMatch;
+		if (matchLen > (size_t)(oend - op)) return false;
+		// matches can overlap what they are writing so copy a byte at a time
+		const unsigned char* mp = op - offset;
+		while (matchLen-- > 0) {
+			*op++ = *mp++;
+		}
+	}
+	return op == oend;
+}
+
+}
@@ -25,22 +25,18 @@
 #include "LGOCommon.h"
 
 namespace LG {
-	class Animat {
-	public:
-		// Animat();
-		// Animat(Ogre::String);
-		// ~Animat();
 
-		// returns true if happy, false if animation is done and should be deleted
-		virtual bool Process(float);
+// A small, fast LZ77 block compressor. The block format is the same as LZ4's:
+// a token byte with a literal length and a match length, the literals, then a
+// two byte offset back into the output. It doesn't squeeze as much as zlib but
+// decompressing is not much more than a memcpy which is what we want when
+// loading cached meshes.
 
-		Ogre::String SceneNodeName;
-		int AnimatType;
-#define AnimatTypeAny			0
-#define AnimatTypeFixedRotation 1
-#define AnimatTypeRotation		2
-#define AnimatTypePosition		3
+// The most the compressed form of 'len' bytes can take
+extern size_t LZCompressBound(size_t len);
+// Returns the compressed length or zero if it didn't fit in 'dstCap'
+extern size_t LZCompress(const void* src, size_t srcLen, void* dst, size_t dstCap);
+// Returns true if the compressed data decompressed to exactly 'dstLen' bytes
+extern bool LZDecompress(const void* src, size_t srcLen, void* dst, size_t dstLen);
 
-	private:
-};
-}
\ No newline at end of file
+}
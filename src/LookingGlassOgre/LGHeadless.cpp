@@ -0,0 +1,338 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "LGOCommon.h"
+#include "LGHeadless.h"
+#include "LookingGlassOgre.h"
+
+namespace LG {
+
+// A render system that renders nothing. Only the capabilities and the matrix
+// routines (same as the GL render system's) do anything.
+class HeadlessRenderSystem : public Ogre::RenderSystem {
+public:
+	HeadlessRenderSystem() {
+		mRealCapabilities = createRenderSystemCapabilities();
+		mCurrentCapabilities = mRealCapabilities;
+	}
+	~HeadlessRenderSystem() { }
+
+	const Ogre::String& getName(void) const { static Ogre::String name("Headless Rendering Subsystem"); return name; }
+	Ogre::ConfigOptionMap& getConfigOptions(void) { return m_options; }
+	void setConfigOption(const Ogre::String &name, const Ogre::String &value) { }
+	Ogre::HardwareOcclusionQuery* createHardwareOcclusionQuery(void) { return NULL; }
+	Ogre::String validateConfigOptions(void) { return Ogre::StringUtil::BLANK; }
+	Ogre::RenderSystemCapabilities* createRenderSystemCapabilities() const;
+	void reinitialise(void) { }
+	void setAmbientLight(float r, float g, float b) { }
+	void setShadingType(Ogre::ShadeOptions so) { }
+	void setLightingEnabled(bool enabled) { }
+	Ogre::RenderWindow* _createRenderWindow(const Ogre::String &name, unsigned int width, unsigned int height, bool fullScreen, const Ogre::NameValuePairList *miscParams = 0);
+	Ogre::MultiRenderTarget * createMultiRenderTarget(const Ogre::String & name) { return NULL; }
+	Ogre::String getErrorDescription(long errorNumber) const { return Ogre::StringUtil::BLANK; }
+	void _useLights(const Ogre::LightList& lights, unsigned short limit) { }
+	void _setWorldMatrix(const Ogre::Matrix4 &m) { }
+	void _setViewMatrix(const Ogre::Matrix4 &m) { }
+	void _setProjectionMatrix(const Ogre::Matrix4 &m) { }
+	void _setSurfaceParams(const Ogre::ColourValue &ambient, const Ogre::ColourValue &diffuse, const Ogre::ColourValue &specular, const Ogre::ColourValue &emissive, Ogre::Real shininess, Ogre::TrackVertexColourType tracking = Ogre::TVC_NONE) { }
+	void _setPointSpritesEnabled(bool enabled) { }
+	void _setPointParameters(Ogre::Real size, bool attenuationEnabled, Ogre::Real constant, Ogre::Real linear, Ogre::Real quadratic, Ogre::Real minSize, Ogre::Real maxSize) { }
+	void _setTexture(size_t unit, bool enabled, const Ogre::TexturePtr &texPtr) { }
+	void _setTextureCoordSet(size_t unit, size_t index) { }
+	void _setTextureCoordCalculation(size_t unit, Ogre::TexCoordCalcMethod m, const Ogre::Frustum* frustum = 0) { }
+	void _setTextureBlendMode(size_t unit, const Ogre::LayerBlendModeEx& bm) { }
+	void _setTextureUnitFiltering(size_t unit, Ogre::FilterType ftype, Ogre::FilterOptions filter) { }
+	void _setTextureLayerAnisotropy(size_t unit, unsigned int maxAnisotropy) { }
+	void _setTextureAddressingMode(size_t unit, const Ogre::TextureUnitState::UVWAddressingMode& uvw) { }
+	void _setTextureBorderColour(size_t unit, const Ogre::ColourValue& colour) { }
+	void _setTextureMipmapBias(size_t unit, float bias) { }
+	void _setTextureMatrix(size_t unit, const Ogre::Matrix4& xform) { }
+	void _setSceneBlending(Ogre::SceneBlendFactor sourceFactor, Ogre::SceneBlendFactor destFactor, Ogre::SceneBlendOperation op = Ogre::SBO_ADD) { }
+	void _setSeparateSceneBlending(Ogre::SceneBlendFactor sourceFactor, Ogre::SceneBlendFactor destFactor, Ogre::SceneBlendFactor sourceFactorAlpha, Ogre::SceneBlendFactor destFactorAlpha, Ogre::SceneBlendOperation op = Ogre::SBO_ADD, Ogre::SceneBlendOperation alphaOp = Ogre::SBO_ADD) { }
+	void _setAlphaRejectSettings(Ogre::CompareFunction func, unsigned char value, bool alphaToCoverage) { }
+	void _beginFrame(void) { }
+	void _endFrame(void) { }
+	void _setViewport(Ogre::Viewport *vp) { }
+	void _setCullingMode(Ogre::CullingMode mode) { }
+	void _setDepthBufferParams(bool depthTest = true, bool depthWrite = true, Ogre::CompareFunction depthFunction = Ogre::CMPF_LESS_EQUAL) { }
+	void _setDepthBufferCheckEnabled(bool enabled = true) { }
+	void _setDepthBufferWriteEnabled(bool enabled = true) { }
+	void _setDepthBufferFunction(Ogre::CompareFunction func = Ogre::CMPF_LESS_EQUAL) { }
+	void _setColourBufferWriteEnabled(bool red, bool green, bool blue, bool alpha) { }
+	void _setDepthBias(float constantBias, float slopeScaleBias = 0.0f) { }
+	void _setFog(Ogre::FogMode mode = Ogre::FOG_NONE, const Ogre::ColourValue& colour = Ogre::ColourValue::White, Ogre::Real expDensity = 1.0, Ogre::Real linearStart = 0.0, Ogre::Real linearEnd = 1.0) { }
+	Ogre::VertexElementType getColourVertexElementType(void) const { return Ogre::VET_COLOUR_ABGR; }
+	void _convertProjectionMatrix(const Ogre::Matrix4& matrix, Ogre::Matrix4& dest, bool forGpuProgram = false) { dest = matrix; }
+	void _makeProjectionMatrix(const Ogre::Radian& fovy, Ogre::Real aspect, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4& dest, bool forGpuProgram = false);
+	void _makeProjectionMatrix(Ogre::Real left, Ogre::Real right, Ogre::Real bottom, Ogre::Real top, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4& dest, bool forGpuProgram = false);
+	void _makeOrthoMatrix(const Ogre::Radian& fovy, Ogre::Real aspect, Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4& dest, bool forGpuProgram = false);
+	void _applyObliqueDepthProjection(Ogre::Matrix4& matrix, const Ogre::Plane& plane, bool forGpuProgram) { }
+	void _setPolygonMode(Ogre::PolygonMode level) { }
+	void setStencilCheckEnabled(bool enabled) { }
+	void setStencilBufferParams(Ogre::CompareFunction func = Ogre::CMPF_ALWAYS_PASS, Ogre::uint32 refValue = 0, Ogre::uint32 mask = 0xFFFFFFFF, Ogre::StencilOperation stencilFailOp = Ogre::SOP_KEEP, Ogre::StencilOperation depthFailOp = Ogre::SOP_KEEP, Ogre::StencilOperation passOp = Ogre::SOP_KEEP, bool twoSidedOperation = false) { }
+	void setVertexDeclaration(Ogre::VertexDeclaration* decl) { }
+	void setVertexBufferBinding(Ogre::VertexBufferBinding* binding) { }
+	void setNormaliseNormals(bool normalise) { }
+	void bindGpuProgramParameters(Ogre::GpuProgramType gptype, Ogre::GpuProgramParametersSharedPtr params, Ogre::uint16 variabilityMask) { }
+	void bindGpuProgramPassIterationParameters(Ogre::GpuProgramType gptype) { }
+	void setScissorTest(bool enabled, size_t left = 0, size_t top = 0, size_t right = 800, size_t bottom = 600) { }
+	void clearFrameBuffer(unsigned int buffers, const Ogre::ColourValue& colour = Ogre::ColourValue::Black, Ogre::Real depth = 1.0f, unsigned short stencil = 0) { }
+	Ogre::Real getHorizontalTexelOffset(void) { return 0.0; }
+	Ogre::Real getVerticalTexelOffset(void) { return 0.0; }
+	Ogre::Real getMinimumDepthInputValue(void) { return -1.0; }
+	Ogre::Real getMaximumDepthInputValue(void) { return 1.0; }
+	void _setRenderTarget(Ogre::RenderTarget *target) { }
+	void preExtraThreadsStarted() { }
+	void postExtraThreadsStarted() { }
+	void registerThread() { }
+	void unregisterThread() { }
+	unsigned int getDisplayMonitorCount() const { return 1; }
+	void setClipPlanesImpl(const Ogre::PlaneList& clipPlanes) { }
+	void initialiseFromRenderSystemCapabilities(Ogre::RenderSystemCapabilities* caps, Ogre::RenderTarget* primary) { }
+private:
+	Ogre::ConfigOptionMap m_options;
+};
+
+Ogre::RenderSystemCapabilities* HeadlessRenderSystem::createRenderSystemCapabilities() const {
+	Ogre::RenderSystemCapabilities* caps = OGRE_NEW Ogre::RenderSystemCapabilities();
+	caps->setRenderSystemName(getName());
+	caps->setNumTextureUnits(16);
+	caps->setCapability(Ogre::RSC_FIXED_FUNCTION);
+	caps->setCapability(Ogre::RSC_AUTOMIPMAP);
+	caps->setCapability(Ogre::RSC_BLENDING);
+	caps->setCapability(Ogre::RSC_VBO);
+	caps->setCapability(Ogre::RSC_TEXTURE_COMPRESSION);
+	caps->setCapability(Ogre::RSC_TEXTURE_COMPRESSION_DXT);
+	caps->setCapability(Ogre::RSC_NON_POWER_OF_2_TEXTURES);
+	return caps;
+}
+
+Ogre::RenderWindow* HeadlessRenderSystem::_createRenderWindow(const Ogre::String &name, unsigned int width, 
+			unsigned int height, bool fullScreen, const Ogre::NameValuePairList *miscParams) {
+	OGRE_EXCEPT(Ogre::Exception::ERR_NOT_IMPLEMENTED, "No windows when headless", "HeadlessRenderSystem::_createRenderWindow");
+	return NULL;
+}
+
+void HeadlessRenderSystem::_makeProjectionMatrix(const Ogre::Radian& fovy, Ogre::Real aspect, Ogre::Real nearPlane, 
+			Ogre::Real farPlane, Ogre::Matrix4& dest, bool forGpuProgram) {
+	Ogre::Real tanThetaY = Ogre::Math::Tan(fovy / 2.0f);
+	Ogre::Real q, qn;
+	if (farPlane == 0) {
+		q = Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 1;
+		qn = nearPlane * (Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 2);
+	}
+	else {
+		q = -(farPlane + nearPlane) / (farPlane - nearPlane);
+		qn = -2 * (farPlane * nearPlane) / (farPlane - nearPlane);
+	}
+	dest = Ogre::Matrix4::ZERO;
+	dest[0][0] = (1.0f / tanThetaY) / aspect;
+	dest[1][1] = 1.0f / tanThetaY;
+	dest[2][2] = q;
+	dest[2][3] = qn;
+	dest[3][2] = -1;
+}
+
+void HeadlessRenderSystem::_makeProjectionMatrix(Ogre::Real left, Ogre::Real right, Ogre::Real bottom, Ogre::Real top, 
+			Ogre::Real nearPlane, Ogre::Real farPlane, Ogre::Matrix4& dest, bool forGpuProgram) {
+	Ogre::Real width = right - left;
+	Ogre::Real height = top - bottom;
+	Ogre::Real q, qn;
+	if (farPlane == 0) {
+		q = Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 1;
+		qn = nearPlane * (Ogre::Frustum::INFINITE_FAR_PLANE_ADJUST - 2);
+	}
+	else {
+		q = -(farPlane + nearPlane) / (farPlane - nearPlane);
+		qn = -2 * (farPlane * nearPlane) / (farPlane - nearPlane);
+	}
+	dest = Ogre::Matrix4::ZERO;
+	dest[0][0] = 2 * nearPlane / width;
+	dest[0][2] = (right + left) / width;
+	dest[1][1] = 2 * nearPlane / height;
+	dest[1][2] = (top + bottom) / height;
+	dest[2][2] = q;
+	dest[2][3] = qn;
+	dest[3][2] = -1;
+}
+
+void HeadlessRenderSystem::_makeOrthoMatrix(const Ogre::Radian& fovy, Ogre::Real aspect, Ogre::Real nearPlane, 
+			Ogre::Real farPlane, Ogre::Matrix4& dest, bool forGpuProgram) {
+	Ogre::Real tanThetaY = Ogre::Math::Tan(fovy / 2.0f);
+	Ogre::Real halfWidth = tanThetaY * aspect * nearPlane;
+	Ogre::Real halfHeight = tanThetaY * nearPlane;
+	Ogre::Real q, qn;
+	if (farPlane == 0) {
+		q = 0;
+		qn = -1;
+	}
+	else {
+		q = 2 / (farPlane - nearPlane);
+		qn = -(farPlane + nearPlane) / (farPlane - nearPlane);
+	}
+	dest = Ogre::Matrix4::ZERO;
+	dest[0][0] = 1 / halfWidth;
+	dest[1][1] = 1 / halfHeight;
+	dest[2][2] = -q;
+	dest[2][3] = qn;
+	dest[3][3] = 1;
+}
+
+void HeadlessInitialize(Ogre::Root* root) {
+	HeadlessRenderSystem* rs = OGRE_NEW HeadlessRenderSystem();
+	root->addRenderSystem(rs);
+	root->setRenderSystem(rs);
+	// The managers live as long as the process. Made before initialise() since a
+	// real render system would have made them by then.
+	OGRE_NEW Ogre::DefaultHardwareBufferManager();
+	OGRE_NEW HeadlessTextureManager();
+	root->initialise(false);
+}
+
+// ====================================================================
+HeadlessPixelBuffer::HeadlessPixelBuffer(size_t width, size_t height, size_t depth, 
+			Ogre::PixelFormat format, Ogre::HardwareBuffer::Usage usage)
+		: Ogre::HardwarePixelBuffer(width, height, depth, format, usage, true, false) {
+	// the base only knows the size of uncompressed formats
+	mSizeInBytes = Ogre::PixelUtil::getMemorySize(width, height, depth, format);
+	m_pixels = OGRE_ALLOC_T(Ogre::uint8, mSizeInBytes, Ogre::MEMCATEGORY_RESOURCE);
+}
+
+HeadlessPixelBuffer::~HeadlessPixelBuffer() {
+	OGRE_FREE(m_pixels, Ogre::MEMCATEGORY_RESOURCE);
+}
+
+Ogre::PixelBox HeadlessPixelBuffer::lockImpl(const Ogre::Image::Box lockBox, Ogre::HardwareBuffer::LockOptions options) {
+	return Ogre::PixelBox(mWidth, mHeight, mDepth, mFormat, m_pixels).getSubVolume(lockBox);
+}
+
+void HeadlessPixelBuffer::unlockImpl(void) {
+}
+
+// Scaled if the sizes differ (which is how the mipmaps are made)
+void HeadlessPixelBuffer::blitFromMemory(const Ogre::PixelBox& src, const Ogre::Image::Box& dstBox) {
+	Ogre::PixelBox dst = Ogre::PixelBox(mWidth, mHeight, mDepth, mFormat, m_pixels).getSubVolume(dstBox);
+	if (src.getWidth() == dst.getWidth() && src.getHeight() == dst.getHeight() && src.getDepth() == dst.getDepth()) {
+		Ogre::PixelUtil::bulkPixelConversion(src, dst);
+	}
+	else {
+		Ogre::Image::scale(src, dst);
+	}
+}
+
+void HeadlessPixelBuffer::blitToMemory(const Ogre::Image::Box& srcBox, const Ogre::PixelBox& dst) {
+	Ogre::PixelBox src = Ogre::PixelBox(mWidth, mHeight, mDepth, mFormat, m_pixels).getSubVolume(srcBox);
+	if (src.getWidth() == dst.getWidth() && src.getHeight() == dst.getHeight() && src.getDepth() == dst.getDepth()) {
+		Ogre::PixelUtil::bulkPixelConversion(src, dst);
+	}
+	else {
+		Ogre::Image::scale(src, dst);
+	}
+}
+
+// ====================================================================
+HeadlessTexture::HeadlessTexture(Ogre::ResourceManager* creator, const Ogre::String& name, Ogre::ResourceHandle handle,
+				const Ogre::String& group, bool isManual, Ogre::ManualResourceLoader* loader)
+		: Ogre::Texture(creator, name, handle, group, isManual, loader) {
+}
+
+HeadlessTexture::~HeadlessTexture() {
+	// have to call this here rather than in Resource destructor
+	// since calling virtual methods in base destructors causes crash
+	if (isLoaded()) {
+		unload();
+	}
+	else {
+		freeInternalResources();
+	}
+}
+
+// The simple case of what the render system textures do: one image file
+// from the resource group
+void HeadlessTexture::loadImpl(void) {
+	Ogre::Image img;
+	img.load(mName, mGroup);
+	Ogre::ConstImagePtrList images;
+	images.push_back(&img);
+	_loadImages(images);
+}
+
+void HeadlessTexture::createInternalResourcesImpl(void) {
+	for (size_t face = 0; face < getNumFaces(); face++) {
+		size_t width = mWidth;
+		size_t height = mHeight;
+		size_t depth = mDepth;
+		for (size_t mip = 0; mip <= mNumMipmaps; mip++) {
+			m_surfaces.push_back(Ogre::HardwarePixelBufferSharedPtr(OGRE_NEW HeadlessPixelBuffer(
+						width, height, depth, mFormat, (Ogre::HardwareBuffer::Usage)mUsage)));
+			if (width > 1) width = width / 2;
+			if (height > 1) height = height / 2;
+			if (depth > 1) depth = depth / 2;
+		}
+	}
+}
+
+void HeadlessTexture::freeInternalResourcesImpl(void) {
+	m_surfaces.clear();
+}
+
+size_t HeadlessTexture::calculateSize(void) const {
+	return getNumFaces() * Ogre::PixelUtil::getMemorySize(mWidth, mHeight, mDepth, mFormat);
+}
+
+Ogre::HardwarePixelBufferSharedPtr HeadlessTexture::getBuffer(size_t face, size_t mipmap) {
+	size_t index = face * (mNumMipmaps + 1) + mipmap;
+	if (face >= getNumFaces() || mipmap > mNumMipmaps || index >= m_surfaces.size()) {
+		OGRE_EXCEPT(Ogre::Exception::ERR_INVALIDPARAMS, "No such face or mipmap", "HeadlessTexture::getBuffer");
+	}
+	return m_surfaces[index];
+}
+
+// ====================================================================
+HeadlessTextureManager::HeadlessTextureManager() {
+	// the base doesn't register itself. The render system's managers do this.
+	mResourceType = "Texture";
+	mLoadOrder = 75.0f;
+	Ogre::ResourceGroupManager::getSingleton()._registerResourceManager(mResourceType, this);
+}
+
+HeadlessTextureManager::~HeadlessTextureManager() {
+	Ogre::ResourceGroupManager::getSingleton()._unregisterResourceManager(mResourceType);
+}
+
+// Memory can hold anything
+Ogre::PixelFormat HeadlessTextureManager::getNativeFormat(Ogre::TextureType ttype, Ogre::PixelFormat format, int usage) {
+	return format;
+}
+
+bool HeadlessTextureManager::isHardwareFilteringSupported(Ogre::TextureType ttype, Ogre::PixelFormat format, int usage, bool preciseFormatOnly) {
+	return true;
+}
+
+Ogre::Resource* HeadlessTextureManager::createImpl(const Ogre::String& name, Ogre::ResourceHandle handle, 
+				const Ogre::String& group, bool isManual, Ogre::ManualResourceLoader* loader, 
+				const Ogre::NameValuePairList* createParams) {
+	return OGRE_NEW HeadlessTexture(this, name, handle, group, isManual, loader);
+}
+
+}
@@ -0,0 +1,82 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "OgreDefaultHardwareBufferManager.h"
+#include "OgreHardwarePixelBuffer.h"
+
+namespace LG {
+
+// Running without a window or GPU (Renderer.Ogre.Headless), for the replay
+// benchmark and anything else that wants the scene, mesh and material code
+// on a machine without a display.
+// The render system is a stub that does nothing but answer questions about its
+// capabilities (materials are compiled against them). Vertex and index buffers
+// are Ogre's software ones (DefaultHardwareBufferManager). Textures are read,
+// decoded and converted as usual but the pixels just stay in memory.
+
+// Make the stub render system the active one and create the buffer and texture
+// managers. Call instead of setting up a real render system.
+extern void HeadlessInitialize(Ogre::Root*);
+
+// A pixel buffer in memory
+class HeadlessPixelBuffer : public Ogre::HardwarePixelBuffer {
+public:
+	HeadlessPixelBuffer(size_t width, size_t height, size_t depth, Ogre::PixelFormat format, Ogre::HardwareBuffer::Usage usage);
+	~HeadlessPixelBuffer();
+	void blitFromMemory(const Ogre::PixelBox&, const Ogre::Image::Box&);
+	void blitToMemory(const Ogre::Image::Box&, const Ogre::PixelBox&);
+protected:
+	Ogre::PixelBox lockImpl(const Ogre::Image::Box, Ogre::HardwareBuffer::LockOptions);
+	void unlockImpl(void);
+	Ogre::uint8* m_pixels;
+};
+
+class HeadlessTexture : public Ogre::Texture {
+public:
+	HeadlessTexture(Ogre::ResourceManager*, const Ogre::String&, Ogre::ResourceHandle,
+				const Ogre::String&, bool, Ogre::ManualResourceLoader*);
+	~HeadlessTexture();
+	Ogre::HardwarePixelBufferSharedPtr getBuffer(size_t face = 0, size_t mipmap = 0);
+protected:
+	void loadImpl(void);
+	void createInternalResourcesImpl(void);
+	void freeInternalResourcesImpl(void);
+	size_t calculateSize(void) const;
+	// face major: all the mipmaps of face 0, then face 1, ...
+	std::vector<Ogre::HardwarePixelBufferSharedPtr> m_surfaces;
+};
+
+class HeadlessTextureManager : public Ogre::TextureManager {
+public:
+	HeadlessTextureManager();
+	~HeadlessTextureManager();
+	Ogre::PixelFormat getNativeFormat(Ogre::TextureType, Ogre::PixelFormat, int);
+	bool isHardwareFilteringSupported(Ogre::TextureType, Ogre::PixelFormat, int, bool);
+protected:
+	Ogre::Resource* createImpl(const Ogre::String&, Ogre::ResourceHandle, const Ogre::String&,
+				bool, Ogre::ManualResourceLoader*, const Ogre::NameValuePairList*);
+};
+
+}
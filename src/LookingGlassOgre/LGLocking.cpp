@@ -25,14 +25,90 @@
 
 // #include "stdafx.h"
 #include "LGLocking.h"
+#include "boost/thread/tss.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
 
 namespace LG {
 
 int LGLockingThreadInitializeCount = 0;
 
-LGLock::LGLock() { }
+// =========================================
+// Lock profiling.
+// Each thread has its own block of counters so recording never adds contention.
+// Each lock name gets a slot in the blocks. A snapshot adds up the slot over all
+// the threads. The threads' blocks are kept after the thread exits so their
+// counts are not lost.
+// The counters are only written by their thread and are read without locking
+// so a snapshot taken while running is approximate.
+#define LGLOCK_PROFILE_SLOTS 64
+// bucket N of the hold time histogram counts holds under 2^N microseconds
+#define LGLOCK_PROFILE_BUCKETS 20
+
+typedef struct {
+	Ogre::uint64 acquisitions;
+	Ogre::uint64 contended;		// had to wait for the lock
+	Ogre::uint64 waitTotal;		// microseconds waiting for the lock
+	Ogre::uint64 waitMax;
+	Ogre::uint64 holdTotal;		// microseconds holding the lock
+	Ogre::uint64 holdMax;
+	Ogre::uint64 hold[LGLOCK_PROFILE_BUCKETS];
+} LockProfile;
+
+typedef struct {
+	LockProfile slots[LGLOCK_PROFILE_SLOTS];
+} LockProfileBlock;
+
+bool LGLock::m_profiling = false;
+
+// the registry of slot names and thread blocks. Not an LGLock so it doesn't profile itself.
+static boost::mutex& ProfileRegistryLock() {
+	static boost::mutex registryLock;
+	return registryLock;
+}
+static std::vector<Ogre::String> profileSlotNames;
+static std::vector<LockProfileBlock*> profileBlocks;
+
+// the block is owned by profileBlocks so don't delete it when the thread exits
+static void KeepProfileBlock(LockProfileBlock*) { }
+static boost::thread_specific_ptr<LockProfileBlock> threadProfileBlock(&KeepProfileBlock);
+
+static LockProfile* ThreadLockProfile(int slot) {
+	LockProfileBlock* block = threadProfileBlock.get();
+	if (block == NULL) {
+		block = new LockProfileBlock;
+		memset(block, 0, sizeof(LockProfileBlock));
+		{
+			boost::mutex::scoped_lock lock(ProfileRegistryLock());
+			profileBlocks.push_back(block);
+		}
+		threadProfileBlock.reset(block);
+	}
+	return &(block->slots[slot]);
+}
+
+static int ProfileSlot(const Ogre::String& name) {
+	boost::mutex::scoped_lock lock(ProfileRegistryLock());
+	for (unsigned int ii = 0; ii < profileSlotNames.size(); ii++) {
+		if (profileSlotNames[ii] == name) return (int)ii;
+	}
+	if (profileSlotNames.size() >= LGLOCK_PROFILE_SLOTS) return -1;
+	profileSlotNames.push_back(name);
+	return (int)profileSlotNames.size() - 1;
+}
+
+// =========================================
+LGLock::LGLock() {
+	m_profileSlot = -1;
+	m_lockedAt = 0;
+}
 LGLock::LGLock(Ogre::String nam) { 
 	Name = nam;
+	m_profileSlot = ProfileSlot(nam);
+	m_lockedAt = 0;
 #if defined(LGLOCK_BOOST)
 	m_mutex = new boost::mutex();
 	m_condition = new boost::condition();
@@ -49,17 +125,60 @@ LGLock::~LGLock() {
 // =========================================
 void LGLock::Lock() {
 #ifdef LGLOCK_BOOST
-	m_mutex->lock();
+	if (!m_profiling || m_profileSlot < 0) {
+		m_mutex->lock();
+		return;
+	}
+	LockProfile* prof = ThreadLockProfile(m_profileSlot);
+	prof->acquisitions++;
+	if (!m_mutex->try_lock()) {
+		// someone else has it. Time how long we wait.
+		Ogre::uint64 start = LGLock_Microseconds();
+		m_mutex->lock();
+		Ogre::uint64 waited = LGLock_Microseconds() - start;
+		prof->contended++;
+		prof->waitTotal += waited;
+		if (waited > prof->waitMax) prof->waitMax = waited;
+	}
+	m_lockedAt = LGLock_Microseconds();
 #endif
 	return;
 }
 // =========================================
 void LGLock::Unlock() {
 #ifdef LGLOCK_BOOST
+	if (m_lockedAt != 0) RecordHold();
 	m_mutex->unlock();
 #endif
 	return;
 }
+// =========================================
+// The lock is released while waiting so the wait is not counted as holding it
+void LGLock::Wait() {
+#ifdef LGLOCK_BOOST
+	if (m_lockedAt != 0) RecordHold();
+	m_condition->wait(*m_mutex);
+	if (m_profiling && m_profileSlot >= 0) {
+		m_lockedAt = LGLock_Microseconds();
+	}
+#endif
+	return;
+}
+
+// Called with the lock held by the thread that took it
+void LGLock::RecordHold() {
+	Ogre::uint64 held = LGLock_Microseconds() - m_lockedAt;
+	m_lockedAt = 0;
+	LockProfile* prof = ThreadLockProfile(m_profileSlot);
+	prof->holdTotal += held;
+	if (held > prof->holdMax) prof->holdMax = held;
+	int bucket = 0;
+	while (held > 0 && bucket < (LGLOCK_PROFILE_BUCKETS - 1)) {
+		held >>= 1;
+		bucket++;
+	}
+	prof->hold[bucket]++;
+}
 
 LGLock* LGLock::LGLock_Allocate_Mutex(Ogre::String name) {
 	return new LGLock(name);
@@ -69,6 +188,98 @@ void LGLock::LGLock_Release_Lock(LGLock* lock) {
 	if (lock != NULL) delete lock;
 }
 
+// Ogre's timer keeps state so it can't be shared between threads
+Ogre::uint64 LGLock::LGLock_Microseconds() {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (Ogre::uint64)((now.QuadPart / frequency.QuadPart) * 1000000
+				+ ((now.QuadPart % frequency.QuadPart) * 1000000) / frequency.QuadPart);
+#else
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (Ogre::uint64)now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+// =========================================
+void LGLock::LGLock_Profile(bool onOff) {
+	m_profiling = onOff;
+}
+
+// upper bound of the histogram bucket the percentile falls in
+static Ogre::uint64 HoldPercentile(const LockProfile& prof, Ogre::uint64 total, int percent) {
+	Ogre::uint64 want = (total * percent + 99) / 100;
+	Ogre::uint64 seen = 0;
+	for (int ii = 0; ii < LGLOCK_PROFILE_BUCKETS; ii++) {
+		seen += prof.hold[ii];
+		if (seen >= want) return ((Ogre::uint64)1) << ii;
+	}
+	return ((Ogre::uint64)1) << (LGLOCK_PROFILE_BUCKETS - 1);
+}
+
+// Add up the threads' counters for each lock name and return a line per lock
+// with the most waited on locks first. If 'reset', the counters are zeroed.
+Ogre::String LGLock::LGLock_ProfileSnapshot(bool reset) {
+	boost::mutex::scoped_lock lock(ProfileRegistryLock());
+	std::vector<LockProfile> totals(profileSlotNames.size());
+	if (!totals.empty()) memset(&totals[0], 0, totals.size() * sizeof(LockProfile));
+	std::vector<LockProfileBlock*>::iterator bi;
+	for (bi = profileBlocks.begin(); bi != profileBlocks.end(); bi++) {
+		for (unsigned int ii = 0; ii < totals.size(); ii++) {
+			LockProfile& from = (*bi)->slots[ii];
+			LockProfile& to = totals[ii];
+			to.acquisitions += from.acquisitions;
+			to.contended += from.contended;
+			to.waitTotal += from.waitTotal;
+			if (from.waitMax > to.waitMax) to.waitMax = from.waitMax;
+			to.holdTotal += from.holdTotal;
+			if (from.holdMax > to.holdMax) to.holdMax = from.holdMax;
+			for (int jj = 0; jj < LGLOCK_PROFILE_BUCKETS; jj++) {
+				to.hold[jj] += from.hold[jj];
+			}
+		}
+		if (reset) {
+			memset(*bi, 0, sizeof(LockProfileBlock));
+		}
+	}
+
+	std::vector<std::pair<Ogre::uint64, int> > order;
+	for (unsigned int ii = 0; ii < totals.size(); ii++) {
+		if (totals[ii].acquisitions > 0) {
+			order.push_back(std::pair<Ogre::uint64, int>(totals[ii].waitTotal, ii));
+		}
+	}
+	std::sort(order.rbegin(), order.rend());
+
+	Ogre::StringUtil::StrStreamType buff;
+	buff << "lock profile: " << (m_profiling ? "on" : "off") << ", " << profileBlocks.size() << " threads" << std::endl;
+	for (unsigned int ii = 0; ii < order.size(); ii++) {
+		LockProfile& prof = totals[order[ii].second];
+		Ogre::uint64 holds = 0;
+		for (int jj = 0; jj < LGLOCK_PROFILE_BUCKETS; jj++) holds += prof.hold[jj];
+		buff << profileSlotNames[order[ii].second]
+			<< ": acquired=" << prof.acquisitions
+			<< " contended=" << prof.contended
+			<< " (" << (prof.contended * 100 / prof.acquisitions) << "%)"
+			<< " waitUs=" << prof.waitTotal
+			<< " maxWaitUs=" << prof.waitMax
+			<< " holdUs=" << prof.holdTotal
+			<< " maxHoldUs=" << prof.holdMax;
+		if (holds > 0) {
+			buff << " p50HoldUs<" << HoldPercentile(prof, holds, 50)
+				<< " p99HoldUs<" << HoldPercentile(prof, holds, 99);
+		}
+		buff << std::endl;
+	}
+	return buff.str();
+}
+
+// =========================================
 #ifdef LGLOCK_BOOST
 void LGLock::LGLock_Sleep(int ms) {
 	boost::xtime xt;
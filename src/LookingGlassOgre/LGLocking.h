@@ -72,6 +72,14 @@ public:
 	static LGLock* LGLock_Allocate_Mutex(Ogre::String);
 	static void LGLock_Release_Lock(LGLock*);
 	static void LGLock_Sleep(int);
+	static Ogre::uint64 LGLock_Microseconds();
+
+	// Contention profiling. When on, every lock records, per thread, how often it
+	// is taken, how often it had to wait, how long it waited and how long it was
+	// held. Locks with the same name are counted together.
+	static void LGLock_Profile(bool);
+	static bool LGLock_Profiling() { return m_profiling; }
+	static Ogre::String LGLock_ProfileSnapshot(bool reset);
 
 #ifdef LGLOCK_PTHREADS
 #endif
@@ -81,6 +89,10 @@ public:
 	boost::condition* m_condition;
 #endif
 private:
+	static bool m_profiling;
+	int m_profileSlot;				// -1 if not profiled
+	Ogre::uint64 m_lockedAt;		// when the lock was taken if profiling, else zero
+	void RecordHold();
 };
 
 extern int LGLockingThreadInitializeCount;
@@ -99,7 +111,7 @@ extern int LGLockingThreadInitializeCount;
 
 // WAIT and NOTIFY
 #ifdef LGLOCK_BOOST
-#define LGLOCK_WAIT(mutex) (mutex)->m_condition->wait(*((mutex)->m_mutex));
+#define LGLOCK_WAIT(mutex) (mutex)->Wait();
 #define LGLOCK_NOTIFY_ONE(mutex) (mutex)->m_condition->notify_one();
 #define LGLOCK_NOTIFY_ALL(mutex) (mutex)->m_condition->notify_all();
 #define LGLOCK_SLEEP(ms) LG::LGLock::LGLock_Sleep(ms);
@@ -110,6 +122,35 @@ extern int LGLockingThreadInitializeCount;
 #define LGLOCK_SLEEP 
 #endif
 
+// ATOMIC OPERATIONS
+// For counters and sequence numbers that are shared between threads without
+// a lock. LGLOCK_ATOMIC_INT is 32 bits. INC, DEC, ADD return the new value.
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LGLOCK_ATOMIC_INT long
+#define LGLOCK_ATOMIC_INC(var) _InterlockedIncrement((volatile long*)&(var))
+#define LGLOCK_ATOMIC_DEC(var) _InterlockedDecrement((volatile long*)&(var))
+#define LGLOCK_ATOMIC_ADD(var, val) (_InterlockedExchangeAdd((volatile long*)&(var), (val)) + (val))
+#define LGLOCK_ATOMIC_CAS(var, old, nu) (_InterlockedCompareExchange((volatile long*)&(var), (nu), (old)) == (old))
+#define LGLOCK_ATOMIC_GET(var) (*(volatile long*)&(var))
+#define LGLOCK_ATOMIC_SET(var, val) _InterlockedExchange((volatile long*)&(var), (val))
+#else
+#define LGLOCK_ATOMIC_INT int
+#define LGLOCK_ATOMIC_INC(var) __sync_add_and_fetch(&(var), 1)
+#define LGLOCK_ATOMIC_DEC(var) __sync_sub_and_fetch(&(var), 1)
+#define LGLOCK_ATOMIC_ADD(var, val) __sync_add_and_fetch(&(var), (val))
+#define LGLOCK_ATOMIC_CAS(var, old, nu) __sync_bool_compare_and_swap(&(var), (old), (nu))
+#define LGLOCK_ATOMIC_GET(var) __sync_add_and_fetch(&(var), 0)
+#define LGLOCK_ATOMIC_SET(var, val) { __sync_synchronize(); (var) = (val); __sync_synchronize(); }
+#endif
+
+// a clock for timing short things on any thread
+#define LGLOCK_MICROSECONDS() LG::LGLock::LGLock_Microseconds()
+
+// PROFILING
+#define LGLOCK_PROFILE(onOff) LG::LGLock::LGLock_Profile(onOff)
+#define LGLOCK_PROFILE_SNAPSHOT(reset) LG::LGLock::LGLock_ProfileSnapshot(reset)
+
 // CREATE and RELEASE THREADS
 #define LGLOCK_THREAD boost::thread
 #define LGLOCK_ALLOCATE_THREAD(func) boost::thread(func);
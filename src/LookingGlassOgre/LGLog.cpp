@@ -0,0 +1,455 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include <stdarg.h>
+#include "LGOCommon.h"
+#include "LGLocking.h"
+#include "LGLog.h"
+#include "boost/thread/tss.hpp"
+
+#ifdef _MSC_VER
+#define LGLOG_SNPRINTF _snprintf
+#else
+#define LGLOG_SNPRINTF snprintf
+#endif
+
+namespace LG {
+
+bool logDetailEnabled = false;
+
+// messages kept for each thread. A power of two.
+#define LogRingSize 512
+// bytes for the format and the arguments of one message
+#define LogRecordSize 480
+// longest formatted message
+#define LogMessageSize 2048
+// most characters handed to the managed logger at once
+#define LogBatchSize 8192
+
+typedef enum {
+	LogArgNone,
+	LogArgInt,
+	LogArgLong,
+	LogArgLongLong,
+	LogArgDouble,
+	LogArgLongDouble,
+	LogArgPointer,
+	LogArgString
+} LogArgType;
+
+// The format string followed by the arguments. Each argument is a type byte
+// and the value. Strings are copied and null terminated.
+typedef struct {
+	Ogre::uint64 time;
+	char data[LogRecordSize];
+} LogRecord;
+
+// Written by its thread (head) and the background thread (tail)
+typedef struct {
+	LGLOCK_ATOMIC_INT head;
+	LGLOCK_ATOMIC_INT tail;
+	LGLOCK_ATOMIC_INT dropped;
+	LogRecord records[LogRingSize];
+} LogRing;
+
+static bool logAsync = false;
+static bool logKeepRunning = false;
+static boost::thread* logThread = NULL;
+
+// Not LGLocks since locking can log. 'rings' protects the list of rings and
+// 'flush' makes sure only one thread is reading the rings.
+static boost::mutex& LogRingsLock() {
+	static boost::mutex ringsLock;
+	return ringsLock;
+}
+static boost::mutex& LogFlushLock() {
+	static boost::mutex flushLock;
+	return flushLock;
+}
+static std::vector<LogRing*> logRings;
+// rings are kept after their thread exits so its last messages still go out
+static void KeepLogRing(LogRing*) { }
+static boost::thread_specific_ptr<LogRing> threadLogRing(&KeepLogRing);
+
+static LogRing* ThreadLogRing() {
+	LogRing* ring = threadLogRing.get();
+	if (ring == NULL) {
+		ring = new LogRing;
+		ring->head = 0;
+		ring->tail = 0;
+		ring->dropped = 0;
+		{
+			boost::mutex::scoped_lock lock(LogRingsLock());
+			logRings.push_back(ring);
+		}
+		threadLogRing.reset(ring);
+	}
+	return ring;
+}
+
+// ================================================================
+// Parse one printf conversion. 'spec' points just past the '%'. Returns the
+// length of the conversion and sets the number of '*' widths it takes and the
+// type of its argument (LogArgNone for '%%').
+static int LogParseSpec(const char* spec, int& stars, LogArgType& argType) {
+	const char* cc = spec;
+	stars = 0;
+	argType = LogArgNone;
+	while (*cc != '\0' && strchr("-+ #0", *cc) != NULL) cc++;
+	if (*cc == '*') { stars++; cc++; }
+	else while (*cc >= '0' && *cc <= '9') cc++;
+	if (*cc == '.') {
+		cc++;
+		if (*cc == '*') { stars++; cc++; }
+		else while (*cc >= '0' && *cc <= '9') cc++;
+	}
+	int longs = 0;
+	bool longDouble = false;
+	if (strncmp(cc, "I64", 3) == 0) { longs = 2; cc += 3; }
+	else if (strncmp(cc, "I32", 3) == 0) { cc += 3; }
+	else {
+		while (*cc == 'h') cc++;
+		while (*cc == 'l') { longs++; cc++; }
+		if (*cc == 'L') { longDouble = true; cc++; }
+	}
+	switch (*cc) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+			argType = longs == 0 ? LogArgInt : (longs == 1 ? LogArgLong : LogArgLongLong);
+			break;
+		case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+			argType = longDouble ? LogArgLongDouble : LogArgDouble;
+			break;
+		case 's':
+			argType = LogArgString;
+			break;
+		case 'p': case 'n':
+			argType = LogArgPointer;
+			break;
+		case '%':
+			argType = LogArgNone;
+			break;
+		case '\0':
+			return (int)(cc - spec);
+		default:
+			argType = LogArgInt;
+			break;
+	}
+	return (int)(cc - spec) + 1;
+}
+
+// put a value into the record. Returns false if it doesn't fit.
+static bool LogPut(char*& out, char* end, LogArgType typ, const void* val, size_t len) {
+	if (out + 1 + len > end) return false;
+	*out++ = (char)typ;
+	memcpy(out, val, len);
+	out += len;
+	return true;
+}
+
+// Copy the format and the arguments into the record without formatting
+static void LogCapture(LogRecord* rec, const char* fmt, va_list args) {
+	char* out = rec->data;
+	char* end = rec->data + LogRecordSize;
+	size_t fmtLen = strlen(fmt);
+	if (fmtLen > LogRecordSize / 2) fmtLen = LogRecordSize / 2;
+	memcpy(out, fmt, fmtLen);
+	out[fmtLen] = '\0';
+	const char* cc = out;
+	out += fmtLen + 1;
+	bool full = false;
+	while (*cc != '\0' && !full) {
+		if (*cc++ != '%') continue;
+		int stars;
+		LogArgType typ;
+		cc += LogParseSpec(cc, stars, typ);
+		for (int ii = 0; ii < stars && !full; ii++) {
+			int star = va_arg(args, int);
+			full = !LogPut(out, end, LogArgInt, &star, sizeof(star));
+		}
+		if (full) break;
+		switch (typ) {
+			case LogArgInt: {
+				int val = va_arg(args, int);
+				full = !LogPut(out, end, typ, &val, sizeof(val));
+				break;
+			}
+			case LogArgLong: {
+				long val = va_arg(args, long);
+				full = !LogPut(out, end, typ, &val, sizeof(val));
+				break;
+			}
+			case LogArgLongLong: {
+				long long val = va_arg(args, long long);
+				full = !LogPut(out, end, typ, &val, sizeof(val));
+				break;
+			}
+			case LogArgDouble: {
+				double val = va_arg(args, double);
+				full = !LogPut(out, end, typ, &val, sizeof(val));
+				break;
+			}
+			case LogArgLongDouble: {
+				long double val = va_arg(args, long double);
+				full = !LogPut(out, end, typ, &val, sizeof(val));
+				break;
+			}
+			case LogArgPointer: {
+				void* val = va_arg(args, void*);
+				full = !LogPut(out, end, typ, &val, sizeof(val));
+				break;
+			}
+			case LogArgString: {
+				const char* val = va_arg(args, const char*);
+				if (val == NULL) val = "(null)";
+				if (out + 2 > end) {
+					full = true;
+					break;
+				}
+				*out++ = (char)typ;
+				while (*val != '\0' && out < (end - 1)) *out++ = *val++;
+				*out++ = '\0';
+				break;
+			}
+			default:
+				break;
+		}
+	}
+	// mark the end of the arguments
+	if (out < end) *out = (char)LogArgNone;
+	else end[-1] = (char)LogArgNone;
+}
+
+// get the next argument out of the record. Returns NULL if there are no more.
+static const char* LogGet(const char*& in, const char* end, LogArgType want) {
+	if (in >= end || *in == (char)LogArgNone || *in != (char)want) return NULL;
+	const char* val = in + 1;
+	switch (want) {
+		case LogArgInt: in = val + sizeof(int); break;
+		case LogArgLong: in = val + sizeof(long); break;
+		case LogArgLongLong: in = val + sizeof(long long); break;
+		case LogArgDouble: in = val + sizeof(double); break;
+		case LogArgLongDouble: in = val + sizeof(long double); break;
+		case LogArgPointer: in = val + sizeof(void*); break;
+		case LogArgString: in = val + strlen(val) + 1; break;
+		default: return NULL;
+	}
+	return in > end ? NULL : val;
+}
+
+// Format a captured message. The output is always null terminated and
+// never longer than 'len'.
+static void LogFormat(const LogRecord* rec, char* buff, size_t len) {
+	const char* fmt = rec->data;
+	const char* in = fmt + strlen(fmt) + 1;
+	const char* end = rec->data + LogRecordSize;
+	size_t used = 0;
+	const char* cc = fmt;
+	while (*cc != '\0' && used < len - 1) {
+		if (*cc != '%') {
+			buff[used++] = *cc++;
+			continue;
+		}
+		const char* specStart = cc++;
+		int stars;
+		LogArgType typ;
+		cc += LogParseSpec(cc, stars, typ);
+		if (typ == LogArgNone) {
+			if (cc > specStart + 1 && cc[-1] == '%') buff[used++] = '%';
+			continue;
+		}
+		// rebuild the conversion with the '*' widths filled in
+		char spec[64];
+		size_t specLen = 0;
+		bool missing = false;
+		for (const char* ss = specStart; ss < cc && specLen < sizeof(spec) - 16; ss++) {
+			if (*ss == '*') {
+				const char* star = LogGet(in, end, LogArgInt);
+				if (star == NULL) { missing = true; break; }
+				int starVal;
+				memcpy(&starVal, star, sizeof(starVal));
+				specLen += sprintf(spec + specLen, "%d", starVal);
+			}
+			else {
+				spec[specLen++] = *ss;
+			}
+		}
+		spec[specLen] = '\0';
+		const char* val = missing ? NULL : LogGet(in, end, typ);
+		if (val == NULL) {
+			// the arguments didn't fit in the record
+			const char* more = "...";
+			while (*more != '\0' && used < len - 1) buff[used++] = *more++;
+			break;
+		}
+		int wrote = 0;
+		size_t room = len - used;
+		switch (typ) {
+			case LogArgInt: { int v; memcpy(&v, val, sizeof(v)); wrote = LGLOG_SNPRINTF(buff + used, room, spec, v); break; }
+			case LogArgLong: { long v; memcpy(&v, val, sizeof(v)); wrote = LGLOG_SNPRINTF(buff + used, room, spec, v); break; }
+			case LogArgLongLong: { long long v; memcpy(&v, val, sizeof(v)); wrote = LGLOG_SNPRINTF(buff + used, room, spec, v); break; }
+			case LogArgDouble: { double v; memcpy(&v, val, sizeof(v)); wrote = LGLOG_SNPRINTF(buff + used, room, spec, v); break; }
+			case LogArgLongDouble: { long double v; memcpy(&v, val, sizeof(v)); wrote = LGLOG_SNPRINTF(buff + used, room, spec, v); break; }
+			case LogArgPointer: {
+				void* v;
+				memcpy(&v, val, sizeof(v));
+				if (cc[-1] != 'n') wrote = LGLOG_SNPRINTF(buff + used, room, spec, v);
+				break;
+			}
+			case LogArgString: wrote = LGLOG_SNPRINTF(buff + used, room, spec, val); break;
+			default: break;
+		}
+		// both flavors of snprintf: negative or too big means it was cut off
+		if (wrote < 0 || (size_t)wrote >= room) {
+			used = len - 1;
+			break;
+		}
+		used += wrote;
+	}
+	buff[used] = '\0';
+}
+
+// ================================================================
+static void LogMessage(bool detail, const char* fmt, va_list args) {
+	if (LG::debugLogCallback == NULL) return;
+	if (detail && !logDetailEnabled) return;
+	if (!logAsync) {
+		// before the background thread starts and after it stops
+		LogRecord rec;
+		char buff[LogMessageSize];
+		LogCapture(&rec, fmt, args);
+		LogFormat(&rec, buff, sizeof(buff));
+		(*LG::debugLogCallback)(buff);
+		return;
+	}
+	LogRing* ring = ThreadLogRing();
+	int head = ring->head;
+	if ((head - LGLOCK_ATOMIC_GET(ring->tail)) >= LogRingSize) {
+		LGLOCK_ATOMIC_INC(ring->dropped);
+		return;
+	}
+	LogRecord* rec = &(ring->records[head & (LogRingSize - 1)]);
+	rec->time = LGLOCK_MICROSECONDS();
+	LogCapture(rec, fmt, args);
+	LGLOCK_ATOMIC_INC(ring->head);
+}
+
+// Call back into the managed world to output a log message with formatting
+void Log(const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	LogMessage(false, fmt, args);
+	va_end(args);
+}
+
+// For the chatty messages in the busy places
+void LogDetail(const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	LogMessage(true, fmt, args);
+	va_end(args);
+}
+
+// ================================================================
+static bool LogTimeLess(const std::pair<Ogre::uint64, Ogre::String>& a, const std::pair<Ogre::uint64, Ogre::String>& b) {
+	return a.first < b.first;
+}
+
+static void LogSendBatch(Ogre::String& batch) {
+	if (batch.length() > 0) {
+		if (LG::debugLogCallback != NULL) (*LG::debugLogCallback)(batch.c_str());
+		batch.clear();
+	}
+}
+
+// Format what's in the rings, put the messages from all the threads in time
+// order and send them in batches of lines.
+void LogFlush() {
+	boost::mutex::scoped_lock flushLock(LogFlushLock());
+	std::vector<LogRing*> rings;
+	{
+		boost::mutex::scoped_lock lock(LogRingsLock());
+		rings = logRings;
+	}
+	std::vector<std::pair<Ogre::uint64, Ogre::String> > messages;
+	char buff[LogMessageSize];
+	std::vector<LogRing*>::iterator ri;
+	for (ri = rings.begin(); ri != rings.end(); ri++) {
+		LogRing* ring = *ri;
+		int head = LGLOCK_ATOMIC_GET(ring->head);
+		int tail = ring->tail;
+		for (int ii = tail; ii != head; ii++) {
+			LogRecord* rec = &(ring->records[ii & (LogRingSize - 1)]);
+			LogFormat(rec, buff, sizeof(buff));
+			messages.push_back(std::pair<Ogre::uint64, Ogre::String>(rec->time, Ogre::String(buff)));
+		}
+		LGLOCK_ATOMIC_SET(ring->tail, head);
+		int dropped = LGLOCK_ATOMIC_GET(ring->dropped);
+		if (dropped != 0) {
+			LGLOCK_ATOMIC_ADD(ring->dropped, -dropped);
+			sprintf(buff, "LGLog: %d messages dropped because the log buffer was full", dropped);
+			messages.push_back(std::pair<Ogre::uint64, Ogre::String>(LGLOCK_MICROSECONDS(), Ogre::String(buff)));
+		}
+	}
+	if (messages.empty()) return;
+	std::stable_sort(messages.begin(), messages.end(), LogTimeLess);
+	Ogre::String batch;
+	std::vector<std::pair<Ogre::uint64, Ogre::String> >::iterator mi;
+	for (mi = messages.begin(); mi != messages.end(); mi++) {
+		if (batch.length() > 0 && (batch.length() + mi->second.length()) >= LogBatchSize) {
+			LogSendBatch(batch);
+		}
+		if (batch.length() > 0) batch += "\n";
+		batch += mi->second;
+	}
+	LogSendBatch(batch);
+}
+
+static void LogThreadRoutine() {
+	while (logKeepRunning) {
+		LogFlush();
+		boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+	}
+	LogFlush();
+}
+
+void LogInitialize() {
+	logDetailEnabled = LG::GetParameterBool("Renderer.Ogre.LogDetail");
+	if (logThread == NULL && LG::GetParameterBool("Renderer.Ogre.AsyncLog")) {
+		logKeepRunning = true;
+		logThread = new boost::thread(&LogThreadRoutine);
+		logAsync = true;
+	}
+}
+
+void LogShutdown() {
+	if (logThread != NULL) {
+		logAsync = false;
+		logKeepRunning = false;
+		logThread->join();
+		delete logThread;
+		logThread = NULL;
+	}
+	LogFlush();
+}
+
+}
@@ -23,20 +23,28 @@
 #pragma once
 
 #include "LGOCommon.h"
-#include "Animat.h"
+#include "LookingGlassOgre.h"
 
 namespace LG {
-	class AnimatRotation : public Animat {
-	public:
-		AnimatRotation();
-		AnimatRotation(Ogre::String nodeName, Ogre::Quaternion newRot, float duration);
-		~AnimatRotation();
 
-		bool Process(float);
+// Asynchronous logging for LG::Log and LG::LogDetail.
+// A log call doesn't format the message. It copies the format and the
+// arguments, in binary, into a ring buffer that belongs to the calling thread.
+// A background thread takes the messages from all the rings, formats them and
+// hands them to the managed logger in batches. So logging on the render thread
+// or while holding a lock costs a copy instead of a call into managed code.
+// If a thread's ring is full, its messages are dropped and counted.
+// Messages are only captured if the managed side set a logger and, for
+// LogDetail, if Renderer.Ogre.LogDetail is set.
 
-	private:
-		float m_progress;		// 0..1
-		float m_durationSeconds;
-		Ogre::Quaternion m_targetRotation;
-};
-}
\ No newline at end of file
+extern bool logDetailEnabled;
+
+// read the parameters
+extern void LogInitialize();
+// format and send anything waiting. Done by the background thread but can
+// be called when the messages must get out now.
+extern void LogFlush();
+// stop the background thread after sending everything
+extern void LogShutdown();
+
+}
@@ -0,0 +1,217 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "LGOCommon.h"
+#include "LGParams.h"
+#include "boost/thread/mutex.hpp"
+
+namespace LG {
+
+// More than enough. The renderer has about a hundred parameters.
+#define LGParamMaxKeys 1024
+
+// The values indexed by key. Only ever replaced, never cleared, so a reader
+// just loads the pointer. Key 0 is for names that didn't fit.
+static ParamValue* volatile paramValues[LGParamMaxKeys];
+
+typedef struct {
+	Ogre::String prefix;
+	ParamListener* listener;
+	void* obj;
+} ParamListenerEntry;
+
+// Everything else is only touched with the lock held. The parameter lock is
+// a plain mutex (not an LGLock) since the lock profiler reads parameters.
+typedef std::map<Ogre::String, ParamKey> ParamKeyMap;
+static ParamKeyMap& ParamKeys() {
+	static ParamKeyMap paramKeys;
+	return paramKeys;
+}
+static std::vector<Ogre::String>& ParamNames() {
+	static std::vector<Ogre::String> paramNames;
+	return paramNames;
+}
+static std::list<ParamListenerEntry>& ParamListeners() {
+	static std::list<ParamListenerEntry> paramListeners;
+	return paramListeners;
+}
+// Replaced values are kept since readers could still be using them (GetParameter
+// returns the string). Parameters seldom change so this doesn't grow much.
+static std::list<ParamValue*>& ParamRetired() {
+	static std::list<ParamValue*> paramRetired;
+	return paramRetired;
+}
+static boost::mutex& ParamLock() {
+	static boost::mutex paramLock;
+	return paramLock;
+}
+
+ParamValue::ParamValue(const char* val) {
+	Str = (val == NULL) ? "" : val;
+	Int = 0;
+	sscanf(Str.c_str(), "%d", &Int);
+	Float = 0.0;
+	sscanf(Str.c_str(), "%f", &Float);
+	Bool = isTrue(Str.c_str());
+	float rnum, gnum, bnum;
+	if (sscanf(Str.c_str(), "<%f,%f,%f>", &rnum, &gnum, &bnum) == 3) {
+		Color = Ogre::ColourValue(rnum, gnum, bnum);
+	}
+	else {
+		Color = Ogre::ColourValue::Red;
+	}
+}
+
+// Make the new value visible to the readers only after it is all there
+static void ParamPublish(ParamKey key, ParamValue* val) {
+#ifdef _MSC_VER
+	_InterlockedExchangePointer((void* volatile*)&paramValues[key], val);
+#else
+	__sync_synchronize();
+	paramValues[key] = val;
+	__sync_synchronize();
+#endif
+}
+
+// Called with the lock held
+static ParamKey ParamInternLocked(const Ogre::String& name) {
+	ParamKeyMap& keys = ParamKeys();
+	ParamKeyMap::iterator ki = keys.find(name);
+	if (ki != keys.end()) {
+		return ki->second;
+	}
+	std::vector<Ogre::String>& names = ParamNames();
+	if (names.empty()) {
+		names.push_back("");		// key zero
+	}
+	if (names.size() >= LGParamMaxKeys) {
+		LG::Log("LGParams: too many parameters. Not keeping %s", name.c_str());
+		return 0;
+	}
+	ParamKey key = (ParamKey)names.size();
+	names.push_back(name);
+	keys.insert(ParamKeyMap::value_type(name, key));
+	return key;
+}
+
+ParamKey ParamIntern(const char* name) {
+	Ogre::String lname(name);
+	Ogre::StringUtil::toLowerCase(lname);
+	boost::mutex::scoped_lock lock(ParamLock());
+	return ParamInternLocked(lname);
+}
+
+// The parameter wasn't pushed. Ask the managed code for it, once.
+static const ParamValue* ParamFetch(ParamKey key) {
+	boost::mutex::scoped_lock lock(ParamLock());
+	if (paramValues[key] == NULL) {
+		const char* val = NULL;
+		if (key != 0) {
+			const char* name = ParamNames()[key].c_str();
+			if (LG::fetchParameterCallback != NULL) {
+				val = (*LG::fetchParameterCallback)(name);
+			}
+			else {
+				LG::Log("DEBUG: LookingGlassOrge: could not get parameter %s", name);
+			}
+		}
+		ParamPublish(key, new ParamValue(val));
+	}
+	return paramValues[key];
+}
+
+const ParamValue* ParamLookup(ParamKey key) {
+	const ParamValue* val = paramValues[key];
+	if (val == NULL) {
+		val = ParamFetch(key);
+	}
+	return val;
+}
+
+void ParamUpdate(const char* name, const char* value) {
+	Ogre::String lname(name);
+	Ogre::StringUtil::toLowerCase(lname);
+	std::list<ParamListenerEntry> toCall;
+	ParamKey key;
+	{
+		boost::mutex::scoped_lock lock(ParamLock());
+		key = ParamInternLocked(lname);
+		if (key == 0) return;
+		ParamValue* old = paramValues[key];
+		if (old != NULL && old->Str == ((value == NULL) ? "" : value)) {
+			return;		// not really a change
+		}
+		ParamPublish(key, new ParamValue(value));
+		if (old == NULL) {
+			return;		// first value (the snapshot). No one has seen the old one.
+		}
+		ParamRetired().push_back(old);
+		std::list<ParamListenerEntry>& listeners = ParamListeners();
+		for (std::list<ParamListenerEntry>::iterator li = listeners.begin(); li != listeners.end(); li++) {
+			if (Ogre::StringUtil::startsWith(lname, li->prefix, false)) {
+				toCall.push_back(*li);
+			}
+		}
+	}
+	// outside the lock so the listeners can read parameters
+	for (std::list<ParamListenerEntry>::iterator li = toCall.begin(); li != toCall.end(); li++) {
+		(*(li->listener))(key, li->obj);
+	}
+}
+
+int ParamCount() {
+	boost::mutex::scoped_lock lock(ParamLock());
+	return (int)ParamNames().size();
+}
+
+Ogre::String ParamName(ParamKey key) {
+	boost::mutex::scoped_lock lock(ParamLock());
+	std::vector<Ogre::String>& names = ParamNames();
+	if (key <= 0 || key >= (ParamKey)names.size()) return "";
+	return names[key];
+}
+
+void ParamAddListener(const char* prefix, ParamListener* listener, void* obj) {
+	ParamListenerEntry ent;
+	ent.prefix = prefix;
+	Ogre::StringUtil::toLowerCase(ent.prefix);
+	ent.listener = listener;
+	ent.obj = obj;
+	boost::mutex::scoped_lock lock(ParamLock());
+	ParamListeners().push_back(ent);
+}
+
+void ParamRemoveListener(ParamListener* listener, void* obj) {
+	boost::mutex::scoped_lock lock(ParamLock());
+	std::list<ParamListenerEntry>& listeners = ParamListeners();
+	for (std::list<ParamListenerEntry>::iterator li = listeners.begin(); li != listeners.end(); ) {
+		if (li->listener == listener && li->obj == obj) {
+			li = listeners.erase(li);
+		}
+		else {
+			li++;
+		}
+	}
+}
+
+}
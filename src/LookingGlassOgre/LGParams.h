@@ -0,0 +1,87 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LookingGlassOgre.h"
+
+namespace LG {
+
+// The parameters are kept here rather than asked of the managed code on every
+// read. The managed code pushes all the Renderer.Ogre parameters before Ogre is
+// initialized (UpdateParameter) and pushes each one again whenever it changes.
+// The value is parsed into all the types it could be read as when it arrives so
+// reads are a couple of loads with no locking.
+// A parameter that was never pushed is fetched from the managed code the first
+// time it is asked for and kept.
+// Names are not case sensitive (the managed parameter sets aren't either).
+
+// A parsed value. Never changed once made: an update makes a new one so a reader
+// holding the old one (or its string) is not disturbed.
+class ParamValue {
+public:
+	ParamValue(const char*);
+	Ogre::String Str;
+	int Int;
+	float Float;
+	bool Bool;
+	Ogre::ColourValue Color;
+};
+
+typedef int ParamKey;
+
+// Find or make the key for a parameter name. Takes a lock so do it once.
+extern ParamKey ParamIntern(const char*);
+// The current value for a key. Never NULL.
+extern const ParamValue* ParamLookup(ParamKey);
+// Set a parameter and tell the listeners
+extern void ParamUpdate(const char*, const char*);
+// Keys are 1 to ParamCount()-1. The name is as stored (lower case).
+extern int ParamCount();
+extern Ogre::String ParamName(ParamKey);
+
+// Called after a parameter whose name starts with the listener's prefix changes.
+// Called on the thread doing the update (usually a managed thread) so listeners
+// should just note the new value and let their own thread act on it.
+typedef void ParamListener(ParamKey, void*);
+extern void ParamAddListener(const char*, ParamListener*, void*);
+extern void ParamRemoveListener(ParamListener*, void*);
+
+// A parameter read often. Make it once (a static or a member) and read it as
+// often as needed:
+//    static LG::LGParam terrainMaterial("Renderer.Ogre.DefaultTerrainMaterial");
+//    mo->begin(terrainMaterial.Str());
+class LGParam {
+public:
+	LGParam(const char* name) { m_key = ParamIntern(name); }
+	ParamKey Key() { return m_key; }
+	const char* Str() { return ParamLookup(m_key)->Str.c_str(); }
+	int Int() { return ParamLookup(m_key)->Int; }
+	float Float() { return ParamLookup(m_key)->Float; }
+	bool Bool() { return ParamLookup(m_key)->Bool; }
+	Ogre::ColourValue Color() { return ParamLookup(m_key)->Color; }
+private:
+	ParamKey m_key;
+};
+
+}
@@ -0,0 +1,313 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "LGOCommon.h"
+#include "LGReplay.h"
+#include "LGParams.h"
+#include "LGLocking.h"
+#include "boost/thread/mutex.hpp"
+
+namespace LG {
+
+bool replayRecording = false;
+static FILE* replayFile = NULL;
+static Ogre::uint64 replayStart = 0;
+
+// A plain mutex since the records are written from any thread, including
+// from inside LGLock.
+static boost::mutex& ReplayLock() {
+	static boost::mutex replayLock;
+	return replayLock;
+}
+
+static const char* replayCodeNames[ReplayCodeCount] = {
+	"None",
+	"Parameter",
+	"Frame",
+	"UpdateCameraBF",
+	"RefreshResourceBF",
+	"CreateMeshResourceBF",
+	"CreateMaterialResource2BF",
+	"CreateMaterialResource7BF",
+	"AddRegionBF",
+	"UpdateTerrainBF",
+	"SetFocusRegionBF",
+	"SetRegionDetailBF",
+	"CreateMeshSceneNodeBF",
+	"UpdateSceneNodeBF",
+	"RemoveSceneNodeBF",
+	"UpdateAnimationBF",
+	"UpdateMotion",
+	"SetAvatarAnimation"
+};
+
+const char* ReplayCodeName(int code) {
+	if (code < 0 || code >= ReplayCodeCount) return "Unknown";
+	return replayCodeNames[code];
+}
+
+// Parameters changing while recording are recorded so the playback sees them
+// change at the same place.
+static void ReplayParameterChanged(ParamKey key, void* obj) {
+	if (replayRecording) {
+		ReplayRecord(ReplayParameter).Str(ParamName(key).c_str()).Str(ParamLookup(key)->Str.c_str());
+	}
+}
+
+void ReplayInitialize() {
+	Ogre::String filename = LG::GetParameter("Renderer.Ogre.Replay.Record");
+	if (filename.length() == 0) return;
+	{
+		boost::mutex::scoped_lock lock(ReplayLock());
+		replayFile = fopen(filename.c_str(), "wb");
+		if (replayFile == NULL) {
+			LG::Log("ReplayInitialize: could not open %s. Not recording.", filename.c_str());
+			return;
+		}
+		Ogre::uint32 version = LGReplayVersion;
+		fwrite("LGREPLAY", 1, 8, replayFile);
+		fwrite(&version, sizeof(version), 1, replayFile);
+		replayStart = LGLOCK_MICROSECONDS();
+		replayRecording = true;
+	}
+	// the parameters first so the playback is set up the same way
+	for (ParamKey key = 1; key < ParamCount(); key++) {
+		ReplayParameterChanged(key, NULL);
+	}
+	LG::ParamAddListener("", &ReplayParameterChanged, NULL);
+	LG::Log("ReplayInitialize: recording between frame calls to %s", filename.c_str());
+}
+
+void ReplayShutdown() {
+	if (!replayRecording) return;
+	LG::ParamRemoveListener(&ReplayParameterChanged, NULL);
+	boost::mutex::scoped_lock lock(ReplayLock());
+	replayRecording = false;
+	if (replayFile != NULL) {
+		fclose(replayFile);
+		replayFile = NULL;
+	}
+}
+
+// ====================================================================
+ReplayRecord::ReplayRecord(int code) {
+	m_code = code;
+}
+
+ReplayRecord::~ReplayRecord() {
+	Ogre::uint32 head[2];
+	head[0] = (Ogre::uint32)m_code;
+	head[1] = (Ogre::uint32)m_data.size();
+	boost::mutex::scoped_lock lock(ReplayLock());
+	if (replayFile != NULL) {
+		Ogre::uint64 when = LGLOCK_MICROSECONDS() - replayStart;
+		fwrite(head, sizeof(head), 1, replayFile);
+		fwrite(&when, sizeof(when), 1, replayFile);
+		if (!m_data.empty()) {
+			fwrite(&m_data[0], 1, m_data.size(), replayFile);
+		}
+	}
+}
+
+void ReplayRecord::Add(const void* data, size_t len) {
+	const char* cdata = (const char*)data;
+	m_data.insert(m_data.end(), cdata, cdata + len);
+}
+
+ReplayRecord& ReplayRecord::Int(int val) {
+	Add(&val, sizeof(val));
+	return *this;
+}
+
+ReplayRecord& ReplayRecord::Bool(bool val) {
+	char cval = val ? 1 : 0;
+	Add(&cval, 1);
+	return *this;
+}
+
+ReplayRecord& ReplayRecord::Float(float val) {
+	Add(&val, sizeof(val));
+	return *this;
+}
+
+ReplayRecord& ReplayRecord::Double(double val) {
+	Add(&val, sizeof(val));
+	return *this;
+}
+
+ReplayRecord& ReplayRecord::Str(const char* val) {
+	if (val == NULL) {
+		return Int(-1);
+	}
+	int len = (int)strlen(val);
+	Int(len);
+	Add(val, len);
+	return *this;
+}
+
+ReplayRecord& ReplayRecord::Ints(const int* vals, int count) {
+	if (vals == NULL) count = 0;
+	Int(count);
+	if (count > 0) Add(vals, count * sizeof(int));
+	return *this;
+}
+
+ReplayRecord& ReplayRecord::Floats(const float* vals, int count) {
+	if (vals == NULL) count = 0;
+	Int(count);
+	if (count > 0) Add(vals, count * sizeof(float));
+	return *this;
+}
+
+// ====================================================================
+ReplayReader::ReplayReader() {
+	m_file = NULL;
+	m_code = 0;
+	m_time = 0;
+	m_pos = 0;
+	m_bad = false;
+}
+
+ReplayReader::~ReplayReader() {
+	Close();
+}
+
+bool ReplayReader::Open(const char* filename) {
+	Close();
+	m_file = fopen(filename, "rb");
+	if (m_file == NULL) {
+		LG::Log("ReplayReader: could not open %s", filename);
+		return false;
+	}
+	char magic[8];
+	Ogre::uint32 version = 0;
+	if (fread(magic, 1, 8, m_file) != 8 || memcmp(magic, "LGREPLAY", 8) != 0
+				|| fread(&version, sizeof(version), 1, m_file) != 1) {
+		LG::Log("ReplayReader: %s is not a replay file", filename);
+		Close();
+		return false;
+	}
+	if (version != LGReplayVersion) {
+		LG::Log("ReplayReader: %s is version %d. Can only read version %d", filename, (int)version, LGReplayVersion);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ReplayReader::Close() {
+	if (m_file != NULL) {
+		fclose(m_file);
+		m_file = NULL;
+	}
+}
+
+bool ReplayReader::Next() {
+	m_strings.clear();
+	m_pos = 0;
+	m_bad = false;
+	if (m_file == NULL) return false;
+	Ogre::uint32 head[2];
+	if (fread(head, sizeof(head), 1, m_file) != 1 || fread(&m_time, sizeof(m_time), 1, m_file) != 1) {
+		return false;
+	}
+	m_code = (int)head[0];
+	m_data.resize(head[1]);
+	if (head[1] > 0 && fread(&m_data[0], 1, head[1], m_file) != head[1]) {
+		LG::Log("ReplayReader: recording ends in the middle of a record");
+		return false;
+	}
+	return true;
+}
+
+// The next 'len' bytes of the record or NULL if there aren't that many
+const char* ReplayReader::Take(size_t len) {
+	if (m_pos + len > m_data.size()) {
+		m_bad = true;
+		return NULL;
+	}
+	const char* ret = len == 0 ? "" : &m_data[m_pos];
+	m_pos += len;
+	return ret;
+}
+
+int ReplayReader::Int() {
+	int val = 0;
+	const char* data = Take(sizeof(val));
+	if (data != NULL) memcpy(&val, data, sizeof(val));
+	return val;
+}
+
+bool ReplayReader::Bool() {
+	const char* data = Take(1);
+	return data != NULL && *data != 0;
+}
+
+float ReplayReader::Float() {
+	float val = 0.0;
+	const char* data = Take(sizeof(val));
+	if (data != NULL) memcpy(&val, data, sizeof(val));
+	return val;
+}
+
+double ReplayReader::Double() {
+	double val = 0.0;
+	const char* data = Take(sizeof(val));
+	if (data != NULL) memcpy(&val, data, sizeof(val));
+	return val;
+}
+
+char* ReplayReader::Str() {
+	int len = Int();
+	if (len < 0) return NULL;
+	const char* data = Take(len);
+	if (data == NULL) return NULL;
+	m_strings.push_back(std::vector<char>(data, data + len));
+	m_strings.back().push_back('\0');
+	return &(m_strings.back()[0]);
+}
+
+// Arrays are copied out so they are aligned
+const int* ReplayReader::Ints(int& count) {
+	count = Int();
+	const char* data = (count > 0) ? Take(count * sizeof(int)) : NULL;
+	if (data == NULL) {
+		count = 0;
+		return NULL;
+	}
+	m_strings.push_back(std::vector<char>(data, data + count * sizeof(int)));
+	return (const int*)&(m_strings.back()[0]);
+}
+
+const float* ReplayReader::Floats(int& count) {
+	count = Int();
+	const char* data = (count > 0) ? Take(count * sizeof(float)) : NULL;
+	if (data == NULL) {
+		count = 0;
+		return NULL;
+	}
+	m_strings.push_back(std::vector<char>(data, data + count * sizeof(float)));
+	return (const float*)&(m_strings.back()[0]);
+}
+
+}
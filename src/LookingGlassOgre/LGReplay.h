@@ -0,0 +1,125 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LookingGlassOgre.h"
+
+namespace LG {
+
+// Recording of the between frame calls from the managed code so they can be
+// played back without the viewer (see Bench/LGReplayBench.cpp).
+// When Renderer.Ogre.Replay.Record names a file, every parameter value, every
+// BF call (with its arrays) and every frame boundary is appended to that file.
+// The file:
+//    header: "LGREPLAY" then a uint32 version
+//    records: uint32 code, uint32 payload length, uint64 microseconds since
+//             the recording started, payload
+// Everything is in the byte order of the machine that recorded it.
+// Strings are a int32 length (-1 for NULL) and the characters. Arrays are an
+// int32 count and the elements.
+
+#define LGReplayVersion 1
+
+// The record codes. These are in recordings so only add to the end.
+typedef enum {
+	ReplayParameter = 1,		// name, value
+	ReplayFrame,				// (nothing)
+	ReplayUpdateCamera,
+	ReplayRefreshResource,
+	ReplayCreateMeshResource,
+	ReplayCreateMaterialResource2,
+	ReplayCreateMaterialResource7,
+	ReplayAddRegion,
+	ReplayUpdateTerrain,
+	ReplaySetFocusRegion,
+	ReplaySetRegionDetail,
+	ReplayCreateMeshSceneNode,
+	ReplayUpdateSceneNode,
+	ReplayRemoveSceneNode,
+	ReplayUpdateAnimation,
+	ReplayUpdateMotion,
+	ReplaySetAvatarAnimation,
+	ReplayCodeCount
+} ReplayCode;
+
+extern bool replayRecording;
+// Start recording if the parameter says to. The current parameters are the
+// first records.
+extern void ReplayInitialize();
+extern void ReplayShutdown();
+extern const char* ReplayCodeName(int);
+
+// One record. Built up and written when it goes out of scope so a whole call
+// is one statement:
+//    if (LG::replayRecording) LG::ReplayRecord(LG::ReplayRemoveSceneNode).Float(prio).Str(name);
+class ReplayRecord {
+public:
+	ReplayRecord(int code);
+	~ReplayRecord();
+	ReplayRecord& Int(int);
+	ReplayRecord& Bool(bool);
+	ReplayRecord& Float(float);
+	ReplayRecord& Double(double);
+	ReplayRecord& Str(const char*);
+	ReplayRecord& Ints(const int*, int);
+	ReplayRecord& Floats(const float*, int);
+private:
+	void Add(const void*, size_t);
+	int m_code;
+	std::vector<char> m_data;
+};
+
+// Reads a recording back
+class ReplayReader {
+public:
+	ReplayReader();
+	~ReplayReader();
+	bool Open(const char*);
+	void Close();
+	// Read the next record. Returns false at the end of the file or if it is bad.
+	bool Next();
+	int Code() { return m_code; }
+	Ogre::uint64 Time() { return m_time; }
+	// The values in the order they were recorded. The pointers are good until Next().
+	int Int();
+	bool Bool();
+	float Float();
+	double Double();
+	char* Str();
+	const int* Ints(int&);
+	const float* Floats(int&);
+	// true if a read went past the end of the record
+	bool Bad() { return m_bad; }
+private:
+	const char* Take(size_t);
+	FILE* m_file;
+	int m_code;
+	Ogre::uint64 m_time;
+	std::vector<char> m_data;
+	size_t m_pos;
+	bool m_bad;
+	std::list<std::vector<char> > m_strings;
+};
+
+}
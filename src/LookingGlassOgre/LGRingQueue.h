@@ -0,0 +1,111 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LGLocking.h"
+
+namespace LG {
+
+// Bounded queue for many producer threads and one consumer thread that doesn't
+// take a lock. Each slot has a sequence number which says whose turn it is:
+// equal to the position when a producer may fill it and the position plus one
+// when the consumer may empty it. Producers claim a position by moving the
+// tail along with a compare-and-swap. Positions are compared by difference so
+// they can wrap.
+// Push returns false if the queue is full. Pop returns false if it's empty or
+// if the producer that claimed the next slot hasn't finished filling it.
+template<class T> class LGRingQueue {
+public:
+	LGRingQueue(int capacity) {
+		int size = 2;
+		while (size < capacity) size <<= 1;
+		m_mask = size - 1;
+		m_slots = new Slot[size];
+		for (int ii = 0; ii < size; ii++) {
+			m_slots[ii].sequence = ii;
+		}
+		m_tail = 0;
+		m_head = 0;
+	}
+	~LGRingQueue() {
+		delete[] m_slots;
+	}
+
+	// any thread
+	bool Push(const T& item) {
+		LGLOCK_ATOMIC_INT pos = LGLOCK_ATOMIC_GET(m_tail);
+		Slot* slot;
+		while (true) {
+			slot = &m_slots[pos & m_mask];
+			int diff = Difference(LGLOCK_ATOMIC_GET(slot->sequence), pos);
+			if (diff == 0) {
+				if (LGLOCK_ATOMIC_CAS(m_tail, pos, pos + 1)) break;
+			}
+			else if (diff < 0) {
+				// the consumer hasn't emptied this slot from the last time around
+				return false;
+			}
+			pos = LGLOCK_ATOMIC_GET(m_tail);
+		}
+		slot->item = item;
+		LGLOCK_ATOMIC_SET(slot->sequence, pos + 1);
+		return true;
+	}
+
+	// only the consumer thread
+	bool Pop(T& item) {
+		Slot* slot = &m_slots[m_head & m_mask];
+		if (Difference(LGLOCK_ATOMIC_GET(slot->sequence), m_head + 1) < 0) {
+			return false;
+		}
+		item = slot->item;
+		LGLOCK_ATOMIC_SET(slot->sequence, m_head + m_mask + 1);
+		m_head++;
+		return true;
+	}
+
+	// a guess when not called on the consumer thread
+	bool IsEmpty() {
+		return Difference(LGLOCK_ATOMIC_GET(m_slots[m_head & m_mask].sequence), m_head + 1) < 0;
+	}
+
+private:
+	typedef struct {
+		LGLOCK_ATOMIC_INT sequence;
+		T item;
+	} Slot;
+	Slot* m_slots;
+	LGLOCK_ATOMIC_INT m_mask;
+	// the producers and the consumer each have their own cache line
+	char m_pad1[64];
+	LGLOCK_ATOMIC_INT m_tail;
+	char m_pad2[64];
+	LGLOCK_ATOMIC_INT m_head;
+
+	static int Difference(LGLOCK_ATOMIC_INT a, LGLOCK_ATOMIC_INT b) {
+		return (int)((unsigned int)a - (unsigned int)b);
+	}
+};
+
+}
@@ -0,0 +1,323 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "LGOCommon.h"
+#include "LGStats.h"
+#include "boost/thread/tss.hpp"
+
+namespace LG {
+
+// The schema. Must be in the same order as StatCode and StatHistCode.
+// The names are what the managed side has always shown.
+typedef struct {
+	int code;
+	int kind;
+	const char* name;
+	const char* description;
+	int divisor;
+} StatSchemaDef;
+
+static StatSchemaDef statSchema[StatCount] = {
+	{ StatTotalFrames, StatKindCounter, "TotalFrames", "Number of frames rendered", 1 },
+	{ StatFramesPerSecond, StatKindGauge, "FramesPerSecond", "Frames per second", 1000 },
+	{ StatLastFrameMs, StatKindGauge, "LastFrameMS", "Milliseconds used rendering last frame", 1 },
+	{ StatVisibleToVisible, StatKindGauge, "VisibleToVisible", "Meshes at were visible that are still visible in last frame", 1 },
+	{ StatInvisibleToVisible, StatKindGauge, "InvisibleToVisible", "Meshes that were invisible that are now visible in last frame", 1 },
+	{ StatVisibleToInvisible, StatKindGauge, "VisibleToInvisible", "Meshes that were visible that are now invisible in last frame", 1 },
+	{ StatInvisibleToInvisible, StatKindGauge, "InvisibleToInvisible", "Meshes that were invisible that are still invisible in last frame", 1 },
+	{ StatCullMeshesLoaded, StatKindCounter, "CullMeshesLoaded", "Total meshes loaded due to unculling", 1 },
+	{ StatCullTexturesLoaded, StatKindCounter, "CullTexturesLoaded", "Total textures loaded due to unculling", 1 },
+	{ StatCullMeshesUnloaded, StatKindCounter, "CullMeshesUnloaded", "Total meshes unloaded due to culling", 1 },
+	{ StatCullTexturesUnloaded, StatKindCounter, "CullTexturesUnloaded", "Total textures unloaded due to culling", 1 },
+	{ StatCullMeshesQueuedToLoad, StatKindGauge, "CullMeshesQueuedToLoad", "Meshes currently queued to load due to unculling", 1 },
+	{ StatBetweenFrameWorkItems, StatKindGauge, "BetweenFrameworkItems", "Number of between frame work items waiting", 1 },
+	{ StatBetweenFrameRefreshResource, StatKindCounter, "TotalBetweenFrameRefreshResource", "Number of 'refresh resource' work items queued", 1 },
+	{ StatBetweenFrameRemoveSceneNode, StatKindCounter, "TotalBetweenFrameRemoveSceneNode", "Number of 'remove scene node' work items queued", 1 },
+	{ StatBetweenFrameCreateMaterialResource, StatKindCounter, "TotalBetweenFrameCreateMaterialResource", "Number of 'create material resource' work items queued", 1 },
+	{ StatBetweenFrameCreateMeshResource, StatKindCounter, "TotalBetweenFrameCreateMeshResource", "Number of 'create mesh resource' work items queued", 1 },
+	{ StatBetweenFrameCreateMeshSceneNode, StatKindCounter, "TotalBetweenFrameCreateMeshScenenode", "Number of 'create mesh scene node' work items queued", 1 },
+	{ StatBetweenFrameAddLoadedMesh, StatKindCounter, "TotalBetweenFrameAddLoadedMesh", "Number of 'add loaded mesh' work items queued", 1 },
+	{ StatBetweenFrameUpdateSceneNode, StatKindCounter, "TotalBetweenframeupdatescenenode", "Number of 'update scene node' work items queued", 1 },
+	{ StatBetweenFrameTotalProcessed, StatKindCounter, "TotalBetweenFrameTotalProcessed", "Total number of work items actually processed", 1 },
+	{ StatBetweenFrameUnknownProcess, StatKindCounter, "TotalBetweenFrameUnknownProcess", "Number of work items with unknow process codes", 1 },
+	{ StatBetweenFrameDiscardedDups, StatKindCounter, "BetweenFrameworkDiscardedDups", "Between frame work requests which duplicated existing requests", 1 },
+	{ StatBetweenFrameEnqueueP99Us, StatKindGauge, "BetweenFrameEnqueueP99Us", "99th percentile microseconds to queue between frame work (recent)", 1 },
+	{ StatBetweenFrameOverflows, StatKindCounter, "BetweenFrameOverflows", "Between frame work queued on the slow path because the queue was full", 1 },
+	{ StatProcessAnyTimeWorkItems, StatKindGauge, "AnyTimeWorkItems", "Number of any time work items waiting", 1 },
+	{ StatProcessAnyTimeTotalProcessed, StatKindCounter, "TotalAnyTimeProcessed", "Total number of any time work items processed", 1 },
+	{ StatProcessAnyTimeDiscardedDups, StatKindCounter, "AnyTimeDiscardedDups", "Any time work requests which duplicated existing requests", 1 },
+	{ StatMaterialUpdatesRemaining, StatKindGauge, "MaterialUpdatesRemaining", "Number of material updates waiting", 1 },
+	{ StatMeshTrackerLoadQueued, StatKindGauge, "MeshTrackerLoadQueued", "Number of mesh loads queued", 1 },
+	{ StatMeshTrackerUnloadQueued, StatKindGauge, "MeshTrackerUnloadQueued", "Number of mesh unloads queued", 1 },
+	{ StatMeshTrackerSerializedQueued, StatKindGauge, "MeshTrackerSerializedQueued", "Number of mesh serializations queued", 1 },
+	{ StatMeshTrackerTotalQueued, StatKindCounter, "MeshTrackerTotalQueued", "Total mesh tracker requests queued", 1 },
+	{ StatAnimTracks, StatKindGauge, "AnimTracks", "Number of animation tracks", 1 },
+	{ StatAnimEvaluateUs, StatKindGauge, "AnimEvaluateUs", "Microseconds evaluating animations last frame", 1 },
+	{ StatAnimApplyUs, StatKindGauge, "AnimApplyUs", "Microseconds applying animations to scene nodes last frame", 1 },
+	{ StatAvatars, StatKindGauge, "Avatars", "Number of skeletal entities", 1 },
+	{ StatAvatarPools, StatKindGauge, "AvatarPools", "Number of skeletons shared by far away avatars", 1 },
+	{ StatLockParity, StatKindCounter, "LockParity", "Parity of LG locks", 1 },
+	{ StatInOut, StatKindGauge, "RoutineInOut", "Entry and exit of routines", 1 },
+};
+
+static StatSchemaDef histSchema[HistCount] = {
+	{ HistFrameTime, StatKindHistogram, "FrameTimeUs", "Microseconds between frames", 1 },
+	{ HistVisibilityPass, StatKindHistogram, "VisibilityPassUs", "Microseconds calculating visibility", 1 },
+	{ HistMeshBuild, StatKindHistogram, "MeshBuildUs", "Microseconds building a mesh", 1 },
+	{ HistMaterialBuild, StatKindHistogram, "MaterialBuildUs", "Microseconds building a material", 1 },
+	{ HistBFRefreshResource, StatKindHistogram, "BetweenFrameRefreshResourceUs", "Microseconds doing 'refresh resource' work", 1 },
+	{ HistBFRemoveSceneNode, StatKindHistogram, "BetweenFrameRemoveSceneNodeUs", "Microseconds doing 'remove scene node' work", 1 },
+	{ HistBFCreateMaterialResource, StatKindHistogram, "BetweenFrameCreateMaterialResourceUs", "Microseconds doing 'create material resource' work", 1 },
+	{ HistBFCreateMeshResource, StatKindHistogram, "BetweenFrameCreateMeshResourceUs", "Microseconds doing 'create mesh resource' work", 1 },
+	{ HistBFCreateMeshSceneNode, StatKindHistogram, "BetweenFrameCreateMeshSceneNodeUs", "Microseconds doing 'create mesh scene node' work", 1 },
+	{ HistBFUpdateSceneNode, StatKindHistogram, "BetweenFrameUpdateSceneNodeUs", "Microseconds doing 'update scene node' work", 1 },
+	{ HistBFOther, StatKindHistogram, "BetweenFrameOtherUs", "Microseconds doing other between frame work", 1 },
+};
+
+// each histogram is these values in the schema
+static const int HistValues = 6;
+static const char* histValueNames[HistValues] = { ".Count", ".Mean", ".P50", ".P90", ".P99", ".Max" };
+
+// Histogram buckets are log-linear like HdrHistogram: values under 8 get their
+// own bucket and each power of two above that is split into 8 so a bucket is
+// within 12.5% of the value. Values up to 2^32 microseconds (an hour).
+static const int HistSubBucketBits = 3;
+static const int HistSubBuckets = 1 << HistSubBucketBits;
+static const int HistBuckets = HistSubBuckets + (32 - HistSubBucketBits) * HistSubBuckets;
+
+static int HistBucket(Ogre::uint64 val) {
+	if (val < HistSubBuckets) return (int)val;
+	if ((val >> 32) != 0) return HistBuckets - 1;
+	int exp = HistSubBucketBits;
+	while ((val >> (exp + 1)) != 0) exp++;
+	int sub = (int)((val >> (exp - HistSubBucketBits)) & (HistSubBuckets - 1));
+	return HistSubBuckets + (exp - HistSubBucketBits) * HistSubBuckets + sub;
+}
+
+// the largest value that goes in the bucket
+static Ogre::uint64 HistBucketTop(int bucket) {
+	if (bucket < HistSubBuckets) return bucket;
+	int shift = (bucket - HistSubBuckets) / HistSubBuckets;
+	int sub = (bucket - HistSubBuckets) % HistSubBuckets;
+	return (((Ogre::uint64)(HistSubBuckets + sub + 1)) << shift) - 1;
+}
+
+// Each thread's counters and histograms. Only written by its thread. Kept
+// after the thread exits so its counts aren't lost.
+typedef struct {
+	Ogre::int64 counters[StatCount];
+	Ogre::uint64 histCount[HistCount];
+	Ogre::uint64 histTotal[HistCount];
+	Ogre::uint64 histMax[HistCount];
+	Ogre::uint32 histBuckets[HistCount][HistBuckets];
+} StatShard;
+
+static bool statsEnabled = false;
+static LGLOCK_ATOMIC_INT statGauges[StatCount];
+
+// Not an LGLock since locking does IncStat
+static boost::mutex& ShardLock() {
+	static boost::mutex shardLock;
+	return shardLock;
+}
+static std::vector<StatShard*> statShards;
+static void KeepStatShard(StatShard*) { }
+static boost::thread_specific_ptr<StatShard> threadStatShard(&KeepStatShard);
+
+static StatShard* ThreadStatShard() {
+	StatShard* shard = threadStatShard.get();
+	if (shard == NULL) {
+		shard = new StatShard;
+		memset(shard, 0, sizeof(StatShard));
+		{
+			boost::mutex::scoped_lock lock(ShardLock());
+			statShards.push_back(shard);
+		}
+		threadStatShard.reset(shard);
+	}
+	return shard;
+}
+
+// ================================================================
+void StatsSetEnabled(bool onOff) {
+	if (onOff && !statsEnabled) {
+		for (int ii = 0; ii < StatCount; ii++) {
+			if (statSchema[ii].code != ii) {
+				LG::Log("LGStats: schema out of order at %d (%s)", ii, statSchema[ii].name);
+			}
+		}
+	}
+	statsEnabled = onOff;
+}
+
+void SetStat(int cod, int val) {
+	if (statsEnabled) {
+		LGLOCK_ATOMIC_SET(statGauges[cod], val);
+	}
+}
+
+// these are done from many threads (every lock does StatLockParity)
+void IncStat(int cod) {
+	if (statsEnabled) {
+		if (statSchema[cod].kind == StatKindCounter) {
+			ThreadStatShard()->counters[cod]++;
+		}
+		else {
+			LGLOCK_ATOMIC_INC(statGauges[cod]);
+		}
+	}
+}
+
+void DecStat(int cod) {
+	if (statsEnabled) {
+		if (statSchema[cod].kind == StatKindCounter) {
+			ThreadStatShard()->counters[cod]--;
+		}
+		else {
+			LGLOCK_ATOMIC_DEC(statGauges[cod]);
+		}
+	}
+}
+
+void StatIn(int cod) {
+	if (statsEnabled) {
+		LGLOCK_ATOMIC_INT old;
+		do {
+			old = LGLOCK_ATOMIC_GET(statGauges[StatInOut]);
+		} while (!LGLOCK_ATOMIC_CAS(statGauges[StatInOut], old, old | cod));
+	}
+}
+
+void StatOut(int cod) {
+	if (statsEnabled) {
+		LGLOCK_ATOMIC_INT old;
+		do {
+			old = LGLOCK_ATOMIC_GET(statGauges[StatInOut]);
+		} while (!LGLOCK_ATOMIC_CAS(statGauges[StatInOut], old, old & ~cod));
+	}
+}
+
+void StatTime(int hist, Ogre::uint64 us) {
+	if (statsEnabled) {
+		StatShard* shard = ThreadStatShard();
+		shard->histCount[hist]++;
+		shard->histTotal[hist] += us;
+		if (us > shard->histMax[hist]) shard->histMax[hist] = us;
+		shard->histBuckets[hist][HistBucket(us)]++;
+	}
+}
+
+// ================================================================
+int StatsSchemaLength() {
+	return StatCount + HistCount * HistValues;
+}
+
+bool StatsSchemaDescribe(int ii, Ogre::String& name, Ogre::String& desc, int& kind, int& divisor) {
+	if (ii < 0 || ii >= StatsSchemaLength()) return false;
+	if (ii < StatCount) {
+		name = statSchema[ii].name;
+		desc = statSchema[ii].description;
+		kind = statSchema[ii].kind;
+		divisor = statSchema[ii].divisor;
+		return true;
+	}
+	int hist = (ii - StatCount) / HistValues;
+	int which = (ii - StatCount) % HistValues;
+	name = Ogre::String(histSchema[hist].name) + histValueNames[which];
+	desc = histSchema[hist].description;
+	if (which == 0) desc += " (count)";
+	else if (which == 1) desc += " (mean)";
+	else if (which == 5) desc += " (max)";
+	else desc += Ogre::String(" (") + (histValueNames[which] + 1) + ")";
+	kind = StatKindHistogram;
+	divisor = 1;
+	return true;
+}
+
+// The shards are read without their threads stopping so the values are a
+// little fuzzy while things are running.
+int StatsCollect(Ogre::int64* values, int count) {
+	int filled = 0;
+	Ogre::int64 counters[StatCount];
+	Ogre::uint64 histCount[HistCount];
+	Ogre::uint64 histTotal[HistCount];
+	Ogre::uint64 histMax[HistCount];
+	std::vector<Ogre::uint64> buckets(HistCount * HistBuckets, 0);
+	memset(counters, 0, sizeof(counters));
+	memset(histCount, 0, sizeof(histCount));
+	memset(histTotal, 0, sizeof(histTotal));
+	memset(histMax, 0, sizeof(histMax));
+	{
+		boost::mutex::scoped_lock lock(ShardLock());
+		std::vector<StatShard*>::iterator si;
+		for (si = statShards.begin(); si != statShards.end(); si++) {
+			StatShard* shard = *si;
+			for (int ii = 0; ii < StatCount; ii++) {
+				counters[ii] += shard->counters[ii];
+			}
+			for (int hh = 0; hh < HistCount; hh++) {
+				histCount[hh] += shard->histCount[hh];
+				histTotal[hh] += shard->histTotal[hh];
+				if (shard->histMax[hh] > histMax[hh]) histMax[hh] = shard->histMax[hh];
+				for (int bb = 0; bb < HistBuckets; bb++) {
+					buckets[hh * HistBuckets + bb] += shard->histBuckets[hh][bb];
+				}
+			}
+		}
+	}
+
+	for (int ii = 0; ii < StatCount && filled < count; ii++) {
+		if (statSchema[ii].kind == StatKindCounter) {
+			values[filled++] = counters[ii];
+		}
+		else {
+			values[filled++] = LGLOCK_ATOMIC_GET(statGauges[ii]);
+		}
+	}
+	for (int hh = 0; hh < HistCount; hh++) {
+		Ogre::uint64 hist[HistValues];
+		hist[0] = histCount[hh];
+		hist[1] = histCount[hh] == 0 ? 0 : histTotal[hh] / histCount[hh];
+		int percents[3] = { 50, 90, 99 };
+		for (int pp = 0; pp < 3; pp++) {
+			Ogre::uint64 want = (histCount[hh] * percents[pp] + 99) / 100;
+			Ogre::uint64 seen = 0;
+			hist[2 + pp] = 0;
+			if (want == 0) continue;
+			for (int bb = 0; bb < HistBuckets; bb++) {
+				seen += buckets[hh * HistBuckets + bb];
+				if (seen >= want) {
+					hist[2 + pp] = std::min(HistBucketTop(bb), histMax[hh]);
+					break;
+				}
+			}
+		}
+		hist[5] = histMax[hh];
+		for (int vv = 0; vv < HistValues && filled < count; vv++) {
+			values[filled++] = (Ogre::int64)hist[vv];
+		}
+	}
+	return filled;
+}
+
+}
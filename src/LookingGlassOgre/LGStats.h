@@ -0,0 +1,79 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LookingGlassOgre.h"
+#include "LGLocking.h"
+
+namespace LG {
+
+// Change this when the stats, histograms or their names change so readers of
+// the schema can tell.
+#define LGStatsSchemaVersion 2
+
+// What a stat is.
+//   counter: only added to (IncStat, DecStat). Each thread adds to its own copy
+//            and the copies are summed when read.
+//   gauge:   set to a value (SetStat) or changed atomically (IncStat, DecStat,
+//            StatIn, StatOut).
+// Histograms are timings (StatTime, StatTimer). Each becomes several values in
+// the schema (count, mean and percentiles).
+typedef enum {
+	StatKindCounter,
+	StatKindGauge,
+	StatKindHistogram
+} StatKind;
+
+// Statistics are only collected after this is turned on
+extern void StatsSetEnabled(bool);
+
+// The schema is a flat list of named values. Returns the number of values.
+extern int StatsSchemaLength();
+// Name and description of one value. 'divisor' is what the value should be
+// divided by for display (FramesPerSecond is kept times 1000). Returns false
+// if there is no such value.
+extern bool StatsSchemaDescribe(int, Ogre::String&, Ogre::String&, int&, int&);
+// Fill the array with the current values in schema order. Returns the number filled.
+extern int StatsCollect(Ogre::int64*, int);
+
+// Time the enclosing block into a histogram:
+//    {
+//        LG::StatTimer timer(LG::HistMeshBuild);
+//        ... build the mesh
+//    }
+class StatTimer {
+public:
+	StatTimer(int hist) {
+		m_hist = hist;
+		m_start = LGLOCK_MICROSECONDS();
+	}
+	~StatTimer() {
+		LG::StatTime(m_hist, LGLOCK_MICROSECONDS() - m_start);
+	}
+private:
+	int m_hist;
+	Ogre::uint64 m_start;
+};
+
+}
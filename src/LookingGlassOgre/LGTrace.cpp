@@ -0,0 +1,255 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "LGOCommon.h"
+#include "LookingGlassOgre.h"
+#include "LGTrace.h"
+#include "boost/thread/tss.hpp"
+
+namespace LG {
+
+bool traceEnabled = false;
+
+// events kept for each thread. A power of two.
+#define TraceRingSize 8192
+#define TraceNameLength 32
+
+typedef struct {
+	LGLOCK_ATOMIC_INT seq;		// odd while the event is being written
+	char name[TraceNameLength];
+	Ogre::uint64 start;
+	Ogre::uint64 duration;
+} TraceEvent;
+
+// The events are only allocated when the thread first records so threads
+// cost little when tracing is off.
+typedef struct {
+	int tid;
+	char threadName[TraceNameLength];
+	LGLOCK_ATOMIC_INT head;		// number of events ever written
+	TraceEvent* events;			// TraceRingSize of them
+} TraceRing;
+
+// What a dump writes: the events copied out of one ring
+typedef struct {
+	int tid;
+	char threadName[TraceNameLength];
+	std::vector<TraceEvent> events;
+} TraceRingCopy;
+typedef std::list<TraceRingCopy> TraceSnapshot;
+
+// Not an LGLock so it isn't in the lock profile. Protects the list of rings
+// and keeps two dumps from happening at once.
+static boost::mutex& TraceRingsLock() {
+	static boost::mutex ringsLock;
+	return ringsLock;
+}
+static std::vector<TraceRing*> traceRings;
+// rings are kept after their thread exits so its events can still be dumped
+static void KeepTraceRing(TraceRing*) { }
+static boost::thread_specific_ptr<TraceRing> threadTraceRing(&KeepTraceRing);
+
+static Ogre::uint64 traceStartUs = 0;
+static Ogre::uint64 traceLongFrameUs = 0;
+static Ogre::uint64 traceLastAutoDumpUs = 0;
+static int traceDumpCount = 0;
+static Ogre::String traceFilename;
+// long frame traces are written on this thread so the frame isn't held up more
+static LGLOCK_THREAD* traceWriter = NULL;
+
+// don't write a long frame trace more often than this
+static const Ogre::uint64 TraceAutoDumpIntervalUs = 10000000;
+
+static TraceRing* ThreadTraceRing() {
+	TraceRing* ring = threadTraceRing.get();
+	if (ring == NULL) {
+		ring = new TraceRing;
+		memset(ring, 0, sizeof(TraceRing));
+		{
+			boost::mutex::scoped_lock lock(TraceRingsLock());
+			ring->tid = (int)traceRings.size() + 1;
+			sprintf(ring->threadName, "thread %d", ring->tid);
+			traceRings.push_back(ring);
+		}
+		threadTraceRing.reset(ring);
+	}
+	return ring;
+}
+
+void TraceInitialize() {
+	traceFilename = LG::GetParameter("Renderer.Ogre.Trace.Filename");
+	if (traceFilename.length() == 0) traceFilename = "LookingGlassTrace";
+	traceLongFrameUs = (Ogre::uint64)LG::GetParameterInt("Renderer.Ogre.Trace.LongFrameMs") * 1000;
+	traceStartUs = LGLOCK_MICROSECONDS();
+	traceEnabled = LG::GetParameterBool("Renderer.Ogre.Trace.Enable");
+	if (traceEnabled) {
+		LG::Log("LGTrace: tracing enabled. Long frame = %dms", (int)(traceLongFrameUs / 1000));
+	}
+}
+
+void TraceThreadName(const char* name) {
+	TraceRing* ring = ThreadTraceRing();
+	strncpy(ring->threadName, name, TraceNameLength - 1);
+	ring->threadName[TraceNameLength - 1] = '\0';
+}
+
+void TraceRecord(const char* name, Ogre::uint64 start, Ogre::uint64 duration) {
+	TraceRing* ring = ThreadTraceRing();
+	if (ring->events == NULL) {
+		// set before head first moves so a dump that sees events sees the array
+		TraceEvent* events = new TraceEvent[TraceRingSize];
+		memset(events, 0, sizeof(TraceEvent) * TraceRingSize);
+		ring->events = events;
+	}
+	TraceEvent& ev = ring->events[ring->head & (TraceRingSize - 1)];
+	LGLOCK_ATOMIC_INC(ev.seq);
+	strncpy(ev.name, name, TraceNameLength - 1);
+	ev.name[TraceNameLength - 1] = '\0';
+	ev.start = start;
+	ev.duration = duration;
+	LGLOCK_ATOMIC_INC(ev.seq);
+	LGLOCK_ATOMIC_INC(ring->head);
+}
+
+// names are our own identifiers but be safe about what goes into the JSON
+static void TraceWriteString(FILE* out, const char* str) {
+	fputc('"', out);
+	for (const char* cc = str; *cc != '\0'; cc++) {
+		if (*cc == '"' || *cc == '\\') fputc('\\', out);
+		if ((unsigned char)*cc >= ' ') fputc(*cc, out);
+	}
+	fputc('"', out);
+}
+
+// The threads keep recording while this reads their rings. An event that is
+// being written (odd sequence) or is rewritten while being copied is skipped.
+// Called with the rings lock held.
+static void TraceCopyRings(TraceSnapshot* snap) {
+	std::vector<TraceRing*>::iterator ri;
+	for (ri = traceRings.begin(); ri != traceRings.end(); ri++) {
+		TraceRing* ring = *ri;
+		snap->push_back(TraceRingCopy());
+		TraceRingCopy& copied = snap->back();
+		copied.tid = ring->tid;
+		memcpy(copied.threadName, ring->threadName, TraceNameLength);
+		copied.threadName[TraceNameLength - 1] = '\0';
+		int head = LGLOCK_ATOMIC_GET(ring->head);
+		if (head == 0 || ring->events == NULL) continue;
+		int first = head > TraceRingSize ? head - TraceRingSize : 0;
+		copied.events.reserve(head - first);
+		for (int ii = first; ii < head; ii++) {
+			TraceEvent& ev = ring->events[ii & (TraceRingSize - 1)];
+			int seq = LGLOCK_ATOMIC_GET(ev.seq);
+			if ((seq & 1) != 0) continue;
+			TraceEvent copy = ev;
+			if (LGLOCK_ATOMIC_GET(ev.seq) != seq) continue;
+			copy.name[TraceNameLength - 1] = '\0';
+			copied.events.push_back(copy);
+		}
+	}
+}
+
+static bool TraceWrite(const TraceSnapshot& snap, const Ogre::String& filename, const Ogre::String& reason) {
+	FILE* out = fopen(filename.c_str(), "w");
+	if (out == NULL) {
+		LG::Log("LGTrace: could not open trace file %s", filename.c_str());
+		return false;
+	}
+	int events = 0;
+	fprintf(out, "{\"traceEvents\":[\n");
+	fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"LookingGlassOgre\"}}");
+	TraceSnapshot::const_iterator ri;
+	for (ri = snap.begin(); ri != snap.end(); ri++) {
+		fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", ri->tid);
+		TraceWriteString(out, ri->threadName);
+		fprintf(out, "}}");
+		std::vector<TraceEvent>::const_iterator ei;
+		for (ei = ri->events.begin(); ei != ri->events.end(); ei++) {
+			fprintf(out, ",\n{\"name\":");
+			TraceWriteString(out, ei->name);
+			fprintf(out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%llu,\"dur\":%llu}",
+						ri->tid, 
+						(unsigned long long)(ei->start > traceStartUs ? ei->start - traceStartUs : 0),
+						(unsigned long long)ei->duration);
+			events++;
+		}
+	}
+	fprintf(out, "\n],\"otherData\":{\"reason\":");
+	TraceWriteString(out, reason.c_str());
+	fprintf(out, "}}\n");
+	fclose(out);
+	LG::Log("LGTrace: wrote %d events to %s (%s)", events, filename.c_str(), reason.c_str());
+	return true;
+}
+
+bool TraceDump(const char* reason) {
+	TraceSnapshot snap;
+	Ogre::String filename;
+	{
+		boost::mutex::scoped_lock lock(TraceRingsLock());
+		filename = traceFilename + "-" + Ogre::StringConverter::toString(++traceDumpCount) + ".json";
+		TraceCopyRings(&snap);
+	}
+	return TraceWrite(snap, filename, reason);
+}
+
+static void TraceWriteThreadRoutine(TraceSnapshot* snap, Ogre::String filename, Ogre::String reason) {
+	TraceWrite(*snap, filename, reason);
+	delete snap;
+}
+
+// A frame that takes too long writes the trace so the cause can be seen
+void TraceFrameTime(Ogre::uint64 frameUs) {
+	if (!traceEnabled || traceLongFrameUs == 0 || frameUs < traceLongFrameUs) return;
+	Ogre::uint64 now = LGLOCK_MICROSECONDS();
+	if (traceLastAutoDumpUs != 0 && (now - traceLastAutoDumpUs) < TraceAutoDumpIntervalUs) return;
+	traceLastAutoDumpUs = now;
+	char reason[64];
+	sprintf(reason, "long frame %dms", (int)(frameUs / 1000));
+	// the last one had ten seconds to finish
+	if (traceWriter != NULL) {
+		traceWriter->join();
+		delete traceWriter;
+		traceWriter = NULL;
+	}
+	// only the copy happens on the frame thread
+	TraceSnapshot* snap = new TraceSnapshot();
+	Ogre::String filename;
+	{
+		boost::mutex::scoped_lock lock(TraceRingsLock());
+		filename = traceFilename + "-" + Ogre::StringConverter::toString(++traceDumpCount) + ".json";
+		TraceCopyRings(snap);
+	}
+	traceWriter = new LGLOCK_THREAD(&TraceWriteThreadRoutine, snap, filename, Ogre::String(reason));
+}
+
+// wait for a long frame trace that's still being written
+void TraceShutdown() {
+	if (traceWriter != NULL) {
+		traceWriter->join();
+		delete traceWriter;
+		traceWriter = NULL;
+	}
+}
+
+}
@@ -0,0 +1,76 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LGLocking.h"
+
+namespace LG {
+
+// Timeline tracing of the frame phases.
+// Scoped markers record when they started and how long they took into a ring
+// buffer for each thread. Only the thread writes its ring so recording doesn't
+// lock. When asked (DumpTrace) or when a frame takes longer than
+// Renderer.Ogre.Trace.LongFrameMs, the rings are written to a file as Chrome
+// trace-event JSON which can be opened with chrome://tracing or Perfetto.
+// A long frame only copies the rings; the file is written on another thread.
+// Use:
+//    bool SomeTracker::frameEnded(const Ogre::FrameEvent& evt) {
+//        LGTRACE_SCOPE("SomeTracker");
+//        ...
+//    }
+extern bool traceEnabled;
+
+extern void TraceInitialize();
+// name the calling thread in the trace
+extern void TraceThreadName(const char*);
+// add an event to the calling thread's ring. The name is copied.
+extern void TraceRecord(const char*, Ogre::uint64, Ogre::uint64);
+// write the rings to a new trace file. Returns false if not written.
+extern bool TraceDump(const char*);
+// called each frame with the length of the last frame
+extern void TraceFrameTime(Ogre::uint64);
+extern void TraceShutdown();
+
+class TraceScope {
+public:
+	TraceScope(const char* name) {
+		m_name = name;
+		m_start = traceEnabled ? LGLOCK_MICROSECONDS() : 0;
+	}
+	~TraceScope() {
+		if (m_start != 0) {
+			TraceRecord(m_name, m_start, LGLOCK_MICROSECONDS() - m_start);
+		}
+	}
+private:
+	const char* m_name;
+	Ogre::uint64 m_start;
+};
+
+}
+
+#define LGTRACE_CONCAT2(a, b) a##b
+#define LGTRACE_CONCAT(a, b) LGTRACE_CONCAT2(a, b)
+#define LGTRACE_SCOPE(name) LG::TraceScope LGTRACE_CONCAT(lgTraceScope, __LINE__)(name)
+#define LGTRACE_THREAD(name) LG::TraceThreadName(name)
@@ -28,7 +28,13 @@
 #include "LookingGlassOgre.h"
 #include "RegionTracker.h"
 #include "RendererOgre.h"
+#include "LGStats.h"
+#include "LGTrace.h"
+#include "LGParams.h"
+#include "LGReplay.h"
 #include "ProcessBetweenFrame.h"
+#include "AnimTracker.h"
+#include "AvatarTracker.h"
 
 // The switch yard from the managed to unmanaged.
 // All of the external entry points are declared in this module.
@@ -44,8 +50,6 @@ UserIOCallback* userIOCallback;
 RequestResourceCallback* requestResourceCallback;
 BetweenFramesCallback* betweenFramesCallback;
 
-int* statsBlock;
-
 // ==========================================================
 extern "C" DLLExport void InitializeOgre() {
 	LG::RendererOgre::Instance()->initialize();
@@ -68,6 +72,11 @@ extern "C" DLLExport bool RenderOneFrame(bool pump, int length) {
 extern "C" DLLExport void SetFetchParameterCallback(FetchParameterCallback* fpc) {
 	fetchParameterCallback = fpc;
 }
+// Push the value of a parameter. Called for all of them before InitializeOgre
+// and again for each one that changes.
+extern "C" DLLExport void UpdateParameter(const char* paramName, const char* paramValue) {
+	LG::ParamUpdate(paramName, paramValue);
+}
 extern "C" DLLExport void SetDebugLogCallback(DebugLogCallback* dlc) {
 	debugLogCallback = dlc;
 }
@@ -83,14 +92,37 @@ extern "C" DLLExport void SetRequestResourceCallback(RequestResourceCallback* rr
 extern "C" DLLExport void SetBetweenFramesCallback(BetweenFramesCallback* bf) {
 	betweenFramesCallback = bf;
 }
-extern "C" DLLExport void SetStatsBlock(int* sb) {
-	statsBlock = sb;
+// statistics are collected once enabled and read through the schema
+extern "C" DLLExport void EnableStats(bool onOff) {
+	LG::StatsSetEnabled(onOff);
+}
+extern "C" DLLExport int StatsSchemaVersion() {
+	return LGStatsSchemaVersion;
+}
+extern "C" DLLExport int StatsSchemaSize() {
+	return LG::StatsSchemaLength();
+}
+// Returns the divisor to display the value with or zero if there is no such entry
+extern "C" DLLExport int StatsSchemaEntry(int index, char* name, int nameLen, char* desc, int descLen) {
+	Ogre::String entryName, entryDesc;
+	int kind, divisor;
+	if (!LG::StatsSchemaDescribe(index, entryName, entryDesc, kind, divisor)) return 0;
+	strncpy(name, entryName.c_str(), nameLen - 1);
+	name[nameLen - 1] = '\0';
+	strncpy(desc, entryDesc.c_str(), descLen - 1);
+	desc[descLen - 1] = '\0';
+	return divisor;
+}
+extern "C" DLLExport int StatsSnapshot(Ogre::int64* values, int count) {
+	return LG::StatsCollect(values, count);
 }
 // ==========================================================
 // update the camera position with a position and a direction
 extern "C" DLLExport void UpdateCameraBF(double px, double py, double pz, 
 									   float dw, float dx, float dy, float dz,
 									   float nearClip, float farClip, float aspect) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayUpdateCamera).Double(px).Double(py).Double(pz)
+			.Float(dw).Float(dx).Float(dy).Float(dz).Float(nearClip).Float(farClip).Float(aspect);
 	LG::ProcessBetweenFrame::Instance()->UpdateCamera(px, py, pz, dw, dx, dy, dz, nearClip, farClip, aspect);
 }
 extern "C" DLLExport bool AttachCamera(const char* parentNode, float offsetX, float offsetY, float offsetZ,
@@ -98,10 +130,14 @@ extern "C" DLLExport bool AttachCamera(const char* parentNode, float offsetX, fl
    return LG::RendererOgre::Instance()->m_camera->AttachCamera(parentNode, offsetX, offsetY, offsetZ, ow, ox, oy, oz);
 }
 extern "C" DLLExport void RefreshResourceBF(float pri, int rType, char* resourceName) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayRefreshResource).Float(pri).Int(rType).Str(resourceName);
 	LG::ProcessBetweenFrame::Instance()->RefreshResource(pri, resourceName, rType);
 }
 extern "C" DLLExport void CreateMeshResourceBF(float pri, const char* meshName, char* contextSceneNode, 
 											   const int* faceCounts, const float* faceVertices) {
+	// the first element of each array is its length
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayCreateMeshResource).Float(pri).Str(meshName).Str(contextSceneNode)
+			.Ints(faceCounts, faceCounts[0]).Floats(faceVertices, (int)faceVertices[0]);
 	LG::ProcessBetweenFrame::Instance()->CreateMeshResource(pri, meshName, contextSceneNode, faceCounts, faceVertices);
 }
 extern "C" DLLExport void CreateMaterialResource(const char* matName, char* textureName,
@@ -116,6 +152,8 @@ extern "C" DLLExport void CreateMaterialResource2(const char* matName, char* tex
 }
 extern "C" DLLExport void CreateMaterialResource2BF(float pri, const char* matName, char* textureName, 
 												  const float* parms) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayCreateMaterialResource2).Float(pri).Str(matName).Str(textureName)
+			.Floats(parms, LG::OLMaterialTracker::CreateMaterialSize);
 	  LG::ProcessBetweenFrame::Instance()->CreateMaterialResource2(pri, matName, textureName, parms);
 }
 
@@ -127,6 +165,12 @@ extern "C" DLLExport void CreateMaterialResource7BF(float prio, char* uniq,
 			char* textureName4, char* textureName5, char* textureName6, 
 			char* textureName7,
 			const float* parms) {
+	// parms[0] is the size of one material's parameters
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayCreateMaterialResource7).Float(prio).Str(uniq)
+			.Str(matName1).Str(matName2).Str(matName3).Str(matName4).Str(matName5).Str(matName6).Str(matName7)
+			.Str(textureName1).Str(textureName2).Str(textureName3).Str(textureName4)
+			.Str(textureName5).Str(textureName6).Str(textureName7)
+			.Floats(parms, ((int)parms[0]) * 7 + 1);
 	LG::ProcessBetweenFrame::Instance()->CreateMaterialResource7(prio, uniq,
 						matName1, matName2, matName3, 
 						matName4, matName5, matName6, matName7,
@@ -143,18 +187,24 @@ extern "C" DLLExport void DiagnosticAction(int flag) {
 extern "C" DLLExport void AddRegionBF(float prio, const char* regionNodeName, 
 		 double globalX, double globalY, double globalZ,
 		 const float sizeX, const float sizeY, const float waterHeight) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayAddRegion).Float(prio).Str(regionNodeName)
+			.Double(globalX).Double(globalY).Double(globalZ).Float(sizeX).Float(sizeY).Float(waterHeight);
 	 LG::ProcessBetweenFrame::Instance()->AddRegion(prio, regionNodeName, 
 		 globalX, globalY, globalZ, sizeX, sizeY, waterHeight);
 }
 extern "C" DLLExport void UpdateTerrainBF(float prio, const char* regionName, 
 											const int width, const int length, const float* heights) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayUpdateTerrain).Float(prio).Str(regionName)
+			.Int(width).Int(length).Floats(heights, width * length);
 	 LG::ProcessBetweenFrame::Instance()->UpdateTerrain(prio, regionName, width, length, heights);
 }
 extern "C" DLLExport void SetFocusRegionBF(const char* regionName) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplaySetFocusRegion).Str(regionName);
 	// LG::RegionTracker::Instance()->SetFocusRegion(regionName);
 	 LG::ProcessBetweenFrame::Instance()->SetFocusRegion(0.0, regionName);
 }
 extern "C" DLLExport void SetRegionDetailBF(const char* regionName, const RegionRezCode LODLevel) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplaySetRegionDetail).Str(regionName).Int((int)LODLevel);
 	// LG::RegionTracker::Instance()->SetFocusRegion(regionName);
 	 LG::ProcessBetweenFrame::Instance()->SetRegionDetail(0.0, regionName, LODLevel);
 }
@@ -187,6 +237,12 @@ extern "C" DLLExport bool CreateMeshSceneNodeBF(float pri,
 			return false;	// cannot create it now
 		}
 	}
+	// only the calls that were queued. The scene manager is the only one there is.
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayCreateMeshSceneNode).Float(pri)
+			.Str(sceneNodeName).Str(parentNodeName).Str(entityName).Str(meshName)
+			.Bool(inheritScale).Bool(inheritOrientation)
+			.Float(px).Float(py).Float(pz).Float(sx).Float(sy).Float(sz)
+			.Float(ow).Float(ox).Float(oy).Float(oz);
 	LG::ProcessBetweenFrame::Instance()->CreateMeshSceneNode(pri, sceneMgr, 
 			sceneNodeName, parentNode, entityName, meshName,
 			inheritScale, inheritOrientation,
@@ -211,6 +267,10 @@ extern "C" DLLExport void UpdateSceneNodeBF(float pri,
 					bool setPosition, float px, float py, float pz, float pd,
 					bool setScale, float sx, float sy, float sz, float sd,
 					bool setRotation, float ow, float ox, float oy, float oz, float od) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayUpdateSceneNode).Float(pri).Str(nodeName)
+			.Bool(setPosition).Float(px).Float(py).Float(pz).Float(pd)
+			.Bool(setScale).Float(sx).Float(sy).Float(sz).Float(sd)
+			.Bool(setRotation).Float(ow).Float(ox).Float(oy).Float(oz).Float(od);
 	LG::ProcessBetweenFrame::Instance()->UpdateSceneNode(pri, nodeName,
 					setPosition, px, py, pz, pd,
 					setScale, sx, sy, sz, sd,
@@ -218,96 +278,97 @@ extern "C" DLLExport void UpdateSceneNodeBF(float pri,
 	return;
 }
 extern "C" DLLExport void RemoveSceneNodeBF(float prio, char* sceneNodeName) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayRemoveSceneNode).Float(prio).Str(sceneNodeName);
 	LG::ProcessBetweenFrame::Instance()->RemoveSceneNode(prio, sceneNodeName);
 }
 // ================================================================
 extern "C" DLLExport void UpdateAnimationBF(float prio, char* sceneNodeName, float X, float Y, float Z, float rate) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayUpdateAnimation).Float(prio).Str(sceneNodeName)
+			.Float(X).Float(Y).Float(Z).Float(rate);
 	LG::ProcessBetweenFrame::Instance()->UpdateAnimation(prio, sceneNodeName, X, Y, Z, rate);
 }
-
-// ================================================================
-Ogre::Root* GetOgreRoot() {
-	return LG::RendererOgre::Instance()->m_root;
-}
-
-// ================================================================
-void SetStat(int cod, int val) {
-	if (LG::statsBlock != NULL) {
-		LG::statsBlock[cod] = val;
+// Dead reckoning update. Not queued for between frames since it doesn't touch the scene.
+extern "C" DLLExport void UpdateMotion(char* sceneNodeName,
+					float px, float py, float pz, float vx, float vy, float vz,
+					float ax, float ay, float az, float ow, float ox, float oy, float oz,
+					float wx, float wy, float wz, double timestamp) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplayUpdateMotion).Str(sceneNodeName)
+			.Float(px).Float(py).Float(pz).Float(vx).Float(vy).Float(vz).Float(ax).Float(ay).Float(az)
+			.Float(ow).Float(ox).Float(oy).Float(oz).Float(wx).Float(wy).Float(wz).Double(timestamp);
+	LG::AnimTracker::Instance()->UpdateMotion(Ogre::String(sceneNodeName), 
+					Ogre::Vector3(px, py, pz), Ogre::Vector3(vx, vy, vz), Ogre::Vector3(ax, ay, az),
+					Ogre::Quaternion(ow, ox, oy, oz), Ogre::Vector3(wx, wy, wz), timestamp);
+}
+// Start, change or (weight of zero) stop a skeletal animation. Applied at the next frame.
+extern "C" DLLExport void SetAvatarAnimation(char* entityName, char* animName,
+					float weight, float rate, int loop) {
+	if (LG::replayRecording) LG::ReplayRecord(LG::ReplaySetAvatarAnimation).Str(entityName).Str(animName)
+			.Float(weight).Float(rate).Int(loop);
+	LG::AvatarTracker::Instance()->SetAnimation(Ogre::String(entityName), Ogre::String(animName),
+					weight, rate, loop != 0);
+}
+
+// Synthetic load on the between frame queue. See StatBetweenFrameEnqueueP99Us.
+extern "C" DLLExport void BetweenFrameLoadTest(int threads, int items) {
+	LG::ProcessBetweenFrame::Instance()->LoadTest(threads, items);
+}
+
+// Write the frame phase trace to a new file. Returns false if tracing is off
+// or the file couldn't be written.
+extern "C" DLLExport bool DumpTrace() {
+	if (!LG::traceEnabled) return false;
+	return LG::TraceDump("requested");
+}
+
+// Log the lock profile and copy it into 'buff' (if not NULL). Returns the length
+// of the whole profile which can be more than 'buffLen'.
+extern "C" DLLExport int DumpLockProfile(char* buff, int buffLen, bool reset) {
+	Ogre::String profile = LGLOCK_PROFILE_SNAPSHOT(reset);
+	// a line at a time since the whole thing can be longer than a log message
+	Ogre::StringVector lines = Ogre::StringUtil::split(profile, "\n");
+	for (Ogre::StringVector::iterator li = lines.begin(); li != lines.end(); li++) {
+		LG::Log("%s", li->c_str());
 	}
-}
-
-void IncStat(int cod) {
-	if (LG::statsBlock != NULL) {
-		LG::statsBlock[cod]++;
+	if (buff != NULL && buffLen > 0) {
+		strncpy(buff, profile.c_str(), buffLen - 1);
+		buff[buffLen - 1] = '\0';
 	}
+	return (int)profile.length();
 }
 
-void DecStat(int cod) {
-	if (LG::statsBlock != NULL) {
-		LG::statsBlock[cod]--;
-	}
-}
-
-void StatIn(int cod) {
-	if (LG::statsBlock != NULL) {
-		LG::statsBlock[StatInOut] |= cod;
-	}
-}
-
-void StatOut(int cod) {
-	if (LG::statsBlock != NULL) {
-		LG::statsBlock[StatInOut] &= ~cod;
-	}
+// ================================================================
+Ogre::Root* GetOgreRoot() {
+	return LG::RendererOgre::Instance()->m_root;
 }
 
-// Routine which calls back into the managed world to fetch a string/value configuration
-// parameter.
+// Configuration parameters come from the native parameter store (LGParams)
+// which is filled by the managed code. These look up the name each call so code
+// that reads a parameter often should keep an LGParam.
 const char* GetParameter(const char* paramName) {
-	if (LG::fetchParameterCallback != NULL) {
-		return (*LG::fetchParameterCallback)(paramName);
-	}
-	else {
-		LG::Log("DEBUG: LookingGlassOrge: could not get parameter %s", paramName);
-	}
-	return NULL;
+	return ParamLookup(ParamIntern(paramName))->Str.c_str();
 }
 
 const int GetParameterInt(const char* paramName) {
-	int inum = 0;
-	if (sscanf(GetParameter(paramName), "%d", &inum)) {
-		return inum;
-	}
-	return 0;
+	return ParamLookup(ParamIntern(paramName))->Int;
 }
 
 const bool GetParameterBool(const char* paramName) {
-	return isTrue(GetParameter(paramName));
+	return ParamLookup(ParamIntern(paramName))->Bool;
 }
 
 const float GetParameterFloat(const char* paramName) {
-	float fnum = 0;
-	if (sscanf(GetParameter(paramName), "%f", &fnum)) {
-		return fnum;
-	}
-	return 0.0;
+	return ParamLookup(ParamIntern(paramName))->Float;
 }
 
 const Ogre::ColourValue GetParameterColor(const char* paramName) {
-	float rnum;
-	float gnum;
-	float bnum;
-	if (sscanf(GetParameter(paramName), "<%f,%f,%f>", &rnum, &gnum, &bnum)) {
-		return Ogre::ColourValue(rnum, gnum, bnum);
-	}
-	return Ogre::ColourValue::Red;
+	return ParamLookup(ParamIntern(paramName))->Color;
 }
 
 // Print out a message of the pointer thing is null. At least the log will know
 // of the problem
 void AssertNonNull(void* thing, const char* msg) {
 	if (thing == NULL) {
-		LG::Log(msg);
+		LG::Log("%s", msg);
 	}
 }
 
@@ -318,18 +379,6 @@ const bool isTrue(const char* txt) {
 }
 
 
-// Call back into the managed world to output a log message with formatting
-void Log(const char* msg, ...) {
-	char buff[2048];
-	if (LG::debugLogCallback != NULL) {
-		va_list args;
-		va_start(args, msg);
-		vsprintf(buff, msg, args);
-		va_end(args);
-		(*LG::debugLogCallback)(buff);
-	}
-}
-
 // call out to the main program and make sure we should keep running
 const bool checkKeepRunning() {
 	if (LG::checkKeepRunningCallback != NULL) {
@@ -52,40 +52,76 @@ static const int ResourceTypeTexture = 2;	// Texture
 static const int ResourceTypeMaterial = 3;	// Material
 static const int ResourceTypeTransparentTexture = 4;	// A texture with some transparancy
 
-// offsets into statistics block
-static const int StatMaterialUpdatesRemaining = 0;
-static const int StatBetweenFrameWorkItems = 1;
-static const int StatVisibleToVisible = 2;
-static const int StatInvisibleToVisible = 3;
-static const int StatVisibleToInvisible = 4;
-static const int StatInvisibleToInvisible = 5;
-static const int StatCullMeshesLoaded = 6;
-static const int StatCullTexturesLoaded = 7;
-static const int StatCullMeshesUnloaded = 13;
-static const int StatCullTexturesUnloaded = 14;
-static const int StatCullMeshesQueuedToLoad = 15;
-static const int StatBetweenFrameRefreshResource = 8;
-static const int StatBetweenFrameRemoveSceneNode = 30;
-static const int StatBetweenFrameCreateMaterialResource = 9;
-static const int StatBetweenFrameCreateMeshResource = 10;
-static const int StatBetweenFrameCreateMeshSceneNode = 11;
-static const int StatBetweenFrameAddLoadedMesh = 29;
-static const int StatBetweenFrameUpdateSceneNode = 12;
-static const int StatBetweenFrameTotalProcessed = 16;
-static const int StatBetweenFrameUnknownProcess = 17;
-static const int StatBetweenFrameDiscardedDups = 21;
-static const int StatTotalFrames = 18;
-static const int StatFramesPerSecond = 19;
-static const int StatLastFrameMs = 20;
-static const int StatProcessAnyTimeDiscardedDups = 22;
-static const int StatProcessAnyTimeWorkItems = 23;
-static const int StatProcessAnyTimeTotalProcessed = 24;
-static const int StatMeshTrackerLoadQueued = 25;
-static const int StatMeshTrackerUnloadQueued = 26;
-static const int StatMeshTrackerSerializedQueued = 27;
-static const int StatMeshTrackerTotalQueued = 28;
-static const int StatLockParity = 31;
-static const int StatInOut = 32;
+// Statistics. The names, kinds and descriptions are in the schema table in
+// LGStats.cpp which must be kept in the same order. The managed side reads the
+// schema so it doesn't need to know these numbers. Change LGStatsSchemaVersion
+// when the list changes.
+typedef enum {
+	// frames
+	StatTotalFrames,
+	StatFramesPerSecond,
+	StatLastFrameMs,
+	// visibility
+	StatVisibleToVisible,
+	StatInvisibleToVisible,
+	StatVisibleToInvisible,
+	StatInvisibleToInvisible,
+	StatCullMeshesLoaded,
+	StatCullTexturesLoaded,
+	StatCullMeshesUnloaded,
+	StatCullTexturesUnloaded,
+	StatCullMeshesQueuedToLoad,
+	// between frame work
+	StatBetweenFrameWorkItems,
+	StatBetweenFrameRefreshResource,
+	StatBetweenFrameRemoveSceneNode,
+	StatBetweenFrameCreateMaterialResource,
+	StatBetweenFrameCreateMeshResource,
+	StatBetweenFrameCreateMeshSceneNode,
+	StatBetweenFrameAddLoadedMesh,
+	StatBetweenFrameUpdateSceneNode,
+	StatBetweenFrameTotalProcessed,
+	StatBetweenFrameUnknownProcess,
+	StatBetweenFrameDiscardedDups,
+	StatBetweenFrameEnqueueP99Us,
+	StatBetweenFrameOverflows,
+	// any time work
+	StatProcessAnyTimeWorkItems,
+	StatProcessAnyTimeTotalProcessed,
+	StatProcessAnyTimeDiscardedDups,
+	// materials and meshes
+	StatMaterialUpdatesRemaining,
+	StatMeshTrackerLoadQueued,
+	StatMeshTrackerUnloadQueued,
+	StatMeshTrackerSerializedQueued,
+	StatMeshTrackerTotalQueued,
+	// animation
+	StatAnimTracks,
+	StatAnimEvaluateUs,
+	StatAnimApplyUs,
+	StatAvatars,
+	StatAvatarPools,
+	// debugging
+	StatLockParity,
+	StatInOut,
+	StatCount
+} StatCode;
+
+// Timing histograms (microseconds)
+typedef enum {
+	HistFrameTime,
+	HistVisibilityPass,
+	HistMeshBuild,
+	HistMaterialBuild,
+	HistBFRefreshResource,
+	HistBFRemoveSceneNode,
+	HistBFCreateMaterialResource,
+	HistBFCreateMeshResource,
+	HistBFCreateMeshSceneNode,
+	HistBFUpdateSceneNode,
+	HistBFOther,
+	HistCount
+} StatHistCode;
 
 static const int InOutNone					= 0x00000000;
 static const int InOutMaterialTracker		= 0x00000001;
@@ -123,10 +159,12 @@ extern void IncStat(int);
 extern void DecStat(int);
 extern void StatIn(int);
 extern void StatOut(int);
+extern void StatTime(int, Ogre::uint64);
 
 extern void AssertNonNull(void*, const char*);
 extern const bool isTrue(const char*);
 extern void Log(const char*, ...);
+extern void LogDetail(const char*, ...);
 extern const char* GetParameter(const char*);
 extern const int GetParameterInt(const char*);
 extern const bool GetParameterBool(const char*);
@@ -25,9 +25,17 @@
 #include "OgreFileSystem.h"
 #include "LookingGlassOgre.h"
 #include "RendererOgre.h"
+#include "OLPackFile.h"
 
 namespace LG {
 
+OLArchive::KnownFileHashMap OLArchive::m_knownFiles;
+OLArchive::MissingFileHashMap OLArchive::m_missingFiles;
+LGLOCK_MUTEX OLArchive::m_existenceLock = NULL;
+Ogre::Timer* OLArchive::m_existenceTimeKeeper = NULL;
+unsigned long OLArchive::m_missingRecheckMS = 10000;
+OLArchive* OLArchive::m_cacheArchive = NULL;
+
 OLArchive::OLArchive( const Ogre::String& name, const Ogre::String& archType )
 			: Ogre::Archive(name, archType) {
 	LG::Log("OLArchive creation: n=%s, t=%s", name.c_str(), archType.c_str());
@@ -59,10 +67,112 @@ void OLArchive::load() {
 	LG::Log("OLArchive::load(): loading FSArchive");
 	m_FSArchive->load();
 	LG::Log("OLArchive::load(): completed loading FSArchive");
+
+	// read the default shapes once. Every missing mesh or texture gets one of these.
+	try {
+		m_defaultMeshData = Ogre::MemoryDataStreamPtr(OGRE_NEW Ogre::MemoryDataStream(
+						m_defaultMeshFilename, m_FSArchive->open(m_defaultMeshFilename)));
+	}
+	catch (...) {
+		LG::Log("OLArchive::load(): could not read default mesh %s", m_defaultMeshFilename.c_str());
+	}
+	try {
+		m_defaultTextureData = Ogre::MemoryDataStreamPtr(OGRE_NEW Ogre::MemoryDataStream(
+						m_defaultTextureFilename, m_FSArchive->open(m_defaultTextureFilename)));
+	}
+	catch (...) {
+		LG::Log("OLArchive::load(): could not read default texture %s", m_defaultTextureFilename.c_str());
+	}
+
+	// one pass over the cache directory so we know what's there without asking again
+	if (m_existenceLock == NULL) {
+		m_existenceLock = LGLOCK_ALLOCATE_MUTEX("OLArchiveExistence");
+		m_existenceTimeKeeper = new Ogre::Timer();
+	}
+	m_missingRecheckMS = (unsigned long)LG::GetParameterInt("Renderer.Ogre.CacheMissingRecheckMS");
+	Ogre::StringVectorPtr files = m_FSArchive->list(true, false);
+	LGLOCK_ALOCK existenceLock;
+	existenceLock.Lock(m_existenceLock);
+	for (Ogre::StringVector::iterator ii = files->begin(); ii != files->end(); ii++) {
+		m_knownFiles[*ii] = true;
+	}
+	m_missingFiles.clear();
+	existenceLock.Unlock();
+	LG::Log("OLArchive::load(): found %d files in cache", (int)files->size());
+	m_cacheArchive = this;
+}
+
+// Is the file in the cache directory? Files we know about are found without touching
+// the filesystem. A file we don't know about is looked for and, if it's not there,
+// remembered as missing. It's only looked for again if it's been a while since the
+// last look (the managed code writes textures and such into the cache behind our back).
+bool OLArchive::FileExists(const Ogre::String& filename) const {
+	if (m_existenceLock == NULL) {
+		return m_FSArchive->exists(filename);
+	}
+	LGLOCK_ALOCK existenceLock;
+	existenceLock.Lock(m_existenceLock);
+	if (m_knownFiles.find(filename) != m_knownFiles.end()) {
+		return true;
+	}
+	unsigned long now = m_existenceTimeKeeper->getMilliseconds();
+	MissingFileHashMap::iterator intr = m_missingFiles.find(filename);
+	if (intr != m_missingFiles.end() && (now - intr->second) < m_missingRecheckMS) {
+		return false;
+	}
+	existenceLock.Unlock();
+
+	if (m_FSArchive->exists(filename)) {
+		NoteFileExists(filename);
+		return true;
+	}
+	existenceLock.Lock(m_existenceLock);
+	m_missingFiles[filename] = now;
+	return false;
+}
+
+// Is the resource somewhere we can read it from. If the cache archive hasn't been
+// loaded, we don't know so say it's there and let the regular open sort it out.
+bool OLArchive::IsInCache(const Ogre::String& filename) {
+	if (m_cacheArchive == NULL) return true;
+	if (LG::OLPackFile::Instance()->Exists(filename)) return true;
+	return m_cacheArchive->FileExists(filename);
+}
+
+// Used by the worker threads which don't want defaults or resource requests
+Ogre::DataStreamPtr OLArchive::OpenCached(const Ogre::String& filename) {
+	Ogre::DataStreamPtr packed = LG::OLPackFile::Instance()->Open(filename);
+	if (!packed.isNull() || m_cacheArchive == NULL) {
+		return packed;
+	}
+	if (m_cacheArchive->FileExists(filename)) {
+		return m_cacheArchive->m_FSArchive->open(filename);
+	}
+	return Ogre::DataStreamPtr();
+}
+
+// Someone wrote a file into the cache directory
+void OLArchive::NoteFileExists(const Ogre::String& filename) {
+	if (m_existenceLock == NULL) return;
+	LGLOCK_ALOCK existenceLock;
+	existenceLock.Lock(m_existenceLock);
+	m_knownFiles[filename] = true;
+	m_missingFiles.erase(filename);
+}
+
+// Return a new stream over the shared copy of a default file. If we couldn't read the
+// default when loading, fall back to reading it from the filesystem.
+Ogre::DataStreamPtr OLArchive::OpenDefault(const Ogre::MemoryDataStreamPtr& data, const Ogre::String& defaultFilename) const {
+	if (data.isNull()) {
+		return m_FSArchive->open(defaultFilename);
+	}
+	return Ogre::DataStreamPtr(OGRE_NEW Ogre::MemoryDataStream(defaultFilename, 
+					data->getPtr(), data->size(), false, true));
 }
 
 // Unloads the archive.
 void OLArchive::unload() {
+	if (m_cacheArchive == this) m_cacheArchive = NULL;
 	Ogre::ArchiveManager::getSingleton().unload(m_FSArchive);
 }
 
@@ -73,7 +183,21 @@ Ogre::DataStreamPtr OLArchive::open(const Ogre::String& filename) const {
 // Open a stream on a given file. 
 Ogre::DataStreamPtr OLArchive::open(const Ogre::String& filename, bool readonly) const {
 	// LG::Log("OLArchive::open(%s)", filename.c_str());
-	if (m_FSArchive->exists(filename)) {
+	// the pack cache has most things and doesn't cost any filesystem operations
+	Ogre::DataStreamPtr packed = LG::OLPackFile::Instance()->Open(filename);
+	if (!packed.isNull()) {
+		return packed;
+	}
+	if (FileExists(filename)) {
+		if (LG::OLPackFile::Instance()->ShouldImportLooseFiles()) {
+			// Copy the loose file into the pack so next time it's found there. Textures
+			// and such are named by their asset UUID and don't change. Meshes that change
+			// are written to the pack by the mesh tracker so the newest is always found.
+			Ogre::DataStreamPtr loose = m_FSArchive->open(filename);
+			Ogre::MemoryDataStream* contents = OGRE_NEW Ogre::MemoryDataStream(filename, loose);
+			LG::OLPackFile::Instance()->Store(filename, contents->getPtr(), contents->size());
+			return Ogre::DataStreamPtr(contents);
+		}
 		return m_FSArchive->open(filename);
 	}
 	// if the file doesn't exist, just return a default type
@@ -88,10 +212,10 @@ Ogre::DataStreamPtr OLArchive::open(const Ogre::String& filename, bool readonly)
 			case LG::ResourceTypeMesh:
 				LG::OLMeshTracker::Instance()->RequestMesh(filename, filename);
 				// LG::RequestResource(filename.c_str(), filename.c_str(), LG::ResourceTypeMesh);
-				return m_FSArchive->open(m_defaultMeshFilename);
+				return OpenDefault(m_defaultMeshData, m_defaultMeshFilename);
 			case LG::ResourceTypeTexture:
 				LG::RequestResource(filename.c_str(), filename.c_str(), LG::ResourceTypeTexture);
-				return m_FSArchive->open(m_defaultTextureFilename);
+				return OpenDefault(m_defaultTextureData, m_defaultTextureFilename);
 		}
 	}
 	catch (char* e) {
@@ -102,21 +226,21 @@ Ogre::DataStreamPtr OLArchive::open(const Ogre::String& filename, bool readonly)
 
 // List all file names in the archive.
 Ogre::StringVectorPtr OLArchive::list(bool recursive, bool dirs) {
-	LG::Log("OLArchive::list()");
+	LG::LogDetail("OLArchive::list()");
 	return m_FSArchive->list(recursive, dirs);
 	// return Ogre::StringVectorPtr(new Ogre::StringVector());
 }
 
 // List all files in the archive with accompanying information.
 Ogre::FileInfoListPtr OLArchive::listFileInfo(bool recursive, bool dirs) {
-	LG::Log("OLArchive::listFileInfo()");
+	LG::LogDetail("OLArchive::listFileInfo()");
 	return m_FSArchive->listFileInfo(recursive, dirs);
 	// return Ogre::FileInfoListPtr(new Ogre::FileInfoList());
 }
 
 Ogre::// Find all file or directory names matching a given pattern
 StringVectorPtr OLArchive::find(const Ogre::String& pattern, bool recursive, bool dirs) {
-	LG::Log("OLArchive::find(%s)", pattern.c_str());
+	LG::LogDetail("OLArchive::find(%s)", pattern.c_str());
 	return m_FSArchive->find(pattern, recursive, dirs);
 	// return Ogre::StringVectorPtr(new Ogre::StringVector());
 }
@@ -24,6 +24,7 @@
 #include "LGOCommon.h"
 #include "OgreArchive.h"
 #include "OgreArchiveFactory.h"
+#include "LGLocking.h"
 
 namespace LG {
 
@@ -37,9 +38,35 @@ protected:
 
 	Ogre::String m_defaultMeshFilename;
 	Ogre::String m_defaultTextureFilename;
+	// the default mesh and texture are read once and shared by every open that needs them
+	Ogre::MemoryDataStreamPtr m_defaultMeshData;
+	Ogre::MemoryDataStreamPtr m_defaultTextureData;
+	Ogre::DataStreamPtr OpenDefault(const Ogre::MemoryDataStreamPtr&, const Ogre::String&) const;
 	
 	int ExtractResourceTypeFromName(Ogre::String) const;
 
+	// What we know is in the cache directory. Filled by one directory scan when the
+	// archive is loaded and added to when cache files are written so open() doesn't
+	// have to stat the filesystem for every request.
+	typedef std::map<Ogre::String, bool> KnownFileHashMap;
+	static KnownFileHashMap m_knownFiles;
+	// names we know are missing and when we last looked for them
+	typedef std::map<Ogre::String, unsigned long> MissingFileHashMap;
+	static MissingFileHashMap m_missingFiles;
+	static LGLOCK_MUTEX m_existenceLock;
+	static Ogre::Timer* m_existenceTimeKeeper;
+	static unsigned long m_missingRecheckMS;
+	bool FileExists(const Ogre::String&) const;
+	static OLArchive* m_cacheArchive;	// the loaded archive over the cache directory
+
+public:
+	// Called when a file is written into the cache directory
+	static void NoteFileExists(const Ogre::String&);
+	// Is the named resource in the pack or the cache directory
+	static bool IsInCache(const Ogre::String&);
+	// Open the resource from the pack or the cache directory. Null if it's not there.
+	static Ogre::DataStreamPtr OpenCached(const Ogre::String&);
+
 public:
 	OLArchive( const Ogre::String& name, const Ogre::String& archType );
 
@@ -26,11 +26,26 @@
 #include "LookingGlassOgre.h"
 #include "RendererOgre.h"
 #include "BadImageCodec.h"
+#include "OLArchive.h"
+#include "OLPlaceholder.h"
+#include "OLTextureDecoder.h"
+#include "OLTextureAtlas.h"
+#include "OLTextureStreamer.h"
+#include "OLPackFile.h"
+#include "LGStats.h"
+#include "LGTrace.h"
 
 namespace LG {
 
 OLMaterialTracker* OLMaterialTracker::m_instance = NULL;
 
+static const char* InternedIndexName = "LGMaterials.index";
+// The index is rewritten whole so it's written at most this often (milliseconds)
+static const unsigned long InternedSaveInterval = 60000;
+// The prim programs get the time wrapped to this many seconds (time_0_x in
+// LGPrim.program) so it keeps its precision in long sessions.
+static const Ogre::Real PrimAnimTimeWrap = 3600.0;
+
 OLMaterialTracker::OLMaterialTracker() {
 	m_defaultTextureName = LG::GetParameter("Renderer.Ogre.DefaultTextureResourceName");
 	m_whiteTextureName = LG::GetParameter("Renderer.Ogre.WhiteTextureResourceName");
@@ -45,6 +60,21 @@ OLMaterialTracker::OLMaterialTracker() {
 	}
 
 	m_shouldUseShaders = LG::isTrue(LG::GetParameter("Renderer.Ogre.UseShaders"));
+	m_shouldUseUberShader = m_shouldUseShaders && LG::GetParameterBool("Renderer.Ogre.UseUberShader");
+	SetFaceValuesDefault(m_defaultFaceValues);
+
+	m_internMutex = LGLOCK_ALLOCATE_MUTEX("OLMaterialTrackerIntern");
+	m_internDirty = false;
+	m_internSaved = 0;
+	m_shouldIntern = LG::GetParameterBool("Renderer.Ogre.InternMaterials");
+	if (m_shouldIntern && !LG::OLPackFile::Instance()->IsEnabled()) {
+		// the shared definitions have to be kept with the serialized meshes
+		LG::Log("OLMaterialTracker: pack cache not enabled so materials not interned");
+		m_shouldIntern = false;
+	}
+	if (m_shouldIntern) {
+		LoadInterned();
+	}
 
 	// more kludge processing for corrupt data files
 	Ogre::ImageCodec* codec = OGRE_NEW LG::BadImageCodec();
@@ -53,11 +83,26 @@ OLMaterialTracker::OLMaterialTracker() {
 
 OLMaterialTracker::~OLMaterialTracker() {
 	LGLOCK_RELEASE_MUTEX(m_modifiedMutex);
+	LGLOCK_RELEASE_MUTEX(m_internMutex);
 	LG::GetOgreRoot()->removeFrameListener(this);
 }
 
 // SingletonInstance.Shutdown
 void OLMaterialTracker::Shutdown() {
+	if (m_shouldUseUberShader && LG::RendererOgre::Instance()->m_sceneMgr != NULL) {
+		LG::RendererOgre::Instance()->m_sceneMgr->removeRenderObjectListener(this);
+	}
+	if (m_shouldIntern) {
+		// one last save of the shared definitions. The pack is shut down after us.
+		LGLOCK_ALOCK internLock;
+		internLock.Lock(m_internMutex);
+		std::vector<char>* interned = m_internDirty ? SaveInterned() : NULL;
+		m_internDirty = false;
+		internLock.Unlock();
+		if (interned != NULL) {
+			LG::OLPackFile::Instance()->StoreLater(InternedIndexName, interned);
+		}
+	}
 	return;
 }
 
@@ -71,6 +116,20 @@ void OLMaterialTracker::Shutdown() {
 // use a DB to store the material information so it can be recreated.
 // We check to see if the material file exists which it never will.
 void OLMaterialTracker::FabricateMaterial(Ogre::String name, Ogre::MaterialPtr matPtr) {
+	if (IsInternedName(name)) {
+		FabricateInterned(name, matPtr);
+		return;
+	}
+	{
+		// the definition has to be applied again when it's resent
+		LGLOCK_ALOCK internLock;
+		internLock.Lock(m_internMutex);
+		m_applied.erase(name);
+	}
+	if (LG::OLTextureAtlas::IsAtlasName(name) && LG::OLTextureAtlas::Instance()->MakeAtlasMaterial(name)) {
+		// atlas materials are rebuilt from the atlas layout
+		return;
+	}
 	// Try to get the stream to load the material from.
 	Ogre::DataStreamPtr stream;
 	stream.setNull();
@@ -147,6 +206,8 @@ void OLMaterialTracker::MakeMaterialDefault(Ogre::MaterialPtr matPtr) {
 // Internal request to refresh a resource
 // BETWEEN FRAME OPERATION
 void OLMaterialTracker::RefreshResource(const Ogre::String& resName, const int rType) {
+	// the resource was just put in the cache so stop thinking it's missing
+	LG::OLArchive::NoteFileExists(resName);
 	if (rType == LG::ResourceTypeMesh) {
 		Ogre::MeshPtr theMesh = (Ogre::MeshPtr)Ogre::MeshManager::getSingleton().getByName(resName);
 		// unload it and let the renderer decide if it needs to be loaded again
@@ -161,14 +222,24 @@ void OLMaterialTracker::RefreshResource(const Ogre::String& resName, const int r
 		// mark it so the work happens later between frames (more queues to manage correctly someday)
 		MarkMaterialModified(resName);
 	}
+	if ((rType == LG::ResourceTypeTexture || rType == LG::ResourceTypeTransparentTexture)
+				&& LG::OLTextureDecoder::Instance()->RefreshArrived(resName, rType)) {
+		// we get called again once the texture is decoded
+		return;
+	}
+	if (rType == LG::ResourceTypeTexture || rType == LG::ResourceTypeTransparentTexture) {
+		LG::OLTextureAtlas::Instance()->NoteTextureArrived(resName);
+	}
 	if (rType == LG::ResourceTypeTexture) {
 		LG::Log("OLMaterialTracker::RefreshResource: unloading/reloading texture");
 		Ogre::TextureManager::getSingleton().unload(resName);
+		LG::OLTextureStreamer::Instance()->NoteTextureUnloaded(resName);
 		MarkTextureModified(resName, false);
 	}
 	if (rType == LG::ResourceTypeTransparentTexture) {
 		LG::Log("OLMaterialTracker::RefreshResource: unloading/reloading transparent texture");
 		Ogre::TextureManager::getSingleton().unload(resName);
+		LG::OLTextureStreamer::Instance()->NoteTextureUnloaded(resName);
 		MarkTextureModified(resName, true);
 	}
 }
@@ -224,6 +295,7 @@ void OLMaterialTracker::MarkTextureModified(const Ogre::String materialName, boo
 // between frames, if there were material modified, refresh their containing entities
 bool OLMaterialTracker::frameEnded(const Ogre::FrameEvent&) {
 	LG::StatIn(LG::InOutMaterialTracker);
+	LGTRACE_SCOPE("OLMaterialTracker");
 	LGLOCK_ALOCK modifiedLock;		// a lock that will be released if we have an exception
 	if (this->m_slowCount-- < 0) {
 		if (m_materialsModified.size() > 0 || m_texturesModified.size() > 0) {
@@ -255,6 +327,16 @@ bool OLMaterialTracker::frameEnded(const Ogre::FrameEvent&) {
 				ReloadMeshes(&m_meshesToChange);
 			}
 			m_meshesToChange.clear();
+			unsigned long now = m_materialTimeKeeper->getMilliseconds();
+			if (m_shouldIntern && m_internDirty && (now - m_internSaved) > InternedSaveInterval) {
+				LGLOCK_ALOCK internLock;
+				internLock.Lock(m_internMutex);
+				std::vector<char>* interned = SaveInterned();
+				m_internDirty = false;
+				m_internSaved = now;
+				internLock.Unlock();
+				LG::OLPackFile::Instance()->StoreLater(InternedIndexName, interned);
+			}
 		}
 		catch (...) {
 			LG::Log("OLMaterialTracker: EXCEPTION PROCESSING:");
@@ -373,6 +455,7 @@ void OLMaterialTracker::CreateMaterialResource(const char* mName, const char* tN
 	pass->setAmbient(0.05f, 0.05f, 0.05f);
 	pass->setVertexColourTracking(Ogre::TVC_AMBIENT);
 	if (textureName.length() > 0) {
+		LG::OLPlaceholder::Instance()->DeclareTexture(textureName);
 		Ogre::TextureUnitState* tus = pass->createTextureUnitState(textureName);
 		// TODO: somehow check to see if texture has transparency in it
 		pass->setDepthWriteEnabled(false);
@@ -403,9 +486,674 @@ void OLMaterialTracker::CreateMaterialResource(const char* mName, const char* tN
 */
 }
 
+// Every face definition comes through here, single or in a batch, so this is
+// where the atlas hears about it.
 void OLMaterialTracker::CreateMaterialResource2(const char* mName, const char* tName, const float* parms) {
+	Ogre::String materialName = mName;
+	Ogre::String textureName = tName;
+	int change = CompareApplied(materialName, textureName, parms);
+	if (change == DefinitionSame) {
+		return;
+	}
+	LG::OLTextureAtlas::Instance()->NoteMaterial(materialName, textureName, parms);
+	if (m_shouldUseUberShader && !LG::OLTextureAtlas::IsAtlasName(materialName)) {
+		// the color, texture transform, glow and shininess go to the renderables
+		SetFaceValues(materialName, parms);
+		if (change == DefinitionValues) {
+			return;
+		}
+	}
+	if (m_shouldIntern && !IsInternedName(materialName) && !LG::OLTextureAtlas::IsAtlasName(materialName)) {
+		if (change == DefinitionPatchable) {
+			// this face gets animated. It's cheaper to patch its own material than
+			// to make a new shared material and rebuild the mesh for every change.
+			MakeVolatile(materialName);
+		}
+		else if (InternMaterial(materialName, tName, parms)) {
+			// meshes built before the face was defined (or before interning) still use
+			// the face's own material. Only build that if something referenced it.
+			if (!Ogre::MaterialManager::getSingleton().resourceExists(materialName)) {
+				return;
+			}
+		}
+	}
+	if (change == DefinitionPatchable && PatchMaterial(materialName, textureName, parms)) {
+		PatchMaterial(materialName + "/Skinned", textureName, parms);
+		return;
+	}
+	BuildMaterial(mName, tName, parms);
+}
+
+// The faces of a prim defined together. Each goes through the same definition
+// as a single face.
+void OLMaterialTracker::CreateMaterialResource7(const Ogre::String mNames[], const Ogre::String tNames[], const float parms[]) {
+	int stride = (int)parms[0];
+	for (int ii = 0; ii < 7; ii++) {
+		if (mNames[ii].empty()) continue;
+		CreateMaterialResource2(mNames[ii].c_str(), tNames[ii].c_str(), &parms[1 + stride * ii]);
+	}
+}
+
+// Remember the definition and say how it differs from the last one applied.
+// With the prim shader, most changes are just new values for the renderables.
+// Otherwise, texture transform changes can be patched into the material. So can
+// color changes when using the shaders (otherwise the color decides how the
+// passes are built).
+int OLMaterialTracker::CompareApplied(const Ogre::String& matName, const Ogre::String& texName, const float* parms) {
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	AppliedMaterialHashMap::iterator am = m_applied.find(matName);
+	if (am == m_applied.end()) {
+		AppliedMaterial& applied = m_applied[matName];
+		applied.texName = texName;
+		memcpy(applied.parms, parms, sizeof(applied.parms));
+		return DefinitionChanged;
+	}
+	AppliedMaterial& applied = am->second;
+	int change = DefinitionSame;
+	if (applied.texName != texName) {
+		change = DefinitionChanged;
+	}
+	for (int ii = 0; ii < CreateMaterialSize && change != DefinitionChanged; ii++) {
+		if (applied.parms[ii] == parms[ii]) continue;
+		if (m_shouldUseUberShader && IsFaceValue(ii, applied.parms[ii], parms[ii])) {
+			if (change == DefinitionSame) {
+				change = DefinitionValues;
+			}
+			continue;
+		}
+		switch (ii) {
+			case CreateMaterialScrollU:
+			case CreateMaterialScrollV:
+			case CreateMaterialScaleU:
+			case CreateMaterialScaleV:
+			case CreateMaterialRotate:
+				change = DefinitionPatchable;
+				break;
+			case CreateMaterialColorR:
+			case CreateMaterialColorG:
+			case CreateMaterialColorB:
+			case CreateMaterialColorA:
+				change = m_shouldUseShaders ? DefinitionPatchable : DefinitionChanged;
+				break;
+			default:
+				change = DefinitionChanged;
+				break;
+		}
+	}
+	if (change != DefinitionSame) {
+		applied.texName = texName;
+		memcpy(applied.parms, parms, sizeof(applied.parms));
+	}
+	return change;
+}
+
+// Change the texture transform and color of an existing material without
+// rebuilding it. Returns false if there is no material to patch.
+bool OLMaterialTracker::PatchMaterial(const Ogre::String& matName, const Ogre::String& texName, const float* parms) {
+	Ogre::MaterialPtr mat = (Ogre::MaterialPtr)Ogre::MaterialManager::getSingleton().getByName(matName);
+	if (mat.isNull() || mat->getNumTechniques() == 0) {
+		return false;
+	}
+	Ogre::Material::TechniqueIterator techIter = mat->getTechniqueIterator();
+	while (techIter.hasMoreElements()) {
+		Ogre::Technique* oneTech = techIter.getNext();
+		Ogre::Technique::PassIterator passIter = oneTech->getPassIterator();
+		while (passIter.hasMoreElements()) {
+			Ogre::Pass* onePass = passIter.getNext();
+			if (m_shouldUseShaders) {
+				onePass->setDiffuse(parms[CreateMaterialColorR], parms[CreateMaterialColorG], 
+								parms[CreateMaterialColorB], parms[CreateMaterialColorA] );
+			}
+			Ogre::Pass::TextureUnitStateIterator tusIter = onePass->getTextureUnitStateIterator();
+			while (tusIter.hasMoreElements()) {
+				Ogre::TextureUnitState* oneTus = tusIter.getNext();
+				if (oneTus->getTextureName().length() == 0) continue;
+				oneTus->setTextureUScroll(parms[CreateMaterialScrollU]);
+				oneTus->setTextureVScroll(parms[CreateMaterialScrollV]);
+				oneTus->setTextureUScale(parms[CreateMaterialScaleU]);
+				oneTus->setTextureVScale(parms[CreateMaterialScaleV]);
+				oneTus->setTextureRotate(Ogre::Radian(parms[CreateMaterialRotate]));
+			}
+		}
+	}
+	return true;
+}
+
+// The parameters that the prim shader gets from the renderable rather than the
+// material. Only whether a face is shiny picks the program.
+bool OLMaterialTracker::IsFaceValue(int parm, float oldVal, float newVal) {
+	switch (parm) {
+		case CreateMaterialColorR:
+		case CreateMaterialColorG:
+		case CreateMaterialColorB:
+		case CreateMaterialColorA:
+		case CreateMaterialGlow:
+		case CreateMaterialScrollU:
+		case CreateMaterialScrollV:
+		case CreateMaterialScaleU:
+		case CreateMaterialScaleV:
+		case CreateMaterialRotate:
+		case CreateMaterialAnimationFlag:
+		case CreateMaterialAnimSizeX:
+		case CreateMaterialAnimSizeY:
+		case CreateMaterialAnimStart:
+		case CreateMaterialAnimLength:
+		case CreateMaterialAnimRate:
+			return true;
+		case CreateMaterialShiny:
+			return (oldVal > 0.0) == (newVal > 0.0);
+		default:
+			return false;
+	}
+}
+
+void OLMaterialTracker::SetFaceValuesDefault(FaceValues& fv) {
+	fv.values[0] = Ogre::Vector4(1.0, 1.0, 1.0, 1.0);
+	fv.values[1] = Ogre::Vector4(0.0, 0.0, 1.0, 1.0);
+	fv.values[2] = Ogre::Vector4(0.0, 0.0, 0.0, 0.0);
+	fv.values[3] = Ogre::Vector4(0.0, 0.0, 0.0, 0.0);
+	fv.values[4] = Ogre::Vector4(1.0, 1.0, 0.0, 1.0);
+	fv.values[5] = Ogre::Vector4(0.0, 0.0, 0.0, 0.0);
+	fv.animStart = 0.0;
+	fv.version = 0;
+}
+
+// Remember the face's values for its renderables. If the face shares a mesh
+// section with other faces and its values are now different, it needs a section
+// of its own so the mesh is built again.
+void OLMaterialTracker::SetFaceValues(const Ogre::String& faceName, const float* parms) {
+	std::vector<Ogre::String> rebuildMeshes;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	FaceValuesHashMap::iterator fvi = m_faceValues.find(faceName);
+	if (fvi == m_faceValues.end()) {
+		fvi = m_faceValues.insert(std::pair<Ogre::String, FaceValues>(faceName, m_defaultFaceValues)).first;
+	}
+	FaceValues& fv = fvi->second;
+	Ogre::Vector4 wasAnim[3] = { fv.values[2], fv.values[3], fv.values[4] };
+	fv.values[0] = Ogre::Vector4(parms[CreateMaterialColorR], parms[CreateMaterialColorG],
+							parms[CreateMaterialColorB], parms[CreateMaterialColorA]);
+	fv.values[1] = Ogre::Vector4(parms[CreateMaterialScrollU], parms[CreateMaterialScrollV],
+							parms[CreateMaterialScaleU], parms[CreateMaterialScaleV]);
+	fv.values[2] = Ogre::Vector4(parms[CreateMaterialRotate], parms[CreateMaterialGlow],
+							parms[CreateMaterialShiny], parms[CreateMaterialAnimRate]);
+	// the program can't test bits so the animation flags are broken out
+	int animFlags = (int)parms[CreateMaterialAnimationFlag];
+	float animMode = 0.0;
+	if (animFlags != 0) {
+		animMode = 1.0;
+		if ((animFlags & CreateMaterialAnimFlagRotate) != 0) animMode = 2.0;
+		else if ((animFlags & CreateMaterialAnimFlagScale) != 0) animMode = 3.0;
+	}
+	float animRepeat = 0.0;
+	if ((animFlags & CreateMaterialAnimFlagPingPong) != 0) animRepeat = 2.0;
+	else if ((animFlags & CreateMaterialAnimFlagLoop) != 0) animRepeat = 1.0;
+	fv.values[3] = Ogre::Vector4(animMode, animRepeat, 
+							(animFlags & CreateMaterialAnimFlagReverse) != 0 ? 1.0f : 0.0f,
+							(animFlags & CreateMaterialAnimFlagSmooth) != 0 ? 1.0f : 0.0f);
+	fv.values[4] = Ogre::Vector4(parms[CreateMaterialAnimSizeX], parms[CreateMaterialAnimSizeY],
+							parms[CreateMaterialAnimStart], parms[CreateMaterialAnimLength]);
+	// The animation runs from when it was set. The prim's faces are all sent again
+	// when anything about the prim changes so only a different animation restarts it.
+	if (animMode != 0.0 && (wasAnim[1] != fv.values[3] || wasAnim[2] != fv.values[4] 
+				|| wasAnim[0].w != fv.values[2].w || fv.values[5].w == 0.0)) {
+		fv.animStart = Ogre::ControllerManager::getSingleton().getElapsedTime();
+		fv.values[5] = Ogre::Vector4(fmod(fv.animStart, PrimAnimTimeWrap), 0.0, 0.0, 1.0);
+	}
+	else if (animMode == 0.0) {
+		fv.values[5] = Ogre::Vector4(0.0, 0.0, 0.0, 0.0);
+	}
+	fv.version++;
+	MergedFaceHashMap::iterator merged = m_mergedFaces.find(faceName);
+	if (merged != m_mergedFaces.end() && merged->second != ValuesKey(fv)) {
+		InternedFaceHashMap::iterator used = m_internedFaces.find(faceName);
+		if (used != m_internedFaces.end()) {
+			for (FaceMeshHashMap::iterator fm = used->second.begin(); fm != used->second.end(); fm++) {
+				rebuildMeshes.push_back(fm->first);
+			}
+		}
+		m_mergedFaces.erase(merged);
+		m_internDirty = true;
+	}
+	internLock.Unlock();
+	for (size_t ii = 0; ii < rebuildMeshes.size(); ii++) {
+		LG::OLMeshTracker::Instance()->RequestMesh(rebuildMeshes[ii], rebuildMeshes[ii]);
+	}
+}
+
+// Called with the intern lock held. When the animation started isn't part of it.
+Ogre::String OLMaterialTracker::ValuesKey(const FaceValues& fv) {
+	Ogre::String key;
+	char buff[64];
+	for (int ii = 0; ii < 5; ii++) {
+		sprintf(buff, "%g,%g,%g,%g;", fv.values[ii].x, fv.values[ii].y, fv.values[ii].z, fv.values[ii].w);
+		key += buff;
+	}
+	return key;
+}
+
+// The mesh builder only puts faces in the same section if this is the same.
+Ogre::String OLMaterialTracker::FaceValuesKey(const Ogre::String& faceName) {
+	if (!m_shouldUseUberShader) return Ogre::String();
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	FaceValuesHashMap::iterator fvi = m_faceValues.find(faceName);
+	if (fvi == m_faceValues.end()) {
+		return Ogre::String();
+	}
+	return ValuesKey(fvi->second);
+}
+
+// The mesh builder put these faces in one section. The section is named for the
+// first face so they all get its values.
+void OLMaterialTracker::NoteMergedFaces(const std::vector<Ogre::String>& faces) {
+	if (!m_shouldUseUberShader) return;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	std::vector<Ogre::String>::const_iterator fi;
+	for (fi = faces.begin(); fi != faces.end(); fi++) {
+		FaceValuesHashMap::iterator fvi = m_faceValues.find(*fi);
+		Ogre::String key = (fvi == m_faceValues.end()) ? Ogre::String("-") : ValuesKey(fvi->second);
+		Ogre::String& merged = m_mergedFaces[*fi];
+		if (merged != key) {
+			merged = key;
+			m_internDirty = true;
+		}
+	}
+}
+
+// Find the values for a renderable that's rendered with one of the prim programs.
+// Entities made from our meshes have sections named for a face.
+OLMaterialTracker::FaceValues* OLMaterialTracker::BindFaceValues(Ogre::Renderable* rend) {
+	Ogre::SubEntity* subEnt = dynamic_cast<Ogre::SubEntity*>(rend);
+	if (subEnt == NULL) {
+		return &m_defaultFaceValues;
+	}
+	Ogre::SubMesh* subMesh = subEnt->getSubMesh();
+	Ogre::Mesh* mesh = subMesh->parent;
+	Ogre::String faceName;
+	const Ogre::Mesh::SubMeshNameMap& names = mesh->getSubMeshNameMap();
+	Ogre::Mesh::SubMeshNameMap::const_iterator ni;
+	for (ni = names.begin(); ni != names.end(); ni++) {
+		if (ni->second < mesh->getNumSubMeshes() && mesh->getSubMesh(ni->second) == subMesh) {
+			faceName = ni->first;
+			break;
+		}
+	}
+	if (faceName.length() == 0) {
+		return &m_defaultFaceValues;
+	}
+	// if the face isn't defined yet, its values will be filled in when it is
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	FaceValuesHashMap::iterator fvi = m_faceValues.find(faceName);
+	if (fvi == m_faceValues.end()) {
+		fvi = m_faceValues.insert(std::pair<Ogre::String, FaceValues>(faceName, m_defaultFaceValues)).first;
+	}
+	return &fvi->second;
+}
+
+// The material for a face of a skeletal entity. The skinned copy has the same
+// definition as the face's material but uses the skinned prim program. If the
+// face isn't defined yet, the copy starts as the default and is built when the
+// face's material is.
+Ogre::String OLMaterialTracker::SkinnedMaterialName(const Ogre::String& baseName) {
+	if (!m_shouldUseUberShader || IsSkinnedName(baseName) || LG::OLTextureAtlas::IsAtlasName(baseName)) {
+		return baseName;
+	}
+	Ogre::String skinnedName = baseName + "/Skinned";
+	if (Ogre::MaterialManager::getSingleton().resourceExists(skinnedName)) {
+		return skinnedName;
+	}
+	Ogre::String texName;
+	std::vector<float> parms;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	m_skinned.insert(baseName);
+	AppliedMaterialHashMap::iterator am = m_applied.find(baseName);
+	if (am != m_applied.end()) {
+		texName = am->second.texName;
+		parms.assign(am->second.parms, am->second.parms + CreateMaterialSize);
+	}
+	else {
+		InternedMaterialHashMap::iterator im = m_interned.find(baseName);
+		if (im != m_interned.end()) {
+			texName = im->second.texName;
+			parms = im->second.parms;
+		}
+	}
+	internLock.Unlock();
+	if (parms.empty()) {
+		Ogre::MaterialPtr matPtr = Ogre::MaterialManager::getSingleton().createOrRetrieve(
+					skinnedName, OLResourceGroupName).first;
+		MakeMaterialDefault(matPtr);
+	}
+	else {
+		CreateMaterialResource3(skinnedName.c_str(), texName.c_str(), &parms[0]);
+	}
+	return skinnedName;
+}
+
+// Ogre::RenderObjectListener
+// Called just before each renderable is rendered. For the prim programs, the
+// renderable's custom parameters are set from its face's values the first time
+// and whenever they change.
+void OLMaterialTracker::notifyRenderSingleObject(Ogre::Renderable* rend, const Ogre::Pass* pass, 
+			const Ogre::AutoParamDataSource*, const Ogre::LightList*, bool) {
+	if (!pass->hasVertexProgram() || !IsPrimProgram(pass->getVertexProgramName())) {
+		return;
+	}
+	const Ogre::Any& bound = rend->getUserObjectBindings().getUserAny();
+	FaceBinding* binding = const_cast<FaceBinding*>(Ogre::any_cast<FaceBinding>(&bound));
+	if (binding == NULL) {
+		FaceBinding newBinding;
+		newBinding.values = BindFaceValues(rend);
+		newBinding.version = newBinding.values->version - 1;
+		rend->getUserObjectBindings().setUserAny(Ogre::Any(newBinding));
+		binding = const_cast<FaceBinding*>(Ogre::any_cast<FaceBinding>(&rend->getUserObjectBindings().getUserAny()));
+	}
+	if (binding->version != binding->values->version) {
+		binding->version = binding->values->version;
+		rend->setCustomParameter(0, binding->values->values[0]);
+		rend->setCustomParameter(1, binding->values->values[1]);
+		rend->setCustomParameter(2, binding->values->values[2]);
+		rend->setCustomParameter(3, binding->values->values[3]);
+		rend->setCustomParameter(4, binding->values->values[4]);
+		rend->setCustomParameter(5, binding->values->values[5]);
+	}
+	// Animations that play once are marked done when they get to the end so they
+	// stay there when the program's wrapped time comes around again.
+	FaceValues* fv = binding->values;
+	if (fv->values[5].w != 0.0 && fv->values[5].y == 0.0 && fv->values[3].y == 0.0) {
+		Ogre::Real elapsed = Ogre::ControllerManager::getSingleton().getElapsedTime() - fv->animStart;
+		if (Ogre::Math::Abs(elapsed * fv->values[2].w) >= fv->values[4].w) {
+			LGLOCK_ALOCK internLock;
+			internLock.Lock(m_internMutex);
+			fv->values[5].y = 1.0;
+			fv->version++;
+		}
+	}
+}
+
+// The face's definition keeps changing. Stop interning it and, if a mesh was
+// built with its shared material, build the mesh again so it uses the face's
+// own material.
+void OLMaterialTracker::MakeVolatile(const Ogre::String& faceName) {
+	std::vector<Ogre::String> rebuildMeshes;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	if (!m_volatileFaces.insert(faceName).second) {
+		return;
+	}
+	m_faceCanonical.erase(faceName);
+	InternedFaceHashMap::iterator used = m_internedFaces.find(faceName);
+	if (used != m_internedFaces.end()) {
+		for (FaceMeshHashMap::iterator fm = used->second.begin(); fm != used->second.end(); fm++) {
+			rebuildMeshes.push_back(fm->first);
+			m_meshFaces[fm->first].erase(faceName);
+		}
+		m_internedFaces.erase(used);
+	}
+	internLock.Unlock();
+	for (size_t ii = 0; ii < rebuildMeshes.size(); ii++) {
+		LG::OLMeshTracker::Instance()->RequestMesh(rebuildMeshes[ii], rebuildMeshes[ii]);
+	}
+}
+
+// The face is defined as this texture and parameters. Make sure there's a
+// shared material for the definition. If a mesh was built with the face using
+// a different shared material, the mesh needs building again.
+// Returns false if the face isn't interned because it's volatile.
+bool OLMaterialTracker::InternMaterial(const Ogre::String& faceName, const Ogre::String& texName, const float* parms) {
+	Ogre::String canonName = "LGMat/" + MaterialKey(texName, parms);
+	std::vector<Ogre::String> rebuildMeshes;
+	bool build = false;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	if (m_volatileFaces.find(faceName) != m_volatileFaces.end()) {
+		return false;
+	}
+	InternedMaterialHashMap::iterator im = m_interned.find(canonName);
+	if (im == m_interned.end()) {
+		InternedMaterial def;
+		def.texName = texName;
+		def.parms = std::vector<float>(parms, parms + CreateMaterialSize);
+		def.built = false;
+		im = m_interned.insert(std::pair<Ogre::String, InternedMaterial>(canonName, def)).first;
+		m_internDirty = true;
+	}
+	if (!im->second.built) {
+		im->second.built = true;
+		build = true;
+	}
+	InternedFaceHashMap::iterator used = m_internedFaces.find(faceName);
+	if (used != m_internedFaces.end()) {
+		FaceMeshHashMap::iterator fm = used->second.begin();
+		while (fm != used->second.end()) {
+			if (fm->second != canonName) {
+				rebuildMeshes.push_back(fm->first);
+				m_meshFaces[fm->first].erase(faceName);
+				used->second.erase(fm++);
+			}
+			else {
+				fm++;
+			}
+		}
+		if (used->second.empty()) {
+			m_internedFaces.erase(used);
+		}
+	}
+	m_faceCanonical[faceName] = canonName;
+	internLock.Unlock();
+
+	if (build) {
+		// if something referenced it before it was defined, it has the default
+		// material and the meshes need a refresh
+		bool existed = Ogre::MaterialManager::getSingleton().resourceExists(canonName);
+		BuildMaterial(canonName.c_str(), texName.c_str(), parms);
+		if (existed) {
+			MarkMaterialModified(canonName);
+		}
+	}
+	for (size_t ii = 0; ii < rebuildMeshes.size(); ii++) {
+		LG::OLMeshTracker::Instance()->RequestMesh(rebuildMeshes[ii], rebuildMeshes[ii]);
+	}
+	return true;
+}
+
+// The mesh builder wants the material for a face. Returns the shared material
+// if the face has been defined and remembers that the mesh uses it.
+Ogre::String OLMaterialTracker::CanonicalMaterialName(const Ogre::String& meshName, const Ogre::String& faceName) {
+	if (!m_shouldIntern) return faceName;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	FaceCanonicalHashMap::iterator fc = m_faceCanonical.find(faceName);
+	if (fc == m_faceCanonical.end()) {
+		return faceName;
+	}
+	LinkInternedFace(faceName, meshName, fc->second);
+	return fc->second;
+}
+
+// Called with the intern lock held
+void OLMaterialTracker::LinkInternedFace(const Ogre::String& faceName, const Ogre::String& meshName,
+										const Ogre::String& sharedName) {
+	m_internedFaces[faceName][meshName] = sharedName;
+	m_meshFaces[meshName].insert(faceName);
+}
+
+// A mesh was loaded. If it came from the pack, its sections are named for the
+// faces and use the shared materials they were built with. If a face has been
+// defined differently since, the mesh is built again.
+void OLMaterialTracker::NoteMeshLoaded(const Ogre::String& meshName) {
+	if (!m_shouldIntern) return;
+	Ogre::MeshPtr mesh = (Ogre::MeshPtr)Ogre::MeshManager::getSingleton().getByName(meshName);
+	if (mesh.isNull() || !mesh->isLoaded()) return;
+	bool rebuild = false;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	const Ogre::Mesh::SubMeshNameMap& names = mesh->getSubMeshNameMap();
+	Ogre::Mesh::SubMeshNameMap::const_iterator ni;
+	for (ni = names.begin(); ni != names.end(); ni++) {
+		if (ni->second >= mesh->getNumSubMeshes()) continue;
+		const Ogre::String& sharedName = mesh->getSubMesh(ni->second)->getMaterialName();
+		if (!IsInternedName(sharedName)) continue;
+		if (m_volatileFaces.find(ni->first) != m_volatileFaces.end()) {
+			rebuild = true;
+			continue;
+		}
+		FaceCanonicalHashMap::iterator fc = m_faceCanonical.find(ni->first);
+		if (fc != m_faceCanonical.end() && fc->second != sharedName) {
+			rebuild = true;
+			continue;
+		}
+		LinkInternedFace(ni->first, meshName, sharedName);
+	}
+	internLock.Unlock();
+	if (rebuild) {
+		LG::OLMeshTracker::Instance()->RequestMesh(meshName, meshName);
+	}
+}
+
+// The mesh is unloaded or about to be built again. Forget which faces it used.
+void OLMaterialTracker::NoteMeshUnloaded(const Ogre::String& meshName) {
+	if (!m_shouldIntern) return;
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	MeshFacesHashMap::iterator mf = m_meshFaces.find(meshName);
+	if (mf == m_meshFaces.end()) return;
+	std::set<Ogre::String>::iterator fi;
+	for (fi = mf->second.begin(); fi != mf->second.end(); fi++) {
+		InternedFaceHashMap::iterator used = m_internedFaces.find(*fi);
+		if (used != m_internedFaces.end()) {
+			used->second.erase(meshName);
+			if (used->second.empty()) {
+				m_internedFaces.erase(used);
+			}
+		}
+	}
+	m_meshFaces.erase(mf);
+}
+
+// A serialized mesh referenced a shared material. Build it from the saved
+// definition. If we don't know it (yet), it's the default until a face with
+// the definition shows up.
+bool OLMaterialTracker::FabricateInterned(const Ogre::String& name, Ogre::MaterialPtr matPtr) {
+	LGLOCK_ALOCK internLock;
+	internLock.Lock(m_internMutex);
+	InternedMaterialHashMap::iterator im = m_interned.find(name);
+	if (im == m_interned.end()) {
+		internLock.Unlock();
+		MakeMaterialDefault(matPtr);
+		return false;
+	}
+	im->second.built = true;
+	Ogre::String texName = im->second.texName;
+	std::vector<float> parms = im->second.parms;
+	internLock.Unlock();
+	BuildMaterial(name.c_str(), texName.c_str(), &parms[0]);
+	return true;
+}
+
+// Name a definition: two FNV-1a hashes over the texture name, the parameters and
+// whether shaders are used. The per-face values of the prim shader are not part
+// of the material so they are left out.
+Ogre::String OLMaterialTracker::MaterialKey(const Ogre::String& texName, const float* inParms) {
+	float parms[CreateMaterialSize];
+	memcpy(parms, inParms, sizeof(parms));
+	if (m_shouldUseUberShader) {
+		for (int ii = 0; ii < CreateMaterialSize; ii++) {
+			if (IsFaceValue(ii, 0.0, parms[ii])) {
+				parms[ii] = 0.0;
+			}
+		}
+		parms[CreateMaterialShiny] = (parms[CreateMaterialShiny] > 0.0) ? 1.0f : 0.0f;
+	}
+	Ogre::uint32 hashA = 2166136261U;
+	Ogre::uint32 hashB = 84696351U;
+	for (size_t ii = 0; ii < texName.length(); ii++) {
+		hashA = (hashA ^ (unsigned char)texName[ii]) * 16777619U;
+		hashB = (hashB ^ (unsigned char)texName[ii]) * 16777619U + 1;
+	}
+	const unsigned char* bytes = (const unsigned char*)parms;
+	for (size_t ii = 0; ii < CreateMaterialSize * sizeof(float); ii++) {
+		hashA = (hashA ^ bytes[ii]) * 16777619U;
+		hashB = (hashB ^ bytes[ii]) * 16777619U + 1;
+	}
+	hashA = (hashA ^ (m_shouldUseUberShader ? 2 : (m_shouldUseShaders ? 1 : 0))) * 16777619U;
+	char buff[32];
+	sprintf(buff, "%08x%08x", hashA, hashB);
+	return Ogre::String(buff);
+}
+
+// The index is lines of tab separated fields:
+//   M sharedName texture parameters...
+//   G faceMaterial valuesKey			(faces sharing a mesh section)
+// An empty texture name is written as "-". Older indexes also have F lines
+// for the faces meshes were built with; those now come from the loaded meshes.
+void OLMaterialTracker::LoadInterned() {
+	Ogre::DataStreamPtr stream = LG::OLPackFile::Instance()->Open(InternedIndexName);
+	if (stream.isNull()) {
+		return;
+	}
+	Ogre::StringVector lines = Ogre::StringUtil::split(stream->getAsString(), "\n");
+	Ogre::StringVector::iterator li;
+	for (li = lines.begin(); li != lines.end(); li++) {
+		Ogre::StringVector fields = Ogre::StringUtil::split(*li, "\t");
+		if (fields.size() < 2) continue;
+		if (fields[0] == "M" && fields.size() == (3 + CreateMaterialSize)) {
+			InternedMaterial& def = m_interned[fields[1]];
+			def.texName = (fields[2] == "-") ? Ogre::String() : fields[2];
+			def.parms.clear();
+			for (size_t ii = 3; ii < fields.size(); ii++) {
+				def.parms.push_back((float)atof(fields[ii].c_str()));
+			}
+			def.built = false;
+		}
+		else if (fields[0] == "G" && fields.size() == 3) {
+			m_mergedFaces[fields[1]] = fields[2];
+		}
+	}
+	LG::Log("OLMaterialTracker::LoadInterned: %d materials, %d merged faces",
+			(int)m_interned.size(), (int)m_mergedFaces.size());
+}
+
+// Called with the intern lock held.
+// Only the materials and faces used this session are written so the index
+// doesn't keep growing with everything ever seen. A mesh that comes back later
+// with a dropped material has the default until its faces are defined again.
+std::vector<char>* OLMaterialTracker::SaveInterned() {
+	Ogre::StringUtil::StrStreamType index;
+	char buff[32];
+	for (InternedMaterialHashMap::iterator im = m_interned.begin(); im != m_interned.end(); im++) {
+		if (!im->second.built) continue;
+		index << "M\t" << im->first << "\t" << (im->second.texName.length() == 0 ? Ogre::String("-") : im->second.texName);
+		for (size_t ii = 0; ii < im->second.parms.size(); ii++) {
+			sprintf(buff, "%.9g", im->second.parms[ii]);
+			index << "\t" << buff;
+		}
+		index << "\n";
+	}
+	for (MergedFaceHashMap::iterator gm = m_mergedFaces.begin(); gm != m_mergedFaces.end(); gm++) {
+		if (m_faceValues.find(gm->first) == m_faceValues.end()) continue;
+		index << "G\t" << gm->first << "\t" << gm->second << "\n";
+	}
+	Ogre::String str = index.str();
+	return new std::vector<char>(str.begin(), str.end());
+}
+
+void OLMaterialTracker::BuildMaterial(const char* mName, const char* tName, const float* parms) {
+	LG::StatTimer buildTimer(LG::HistMaterialBuild);
 	if (m_shouldUseShaders) {
 		CreateMaterialResource3(mName, tName, parms);
+		LGLOCK_ALOCK internLock;
+		internLock.Lock(m_internMutex);
+		bool skinned = m_skinned.find(mName) != m_skinned.end();
+		internLock.Unlock();
+		if (skinned) {
+			CreateMaterialResource3((Ogre::String(mName) + "/Skinned").c_str(), tName, parms);
+		}
 		return;
 	}
 	Ogre::String materialName = mName;
@@ -426,6 +1174,7 @@ void OLMaterialTracker::CreateMaterialResource2(const char* mName, const char* t
 	pass->setAmbient(LG::RendererOgre::Instance()->MaterialAmbientColor);
 	pass->setVertexColourTracking(Ogre::TVC_AMBIENT);
 	if (textureName.length() > 0) {
+		LG::OLPlaceholder::Instance()->DeclareTexture(textureName);
 		Ogre::TextureUnitState* tus = pass->createTextureUnitState(textureName);
 
 		// use SceneBlendType to add the alpha information
@@ -533,20 +1282,43 @@ void OLMaterialTracker::CreateMaterialResource3(const char* mName, const char* t
 
 	Ogre::Technique* tech = mat->createTechnique();
 	Ogre::Pass* pass = tech->createPass();
-	Ogre::String vertexProgram = "UnlitTexturedVColVP";
-	Ogre::String fragmentProgram = "UnlitTexturedVColFP";
-	if (parms[CreateMaterialFullBright] > 0.5) {
-		Ogre::String vertexProgram = "LitTexturedVColVP";
-		Ogre::String fragmentProgram = "LitTexturedVColFP";
-	}
-	pass->setVertexProgram(vertexProgram);
-	pass->setFragmentProgram(fragmentProgram);
-	CreateMaterialSetTransparancy(pass, parms[CreateMaterialTransparancy]);
-	pass->setDiffuse(parms[CreateMaterialColorR], parms[CreateMaterialColorG], 
-					parms[CreateMaterialColorB], parms[CreateMaterialColorA] );
-	if (textureName.length() != 0) {
-		Ogre::TextureUnitState* tus = pass->createTextureUnitState(textureName);
-		CreateMaterialDecorateTus(tus, parms);
+	if (m_shouldUseUberShader) {
+		// One of the few prim programs. The color, texture transform, glow and shininess
+		// come from the renderable (see notifyRenderSingleObject) so this material
+		// can be shared by any face with the same texture and transparency.
+		Ogre::String vertexProgram = "LGPrimVP";
+		if (IsSkinnedName(materialName)) {
+			vertexProgram = "LGPrimSkinnedVP";
+		}
+		else if (parms[CreateMaterialFullBright] > 0.5) {
+			vertexProgram = "LGPrimFullbrightVP";
+		}
+		else if (parms[CreateMaterialShiny] > 0.0) {
+			vertexProgram = "LGPrimShinyVP";
+		}
+		pass->setVertexProgram(vertexProgram);
+		pass->setFragmentProgram("LGPrimFP");
+		CreateMaterialSetTransparancy(pass, parms[CreateMaterialTransparancy]);
+		LG::OLPlaceholder::Instance()->DeclareTexture(textureName);
+		pass->createTextureUnitState(textureName);
+	}
+	else {
+		Ogre::String vertexProgram = "UnlitTexturedVColVP";
+		Ogre::String fragmentProgram = "UnlitTexturedVColFP";
+		if (parms[CreateMaterialFullBright] > 0.5) {
+			Ogre::String vertexProgram = "LitTexturedVColVP";
+			Ogre::String fragmentProgram = "LitTexturedVColFP";
+		}
+		pass->setVertexProgram(vertexProgram);
+		pass->setFragmentProgram(fragmentProgram);
+		CreateMaterialSetTransparancy(pass, parms[CreateMaterialTransparancy]);
+		pass->setDiffuse(parms[CreateMaterialColorR], parms[CreateMaterialColorG], 
+						parms[CreateMaterialColorB], parms[CreateMaterialColorA] );
+		if (textureName.length() != 0) {
+			LG::OLPlaceholder::Instance()->DeclareTexture(textureName);
+			Ogre::TextureUnitState* tus = pass->createTextureUnitState(textureName);
+			CreateMaterialDecorateTus(tus, parms);
+		}
 	}
 
 	LG::RendererOgre::Instance()->Shadow->AddReceiverShadow(mat);
@@ -555,14 +1327,32 @@ void OLMaterialTracker::CreateMaterialResource3(const char* mName, const char* t
 	// tus1b->setContentType(Ogre::TextureUnitState::CONTENT_SHADOW);
 
 	// secondary, fallback technique
+	// With the prim programs the material is shared so it can't have one face's
+	// color, texture transform or animation controllers. The fallback is plain.
+	float neutralParms[CreateMaterialSize];
+	const float* fallbackParms = parms;
+	if (m_shouldUseUberShader) {
+		memcpy(neutralParms, parms, sizeof(neutralParms));
+		neutralParms[CreateMaterialColorR] = 1.0;
+		neutralParms[CreateMaterialColorG] = 1.0;
+		neutralParms[CreateMaterialColorB] = 1.0;
+		neutralParms[CreateMaterialColorA] = 1.0;
+		neutralParms[CreateMaterialScrollU] = 0.0;
+		neutralParms[CreateMaterialScrollV] = 0.0;
+		neutralParms[CreateMaterialScaleU] = 1.0;
+		neutralParms[CreateMaterialScaleV] = 1.0;
+		neutralParms[CreateMaterialRotate] = 0.0;
+		neutralParms[CreateMaterialAnimationFlag] = 0.0;
+		fallbackParms = neutralParms;
+	}
 	Ogre::Technique* tech2 = mat->createTechnique();
 	Ogre::Pass* pass2 = tech2->createPass();
 	CreateMaterialSetTransparancy(pass2, parms[CreateMaterialTransparancy]);
-	pass2->setDiffuse(parms[CreateMaterialColorR], parms[CreateMaterialColorG], 
-					parms[CreateMaterialColorB], parms[CreateMaterialColorA] );
+	pass2->setDiffuse(fallbackParms[CreateMaterialColorR], fallbackParms[CreateMaterialColorG], 
+					fallbackParms[CreateMaterialColorB], fallbackParms[CreateMaterialColorA] );
 	if (textureName.length() != 0) {
 		Ogre::TextureUnitState* tus2 = pass2->createTextureUnitState(textureName);
-		CreateMaterialDecorateTus(tus2, parms);
+		CreateMaterialDecorateTus(tus2, fallbackParms);
 	}
 
 	mat->compile();
@@ -576,7 +1366,8 @@ void OLMaterialTracker::CreateMaterialDecorateTus(Ogre::TextureUnitState* tus, c
 	tus->setTextureVScale(parms[CreateMaterialScaleV]);
 	tus->setTextureRotate(Ogre::Radian(parms[CreateMaterialRotate]));
 	int animFlags = (int)parms[CreateMaterialAnimationFlag];
-	// the following works if not using the shaders
+	// the following works if not using the shaders. The prim shader does the
+	// animation itself.
 	if (animFlags != 0) {
 		LG::Log("OLMaterialTracker::CreateMaterialDescorateTus: adding texture animation. f=%d", animFlags);
 		Ogre::WaveformType waveType = Ogre::WFT_SAWTOOTH;
@@ -28,7 +28,7 @@
 
 namespace LG {
 
-class OLMaterialTracker : public Ogre::FrameListener, public SingletonInstance {
+class OLMaterialTracker : public Ogre::FrameListener, public Ogre::RenderObjectListener, public SingletonInstance {
 
 public:
 	OLMaterialTracker();
@@ -72,6 +72,10 @@ public:
 	// Ogre::FrameListener
 	bool frameEnded(const Ogre::FrameEvent&);
 
+	// Ogre::RenderObjectListener
+	void notifyRenderSingleObject(Ogre::Renderable*, const Ogre::Pass*, const Ogre::AutoParamDataSource*,
+			const Ogre::LightList*, bool);
+
 	// given some parameters, update an existing material with new definitions
 	void CreateMaterialResource(const char*, const char*, 
 		const float, const float, const float, const float,
@@ -79,9 +83,40 @@ public:
 
 	// another version with parameters in an array
 	void CreateMaterialResource2(const char*, const char*, const float[]);
+	// up to seven faces of a prim at once. The first parameter is the size of
+	// one face's parameters. Empty names are skipped.
+	void CreateMaterialResource7(const Ogre::String[], const Ogre::String[], const float[]);
+	// build the named material from the parameters
+	void BuildMaterial(const char*, const char*, const float[]);
 	void CreateMaterialSetTransparancy(Ogre::Pass*, float);
 	void CreateMaterialResource3(const char*, const char*, const float[]);
 	void CreateMaterialDecorateTus(Ogre::TextureUnitState* tus, const float[]);
+
+	// Interned materials. Faces with the same texture and parameters share one
+	// material named from a hash of the definition. The mesh builder asks for
+	// the shared material of each face.
+	Ogre::String CanonicalMaterialName(const Ogre::String&, const Ogre::String&);
+	// The mesh tracker tells us when meshes come and go so only the faces of
+	// loaded meshes are remembered.
+	void NoteMeshLoaded(const Ogre::String&);
+	void NoteMeshUnloaded(const Ogre::String&);
+	static bool IsInternedName(const Ogre::String& name) { return name.compare(0, 6, "LGMat/") == 0; }
+
+	// Prim shader materials. The material only has the texture, transparency and
+	// program variant. The face's color, texture transform, glow and shininess are
+	// custom parameters of the renderable which are set when it's rendered. So is
+	// the texture animation which the program computes from the time.
+	// Faces can only share a mesh section if these values are the same.
+	bool UseUberShader() { return m_shouldUseUberShader; }
+	static bool IsPrimProgram(const Ogre::String& name) { return name.compare(0, 6, "LGPrim") == 0; }
+	Ogre::String FaceValuesKey(const Ogre::String&);
+	void NoteMergedFaces(const std::vector<Ogre::String>&);
+	// Skeletal entities (avatars) use a copy of their face materials with the
+	// skinned program so the bones are blended on the card.
+	Ogre::String SkinnedMaterialName(const Ogre::String&);
+	static bool IsSkinnedName(const Ogre::String& name) {
+		return name.length() > 8 && name.compare(name.length() - 8, 8, "/Skinned") == 0;
+	}
 	// the order of the parameters in the CreateMaterialResource2 parameter array
 	enum CreateMaterialParams {
 		CreateMaterialColorR,
@@ -126,6 +161,7 @@ private:
 	Ogre::MaterialSerializer* m_serializer;
 	bool m_shouldSerialize;
 	bool m_shouldUseShaders;
+	bool m_shouldUseUberShader;
 
 	typedef std::map<Ogre::String, unsigned long> RequestedMaterialHashMap;
 	RequestedMaterialHashMap m_requestedMaterials;
@@ -140,6 +176,84 @@ private:
 
 	int m_slowCount;	// the number of frames until we check meshes
 
+	// Interned materials are referenced by serialized meshes so their
+	// definitions are kept in the pack. The faces that loaded meshes were built
+	// with are remembered so the mesh can be built again if the face changes.
+	// A mesh read back from the pack gets its faces from its section names.
+	bool m_shouldIntern;
+	typedef struct {
+		Ogre::String texName;
+		std::vector<float> parms;
+		bool built;
+	} InternedMaterial;
+	typedef std::map<Ogre::String, InternedMaterial> InternedMaterialHashMap;
+	InternedMaterialHashMap m_interned;		// shared name -> definition
+	typedef std::map<Ogre::String, Ogre::String> FaceCanonicalHashMap;
+	FaceCanonicalHashMap m_faceCanonical;	// face material -> shared name
+	typedef std::map<Ogre::String, Ogre::String> FaceMeshHashMap;
+	typedef std::map<Ogre::String, FaceMeshHashMap> InternedFaceHashMap;
+	InternedFaceHashMap m_internedFaces;	// face material -> mesh -> shared name the mesh was built with
+	typedef std::map<Ogre::String, std::set<Ogre::String> > MeshFacesHashMap;
+	MeshFacesHashMap m_meshFaces;			// mesh -> its faces in m_internedFaces
+	bool m_internDirty;
+	unsigned long m_internSaved;			// when the index was last written
+	LGLOCK_MUTEX m_internMutex;
+
+	// The last definition applied to each material. The managed code resends
+	// all the faces of a prim when anything about the prim changes so most
+	// definitions are the same as the last one. Faces whose texture transform
+	// or color changes are patched in place and are no longer interned.
+	typedef struct {
+		Ogre::String texName;
+		float parms[CreateMaterialSize];
+	} AppliedMaterial;
+	typedef std::map<Ogre::String, AppliedMaterial> AppliedMaterialHashMap;
+	AppliedMaterialHashMap m_applied;
+	std::set<Ogre::String> m_volatileFaces;
+	enum {
+		DefinitionSame,
+		DefinitionValues,		// only the per-face values of the prim shader
+		DefinitionPatchable,
+		DefinitionChanged
+	};
+	int CompareApplied(const Ogre::String&, const Ogre::String&, const float*);
+	bool PatchMaterial(const Ogre::String&, const Ogre::String&, const float*);
+	void MakeVolatile(const Ogre::String&);
+
+	// The per-face values for the prim shader. Entries are never removed since
+	// renderables point to them.
+	typedef struct {
+		Ogre::Vector4 values[6];	// custom parameters 0 through 5 (see LGPrim.cg)
+		Ogre::Real animStart;		// controller time the texture animation started
+		unsigned long version;
+	} FaceValues;
+	typedef std::map<Ogre::String, FaceValues> FaceValuesHashMap;
+	FaceValuesHashMap m_faceValues;
+	FaceValues m_defaultFaceValues;
+	// kept in the renderable's user any (which wants to be able to print it)
+	typedef struct {
+		FaceValues* values;
+		unsigned long version;
+	} FaceBinding;
+	friend std::ostream& operator<<(std::ostream& o, const FaceBinding&) { return o; }
+	// faces that were put in one section with other faces -> their values key then
+	typedef std::map<Ogre::String, Ogre::String> MergedFaceHashMap;
+	MergedFaceHashMap m_mergedFaces;
+	bool IsFaceValue(int, float, float);
+	void SetFaceValues(const Ogre::String&, const float*);
+	void SetFaceValuesDefault(FaceValues&);
+	Ogre::String ValuesKey(const FaceValues&);
+	FaceValues* BindFaceValues(Ogre::Renderable*);
+	// materials that have a skinned copy which is built along with them
+	std::set<Ogre::String> m_skinned;
+
+	bool InternMaterial(const Ogre::String&, const Ogre::String&, const float*);
+	bool FabricateInterned(const Ogre::String&, Ogre::MaterialPtr);
+	Ogre::String MaterialKey(const Ogre::String&, const float*);
+	void LinkInternedFace(const Ogre::String&, const Ogre::String&, const Ogre::String&);
+	void LoadInterned();
+	std::vector<char>* SaveInterned();
+
 };
 
 }
\ No newline at end of file
@@ -28,7 +28,12 @@
 #include <sys/stat.h>
 #include "RendererOgre.h"
 #include "ProcessBetweenFrame.h"
+#include "OLPackFile.h"
+#include "OLArchive.h"
+#include "OLMaterialTracker.h"
+#include "OLPlaceholder.h"
 #include "LGLocking.h"
+#include "LGTrace.h"
 
 /*
 NOTE TO THE NEXT PERSON: CODE NOT COMPLETE OR HOOKED INTO MAIN CODE
@@ -110,6 +115,7 @@ void OLMeshTracker::ProcessThreadRoutine() {
 		LG::Log("OLMeshTracker::ProcessThreadRoutine: thread register threw: %s", e.getDescription().c_str());
 	}
 	LGLOCK_THREAD_INITIALIZED;
+	LGTRACE_THREAD("OLMeshTracker");
 
 	LG::OLMeshTracker* inst = LG::OLMeshTracker::Instance();
 	while (inst->KeepProcessing) {
@@ -132,29 +138,34 @@ void OLMeshTracker::ProcessWorkItems(int totalCost) {
 	LG::OLMeshTracker* inst = LG::OLMeshTracker::Instance();
 	while (runningCost > 0) {
 		operate = NULL;
+		const char* traceName = NULL;
 		// get an work entry from one of the lists
 		if (!inst->m_meshesToLoad->isEmpty()) {
 			operate = inst->m_meshesToLoad->GetFirst();
+			traceName = "MeshLoad";
 		}
 		else {
 			if (!inst->m_meshesToUnload->isEmpty()) {
 				operate = inst->m_meshesToUnload->GetFirst();
+				traceName = "MeshUnload";
 			}
 			else {
 				if (!inst->m_meshesToSerialize->isEmpty()) {
 					operate = inst->m_meshesToSerialize->GetFirst();
+					traceName = "MeshSerialize";
 				}
 			}
 		}
 		if (operate != NULL) {
 			try {
+				LGTRACE_SCOPE(traceName);
 				operate->Process();
 			}
 			catch (...) {
 				LG::Log("ProcessBetweenFrame: EXCEPTION PROCESSING: %s", operate->uniq.c_str());
 			}
 			runningCost -= operate->cost;
-			LG::Log("OLMeshTracker::ProcessWorkItems: c=%d, u=%s", runningCost, operate->uniq.c_str());
+			LG::LogDetail("OLMeshTracker::ProcessWorkItems: c=%d, u=%s", runningCost, operate->uniq.c_str());
 
 			delete(operate);
 		}
@@ -188,7 +199,9 @@ public:
 	}
 	void Process() {
 		LG::Log("OLMeshTracker::MakeLoadedQm: loading: %s (%s)", meshName.c_str(), this->stringParam.c_str());
+		LG::OLPlaceholder::Instance()->DeclareMesh(this->meshName);
 		Ogre::MeshManager::getSingleton().load(this->meshName, OLResourceGroupName);
+		LG::OLMaterialTracker::Instance()->NoteMeshLoaded(this->meshName);
 		if ((stringParam == "visible") && (this->entityParam != NULL)) {
 			LG::Log("OLMeshTracker::MakeLoadedQm: making visible");
 			this->entityParam->setVisible(true);
@@ -215,7 +228,9 @@ public:
 	}
 	void Process() {
 		// LG::Log("OLMeshTracker::MakeLoaded2Qm: loading: %s", meshName.c_str());
+		LG::OLPlaceholder::Instance()->DeclareMesh(this->meshName);
 		Ogre::MeshManager::getSingleton().load(this->meshName, OLResourceGroupName);
+		LG::OLMaterialTracker::Instance()->NoteMeshLoaded(this->meshName);
 	}
 };
 
@@ -240,14 +255,28 @@ public:
 		this->stringParam.clear();
 	}
 	void Process() {
-		Ogre::String targetFilename = LG::RendererOgre::Instance()->EntityNameToFilename(this->meshName, Ogre::String(""));
-
-		// Make sure the directory exists -- I wish the serializer did this for me
-		LG::RendererOgre::Instance()->CreateParentDirectory(targetFilename);
-		LG::Log("OLMeshTracker::MakePersistant: persistance to %s", targetFilename.c_str());
-		
 		Ogre::MeshPtr meshHandle = (Ogre::MeshPtr)Ogre::MeshManager::getSingleton().getByName(meshName);
-		LG::OLMeshTracker::Instance()->MeshSerializer->exportMesh(meshHandle.getPointer(), targetFilename);
+		if (LG::OLPackFile::Instance()->IsEnabled()) {
+			// The serializer only writes files so write to one scratch file and
+			// snapshot that into memory. The pack's background thread compresses
+			// and writes it so all we wait for here is the serializer.
+			Ogre::String scratchFilename = LG::RendererOgre::Instance()->EntityNameToFilename("PackScratch", ".mesh");
+			LG::OLMeshTracker::Instance()->MeshSerializer->exportMesh(meshHandle.getPointer(), scratchFilename);
+			if (!LG::OLPackFile::Instance()->StoreFileLater(this->meshName, scratchFilename)) {
+				LG::Log("OLMeshTracker::MakePersistant: failed adding %s to pack", this->meshName.c_str());
+			}
+			remove(scratchFilename.c_str());
+		}
+		else {
+			Ogre::String targetFilename = LG::RendererOgre::Instance()->EntityNameToFilename(this->meshName, Ogre::String(""));
+
+			// Make sure the directory exists -- I wish the serializer did this for me
+			LG::RendererOgre::Instance()->CreateParentDirectory(targetFilename);
+			LG::Log("OLMeshTracker::MakePersistant: persistance to %s", targetFilename.c_str());
+			
+			LG::OLMeshTracker::Instance()->MeshSerializer->exportMesh(meshHandle.getPointer(), targetFilename);
+			LG::OLArchive::NoteFileExists(this->meshName);
+		}
 		if (this->stringParam == "unload") {
 			LG::Log("OLMeshTracker::MakePersistant: queuing unload after persistance");
 			// if we're supposed to unload after serializing, schedule that to happen
@@ -272,6 +301,7 @@ public:
 	}
 	void Process() {
 		meshP->reload();
+		LG::OLMaterialTracker::Instance()->NoteMeshLoaded(meshP->getName());
 		LG::OLMeshTracker::Instance()->UpdateSceneNodesForMesh(meshP);
 	}
 };
@@ -392,6 +422,7 @@ void OLMeshTracker::MakeUnLoadedLocked(Ogre::String meshName, Ogre::String strin
 		if (!meshP.isNull()) {
 			if (meshP.useCount() == 1) {
 				meshP->unload();
+				LG::OLMaterialTracker::Instance()->NoteMeshUnloaded(meshName);
 			}
 			else {
 				LG::Log("OLMeshTracker::MakeUnLoaded: Didn't unload mesh because count = %d", meshP.useCount());
@@ -0,0 +1,850 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <time.h>
+#include "OLPackFile.h"
+#include "LookingGlassOgre.h"
+#include "RendererOgre.h"
+#include "LGCompress.h"
+
+#ifdef WIN32
+#define PACK_FSEEK(fp, off) _fseeki64((fp), (__int64)(off), SEEK_SET)
+#define PACK_FSYNC(fp) _commit(_fileno(fp))
+#define PACK_TRUNCATE(fp, len) _chsize_s(_fileno(fp), (__int64)(len))
+#else
+#define PACK_FSEEK(fp, off) fseeko((fp), (off_t)(off), SEEK_SET)
+#define PACK_FSYNC(fp) fsync(fileno(fp))
+#define PACK_TRUNCATE(fp, len) ftruncate(fileno(fp), (off_t)(len))
+#endif
+
+namespace LG {
+
+OLPackFile* OLPackFile::m_instance = NULL;
+bool OLPackFile::m_keepProcessing = false;
+
+// The data file is a header (magic, version, generation) followed by records.
+// Each record is a header (magic, name length, data length, checksum), the name
+// and then the data.
+// The index file is a header (magic, version, generation, data length, count)
+// followed by the entries (name length, name, data offset, data length).
+// The top bit of the name length says the data is compressed. Compressed data
+// starts with the uncompressed length.
+static const Ogre::uint32 PackDataMagic = 0x4650474C;		// 'LGPF'
+static const Ogre::uint32 PackIndexMagic = 0x4950474C;		// 'LGPI'
+static const Ogre::uint32 PackRecordMagic = 0x5250474C;		// 'LGPR'
+static const Ogre::uint32 PackVersion = 1;
+static const Ogre::uint64 PackDataHeaderSize = 16;
+static const Ogre::uint64 PackRecordHeaderSize = 16;
+static const Ogre::uint32 PackMaxNameLength = 4096;
+static const Ogre::uint64 PackGrowSize = 16 * 1024 * 1024;
+static const Ogre::uint32 PackRecordCompressed = 0x80000000;
+static const Ogre::uint32 PackNameLengthMask = 0x7fffffff;
+
+static Ogre::uint32 PackChecksum(const void* data, Ogre::uint32 len) {
+	Ogre::uint32 hash = 2166136261U;
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (Ogre::uint32 ii = 0; ii < len; ii++) {
+		hash = (hash ^ bytes[ii]) * 16777619U;
+	}
+	return hash;
+}
+
+// A stream that points right into a mapping of the data file. Holds a reference
+// on the mapping until it is closed.
+class PackMapStream : public Ogre::MemoryDataStream {
+public:
+	PackMapStream(const Ogre::String& name, char* data, size_t len, OLPackFile* pack, OLPackFile::PackMap* map)
+				: Ogre::MemoryDataStream(name, data, len, false, true), m_pack(pack), m_map(map) {
+	}
+	~PackMapStream() {
+		close();
+	}
+	void close() {
+		Ogre::MemoryDataStream::close();
+		// a stream that outlives the pack has nothing to release
+		if (m_map != NULL && OLPackFile::m_instance == m_pack) {
+			m_pack->ReleaseMap(m_map);
+		}
+		m_map = NULL;
+	}
+private:
+	OLPackFile* m_pack;
+	OLPackFile::PackMap* m_map;
+};
+
+OLPackFile::OLPackFile() {
+	// the background thread uses the instance so it must be set before it starts
+	m_instance = this;
+	m_dataFile = NULL;
+	m_map = NULL;
+	m_generation = 0;
+	m_dataLength = 0;
+	m_fileLength = 0;
+	m_liveLength = 0;
+	m_unsavedRecords = 0;
+	m_packLock = LGLOCK_ALLOCATE_MUTEX("OLPackFile");
+	m_enabled = LG::GetParameterBool("Renderer.Ogre.PackCache.Enable");
+	m_importLooseFiles = LG::GetParameterBool("Renderer.Ogre.PackCache.ImportLooseFiles");
+	m_compactMinimum = (Ogre::uint64)LG::GetParameterInt("Renderer.Ogre.PackCache.CompactMinimumMB") * 1024 * 1024;
+	m_compress = LG::GetParameterBool("Renderer.Ogre.PackCache.Compress");
+	if (!m_enabled) {
+		LG::Log("OLPackFile: pack cache not enabled");
+		return;
+	}
+	Ogre::String cacheDir = LG::GetParameter("Renderer.Ogre.CacheDir");
+	m_dataFilename = cacheDir + "/LookingGlass.pack";
+	m_indexFilename = cacheDir + "/LookingGlass.packindex";
+	if (!OpenDataFile()) {
+		LG::Log("OLPackFile: could not open pack file %s. Pack cache disabled.", m_dataFilename.c_str());
+		m_enabled = false;
+		return;
+	}
+	LoadIndex();
+	if (!MapData()) {
+		LG::Log("OLPackFile: could not map pack file %s. Pack cache disabled.", m_dataFilename.c_str());
+		m_enabled = false;
+		return;
+	}
+	LG::Log("OLPackFile: opened %s: entries=%d, length=%ld, live=%ld", m_dataFilename.c_str(),
+				(int)m_index.size(), (long)m_dataLength, (long)m_liveLength);
+	m_keepProcessing = true;
+	m_backgroundThread = LGLOCK_ALLOCATE_THREAD(&BackgroundThreadRoutine);
+}
+
+OLPackFile::~OLPackFile() {
+	Shutdown();
+	UnmapAll();
+	m_instance = NULL;
+	if (m_dataFile != NULL) {
+		fclose(m_dataFile);
+		m_dataFile = NULL;
+	}
+	LGLOCK_RELEASE_MUTEX(m_packLock);
+}
+
+// SingletonInstance.Shutdown()
+// Stop the background thread and make sure the index is up to date
+void OLPackFile::Shutdown() {
+	m_keepProcessing = false;
+	// the thread could be in the middle of writing or compacting. Let it finish
+	// before we write what is left.
+	if (m_backgroundThread.joinable()) {
+		m_backgroundThread.join();
+	}
+	if (m_enabled) {
+		FlushPendingStores();
+	}
+	if (m_enabled && m_unsavedRecords > 0) {
+		WriteIndex();
+	}
+	return;
+}
+
+// Open the data file or create a new one if it doesn't exist.
+bool OLPackFile::OpenDataFile() {
+	m_dataFile = fopen(m_dataFilename.c_str(), "r+b");
+	if (m_dataFile == NULL) {
+		LG::RendererOgre::Instance()->CreateParentDirectory(m_dataFilename);
+		m_dataFile = fopen(m_dataFilename.c_str(), "w+b");
+		if (m_dataFile == NULL) {
+			return false;
+		}
+		m_generation = (Ogre::uint64)time(NULL);
+		Ogre::uint32 hdr[2] = { PackDataMagic, PackVersion };
+		fwrite(hdr, sizeof(hdr), 1, m_dataFile);
+		fwrite(&m_generation, sizeof(m_generation), 1, m_dataFile);
+		fflush(m_dataFile);
+		m_dataLength = m_fileLength = PackDataHeaderSize;
+		return true;
+	}
+	Ogre::uint32 hdr[2];
+	if (fread(hdr, sizeof(hdr), 1, m_dataFile) != 1
+				|| fread(&m_generation, sizeof(m_generation), 1, m_dataFile) != 1
+				|| hdr[0] != PackDataMagic || hdr[1] != PackVersion) {
+		LG::Log("OLPackFile::OpenDataFile: bad header on %s", m_dataFilename.c_str());
+		fclose(m_dataFile);
+		m_dataFile = NULL;
+		return false;
+	}
+	fseek(m_dataFile, 0, SEEK_END);
+#ifdef WIN32
+	m_fileLength = (Ogre::uint64)_ftelli64(m_dataFile);
+#else
+	m_fileLength = (Ogre::uint64)ftello(m_dataFile);
+#endif
+	m_dataLength = PackDataHeaderSize;
+	return true;
+}
+
+// Read in the index. Anything in the data file past what the index knows about
+// (appended after the last index write) is found by scanning the records.
+// If the index doesn't match the data file, the whole data file is scanned.
+void OLPackFile::LoadIndex() {
+	Ogre::uint64 indexedLength = PackDataHeaderSize;
+	FILE* idx = fopen(m_indexFilename.c_str(), "rb");
+	if (idx != NULL) {
+		Ogre::uint32 hdr[2];
+		Ogre::uint64 gen, len;
+		Ogre::uint32 count;
+		if (fread(hdr, sizeof(hdr), 1, idx) == 1 && hdr[0] == PackIndexMagic && hdr[1] == PackVersion
+					&& fread(&gen, sizeof(gen), 1, idx) == 1 && fread(&len, sizeof(len), 1, idx) == 1
+					&& fread(&count, sizeof(count), 1, idx) == 1
+					&& gen == m_generation && len <= m_fileLength) {
+			bool good = true;
+			std::vector<char> nm(PackMaxNameLength);
+			for (Ogre::uint32 ii = 0; good && ii < count; ii++) {
+				Ogre::uint32 nameLen;
+				PackEntry ent;
+				good = fread(&nameLen, sizeof(nameLen), 1, idx) == 1;
+				ent.flags = nameLen & PackRecordCompressed;
+				nameLen &= PackNameLengthMask;
+				good = good && nameLen > 0 && nameLen <= PackMaxNameLength
+					&& fread(&nm[0], nameLen, 1, idx) == 1
+					&& fread(&ent.offset, sizeof(ent.offset), 1, idx) == 1
+					&& fread(&ent.length, sizeof(ent.length), 1, idx) == 1
+					&& (ent.offset + ent.length) <= len;
+				if (good) {
+					m_index[Ogre::String(&nm[0], nameLen)] = ent;
+					m_liveLength += PackRecordHeaderSize + nameLen + ent.length;
+				}
+			}
+			if (good) {
+				indexedLength = len;
+			}
+			else {
+				LG::Log("OLPackFile::LoadIndex: index corrupt. Rebuilding from data file.");
+				m_index.clear();
+				m_liveLength = 0;
+			}
+		}
+		else {
+			LG::Log("OLPackFile::LoadIndex: index does not match data file. Rebuilding from data file.");
+		}
+		fclose(idx);
+	}
+	m_dataLength = ScanRecords(indexedLength);
+	if (m_dataLength != indexedLength) {
+		// found things the index didn't know about. Remember them.
+		m_unsavedRecords++;
+	}
+	if (m_dataLength < m_fileLength) {
+		// chop off any partial record or unused growth space
+		PACK_TRUNCATE(m_dataFile, m_dataLength);
+		m_fileLength = m_dataLength;
+	}
+}
+
+// Walk the records starting at 'offset' adding them to the index. Returns the
+// offset of the end of the last good record.
+Ogre::uint64 OLPackFile::ScanRecords(Ogre::uint64 offset) {
+	int found = 0;
+	std::vector<char> nm(PackMaxNameLength);
+	std::vector<char> data;
+	while ((offset + PackRecordHeaderSize) <= m_fileLength) {
+		Ogre::uint32 rhdr[4];
+		PACK_FSEEK(m_dataFile, offset);
+		if (fread(rhdr, sizeof(rhdr), 1, m_dataFile) != 1) break;
+		Ogre::uint32 flags = rhdr[1] & PackRecordCompressed;
+		rhdr[1] &= PackNameLengthMask;
+		if (rhdr[0] != PackRecordMagic || rhdr[1] == 0 || rhdr[1] > PackMaxNameLength) break;
+		Ogre::uint64 dataOffset = offset + PackRecordHeaderSize + rhdr[1];
+		if ((dataOffset + rhdr[2]) > m_fileLength) break;
+		if (fread(&nm[0], rhdr[1], 1, m_dataFile) != 1) break;
+		data.resize(rhdr[2] + 1);
+		if (rhdr[2] > 0 && fread(&data[0], rhdr[2], 1, m_dataFile) != 1) break;
+		if (PackChecksum(&data[0], rhdr[2]) != rhdr[3]) break;
+		Ogre::String name(&nm[0], rhdr[1]);
+		PackIndexHashMap::iterator intr = m_index.find(name);
+		if (intr != m_index.end()) {
+			m_liveLength -= PackRecordHeaderSize + name.length() + intr->second.length;
+		}
+		PackEntry ent;
+		ent.offset = dataOffset;
+		ent.length = rhdr[2];
+		ent.flags = flags;
+		m_index[name] = ent;
+		m_liveLength += PackRecordHeaderSize + name.length() + ent.length;
+		offset = dataOffset + rhdr[2];
+		found++;
+	}
+	if (found > 0) {
+		LG::Log("OLPackFile::ScanRecords: recovered %d records not in the index", found);
+	}
+	return offset;
+}
+
+// Write the index to a temp file and rename it into place.
+void OLPackFile::WriteIndex() {
+	PackIndexHashMap indexCopy;
+	Ogre::uint64 gen, dataLength;
+	// copy what we need so the writing is done without holding the lock
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	if (m_dataFile == NULL) {
+		return;
+	}
+	// the data must be on the disk before an index that points to it
+	fflush(m_dataFile);
+	PACK_FSYNC(m_dataFile);
+	indexCopy = m_index;
+	gen = m_generation;
+	dataLength = m_dataLength;
+	m_unsavedRecords = 0;
+	packLock.Unlock();
+
+	Ogre::String tempFilename = m_indexFilename + ".tmp";
+	FILE* idx = fopen(tempFilename.c_str(), "wb");
+	if (idx == NULL) {
+		LG::Log("OLPackFile::WriteIndex: could not create %s", tempFilename.c_str());
+		return;
+	}
+	Ogre::uint32 hdr[2] = { PackIndexMagic, PackVersion };
+	Ogre::uint32 count = (Ogre::uint32)indexCopy.size();
+	bool good = fwrite(hdr, sizeof(hdr), 1, idx) == 1
+			&& fwrite(&gen, sizeof(gen), 1, idx) == 1
+			&& fwrite(&dataLength, sizeof(dataLength), 1, idx) == 1
+			&& fwrite(&count, sizeof(count), 1, idx) == 1;
+	for (PackIndexHashMap::iterator intr = indexCopy.begin(); good && intr != indexCopy.end(); intr++) {
+		Ogre::uint32 nameLen = (Ogre::uint32)intr->first.length();
+		Ogre::uint32 nameLenFlags = nameLen | intr->second.flags;
+		good = fwrite(&nameLenFlags, sizeof(nameLenFlags), 1, idx) == 1
+			&& fwrite(intr->first.c_str(), nameLen, 1, idx) == 1
+			&& fwrite(&intr->second.offset, sizeof(intr->second.offset), 1, idx) == 1
+			&& fwrite(&intr->second.length, sizeof(intr->second.length), 1, idx) == 1;
+	}
+	good = good && fflush(idx) == 0 && PACK_FSYNC(idx) == 0;
+	fclose(idx);
+	if (!good) {
+		LG::Log("OLPackFile::WriteIndex: failed writing %s", tempFilename.c_str());
+		remove(tempFilename.c_str());
+		return;
+	}
+#ifdef WIN32
+	good = MoveFileExA(tempFilename.c_str(), m_indexFilename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	good = rename(tempFilename.c_str(), m_indexFilename.c_str()) == 0;
+#endif
+	if (!good) {
+		LG::Log("OLPackFile::WriteIndex: failed renaming %s", tempFilename.c_str());
+	}
+}
+
+// Make sure the whole data file is mapped. If there is an existing mapping that
+// is too small, it is retired (streams could still be pointing into it).
+// Called with the lock held.
+bool OLPackFile::MapData() {
+	if (m_map != NULL && m_map->length >= m_fileLength) {
+		return true;
+	}
+	fflush(m_dataFile);
+	RetireMap();
+	char* base;
+#ifdef WIN32
+	HANDLE fileHandle = (HANDLE)_get_osfhandle(_fileno(m_dataFile));
+	HANDLE mapHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 
+				(DWORD)(m_fileLength >> 32), (DWORD)(m_fileLength & 0xffffffff), NULL);
+	if (mapHandle == NULL) {
+		return false;
+	}
+	base = (char*)MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, (SIZE_T)m_fileLength);
+	CloseHandle(mapHandle);		// the view keeps the mapping around
+	if (base == NULL) {
+		return false;
+	}
+#else
+	void* mbase = mmap(NULL, (size_t)m_fileLength, PROT_READ, MAP_SHARED, fileno(m_dataFile), 0);
+	if (mbase == MAP_FAILED) {
+		return false;
+	}
+	base = (char*)mbase;
+#endif
+	m_map = new PackMap;
+	m_map->base = base;
+	m_map->length = m_fileLength;
+	m_map->refs = 1;
+	return true;
+}
+
+// Stop using the current mapping. It goes away when the last stream into it does.
+// Called with the lock held.
+void OLPackFile::RetireMap() {
+	if (m_map != NULL) {
+		PackMap* map = m_map;
+		m_map = NULL;
+		m_retiredMaps.push_back(map);
+		ReleaseMapLocked(map);
+	}
+}
+
+void OLPackFile::ReleaseMap(PackMap* map) {
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	ReleaseMapLocked(map);
+}
+
+// Called with the lock held
+void OLPackFile::ReleaseMapLocked(PackMap* map) {
+	if (--map->refs > 0) {
+		return;
+	}
+	m_retiredMaps.remove(map);
+#ifdef WIN32
+	UnmapViewOfFile(map->base);
+#else
+	munmap(map->base, (size_t)map->length);
+#endif
+	delete map;
+}
+
+// At shutdown. Everything is unmapped whether there are streams into it or not.
+void OLPackFile::UnmapAll() {
+	RetireMap();
+	if (!m_retiredMaps.empty()) {
+		LG::Log("OLPackFile::UnmapAll: %d mappings still in use", (int)m_retiredMaps.size());
+	}
+	while (!m_retiredMaps.empty()) {
+		PackMap* map = m_retiredMaps.front();
+		map->refs = 1;
+		ReleaseMapLocked(map);
+	}
+}
+
+// Write one record at 'offset' in the passed file. 'offset' is updated to point
+// past the record.
+bool OLPackFile::AppendRecord(FILE* fp, Ogre::uint64& offset, const Ogre::String& name, 
+							  const void* data, Ogre::uint32 len, Ogre::uint32 flags) {
+	Ogre::uint32 rhdr[4];
+	rhdr[0] = PackRecordMagic;
+	rhdr[1] = (Ogre::uint32)name.length() | flags;
+	rhdr[2] = len;
+	rhdr[3] = PackChecksum(data, len);
+	if (PACK_FSEEK(fp, offset) != 0
+				|| fwrite(rhdr, sizeof(rhdr), 1, fp) != 1
+				|| fwrite(name.c_str(), name.length(), 1, fp) != 1
+				|| (len > 0 && fwrite(data, len, 1, fp) != 1)) {
+		return false;
+	}
+	offset += PackRecordHeaderSize + name.length() + len;
+	return true;
+}
+
+bool OLPackFile::Exists(const Ogre::String& name) {
+	if (!m_enabled) return false;
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	return m_index.find(name) != m_index.end()
+		|| m_pendingStores.find(name) != m_pendingStores.end()
+		|| m_writingStores.find(name) != m_writingStores.end();
+}
+
+// Return a stream on the named resource or a null stream if we don't have it.
+// The stream points right into the mapped data file. No copy.
+// Compressed records are decompressed here which is usually on the thread
+// doing the resource prepare.
+Ogre::DataStreamPtr OLPackFile::Open(const Ogre::String& name) {
+	if (!m_enabled) return Ogre::DataStreamPtr();
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	// something waiting to be written is newer than anything in the file
+	std::vector<char>* pending = NULL;
+	PendingStoreHashMap::iterator pintr = m_pendingStores.find(name);
+	if (pintr != m_pendingStores.end()) {
+		pending = pintr->second.data;
+	}
+	else {
+		pintr = m_writingStores.find(name);
+		if (pintr != m_writingStores.end()) {
+			pending = pintr->second.data;
+		}
+	}
+	if (pending != NULL) {
+		return CopyToStream(name, pending->empty() ? NULL : &(*pending)[0], pending->size(), 0);
+	}
+	PackIndexHashMap::iterator intr = m_index.find(name);
+	if (intr == m_index.end()) {
+		return Ogre::DataStreamPtr();
+	}
+	if (m_map == NULL || (intr->second.offset + intr->second.length) > m_map->length) {
+		if (!MapData()) {
+			LG::Log("OLPackFile::Open: failed remapping pack file");
+			return Ogre::DataStreamPtr();
+		}
+	}
+	PackMap* map = m_map;
+	map->refs++;
+	if (intr->second.flags & PackRecordCompressed) {
+		// our reference keeps the mapping around so we can decompress without the lock
+		const char* data = map->base + intr->second.offset;
+		size_t len = (size_t)intr->second.length;
+		packLock.Unlock();
+		Ogre::DataStreamPtr ret = CopyToStream(name, data, len, PackRecordCompressed);
+		ReleaseMap(map);
+		return ret;
+	}
+	return Ogre::DataStreamPtr(OGRE_NEW PackMapStream(name, 
+				map->base + intr->second.offset, (size_t)intr->second.length, this, map));
+}
+
+// Make a stream with its own copy of the data, decompressing if need be
+Ogre::DataStreamPtr OLPackFile::CopyToStream(const Ogre::String& name, const char* data, size_t len, Ogre::uint32 flags) {
+	if (!(flags & PackRecordCompressed)) {
+		Ogre::MemoryDataStream* copy = OGRE_NEW Ogre::MemoryDataStream(name, len, true);
+		if (len > 0) memcpy(copy->getPtr(), data, len);
+		return Ogre::DataStreamPtr(copy);
+	}
+	Ogre::uint32 rawLen;
+	if (len < sizeof(rawLen)) {
+		LG::Log("OLPackFile::Open: compressed record too short: %s", name.c_str());
+		return Ogre::DataStreamPtr();
+	}
+	memcpy(&rawLen, data, sizeof(rawLen));
+	Ogre::MemoryDataStream* raw = OGRE_NEW Ogre::MemoryDataStream(name, rawLen, true);
+	if (!LG::LZDecompress(data + sizeof(rawLen), len - sizeof(rawLen), raw->getPtr(), rawLen)) {
+		LG::Log("OLPackFile::Open: failed decompressing %s", name.c_str());
+		OGRE_DELETE raw;
+		return Ogre::DataStreamPtr();
+	}
+	return Ogre::DataStreamPtr(raw);
+}
+
+// Add the named resource to the pack. If there is already one by that name, this
+// one replaces it (the old one becomes dead space until the next compaction).
+bool OLPackFile::Store(const Ogre::String& name, const void* data, size_t len) {
+	if (!m_enabled || name.empty() || name.length() > PackMaxNameLength || len > 0xffffffffUL) {
+		return false;
+	}
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	if (!StoreLocked(name, data, len, 0)) {
+		return false;
+	}
+	fflush(m_dataFile);
+	return true;
+}
+
+// Append the record and index it. Called with the lock held. The caller flushes.
+bool OLPackFile::StoreLocked(const Ogre::String& name, const void* data, size_t len, Ogre::uint32 flags) {
+	Ogre::uint64 recordEnd = m_dataLength + PackRecordHeaderSize + name.length() + len;
+	if (recordEnd > m_fileLength) {
+		// grow the file in big chunks so we don't have to remap often
+		Ogre::uint64 newLength = recordEnd + PackGrowSize;
+		if (PACK_TRUNCATE(m_dataFile, newLength) != 0) {
+			LG::Log("OLPackFile::Store: could not grow pack file");
+			return false;
+		}
+		m_fileLength = newLength;
+	}
+	Ogre::uint64 writeOffset = m_dataLength;
+	if (!AppendRecord(m_dataFile, writeOffset, name, data, (Ogre::uint32)len, flags)) {
+		LG::Log("OLPackFile::Store: failed writing %s", name.c_str());
+		return false;
+	}
+	PackIndexHashMap::iterator intr = m_index.find(name);
+	if (intr != m_index.end()) {
+		m_liveLength -= PackRecordHeaderSize + name.length() + intr->second.length;
+	}
+	PackEntry ent;
+	ent.offset = writeOffset - len;
+	ent.length = (Ogre::uint32)len;
+	ent.flags = flags;
+	m_index[name] = ent;
+	m_liveLength += PackRecordHeaderSize + name.length() + len;
+	m_dataLength = writeOffset;
+	m_unsavedRecords++;
+	return true;
+}
+
+// Add the contents of a file to the pack under the passed name
+bool OLPackFile::StoreFile(const Ogre::String& name, const Ogre::String& filename) {
+	if (!m_enabled) return false;
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if (fp == NULL) {
+		return false;
+	}
+	std::vector<char> contents;
+	char buff[8192];
+	size_t got;
+	while ((got = fread(buff, 1, sizeof(buff), fp)) > 0) {
+		contents.insert(contents.end(), buff, buff + got);
+	}
+	fclose(fp);
+	return Store(name, contents.empty() ? (const void*)buff : (const void*)&contents[0], contents.size());
+}
+
+// Queue the resource to be written by the background thread. Anything already
+// waiting under that name is replaced.
+bool OLPackFile::StoreLater(const Ogre::String& name, std::vector<char>* data, bool compress) {
+	if (!m_enabled || name.empty() || name.length() > PackMaxNameLength || data->size() > 0x7fffffffUL) {
+		delete data;
+		return false;
+	}
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	PendingStoreHashMap::iterator intr = m_pendingStores.find(name);
+	if (intr != m_pendingStores.end()) {
+		delete intr->second.data;
+	}
+	PendingStore pend;
+	pend.data = data;
+	pend.compress = compress;
+	m_pendingStores[name] = pend;
+	return true;
+}
+
+// Read the file into memory and queue it for writing
+bool OLPackFile::StoreFileLater(const Ogre::String& name, const Ogre::String& filename) {
+	if (!m_enabled) return false;
+	FILE* fp = fopen(filename.c_str(), "rb");
+	if (fp == NULL) {
+		return false;
+	}
+	std::vector<char>* contents = new std::vector<char>();
+	char buff[8192];
+	size_t got;
+	while ((got = fread(buff, 1, sizeof(buff), fp)) > 0) {
+		contents->insert(contents->end(), buff, buff + got);
+	}
+	fclose(fp);
+	return StoreLater(name, contents);
+}
+
+// Write everything that's been queued. The compression is done without the lock.
+// The records are all appended and then flushed to the disk once.
+void OLPackFile::FlushPendingStores() {
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	if (m_pendingStores.empty()) {
+		return;
+	}
+	m_writingStores.swap(m_pendingStores);
+	packLock.Unlock();
+
+	// only this thread changes the writing list so the buffers are safe to read
+	std::map<Ogre::String, std::vector<char> > compressed;
+	if (m_compress) {
+		for (PendingStoreHashMap::iterator intr = m_writingStores.begin(); intr != m_writingStores.end(); intr++) {
+			std::vector<char>* raw = intr->second.data;
+			if (!intr->second.compress || raw->size() < 64) continue;
+			Ogre::uint32 rawLen = (Ogre::uint32)raw->size();
+			std::vector<char>& comp = compressed[intr->first];
+			comp.resize(sizeof(rawLen) + LG::LZCompressBound(rawLen));
+			memcpy(&comp[0], &rawLen, sizeof(rawLen));
+			size_t compLen = LG::LZCompress(&(*raw)[0], rawLen, &comp[sizeof(rawLen)], comp.size() - sizeof(rawLen));
+			if (compLen == 0 || (sizeof(rawLen) + compLen) > (raw->size() - raw->size() / 8)) {
+				// not worth it. Store it as is.
+				compressed.erase(intr->first);
+				continue;
+			}
+			comp.resize(sizeof(rawLen) + compLen);
+		}
+	}
+
+	packLock.Lock(m_packLock);
+	int written = 0;
+	for (PendingStoreHashMap::iterator intr = m_writingStores.begin(); intr != m_writingStores.end(); intr++) {
+		std::map<Ogre::String, std::vector<char> >::iterator cintr = compressed.find(intr->first);
+		bool ok;
+		if (cintr != compressed.end()) {
+			ok = StoreLocked(intr->first, &cintr->second[0], cintr->second.size(), PackRecordCompressed);
+		}
+		else {
+			std::vector<char>* raw = intr->second.data;
+			ok = StoreLocked(intr->first, raw->empty() ? (const void*)"" : (const void*)&(*raw)[0], raw->size(), 0);
+		}
+		if (ok) written++;
+		delete intr->second.data;
+	}
+	m_writingStores.clear();
+	fflush(m_dataFile);
+	PACK_FSYNC(m_dataFile);
+	packLock.Unlock();
+	LG::Log("OLPackFile::FlushPendingStores: wrote %d records", written);
+}
+
+// Copy the records still in the index into a new data file and switch to it.
+// Most of the copying is done without the lock. Anything stored while we were
+// copying is added at the end once we have the lock again.
+void OLPackFile::Compact() {
+	LGLOCK_ALOCK packLock;
+	packLock.Lock(m_packLock);
+	if (!MapData()) {
+		return;
+	}
+	PackIndexHashMap indexCopy = m_index;
+	PackMap* snapMap = m_map;		// our reference keeps it mapped even if retired
+	snapMap->refs++;
+	Ogre::uint64 snapLength = m_dataLength;
+	Ogre::uint64 snapLive = m_liveLength;
+	Ogre::uint64 newGeneration = m_generation + 1;
+	packLock.Unlock();
+
+	LG::Log("OLPackFile::Compact: compacting %s: length=%ld, live=%ld", 
+				m_dataFilename.c_str(), (long)snapLength, (long)snapLive);
+	Ogre::String compactFilename = m_dataFilename + ".compact";
+	FILE* newFile = fopen(compactFilename.c_str(), "w+b");
+	if (newFile == NULL) {
+		LG::Log("OLPackFile::Compact: could not create %s", compactFilename.c_str());
+		ReleaseMap(snapMap);
+		return;
+	}
+	Ogre::uint32 hdr[2] = { PackDataMagic, PackVersion };
+	bool good = fwrite(hdr, sizeof(hdr), 1, newFile) == 1
+			&& fwrite(&newGeneration, sizeof(newGeneration), 1, newFile) == 1;
+	Ogre::uint64 writeOffset = PackDataHeaderSize;
+	PackIndexHashMap newIndex;
+	for (PackIndexHashMap::iterator intr = indexCopy.begin(); good && intr != indexCopy.end(); intr++) {
+		good = AppendRecord(newFile, writeOffset, intr->first, snapMap->base + intr->second.offset, 
+					intr->second.length, intr->second.flags);
+		PackEntry ent;
+		ent.offset = writeOffset - intr->second.length;
+		ent.length = intr->second.length;
+		ent.flags = intr->second.flags;
+		newIndex[intr->first] = ent;
+	}
+
+	packLock.Lock(m_packLock);
+	ReleaseMapLocked(snapMap);
+	// catch up with anything stored while we were copying
+	if (good && m_dataLength > snapLength) {
+		good = MapData();
+		for (PackIndexHashMap::iterator intr = m_index.begin(); good && intr != m_index.end(); intr++) {
+			if (intr->second.offset >= snapLength) {
+				good = AppendRecord(newFile, writeOffset, intr->first, m_map->base + intr->second.offset, 
+							intr->second.length, intr->second.flags);
+				PackEntry ent;
+				ent.offset = writeOffset - intr->second.length;
+				ent.length = intr->second.length;
+				ent.flags = intr->second.flags;
+				newIndex[intr->first] = ent;
+			}
+		}
+	}
+	good = good && fflush(newFile) == 0 && PACK_FSYNC(newFile) == 0;
+	// If we crash after the rename, the index generation won't match the new data
+	// file and the index will be rebuilt by scanning the data file.
+	bool switched = false;
+	if (good) {
+#ifdef WIN32
+		// Windows won't rename onto a file that is open or mapped so both files are
+		// closed and the old one unmapped around the rename. That can only be done
+		// when no streams are reading the old file. If some are, try again next time.
+		RetireMap();
+		if (!m_retiredMaps.empty()) {
+			LG::Log("OLPackFile::Compact: %d mappings of %s in use. Will try later.", 
+						(int)m_retiredMaps.size(), m_dataFilename.c_str());
+		}
+		else {
+			fclose(newFile);
+			newFile = NULL;
+			fclose(m_dataFile);
+			switched = MoveFileExA(compactFilename.c_str(), m_dataFilename.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+			// this is either the new file or, if the rename failed, the old one
+			m_dataFile = fopen(m_dataFilename.c_str(), "r+b");
+			if (m_dataFile == NULL) {
+				LG::Log("OLPackFile::Compact: could not reopen %s. Pack cache disabled.", m_dataFilename.c_str());
+				m_enabled = false;
+				return;
+			}
+		}
+#else
+		switched = rename(compactFilename.c_str(), m_dataFilename.c_str()) == 0;
+#endif
+	}
+	if (!switched) {
+		LG::Log("OLPackFile::Compact: failed switching to %s", compactFilename.c_str());
+		if (newFile != NULL) {
+			fclose(newFile);
+		}
+		remove(compactFilename.c_str());
+		MapData();
+		return;
+	}
+#ifndef WIN32
+	fclose(m_dataFile);
+	m_dataFile = newFile;
+#endif
+	m_index = newIndex;
+	m_generation = newGeneration;
+	m_dataLength = m_fileLength = writeOffset;
+	// Something replaced while we were copying is in the new file twice so only
+	// count what the index points to.
+	m_liveLength = 0;
+	for (PackIndexHashMap::iterator intr = m_index.begin(); intr != m_index.end(); intr++) {
+		m_liveLength += PackRecordHeaderSize + intr->first.length() + intr->second.length;
+	}
+	// the current mapping is of the old file
+	RetireMap();
+	MapData();
+	m_unsavedRecords++;
+	packLock.Unlock();
+	WriteIndex();
+	LG::Log("OLPackFile::Compact: compacted to %ld", (long)writeOffset);
+}
+
+// Write anything queued about once a second. Every now and then write the index
+// and see if the data file needs compacting.
+void OLPackFile::BackgroundThreadRoutine() {
+	LG::OLPackFile* inst = LG::OLPackFile::m_instance;
+	Ogre::Timer timeKeeper;
+	unsigned long lastCheck = timeKeeper.getMilliseconds();
+	while (LG::OLPackFile::m_keepProcessing) {
+		LGLOCK_SLEEP(1);
+		try {
+			inst->FlushPendingStores();
+		}
+		catch (...) {
+			LG::Log("OLPackFile::BackgroundThreadRoutine: exception writing queued resources");
+		}
+		if (timeKeeper.getMilliseconds() < (lastCheck + 10000)) {
+			continue;
+		}
+		lastCheck = timeKeeper.getMilliseconds();
+		try {
+			LGLOCK_ALOCK packLock;
+			packLock.Lock(inst->m_packLock);
+			bool unsaved = inst->m_unsavedRecords > 0;
+			Ogre::uint64 dataLength = inst->m_dataLength;
+			Ogre::uint64 wasted = dataLength - PackDataHeaderSize - inst->m_liveLength;
+			packLock.Unlock();
+			if (unsaved) {
+				inst->WriteIndex();
+			}
+			if (wasted > inst->m_compactMinimum && wasted > (dataLength / 2)) {
+				inst->Compact();
+			}
+		}
+		catch (...) {
+			LG::Log("OLPackFile::BackgroundThreadRoutine: exception");
+		}
+	}
+}
+
+}
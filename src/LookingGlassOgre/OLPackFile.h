@@ -0,0 +1,141 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LGLocking.h"
+#include "SingletonInstance.h"
+
+namespace LG {
+
+class PackMapStream;
+
+// A single file cache for meshes and textures.
+// Thousands of little files in the cache directory make for lots of filesystem
+// metadata operations (directory creation, stats, opens). Instead, the resources
+// are appended to one data file which is memory mapped for reading. Reads are
+// MemoryDataStreams that point right into the mapping.
+// An index file records where each named resource is. The index is written to
+// a temp file and renamed into place so a crash leaves either the old or new
+// index. The records in the data file are self describing so anything appended
+// after the last index write is found by scanning the end of the data file.
+// A background thread periodically writes the index and, when enough of the
+// data file is replaced records, compacts the data file.
+// Resources can also be stored write-behind: they are queued and the background
+// thread compresses them and appends them all with one flush to the disk.
+// Until then, they are read from the queue.
+class OLPackFile : public SingletonInstance {
+public:
+	OLPackFile();
+	~OLPackFile();
+
+	static OLPackFile* Instance() { 
+		if (LG::OLPackFile::m_instance == NULL) {
+			LG::OLPackFile::m_instance = new OLPackFile();
+		}
+		return LG::OLPackFile::m_instance; 
+	}
+
+	// SingletonInstance.Shutdown();
+	void Shutdown();
+
+	bool IsEnabled() { return m_enabled; }
+	bool ShouldImportLooseFiles() { return m_enabled && m_importLooseFiles; }
+
+	bool Exists(const Ogre::String&);
+	Ogre::DataStreamPtr Open(const Ogre::String&);
+	bool Store(const Ogre::String&, const void*, size_t);
+	bool StoreFile(const Ogre::String&, const Ogre::String&);
+	// write-behind. The pack takes ownership of the passed buffer.
+	bool StoreLater(const Ogre::String&, std::vector<char>*, bool compress = true);
+	bool StoreFileLater(const Ogre::String&, const Ogre::String&);
+
+private:
+	friend class PackMapStream;
+	static OLPackFile* m_instance;
+
+	typedef struct {
+		Ogre::uint64 offset;	// offset of the data (just past the record header and name)
+		Ogre::uint32 length;	// length of the data
+		Ogre::uint32 flags;		// PackRecordCompressed if the data is compressed
+	} PackEntry;
+	typedef std::map<Ogre::String, PackEntry> PackIndexHashMap;
+	PackIndexHashMap m_index;
+
+	// resources waiting to be written. 'Writing' is the batch the background thread
+	// is working on. Both are searched by Open().
+	typedef struct {
+		std::vector<char>* data;
+		bool compress;
+	} PendingStore;
+	typedef std::map<Ogre::String, PendingStore> PendingStoreHashMap;
+	PendingStoreHashMap m_pendingStores;
+	PendingStoreHashMap m_writingStores;
+	bool m_compress;
+
+	bool m_enabled;
+	bool m_importLooseFiles;
+	Ogre::String m_dataFilename;
+	Ogre::String m_indexFilename;
+	FILE* m_dataFile;
+	Ogre::uint64 m_generation;		// changes when the data file is compacted
+	Ogre::uint64 m_dataLength;		// bytes of good records in the data file
+	Ogre::uint64 m_fileLength;		// size of the data file (grown in chunks past m_dataLength)
+	Ogre::uint64 m_liveLength;		// bytes of records that are still in the index
+	int m_unsavedRecords;			// records added since the last index write
+	Ogre::uint64 m_compactMinimum;	// don't bother compacting if less than this is wasted
+
+	// The mapping of the data file. When the file grows past the mapping, a new
+	// mapping is made. Streams could still point into old mappings so they are
+	// reference counted: the pack holds one reference on the current mapping and
+	// each stream into it holds one. A retired mapping is unmapped when the last
+	// stream into it is closed.
+	typedef struct {
+		char* base;
+		Ogre::uint64 length;
+		int refs;
+	} PackMap;
+	PackMap* m_map;
+	std::list<PackMap*> m_retiredMaps;
+
+	LGLOCK_MUTEX m_packLock;
+	LGLOCK_THREAD m_backgroundThread;
+	static bool m_keepProcessing;
+	static void BackgroundThreadRoutine();
+
+	bool OpenDataFile();
+	void LoadIndex();
+	Ogre::uint64 ScanRecords(Ogre::uint64);
+	void WriteIndex();
+	bool MapData();
+	void RetireMap();
+	void ReleaseMap(PackMap*);
+	void ReleaseMapLocked(PackMap*);
+	void UnmapAll();
+	void Compact();
+	bool AppendRecord(FILE*, Ogre::uint64&, const Ogre::String&, const void*, Ogre::uint32, Ogre::uint32);
+	bool StoreLocked(const Ogre::String&, const void*, size_t, Ogre::uint32);
+	void FlushPendingStores();
+	Ogre::DataStreamPtr CopyToStream(const Ogre::String&, const char*, size_t, Ogre::uint32);
+};
+}
@@ -0,0 +1,212 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "OLPlaceholder.h"
+#include "LookingGlassOgre.h"
+#include "RendererOgre.h"
+#include "OLArchive.h"
+#include "OLMeshTracker.h"
+#include "OLTextureDecoder.h"
+
+namespace LG {
+
+OLPlaceholder* OLPlaceholder::m_instance = NULL;
+
+OLPlaceholder::OLPlaceholder() {
+	m_enabled = LG::GetParameterBool("Renderer.Ogre.Placeholders.Enable");
+	m_defaultMeshFilename = LG::GetParameter("Renderer.Ogre.DefaultMeshFilename");
+	m_defaultTextureFilename = LG::GetParameter("Renderer.Ogre.DefaultTextureFilename");
+	m_defaultsLock = LGLOCK_ALLOCATE_MUTEX("OLPlaceholder");
+	m_defaultImageLoaded = false;
+	LG::Log("OLPlaceholder: placeholders enabled = %s", m_enabled ? "true" : "false");
+}
+
+OLPlaceholder::~OLPlaceholder() {
+	Shutdown();
+	LGLOCK_RELEASE_MUTEX(m_defaultsLock);
+}
+
+// SingletonInstance.Shutdown()
+// Let go of the default mesh so it goes away with the rest of Ogre
+void OLPlaceholder::Shutdown() {
+	m_enabled = false;
+	m_defaultMesh.setNull();
+	return;
+}
+
+// Called before something causes Ogre to create the mesh. If it's not in the cache,
+// create it as a manual mesh that we load.
+bool OLPlaceholder::DeclareMesh(const Ogre::String& meshName) {
+	if (!m_enabled || meshName == m_defaultMeshFilename) return false;
+	if (Ogre::MeshManager::getSingleton().resourceExists(meshName)) return false;
+	if (LG::OLArchive::IsInCache(meshName)) return false;
+	try {
+		Ogre::MeshManager::getSingleton().createOrRetrieve(meshName, OLResourceGroupName, true, this);
+	}
+	catch (Ogre::Exception& e) {
+		LG::Log("OLPlaceholder::DeclareMesh: failed creating %s: %s", meshName.c_str(), e.getDescription().c_str());
+		return false;
+	}
+	return true;
+}
+
+// Called before a material references the texture. If textures are being
+// predecoded, all textures come through us so we can load the decoded form.
+bool OLPlaceholder::DeclareTexture(const Ogre::String& texName) {
+	if (!m_enabled || texName == m_defaultTextureFilename) return false;
+	if (Ogre::TextureManager::getSingleton().resourceExists(texName)) return false;
+	if (!LG::OLTextureDecoder::Instance()->IsEnabled() && LG::OLArchive::IsInCache(texName)) return false;
+	try {
+		Ogre::TextureManager::getSingleton().createOrRetrieve(texName, OLResourceGroupName, true, this);
+	}
+	catch (Ogre::Exception& e) {
+		LG::Log("OLPlaceholder::DeclareTexture: failed creating %s: %s", texName.c_str(), e.getDescription().c_str());
+		return false;
+	}
+	return true;
+}
+
+// Ogre::ManualResourceLoader
+// Called for the first load and for every reload. Might be on the mesh thread.
+void OLPlaceholder::loadResource(Ogre::Resource* res) {
+	if (res->getCreator() == Ogre::MeshManager::getSingletonPtr()) {
+		LoadMesh(static_cast<Ogre::Mesh*>(res));
+		return;
+	}
+	if (res->getCreator() == Ogre::TextureManager::getSingletonPtr()) {
+		LoadTexture(static_cast<Ogre::Texture*>(res));
+		return;
+	}
+}
+
+// If the real mesh has shown up, read it in just like Ogre would. Otherwise
+// build the mesh out of the default mesh and ask for the real one.
+void OLPlaceholder::LoadMesh(Ogre::Mesh* mesh) {
+	Ogre::String meshName = mesh->getName();
+	if (LG::OLArchive::IsInCache(meshName)) {
+		try {
+			Ogre::DataStreamPtr stream = Ogre::ResourceGroupManager::getSingleton().openResource(
+						meshName, mesh->getGroup(), true, mesh);
+			Ogre::MeshSerializer serializer;
+			serializer.setListener(Ogre::MeshManager::getSingleton().getListener());
+			serializer.importMesh(stream, mesh);
+			return;
+		}
+		catch (Ogre::Exception& e) {
+			LG::Log("OLPlaceholder::LoadMesh: failed reading %s: %s", meshName.c_str(), e.getDescription().c_str());
+		}
+	}
+	LG::OLMeshTracker::Instance()->RequestMesh(meshName, meshName);
+	ShareDefaultMesh(mesh);
+}
+
+// Fill the mesh with submeshes that point to the default mesh's hardware buffers.
+// The vertex and index data headers are copied but the buffers are shared so,
+// when this mesh is unloaded, only the references go away.
+void OLPlaceholder::ShareDefaultMesh(Ogre::Mesh* mesh) {
+	LGLOCK_ALOCK defaultsLock;
+	defaultsLock.Lock(m_defaultsLock);
+	try {
+		if (m_defaultMesh.isNull()) {
+			m_defaultMesh = Ogre::MeshManager::getSingleton().load(m_defaultMeshFilename, OLResourceGroupName);
+		}
+		else {
+			// someone could have unloaded it. Loading again is harmless.
+			m_defaultMesh->load();
+		}
+	}
+	catch (Ogre::Exception& e) {
+		LG::Log("OLPlaceholder::ShareDefaultMesh: could not load default mesh %s: %s",
+					m_defaultMeshFilename.c_str(), e.getDescription().c_str());
+		return;
+	}
+	if (m_defaultMesh->sharedVertexData != NULL) {
+		mesh->sharedVertexData = m_defaultMesh->sharedVertexData->clone(false);
+	}
+	Ogre::Mesh::SubMeshIterator smi = m_defaultMesh->getSubMeshIterator();
+	while (smi.hasMoreElements()) {
+		Ogre::SubMesh* defaultSub = smi.getNext();
+		Ogre::SubMesh* sub = mesh->createSubMesh();
+		sub->useSharedVertices = defaultSub->useSharedVertices;
+		if (!defaultSub->useSharedVertices && defaultSub->vertexData != NULL) {
+			sub->vertexData = defaultSub->vertexData->clone(false);
+		}
+		OGRE_DELETE sub->indexData;
+		sub->indexData = defaultSub->indexData->clone(false);
+		sub->operationType = defaultSub->operationType;
+		sub->setMaterialName(defaultSub->getMaterialName());
+	}
+	mesh->_setBounds(m_defaultMesh->getBounds(), false);
+	mesh->_setBoundingSphereRadius(m_defaultMesh->getBoundingSphereRadius());
+}
+
+// If the real texture has been predecoded, use that. If it has shown up, decode
+// it (and have it predecoded for next time). Otherwise use the decoded default
+// image and ask for the real texture.
+void OLPlaceholder::LoadTexture(Ogre::Texture* tex) {
+	Ogre::String texName = tex->getName();
+	Ogre::ConstImagePtrList imagePtrs;
+	if (LG::OLTextureDecoder::Instance()->LoadDecoded(tex)) {
+		return;
+	}
+	if (LG::OLArchive::IsInCache(texName)) {
+		LG::OLTextureDecoder::Instance()->QueueDecode(texName, LG::ResourceTypeUnknown);
+		try {
+			Ogre::DataStreamPtr stream = Ogre::ResourceGroupManager::getSingleton().openResource(
+						texName, tex->getGroup(), true, tex);
+			Ogre::String::size_type pos = texName.find_last_of(".");
+			Ogre::Image img;
+			img.load(stream, (pos == Ogre::String::npos) ? Ogre::String() : texName.substr(pos + 1));
+			imagePtrs.push_back(&img);
+			tex->_loadImages(imagePtrs);
+			return;
+		}
+		catch (Ogre::Exception& e) {
+			LG::Log("OLPlaceholder::LoadTexture: failed reading %s: %s", texName.c_str(), e.getDescription().c_str());
+		}
+	}
+	LG::RequestResource(texName.c_str(), texName.c_str(), LG::ResourceTypeTexture);
+	if (LoadDefaultImage()) {
+		imagePtrs.push_back(&m_defaultImage);
+		tex->_loadImages(imagePtrs);
+	}
+}
+
+// Decode the default texture the first time someone needs it
+bool OLPlaceholder::LoadDefaultImage() {
+	LGLOCK_ALOCK defaultsLock;
+	defaultsLock.Lock(m_defaultsLock);
+	if (!m_defaultImageLoaded) {
+		try {
+			m_defaultImage.load(m_defaultTextureFilename, OLResourceGroupName);
+			m_defaultImageLoaded = true;
+		}
+		catch (Ogre::Exception& e) {
+			LG::Log("OLPlaceholder::LoadDefaultImage: could not load default texture %s: %s",
+						m_defaultTextureFilename.c_str(), e.getDescription().c_str());
+		}
+	}
+	return m_defaultImageLoaded;
+}
+
+}
@@ -0,0 +1,86 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LGLocking.h"
+#include "SingletonInstance.h"
+
+namespace LG {
+
+// Stand-ins for meshes and textures that are not in the cache yet.
+// At login thousands of meshes and textures are referenced before the managed
+// code has made them. Rather than have Ogre read and decode the default mesh
+// and texture for each one, the defaults are loaded once and the missing
+// resources are created as manual resources with this as the loader.
+// Placeholder meshes are built on the default mesh's hardware buffers so there
+// is only one copy of the geometry. Ogre won't share one GPU texture between
+// texture resources so placeholder textures share the one decoded image and
+// only do the (small) upload.
+// When the real resource shows up it is reloaded. The loader looks in the
+// cache again and, if the real resource is there now, loads that.
+// When textures are predecoded (OLTextureDecoder), all textures are loaded
+// through here so the predecoded form can be used.
+class OLPlaceholder : public Ogre::ManualResourceLoader, public SingletonInstance {
+public:
+	OLPlaceholder();
+	~OLPlaceholder();
+
+	static OLPlaceholder* Instance() { 
+		if (LG::OLPlaceholder::m_instance == NULL) {
+			LG::OLPlaceholder::m_instance = new OLPlaceholder();
+		}
+		return LG::OLPlaceholder::m_instance; 
+	}
+
+	// SingletonInstance.Shutdown();
+	void Shutdown();
+
+	bool IsEnabled() { return m_enabled; }
+
+	// If the resource isn't known to Ogre and is not in the cache, create it
+	// with us as the loader. Returns true if a placeholder was made.
+	bool DeclareMesh(const Ogre::String&);
+	bool DeclareTexture(const Ogre::String&);
+
+	// Ogre::ManualResourceLoader
+	void loadResource(Ogre::Resource*);
+
+private:
+	static OLPlaceholder* m_instance;
+
+	bool m_enabled;
+	Ogre::String m_defaultMeshFilename;
+	Ogre::String m_defaultTextureFilename;
+
+	LGLOCK_MUTEX m_defaultsLock;
+	Ogre::MeshPtr m_defaultMesh;
+	Ogre::Image m_defaultImage;
+	bool m_defaultImageLoaded;
+
+	void LoadMesh(Ogre::Mesh*);
+	void LoadTexture(Ogre::Texture*);
+	void ShareDefaultMesh(Ogre::Mesh*);
+	bool LoadDefaultImage();
+};
+}
@@ -0,0 +1,613 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "OLTextureAtlas.h"
+#include "LookingGlassOgre.h"
+#include "OLArchive.h"
+#include "OLMaterialTracker.h"
+#include "OLMeshTracker.h"
+#include "OLPackFile.h"
+#include "OLTextureDecoder.h"
+
+namespace LG {
+
+OLTextureAtlas* OLTextureAtlas::m_instance = NULL;
+bool OLTextureAtlas::m_keepProcessing = false;
+
+static const char* AtlasLayoutName = "LGAtlas.layout";
+static const Ogre::PixelFormat AtlasFormat = Ogre::PF_A8R8G8B8;
+static const size_t AtlasBpp = 4;
+
+OLTextureAtlas::OLTextureAtlas() {
+	// the worker thread uses the instance so it must be set before it starts
+	m_instance = this;
+	m_atlasLock = LGLOCK_ALLOCATE_MUTEX("OLTextureAtlas");
+	m_thread = NULL;
+	m_layoutDirty = false;
+	m_slowCount = 0;
+	m_enabled = LG::GetParameterBool("Renderer.Ogre.Atlas.Enable");
+	m_pageSize = (size_t)LG::GetParameterInt("Renderer.Ogre.Atlas.PageSize");
+	m_minSize = (size_t)LG::GetParameterInt("Renderer.Ogre.Atlas.MinSize");
+	m_maxSize = (size_t)LG::GetParameterInt("Renderer.Ogre.Atlas.MaxSize");
+	m_maxPages = (size_t)LG::GetParameterInt("Renderer.Ogre.Atlas.MaxPages");
+	if (m_enabled && !LG::OLPackFile::Instance()->IsEnabled()) {
+		// the layout has to be kept with the serialized meshes
+		LG::Log("OLTextureAtlas: pack cache not enabled so atlas not enabled");
+		m_enabled = false;
+	}
+	if (m_enabled && (m_maxSize > m_pageSize || m_minSize == 0 || m_minSize > m_maxSize)) {
+		LG::Log("OLTextureAtlas: bad atlas sizes. page=%d, min=%d, max=%d. Atlas not enabled",
+					(int)m_pageSize, (int)m_minSize, (int)m_maxSize);
+		m_enabled = false;
+	}
+	if (!m_enabled) {
+		return;
+	}
+	LoadLayout();
+	m_keepProcessing = true;
+	m_thread = new LGLOCK_THREAD(&AtlasThreadRoutine);
+	LG::GetOgreRoot()->addFrameListener(this);
+}
+
+OLTextureAtlas::~OLTextureAtlas() {
+	Shutdown();
+	for (size_t ii = 0; ii < m_pages.size(); ii++) {
+		delete m_pages[ii].pixels;
+	}
+	LGLOCK_RELEASE_MUTEX(m_atlasLock);
+}
+
+// SingletonInstance.Shutdown()
+void OLTextureAtlas::Shutdown() {
+	if (!m_enabled) return;
+	LGLOCK_LOCK(m_atlasLock);
+	m_keepProcessing = false;
+	LGLOCK_NOTIFY_ALL(m_atlasLock);
+	LGLOCK_UNLOCK(m_atlasLock);
+	// a placement or composition in progress finishes before the layout is saved
+	if (m_thread != NULL) {
+		m_thread->join();
+		delete m_thread;
+		m_thread = NULL;
+	}
+	LG::GetOgreRoot()->removeFrameListener(this);
+	// one last save of the layout. The pack is shut down after us.
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	std::vector<char>* layout = m_layoutDirty ? SaveLayout() : NULL;
+	m_enabled = false;
+	atlasLock.Unlock();
+	if (layout != NULL) {
+		LG::OLPackFile::Instance()->StoreLater(AtlasLayoutName, layout);
+	}
+	return;
+}
+
+Ogre::String OLTextureAtlas::PageName(size_t page) {
+	char buff[32];
+	sprintf(buff, "LGAtlas/Page%d", (int)page);
+	return Ogre::String(buff);
+}
+
+// A name for the material parameters. The atlas material for a page and
+// signature is "LGAtlas/PageN/signature".
+Ogre::String OLTextureAtlas::Signature(const float* parms) {
+	// FNV-1a over the bytes of the parameters
+	Ogre::uint32 hashA = 2166136261U;
+	Ogre::uint32 hashB = 84696351U;
+	const unsigned char* bytes = (const unsigned char*)parms;
+	for (size_t ii = 0; ii < OLMaterialTracker::CreateMaterialSize * sizeof(float); ii++) {
+		hashA = (hashA ^ bytes[ii]) * 16777619U;
+		hashB = (hashB ^ bytes[ii]) * 16777619U + 1;
+	}
+	char buff[32];
+	sprintf(buff, "%08x%08x", hashA, hashB);
+	return Ogre::String(buff);
+}
+
+// A face material is being defined. Remember if it could go in the atlas and
+// get its texture placed. If a mesh was built with this face in the atlas and
+// the face changed, the mesh needs building again.
+void OLTextureAtlas::NoteMaterial(const Ogre::String& matName, const Ogre::String& texName, const float* parms) {
+	if (!m_enabled || IsAtlasName(matName)) return;
+	bool eligible = texName.length() > 0
+			&& parms[OLMaterialTracker::CreateMaterialScrollU] == 0.0
+			&& parms[OLMaterialTracker::CreateMaterialScrollV] == 0.0
+			&& parms[OLMaterialTracker::CreateMaterialScaleU] == 1.0
+			&& parms[OLMaterialTracker::CreateMaterialScaleV] == 1.0
+			&& parms[OLMaterialTracker::CreateMaterialRotate] == 0.0
+			&& parms[OLMaterialTracker::CreateMaterialAnimationFlag] == 0.0;
+	Ogre::String sig = eligible ? Signature(parms) : Ogre::String();
+	bool queued = false;
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	FaceMaterialHashMap::iterator fm = m_atlasedFaces.find(matName);
+	if (fm != m_atlasedFaces.end() && (!eligible || fm->second.texName != texName || fm->second.signature != sig)) {
+		RebuildMesh(fm->second.meshName);
+		m_atlasedFaces.erase(fm);
+		m_layoutDirty = true;
+	}
+	if (!eligible) {
+		m_materials.erase(matName);
+		return;
+	}
+	if (m_signatures.find(sig) == m_signatures.end()) {
+		m_signatures[sig] = std::vector<float>(parms, parms + OLMaterialTracker::CreateMaterialSize);
+		m_layoutDirty = true;
+	}
+	FaceMaterial& face = m_materials[matName];
+	face.texName = texName;
+	face.signature = sig;
+	if (m_placed.find(texName) == m_placed.end() && m_textureState.find(texName) == m_textureState.end()) {
+		m_textureState[texName] = TextureQueued;
+		m_workQueue.push_back(std::pair<Ogre::String, int>(texName, -1));
+		queued = true;
+	}
+	atlasLock.Unlock();
+	if (queued) {
+		LGLOCK_NOTIFY_ONE(m_atlasLock);
+	}
+}
+
+// A texture showed up in the cache. If we were waiting for it, try placing it again.
+void OLTextureAtlas::NoteTextureArrived(const Ogre::String& texName) {
+	if (!m_enabled) return;
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	TextureStateHashMap::iterator ts = m_textureState.find(texName);
+	if (ts == m_textureState.end() || ts->second != TextureWaiting) {
+		return;
+	}
+	ts->second = TextureQueued;
+	m_workQueue.push_back(std::pair<Ogre::String, int>(texName, -1));
+	atlasLock.Unlock();
+	LGLOCK_NOTIFY_ONE(m_atlasLock);
+}
+
+// Called with the lock held. The rebuild requests go out between frames.
+void OLTextureAtlas::RebuildMesh(const Ogre::String& meshName) {
+	if (meshName.length() > 0) {
+		m_rebuildMeshes.insert(meshName);
+	}
+}
+
+// BETWEEN FRAME OPERATION
+bool OLTextureAtlas::MapFace(const Ogre::String& meshName, const Ogre::String& matName, 
+							 const float* verts, int count, int stride,
+							 Ogre::String* atlasMatName, AtlasRect* rect) {
+	if (!m_enabled) return false;
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	FaceMaterialHashMap::iterator fm = m_materials.find(matName);
+	if (fm == m_materials.end()) {
+		return false;
+	}
+	AtlasPlacementHashMap::iterator pl = m_placed.find(fm->second.texName);
+	if (pl == m_placed.end()) {
+		TextureStateHashMap::iterator ts = m_textureState.find(fm->second.texName);
+		if (ts == m_textureState.end() || ts->second != TextureRejected) {
+			m_waitingMeshes[fm->second.texName].insert(meshName);
+		}
+		return false;
+	}
+	// the texture can't repeat in the atlas
+	const float slop = 0.001f;
+	for (int ii = 0; ii < count; ii++) {
+		const float* vert = verts + ii * stride;
+		if (vert[3] < -slop || vert[3] > 1.0 + slop || vert[4] < -slop || vert[4] > 1.0 + slop) {
+			return false;
+		}
+	}
+	const AtlasPage& page = m_pages[pl->second.page];
+	size_t slotsPerRow = m_pageSize / page.slotSize;
+	size_t xx = (pl->second.slot % slotsPerRow) * page.slotSize;
+	size_t yy = (pl->second.slot / slotsPerRow) * page.slotSize;
+	// from the center of the first texel to the center of the last
+	rect->u0 = ((float)xx + 0.5f) / (float)m_pageSize;
+	rect->v0 = ((float)yy + 0.5f) / (float)m_pageSize;
+	rect->su = (float)(pl->second.width - 1) / (float)m_pageSize;
+	rect->sv = (float)(pl->second.height - 1) / (float)m_pageSize;
+	*atlasMatName = PageName(pl->second.page) + "/" + fm->second.signature;
+	FaceMaterial& face = m_atlasedFaces[matName];
+	face = fm->second;
+	face.meshName = meshName;
+	m_layoutDirty = true;
+	atlasLock.Unlock();
+	if (!Ogre::MaterialManager::getSingleton().resourceExists(*atlasMatName)) {
+		MakeAtlasMaterial(*atlasMatName);
+	}
+	return true;
+}
+
+// The atlas material is the face material definition with the page as the texture.
+bool OLTextureAtlas::MakeAtlasMaterial(const Ogre::String& matName) {
+	if (!m_enabled || !IsAtlasName(matName)) return false;
+	Ogre::String::size_type pos = matName.find_last_of("/");
+	Ogre::String pageName = matName.substr(0, pos);
+	Ogre::String sig = matName.substr(pos + 1);
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	SignatureHashMap::iterator sg = m_signatures.find(sig);
+	if (sg == m_signatures.end()) {
+		LG::Log("OLTextureAtlas::MakeAtlasMaterial: unknown atlas material %s", matName.c_str());
+		return false;
+	}
+	std::vector<float> parms = sg->second;
+	atlasLock.Unlock();
+	if (!Ogre::TextureManager::getSingleton().resourceExists(pageName)) {
+		Ogre::TextureManager::getSingleton().createOrRetrieve(pageName, OLResourceGroupName, true, this);
+	}
+	LG::OLMaterialTracker::Instance()->CreateMaterialResource2(matName.c_str(), pageName.c_str(), &parms[0]);
+	return true;
+}
+
+// Ogre::ManualResourceLoader
+// Load a page texture from the page pixels. If the page hasn't been composed
+// yet (it's from an earlier session), load something small and have the
+// worker compose it. The texture is reloaded when the pixels are ready.
+void OLTextureAtlas::loadResource(Ogre::Resource* res) {
+	Ogre::Texture* tex = static_cast<Ogre::Texture*>(res);
+	int page = -1;
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	Ogre::Image img;
+	Ogre::uint8 gray[4] = { 128, 128, 128, 255 };
+	if (sscanf(tex->getName().c_str(), "LGAtlas/Page%d", &page) != 1 || page < 0 || page >= (int)m_pages.size()) {
+		// the texture still has to end up loaded so it gets the small gray one
+		LG::Log("OLTextureAtlas::loadResource: not an atlas page: %s", tex->getName().c_str());
+		img.loadDynamicImage(gray, 1, 1, 1, AtlasFormat, false, 1, 0);
+	}
+	else if (m_pages[page].pixels != NULL) {
+		AtlasPage& pg = m_pages[page];
+		img.loadDynamicImage(&(*pg.pixels)[0], m_pageSize, m_pageSize, 1, AtlasFormat, false, 1, pg.mipmaps);
+		pg.dirty = false;
+	}
+	else {
+		AtlasPage& pg = m_pages[page];
+		img.loadDynamicImage(gray, 1, 1, 1, AtlasFormat, false, 1, 0);
+		if (!pg.composing && m_enabled) {
+			pg.composing = true;
+			m_workQueue.push_back(std::pair<Ogre::String, int>(Ogre::String(), page));
+			LGLOCK_NOTIFY_ONE(m_atlasLock);
+		}
+	}
+	tex->setNumMipmaps(img.getNumMipmaps());
+	Ogre::ConstImagePtrList imagePtrs;
+	imagePtrs.push_back(&img);
+	tex->_loadImages(imagePtrs);
+}
+
+// Between frames, reload the pages that changed, ask for the meshes that
+// should be rebuilt now their textures are in the atlas and save the layout.
+bool OLTextureAtlas::frameEnded(const Ogre::FrameEvent&) {
+	if (!m_enabled || m_slowCount-- > 0) return true;
+	m_slowCount = 30;
+	std::list<Ogre::String> pages;
+	std::set<Ogre::String> meshes;
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	for (size_t ii = 0; ii < m_pages.size(); ii++) {
+		if (m_pages[ii].dirty && m_pages[ii].pixels != NULL) {
+			pages.push_back(PageName(ii));
+		}
+	}
+	meshes.swap(m_rebuildMeshes);
+	std::vector<char>* layout = NULL;
+	if (m_layoutDirty) {
+		layout = SaveLayout();
+		m_layoutDirty = false;
+	}
+	atlasLock.Unlock();
+
+	std::list<Ogre::String>::iterator li;
+	for (li = pages.begin(); li != pages.end(); li++) {
+		Ogre::TexturePtr tex = (Ogre::TexturePtr)Ogre::TextureManager::getSingleton().getByName(*li);
+		if (!tex.isNull() && tex->isLoaded()) {
+			tex->reload();
+		}
+	}
+	std::set<Ogre::String>::iterator si;
+	for (si = meshes.begin(); si != meshes.end(); si++) {
+		LG::OLMeshTracker::Instance()->RequestMesh(*si, *si);
+	}
+	if (layout != NULL) {
+		LG::OLPackFile::Instance()->StoreLater(AtlasLayoutName, layout);
+	}
+	return true;
+}
+
+void OLTextureAtlas::AtlasThreadRoutine() {
+	LG::OLTextureAtlas* inst = LG::OLTextureAtlas::m_instance;
+	while (LG::OLTextureAtlas::m_keepProcessing) {
+		LGLOCK_LOCK(inst->m_atlasLock);
+		while (inst->m_workQueue.empty() && LG::OLTextureAtlas::m_keepProcessing) {
+			LGLOCK_WAIT(inst->m_atlasLock);
+		}
+		if (inst->m_workQueue.empty() || !LG::OLTextureAtlas::m_keepProcessing) {
+			LGLOCK_UNLOCK(inst->m_atlasLock);
+			continue;
+		}
+		std::pair<Ogre::String, int> work = inst->m_workQueue.front();
+		inst->m_workQueue.pop_front();
+		LGLOCK_UNLOCK(inst->m_atlasLock);
+
+		try {
+			if (work.second < 0) {
+				inst->Place(work.first);
+			}
+			else {
+				inst->Compose((size_t)work.second);
+			}
+		}
+		catch (...) {
+			LG::Log("OLTextureAtlas::AtlasThreadRoutine: exception processing %s %d", 
+						work.first.c_str(), work.second);
+		}
+	}
+}
+
+// Read and decode a texture into our pixel format
+bool OLTextureAtlas::LoadPixels(const Ogre::String& texName, std::vector<Ogre::uint8>& pixels, 
+								size_t& width, size_t& height) {
+	Ogre::DataStreamPtr stream = LG::OLArchive::OpenCached(texName);
+	if (stream.isNull()) {
+		return false;
+	}
+	Ogre::String::size_type pos = texName.find_last_of(".");
+	Ogre::Image img;
+	img.load(stream, (pos == Ogre::String::npos) ? Ogre::String() : texName.substr(pos + 1));
+	width = img.getWidth();
+	height = img.getHeight();
+	pixels.resize(width * height * AtlasBpp);
+	Ogre::PixelBox box(width, height, 1, AtlasFormat, &pixels[0]);
+	Ogre::PixelUtil::bulkPixelConversion(img.getPixelBox(), box);
+	return true;
+}
+
+// Called with the lock held. Returns the index of the new page.
+size_t OLTextureAtlas::NewPage(size_t slotSize) {
+	AtlasPage pg;
+	pg.slotSize = slotSize;
+	pg.mipmaps = 0;
+	for (size_t ss = slotSize; ss > 1; ss /= 2) {
+		pg.mipmaps++;
+	}
+	pg.pixels = NULL;
+	pg.composing = false;
+	pg.dirty = false;
+	m_pages.push_back(pg);
+	return m_pages.size() - 1;
+}
+
+// Find the texture a slot and copy it in
+void OLTextureAtlas::Place(const Ogre::String& texName) {
+	std::vector<Ogre::uint8> pixels;
+	size_t width = 0;
+	size_t height = 0;
+	bool loaded = false;
+	try {
+		loaded = LoadPixels(texName, pixels, width, height);
+	}
+	catch (Ogre::Exception& e) {
+		LG::Log("OLTextureAtlas::Place: failed decoding %s: %s", texName.c_str(), e.getDescription().c_str());
+	}
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	if (!loaded) {
+		m_textureState[texName] = TextureWaiting;
+		return;
+	}
+	size_t biggest = (width > height) ? width : height;
+	if (biggest < m_minSize || biggest > m_maxSize) {
+		m_textureState[texName] = TextureRejected;
+		m_waitingMeshes.erase(texName);
+		return;
+	}
+	size_t slotSize = 1;
+	while (slotSize < biggest) slotSize *= 2;
+	size_t slotsPerPage = (m_pageSize / slotSize) * (m_pageSize / slotSize);
+	// the first page of this slot size with room. Pages from an earlier session
+	// get filled once they're composed.
+	size_t page;
+	for (page = 0; page < m_pages.size(); page++) {
+		if (m_pages[page].slotSize == slotSize && m_pages[page].pixels != NULL
+					&& m_pages[page].slots.size() < slotsPerPage) {
+			break;
+		}
+	}
+	if (page == m_pages.size()) {
+		if (m_pages.size() >= m_maxPages) {
+			m_textureState[texName] = TextureRejected;
+			m_waitingMeshes.erase(texName);
+			return;
+		}
+		page = NewPage(slotSize);
+		m_pages[page].pixels = new std::vector<Ogre::uint8>(
+			Ogre::Image::calculateSize(m_pages[page].mipmaps, 1, m_pageSize, m_pageSize, 1, AtlasFormat));
+	}
+	AtlasPage& pg = m_pages[page];
+	AtlasPlacement placement;
+	placement.page = page;
+	placement.slot = pg.slots.size();
+	placement.width = width;
+	placement.height = height;
+	pg.slots.push_back(texName);
+	CopyToSlot(pg, placement.slot, pixels, width, height);
+	pg.dirty = true;
+	m_placed[texName] = placement;
+	m_textureState.erase(texName);
+	WaitingMeshHashMap::iterator wm = m_waitingMeshes.find(texName);
+	if (wm != m_waitingMeshes.end()) {
+		m_rebuildMeshes.insert(wm->second.begin(), wm->second.end());
+		m_waitingMeshes.erase(wm);
+	}
+	m_layoutDirty = true;
+}
+
+// Rebuild the pixels of a page from an earlier session from its textures
+void OLTextureAtlas::Compose(size_t page) {
+	LGLOCK_ALOCK atlasLock;
+	atlasLock.Lock(m_atlasLock);
+	AtlasPage work = m_pages[page];
+	std::vector<Ogre::String> slots = work.slots;
+	size_t mipmaps = work.mipmaps;
+	atlasLock.Unlock();
+
+	work.pixels = new std::vector<Ogre::uint8>(
+		Ogre::Image::calculateSize(mipmaps, 1, m_pageSize, m_pageSize, 1, AtlasFormat));
+	std::vector<Ogre::uint8> pixels;
+	for (size_t ii = 0; ii < slots.size(); ii++) {
+		size_t width, height;
+		try {
+			if (LoadPixels(slots[ii], pixels, width, height)) {
+				CopyToSlot(work, ii, pixels, width, height);
+			}
+		}
+		catch (Ogre::Exception& e) {
+			LG::Log("OLTextureAtlas::Compose: failed decoding %s: %s", slots[ii].c_str(), e.getDescription().c_str());
+		}
+	}
+	atlasLock.Lock(m_atlasLock);
+	m_pages[page].pixels = work.pixels;
+	m_pages[page].composing = false;
+	m_pages[page].dirty = true;
+	atlasLock.Unlock();
+}
+
+// Copy the texture into its slot, filling out the slot with the edge pixels,
+// and build the slot's mip levels.
+void OLTextureAtlas::CopyToSlot(AtlasPage& pg, size_t slot, const std::vector<Ogre::uint8>& pixels, 
+								size_t width, size_t height) {
+	size_t slotSize = pg.slotSize;
+	if (width == 0 || height == 0 || width > slotSize || height > slotSize) {
+		return;
+	}
+	std::vector<Ogre::uint8> level(slotSize * slotSize * AtlasBpp);
+	for (size_t yy = 0; yy < slotSize; yy++) {
+		const Ogre::uint8* srcRow = &pixels[((yy < height) ? yy : height - 1) * width * AtlasBpp];
+		Ogre::uint8* dstRow = &level[yy * slotSize * AtlasBpp];
+		memcpy(dstRow, srcRow, width * AtlasBpp);
+		for (size_t xx = width; xx < slotSize; xx++) {
+			memcpy(dstRow + xx * AtlasBpp, srcRow + (width - 1) * AtlasBpp, AtlasBpp);
+		}
+	}
+	size_t slotsPerRow = m_pageSize / slotSize;
+	size_t slotX = (slot % slotsPerRow) * slotSize;
+	size_t slotY = (slot / slotsPerRow) * slotSize;
+	std::vector<Ogre::uint8> next;
+	for (size_t mip = 0; mip <= pg.mipmaps; mip++) {
+		size_t levelSize = slotSize >> mip;
+		size_t pageSize = m_pageSize >> mip;
+		Ogre::uint8* dst = &(*pg.pixels)[0]
+				+ ((mip == 0) ? 0 : Ogre::Image::calculateSize(mip - 1, 1, m_pageSize, m_pageSize, 1, AtlasFormat))
+				+ (((slotY >> mip) * pageSize) + (slotX >> mip)) * AtlasBpp;
+		for (size_t yy = 0; yy < levelSize; yy++) {
+			memcpy(dst + yy * pageSize * AtlasBpp, &level[yy * levelSize * AtlasBpp], levelSize * AtlasBpp);
+		}
+		if (mip < pg.mipmaps) {
+			next.resize((levelSize / 2) * (levelSize / 2) * AtlasBpp);
+			LG::OLTextureDecoder::BoxFilterHalf(&level[0], levelSize, levelSize, &next[0], levelSize / 2, levelSize / 2);
+			level.swap(next);
+		}
+	}
+}
+
+// The layout is lines of tab separated fields:
+//   P page slotSize
+//   T texture page slot width height
+//   S signature parameters...
+//   F faceMaterial texture signature mesh
+// Pages are listed before their textures and textures are listed in slot order.
+void OLTextureAtlas::LoadLayout() {
+	Ogre::DataStreamPtr stream = LG::OLPackFile::Instance()->Open(AtlasLayoutName);
+	if (stream.isNull()) {
+		return;
+	}
+	Ogre::StringVector lines = Ogre::StringUtil::split(stream->getAsString(), "\n");
+	Ogre::StringVector::iterator li;
+	for (li = lines.begin(); li != lines.end(); li++) {
+		Ogre::StringVector fields = Ogre::StringUtil::split(*li, "\t");
+		if (fields.size() < 2) continue;
+		if (fields[0] == "P" && fields.size() == 3) {
+			NewPage((size_t)atoi(fields[2].c_str()));
+		}
+		else if (fields[0] == "T" && fields.size() == 6) {
+			AtlasPlacement placement;
+			placement.page = (size_t)atoi(fields[2].c_str());
+			placement.slot = (size_t)atoi(fields[3].c_str());
+			placement.width = (size_t)atoi(fields[4].c_str());
+			placement.height = (size_t)atoi(fields[5].c_str());
+			if (placement.page >= m_pages.size() || placement.slot != m_pages[placement.page].slots.size()) {
+				LG::Log("OLTextureAtlas::LoadLayout: bad layout for %s", fields[1].c_str());
+				continue;
+			}
+			m_pages[placement.page].slots.push_back(fields[1]);
+			m_placed[fields[1]] = placement;
+		}
+		else if (fields[0] == "S" && fields.size() == (2 + OLMaterialTracker::CreateMaterialSize)) {
+			std::vector<float> parms;
+			for (size_t ii = 2; ii < fields.size(); ii++) {
+				parms.push_back((float)atof(fields[ii].c_str()));
+			}
+			m_signatures[fields[1]] = parms;
+		}
+		else if (fields[0] == "F" && fields.size() == 5) {
+			FaceMaterial& face = m_atlasedFaces[fields[1]];
+			face.texName = fields[2];
+			face.signature = fields[3];
+			face.meshName = fields[4];
+		}
+	}
+	LG::Log("OLTextureAtlas::LoadLayout: %d pages, %d textures, %d faces",
+			(int)m_pages.size(), (int)m_placed.size(), (int)m_atlasedFaces.size());
+}
+
+// Called with the lock held
+std::vector<char>* OLTextureAtlas::SaveLayout() {
+	Ogre::StringUtil::StrStreamType layout;
+	for (size_t ii = 0; ii < m_pages.size(); ii++) {
+		layout << "P\t" << ii << "\t" << m_pages[ii].slotSize << "\n";
+		for (size_t jj = 0; jj < m_pages[ii].slots.size(); jj++) {
+			const AtlasPlacement& placement = m_placed[m_pages[ii].slots[jj]];
+			layout << "T\t" << m_pages[ii].slots[jj] << "\t" << ii << "\t" << jj
+				<< "\t" << placement.width << "\t" << placement.height << "\n";
+		}
+	}
+	char buff[32];
+	for (SignatureHashMap::iterator sg = m_signatures.begin(); sg != m_signatures.end(); sg++) {
+		layout << "S\t" << sg->first;
+		for (size_t ii = 0; ii < sg->second.size(); ii++) {
+			sprintf(buff, "%.9g", sg->second[ii]);
+			layout << "\t" << buff;
+		}
+		layout << "\n";
+	}
+	for (FaceMaterialHashMap::iterator fm = m_atlasedFaces.begin(); fm != m_atlasedFaces.end(); fm++) {
+		layout << "F\t" << fm->first << "\t" << fm->second.texName << "\t" << fm->second.signature
+			<< "\t" << fm->second.meshName << "\n";
+	}
+	Ogre::String str = layout.str();
+	return new std::vector<char>(str.begin(), str.end());
+}
+
+}
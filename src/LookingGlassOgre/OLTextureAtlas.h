@@ -0,0 +1,166 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LGLocking.h"
+#include "SingletonInstance.h"
+
+namespace LG {
+
+// Packs small prim textures into shared atlas pages.
+// Every prim face has its own material so every face is its own batch with its
+// own texture bind. Faces whose textures are small (Atlas.MinSize to
+// Atlas.MaxSize) and whose materials don't transform the texture can instead
+// use a texture's spot on an atlas page: when the mesh is built the texture
+// coordinates are moved into the spot and the face is given the atlas material
+// for the page and the rest of the material parameters. Faces with the same
+// atlas material end up in one submesh and materials that differed only by
+// texture become one material.
+// Each page holds one size of slot so packing is just the next free slot. A
+// worker thread decodes the textures into the page pixels and builds the mip
+// levels for each slot separately so the levels never mix neighbors. Slots are
+// filled out with the texture's edges which, with the half texel inset of the
+// coordinates, keeps filtering from reaching into the next slot.
+// Meshes are serialized with the atlas coordinates so the layout (which
+// textures are where and the material parameters of the atlas materials) is
+// kept in the pack. Pages from an earlier session are rebuilt from their
+// textures the first time they're loaded.
+// A face is only put in the atlas if its texture is already placed when the
+// mesh is built. Meshes built before their textures were placed are asked
+// for again once the textures are placed.
+class OLTextureAtlas : public Ogre::ManualResourceLoader, public Ogre::FrameListener, public SingletonInstance {
+public:
+	OLTextureAtlas();
+	~OLTextureAtlas();
+
+	static OLTextureAtlas* Instance() { 
+		if (LG::OLTextureAtlas::m_instance == NULL) {
+			LG::OLTextureAtlas::m_instance = new OLTextureAtlas();
+		}
+		return LG::OLTextureAtlas::m_instance; 
+	}
+
+	// SingletonInstance.Shutdown();
+	void Shutdown();
+
+	bool IsEnabled() { return m_enabled; }
+	static bool IsAtlasName(const Ogre::String& name) { return name.compare(0, 8, "LGAtlas/") == 0; }
+
+	// where a face's texture coordinates go: u' = u0 + u * su
+	typedef struct {
+		float u0;
+		float v0;
+		float su;
+		float sv;
+	} AtlasRect;
+
+	// A prim face material is being defined with this texture and parameters
+	void NoteMaterial(const Ogre::String&, const Ogre::String&, const float*);
+	// A texture arrived in the cache
+	void NoteTextureArrived(const Ogre::String&);
+	// Called by the mesh builder for each face. Passed the mesh and face material
+	// names and the face's vertices (position, texture coordinate, normal, ...).
+	// If the face goes in the atlas, returns true with the atlas material name
+	// and the mapping for the texture coordinates.
+	bool MapFace(const Ogre::String&, const Ogre::String&, const float*, int, int, Ogre::String*, AtlasRect*);
+	// Define a referenced atlas material. Returns false if the name isn't one of ours.
+	bool MakeAtlasMaterial(const Ogre::String&);
+
+	// Ogre::ManualResourceLoader
+	void loadResource(Ogre::Resource*);
+
+	// Ogre::FrameListener
+	bool frameEnded(const Ogre::FrameEvent&);
+
+private:
+	static OLTextureAtlas* m_instance;
+
+	bool m_enabled;
+	size_t m_pageSize;
+	size_t m_minSize;
+	size_t m_maxSize;
+	size_t m_maxPages;
+
+	typedef struct {
+		size_t slotSize;
+		size_t mipmaps;					// levels after the first. The last has a pixel per slot.
+		std::vector<Ogre::String> slots;	// texture in each slot
+		std::vector<Ogre::uint8>* pixels;	// all the levels. NULL until composed.
+		bool composing;					// queued for the worker to rebuild the pixels
+		bool dirty;						// pixels changed since the texture was loaded
+	} AtlasPage;
+	std::vector<AtlasPage> m_pages;
+
+	typedef struct {
+		size_t page;
+		size_t slot;
+		size_t width;
+		size_t height;
+	} AtlasPlacement;
+	typedef std::map<Ogre::String, AtlasPlacement> AtlasPlacementHashMap;
+	AtlasPlacementHashMap m_placed;
+
+	enum {
+		TextureQueued,
+		TextureWaiting,		// not in the cache yet
+		TextureRejected		// wrong size or no room
+	};
+	typedef std::map<Ogre::String, int> TextureStateHashMap;
+	TextureStateHashMap m_textureState;
+
+	typedef struct {
+		Ogre::String texName;
+		Ogre::String signature;
+		Ogre::String meshName;
+	} FaceMaterial;
+	typedef std::map<Ogre::String, FaceMaterial> FaceMaterialHashMap;
+	FaceMaterialHashMap m_materials;		// face materials that could go in the atlas
+	FaceMaterialHashMap m_atlasedFaces;		// face materials meshes were built in the atlas with
+	typedef std::map<Ogre::String, std::vector<float> > SignatureHashMap;
+	SignatureHashMap m_signatures;			// material parameters of the atlas materials
+	typedef std::map<Ogre::String, std::set<Ogre::String> > WaitingMeshHashMap;
+	WaitingMeshHashMap m_waitingMeshes;		// meshes built while their textures were being placed
+	std::set<Ogre::String> m_rebuildMeshes;
+	bool m_layoutDirty;
+	int m_slowCount;
+
+	// the worker places textures (page < 0) and composes pages
+	std::list<std::pair<Ogre::String, int> > m_workQueue;
+	LGLOCK_MUTEX m_atlasLock;
+	LGLOCK_THREAD* m_thread;
+	static bool m_keepProcessing;
+	static void AtlasThreadRoutine();
+
+	void Place(const Ogre::String&);
+	void Compose(size_t);
+	bool LoadPixels(const Ogre::String&, std::vector<Ogre::uint8>&, size_t&, size_t&);
+	void CopyToSlot(AtlasPage&, size_t, const std::vector<Ogre::uint8>&, size_t, size_t);
+	size_t NewPage(size_t);
+	void RebuildMesh(const Ogre::String&);
+	static Ogre::String Signature(const float*);
+	static Ogre::String PageName(size_t);
+	void LoadLayout();
+	std::vector<char>* SaveLayout();
+};
+}
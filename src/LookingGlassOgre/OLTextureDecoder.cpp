@@ -0,0 +1,283 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "OLTextureDecoder.h"
+#include "LookingGlassOgre.h"
+#include "OLArchive.h"
+#include "OLPackFile.h"
+#include "OLPlaceholder.h"
+#include "OLTextureStreamer.h"
+#include "ProcessBetweenFrame.h"
+
+namespace LG {
+
+OLTextureDecoder* OLTextureDecoder::m_instance = NULL;
+bool OLTextureDecoder::m_keepProcessing = false;
+
+// The decoded form is a header followed by the pixels of all the mip levels
+// laid out the way Ogre::Image keeps them.
+static const Ogre::uint32 DecodedMagic = 0x5854474C;		// 'LGTX'
+static const Ogre::uint32 DecodedVersion = 1;
+typedef struct {
+	Ogre::uint32 magic;
+	Ogre::uint32 version;
+	Ogre::uint32 width;
+	Ogre::uint32 height;
+	Ogre::uint32 format;
+	Ogre::uint32 numMipmaps;	// levels after the first
+} DecodedHeader;
+static const Ogre::PixelFormat DecodedFormat = Ogre::PF_A8R8G8B8;
+
+OLTextureDecoder::OLTextureDecoder() {
+	// the worker threads use the instance so it must be set before they start
+	m_instance = this;
+	m_decodeLock = LGLOCK_ALLOCATE_MUTEX("OLTextureDecoder");
+	m_enabled = LG::GetParameterBool("Renderer.Ogre.TextureDecode.Enable");
+	if (m_enabled && !LG::OLPackFile::Instance()->IsEnabled()) {
+		// the decoded textures are kept in the pack
+		LG::Log("OLTextureDecoder: pack cache not enabled so texture decoding not enabled");
+		m_enabled = false;
+	}
+	if (m_enabled && !LG::OLPlaceholder::Instance()->IsEnabled()) {
+		// only the placeholder loader reads the decoded form
+		LG::Log("OLTextureDecoder: placeholders not enabled so texture decoding not enabled");
+		m_enabled = false;
+	}
+	if (!m_enabled) {
+		return;
+	}
+	int threads = LG::GetParameterInt("Renderer.Ogre.TextureDecode.Threads");
+	if (threads < 1) threads = 1;
+	LG::Log("OLTextureDecoder: starting %d decoding threads", threads);
+	m_keepProcessing = true;
+	for (int ii = 0; ii < threads; ii++) {
+		m_threads.push_back(new LGLOCK_THREAD(&DecodeThreadRoutine));
+	}
+}
+
+OLTextureDecoder::~OLTextureDecoder() {
+	Shutdown();
+	LGLOCK_RELEASE_MUTEX(m_decodeLock);
+}
+
+// SingletonInstance.Shutdown()
+void OLTextureDecoder::Shutdown() {
+	LGLOCK_LOCK(m_decodeLock);
+	m_keepProcessing = false;
+	m_enabled = false;
+	LGLOCK_NOTIFY_ALL(m_decodeLock);
+	LGLOCK_UNLOCK(m_decodeLock);
+	// a decode in progress finishes before we go on
+	while (!m_threads.empty()) {
+		LGLOCK_THREAD* worker = m_threads.front();
+		m_threads.pop_front();
+		worker->join();
+		delete worker;
+	}
+	return;
+}
+
+bool OLTextureDecoder::QueueDecode(const Ogre::String& texName, int refreshType) {
+	if (!m_enabled) return false;
+	LGLOCK_ALOCK decodeLock;
+	decodeLock.Lock(m_decodeLock);
+	DecodeHashMap::iterator intr = m_queued.find(texName);
+	if (intr != m_queued.end()) {
+		// already on its way. Remember if someone wants to know when it's done.
+		if (refreshType != LG::ResourceTypeUnknown) {
+			intr->second = refreshType;
+		}
+		return true;
+	}
+	m_queued[texName] = refreshType;
+	m_decodeQueue.push_back(std::pair<Ogre::String, int>(texName, refreshType));
+	decodeLock.Unlock();
+	LGLOCK_NOTIFY_ONE(m_decodeLock);
+	return true;
+}
+
+// The managed code has a new texture for us. Decode it before the texture is
+// reloaded. When it's decoded, we queue the refresh again and let it through.
+bool OLTextureDecoder::RefreshArrived(const Ogre::String& texName, int rType) {
+	if (!m_enabled) return false;
+	LGLOCK_ALOCK decodeLock;
+	decodeLock.Lock(m_decodeLock);
+	DecodeHashMap::iterator intr = m_decoded.find(texName);
+	if (intr != m_decoded.end()) {
+		// this is the refresh we queued
+		m_decoded.erase(intr);
+		return false;
+	}
+	decodeLock.Unlock();
+	return QueueDecode(texName, rType);
+}
+
+// Called by the texture loader (on the render thread). If we have the decoded
+// form, point an image at it and let Ogre copy it into the texture.
+bool OLTextureDecoder::LoadDecoded(Ogre::Texture* tex) {
+	if (!m_enabled) return false;
+	Ogre::DataStreamPtr stream = LG::OLPackFile::Instance()->Open(DecodedName(tex->getName()));
+	if (stream.isNull()) {
+		return false;
+	}
+	Ogre::MemoryDataStream* mem = dynamic_cast<Ogre::MemoryDataStream*>(stream.get());
+	if (mem == NULL || mem->size() < sizeof(DecodedHeader)) {
+		return false;
+	}
+	DecodedHeader hdr;
+	memcpy(&hdr, mem->getPtr(), sizeof(hdr));
+	if (hdr.magic != DecodedMagic || hdr.version != DecodedVersion
+			|| (sizeof(hdr) + Ogre::Image::calculateSize(hdr.numMipmaps, 1, hdr.width, hdr.height, 1, 
+						(Ogre::PixelFormat)hdr.format)) != mem->size()) {
+		LG::Log("OLTextureDecoder::LoadDecoded: bad decoded texture for %s", tex->getName().c_str());
+		return false;
+	}
+	// the streamer can have us start partway down the mip chain. The levels are
+	// stored largest first so the smaller ones are a tail of the data.
+	size_t level = LG::OLTextureStreamer::Instance()->LevelToLoad(tex->getName(), 
+				hdr.width, hdr.height, hdr.numMipmaps + 1);
+	size_t skip = (level == 0) ? 0 : Ogre::Image::calculateSize(level - 1, 1, hdr.width, hdr.height, 1,
+				(Ogre::PixelFormat)hdr.format);
+	size_t width = hdr.width >> level;
+	size_t height = hdr.height >> level;
+	Ogre::Image img;
+	img.loadDynamicImage(mem->getPtr() + sizeof(hdr) + skip, (width > 0) ? width : 1, (height > 0) ? height : 1, 1, 
+				(Ogre::PixelFormat)hdr.format, false, 1, hdr.numMipmaps - level);
+	Ogre::ConstImagePtrList imagePtrs;
+	imagePtrs.push_back(&img);
+	tex->_loadImages(imagePtrs);
+	return true;
+}
+
+void OLTextureDecoder::DecodeThreadRoutine() {
+	LG::OLTextureDecoder* inst = LG::OLTextureDecoder::m_instance;
+	while (LG::OLTextureDecoder::m_keepProcessing) {
+		LGLOCK_LOCK(inst->m_decodeLock);
+		if (inst->m_decodeQueue.empty() && LG::OLTextureDecoder::m_keepProcessing) {
+			LGLOCK_WAIT(inst->m_decodeLock);
+		}
+		if (inst->m_decodeQueue.empty() || !LG::OLTextureDecoder::m_keepProcessing) {
+			LGLOCK_UNLOCK(inst->m_decodeLock);
+			continue;
+		}
+		Ogre::String texName = inst->m_decodeQueue.front().first;
+		inst->m_decodeQueue.pop_front();
+		LGLOCK_UNLOCK(inst->m_decodeLock);
+
+		try {
+			inst->Decode(texName);
+		}
+		catch (...) {
+			LG::Log("OLTextureDecoder::DecodeThreadRoutine: exception decoding %s", texName.c_str());
+		}
+
+		// even if the decoding failed, the texture can still be loaded the old way
+		LGLOCK_LOCK(inst->m_decodeLock);
+		int refreshType = LG::ResourceTypeUnknown;
+		DecodeHashMap::iterator intr = inst->m_queued.find(texName);
+		if (intr != inst->m_queued.end()) {
+			refreshType = intr->second;
+			inst->m_queued.erase(intr);
+		}
+		if (refreshType != LG::ResourceTypeUnknown) {
+			inst->m_decoded[texName] = refreshType;
+		}
+		LGLOCK_UNLOCK(inst->m_decodeLock);
+		if (refreshType != LG::ResourceTypeUnknown) {
+			LG::ProcessBetweenFrame::Instance()->RefreshResource(10, const_cast<char*>(texName.c_str()), refreshType);
+		}
+	}
+}
+
+// Read the encoded texture, convert it to our pixel format, build all the mip
+// levels and queue the result to be written into the pack.
+bool OLTextureDecoder::Decode(const Ogre::String& texName) {
+	Ogre::DataStreamPtr stream = LG::OLArchive::OpenCached(texName);
+	if (stream.isNull()) {
+		LG::Log("OLTextureDecoder::Decode: no texture to decode: %s", texName.c_str());
+		return false;
+	}
+	Ogre::String::size_type pos = texName.find_last_of(".");
+	Ogre::Image img;
+	img.load(stream, (pos == Ogre::String::npos) ? Ogre::String() : texName.substr(pos + 1));
+
+	size_t width = img.getWidth();
+	size_t height = img.getHeight();
+	size_t numMipmaps = 0;
+	for (size_t ww = width, hh = height; ww > 1 || hh > 1; numMipmaps++) {
+		ww = (ww > 1) ? ww / 2 : 1;
+		hh = (hh > 1) ? hh / 2 : 1;
+	}
+	size_t pixelBytes = Ogre::Image::calculateSize(numMipmaps, 1, width, height, 1, DecodedFormat);
+	std::vector<char>* decoded = new std::vector<char>(sizeof(DecodedHeader) + pixelBytes);
+	DecodedHeader hdr;
+	hdr.magic = DecodedMagic;
+	hdr.version = DecodedVersion;
+	hdr.width = (Ogre::uint32)width;
+	hdr.height = (Ogre::uint32)height;
+	hdr.format = (Ogre::uint32)DecodedFormat;
+	hdr.numMipmaps = (Ogre::uint32)numMipmaps;
+	memcpy(&(*decoded)[0], &hdr, sizeof(hdr));
+
+	Ogre::uint8* level = (Ogre::uint8*)&(*decoded)[sizeof(hdr)];
+	Ogre::PixelBox top(width, height, 1, DecodedFormat, level);
+	Ogre::PixelUtil::bulkPixelConversion(img.getPixelBox(), top);
+	for (size_t mip = 0; mip < numMipmaps; mip++) {
+		size_t nextWidth = (width > 1) ? width / 2 : 1;
+		size_t nextHeight = (height > 1) ? height / 2 : 1;
+		Ogre::uint8* next = level + Ogre::PixelUtil::getMemorySize(width, height, 1, DecodedFormat);
+		BoxFilterHalf(level, width, height, next, nextWidth, nextHeight);
+		level = next;
+		width = nextWidth;
+		height = nextHeight;
+	}
+	// Not compressed so the render thread loads straight from the pack's mapping
+	// without decompressing several megabytes of pixels.
+	return LG::OLPackFile::Instance()->StoreLater(DecodedName(texName), decoded, false);
+}
+
+// Make the next smaller mip level by averaging each 2x2 block of pixels. Odd
+// sizes reuse the last row or column. Works a byte at a time so it doesn't
+// care about channel order. The inner loop is simple enough for the compiler
+// to vectorize.
+void OLTextureDecoder::BoxFilterHalf(const Ogre::uint8* src, size_t srcWidth, size_t srcHeight,
+									 Ogre::uint8* dst, size_t dstWidth, size_t dstHeight) {
+	const size_t bpp = 4;
+	for (size_t yy = 0; yy < dstHeight; yy++) {
+		size_t y0 = yy * 2;
+		size_t y1 = (y0 + 1 < srcHeight) ? y0 + 1 : y0;
+		const Ogre::uint8* row0 = src + y0 * srcWidth * bpp;
+		const Ogre::uint8* row1 = src + y1 * srcWidth * bpp;
+		Ogre::uint8* out = dst + yy * dstWidth * bpp;
+		for (size_t xx = 0; xx < dstWidth; xx++) {
+			size_t x0 = xx * 2 * bpp;
+			size_t x1 = ((xx * 2 + 1) < srcWidth) ? x0 + bpp : x0;
+			for (size_t cc = 0; cc < bpp; cc++) {
+				out[xx * bpp + cc] = (Ogre::uint8)((row0[x0 + cc] + row0[x1 + cc] 
+								+ row1[x0 + cc] + row1[x1 + cc] + 2) >> 2);
+			}
+		}
+	}
+}
+
+}
@@ -0,0 +1,89 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LGLocking.h"
+#include "SingletonInstance.h"
+
+namespace LG {
+
+// Decodes textures into a form that can go straight to the GPU.
+// Downloaded textures are encoded (PNG, JPEG2000 converted to PNG, ...) and
+// decoding them plus building the mipmaps is the expensive part of a texture
+// load. A pool of worker threads decodes each texture when it shows up, builds
+// the whole mip chain and puts the pixels, compressed, into the pack file. When
+// the texture is loaded, the render thread decompresses the pixels, wraps them
+// in an image and hands it to Ogre which just copies it into the hardware buffer.
+// The placeholder texture loader (OLPlaceholder) is what uses the decoded form
+// so there is no decoding without placeholders.
+class OLTextureDecoder : public SingletonInstance {
+public:
+	OLTextureDecoder();
+	~OLTextureDecoder();
+
+	static OLTextureDecoder* Instance() { 
+		if (LG::OLTextureDecoder::m_instance == NULL) {
+			LG::OLTextureDecoder::m_instance = new OLTextureDecoder();
+		}
+		return LG::OLTextureDecoder::m_instance; 
+	}
+
+	// SingletonInstance.Shutdown();
+	void Shutdown();
+
+	bool IsEnabled() { return m_enabled; }
+
+	// Queue the texture for decoding. When done, a refresh of 'refreshType' is
+	// queued for the texture (ResourceTypeUnknown for no refresh). Returns
+	// false if the texture was not queued.
+	bool QueueDecode(const Ogre::String&, int refreshType);
+	// A refresh for the texture arrived. Returns true if the caller should wait
+	// for the one we'll do after decoding (the texture was queued for decoding).
+	bool RefreshArrived(const Ogre::String&, int);
+
+	// Load the texture from the decoded form. Returns false if there isn't one.
+	bool LoadDecoded(Ogre::Texture*);
+
+	static Ogre::String DecodedName(const Ogre::String& texName) { return texName + ".lgtex"; }
+
+	// Make the next smaller mip level of 32 bit pixels
+	static void BoxFilterHalf(const Ogre::uint8*, size_t, size_t, Ogre::uint8*, size_t, size_t);
+
+private:
+	static OLTextureDecoder* m_instance;
+
+	bool m_enabled;
+	LGLOCK_MUTEX m_decodeLock;
+	std::list<std::pair<Ogre::String, int> > m_decodeQueue;
+	typedef std::map<Ogre::String, int> DecodeHashMap;
+	DecodeHashMap m_queued;			// what's in the queue or being decoded
+	DecodeHashMap m_decoded;		// refreshes we queued that have not been seen yet
+
+	std::list<LGLOCK_THREAD*> m_threads;
+	static bool m_keepProcessing;
+	static void DecodeThreadRoutine();
+
+	bool Decode(const Ogre::String&);
+};
+}
@@ -0,0 +1,252 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+// #include "StdAfx.h"
+#include "OLTextureStreamer.h"
+#include "LookingGlassOgre.h"
+#include "OLTextureDecoder.h"
+
+namespace LG {
+
+OLTextureStreamer* OLTextureStreamer::m_instance = NULL;
+
+OLTextureStreamer::OLTextureStreamer() {
+	m_streamLock = LGLOCK_ALLOCATE_MUTEX("OLTextureStreamer");
+	m_residentBytes = 0;
+	m_pass = 1;
+	m_enabled = LG::GetParameterBool("Renderer.Ogre.TextureStream.Enable");
+	m_initialSize = (size_t)LG::GetParameterInt("Renderer.Ogre.TextureStream.InitialSize");
+	m_reloadsPerFrame = LG::GetParameterInt("Renderer.Ogre.TextureStream.ReloadsPerFrame");
+	m_budget = (size_t)LG::GetParameterInt("Renderer.Ogre.TextureStream.BudgetMB") * 1024 * 1024;
+	if (m_enabled && !LG::OLTextureDecoder::Instance()->IsEnabled()) {
+		// only the predecoded textures have the mip levels to stream
+		LG::Log("OLTextureStreamer: texture decoding not enabled so texture streaming not enabled");
+		m_enabled = false;
+	}
+	if (m_enabled && !LG::GetParameterBool("Renderer.Ogre.Visibility.Cull.Frustrum")
+				&& !LG::GetParameterBool("Renderer.Ogre.Visibility.Cull.Distance")) {
+		// the visibility pass doesn't run so nothing would ever ask for the big levels
+		LG::Log("OLTextureStreamer: visibility culling not enabled so texture streaming not enabled");
+		m_enabled = false;
+	}
+	if (m_enabled) {
+		LG::GetOgreRoot()->addFrameListener(this);
+	}
+}
+
+OLTextureStreamer::~OLTextureStreamer() {
+	Shutdown();
+	LGLOCK_RELEASE_MUTEX(m_streamLock);
+}
+
+// SingletonInstance.Shutdown()
+void OLTextureStreamer::Shutdown() {
+	m_enabled = false;
+	return;
+}
+
+// The number of bytes the texture takes with 'level' as the top
+size_t OLTextureStreamer::LevelBytes(const StreamEntry& ent, int level) {
+	if (level < 0) return 0;
+	size_t ww = ent.width >> level;
+	size_t hh = ent.height >> level;
+	return Ogre::Image::calculateSize(ent.levels - 1 - level, 1, 
+				(ww > 0) ? ww : 1, (hh > 0) ? hh : 1, 1, Ogre::PF_A8R8G8B8);
+}
+
+void OLTextureStreamer::SetResident(StreamEntry& ent, int level) {
+	m_residentBytes -= LevelBytes(ent, ent.resident);
+	ent.resident = level;
+	m_residentBytes += LevelBytes(ent, ent.resident);
+}
+
+// A predecoded texture is being loaded. If we asked for the load, it gets the
+// levels we wanted. Otherwise, it gets just the small levels.
+size_t OLTextureStreamer::LevelToLoad(const Ogre::String& texName, size_t width, size_t height, size_t levels) {
+	if (!m_enabled || levels == 0) return 0;
+	LGLOCK_ALOCK streamLock;
+	streamLock.Lock(m_streamLock);
+	int initial = 0;
+	for (size_t sz = (width > height) ? width : height; sz > m_initialSize && initial < (int)levels - 1; sz /= 2) {
+		initial++;
+	}
+	StreamEntryHashMap::iterator intr = m_textures.find(texName);
+	if (intr == m_textures.end()) {
+		StreamEntry newEnt;
+		newEnt.resident = -1;
+		newEnt.wanted = initial;
+		newEnt.screenSize = 0.0;
+		newEnt.pass = 0;
+		newEnt.reloading = false;
+		intr = m_textures.insert(std::pair<Ogre::String, StreamEntry>(texName, newEnt)).first;
+	}
+	StreamEntry& ent = intr->second;
+	// the sizes could have changed if the texture was refreshed
+	SetResident(ent, -1);
+	ent.width = width;
+	ent.height = height;
+	ent.levels = levels;
+	int level = ent.reloading ? ent.wanted : initial;
+	if (level < 0) level = 0;
+	if (level > (int)levels - 1) level = (int)levels - 1;
+	SetResident(ent, level);
+	return (size_t)level;
+}
+
+void OLTextureStreamer::StartVisibilityPass() {
+	m_pass++;
+}
+
+// The entity is visible and about 'screenSize' pixels on the screen. Note that
+// for all the textures it uses.
+void OLTextureStreamer::NoteEntityVisible(Ogre::Entity* ent, float screenSize) {
+	if (!m_enabled) return;
+	LGLOCK_ALOCK streamLock;
+	streamLock.Lock(m_streamLock);
+	for (unsigned int ii = 0; ii < ent->getNumSubEntities(); ii++) {
+		Ogre::MaterialPtr mat = ent->getSubEntity(ii)->getMaterial();
+		if (mat.isNull() || mat->getNumTechniques() == 0) continue;
+		Ogre::Technique* tech = mat->getBestTechnique();
+		if (tech == NULL) tech = mat->getTechnique(0);
+		Ogre::Technique::PassIterator passIter = tech->getPassIterator();
+		while (passIter.hasMoreElements()) {
+			Ogre::Pass* onePass = passIter.getNext();
+			Ogre::Pass::TextureUnitStateIterator tusIter = onePass->getTextureUnitStateIterator();
+			while (tusIter.hasMoreElements()) {
+				NoteTextureUse(tusIter.getNext()->getTextureName(), screenSize);
+			}
+		}
+	}
+}
+
+// Called with the lock held
+void OLTextureStreamer::NoteTextureUse(const Ogre::String& texName, float screenSize) {
+	StreamEntryHashMap::iterator intr = m_textures.find(texName);
+	if (intr == m_textures.end()) {
+		// not a texture we stream
+		return;
+	}
+	StreamEntry& ent = intr->second;
+	if (ent.pass != m_pass || screenSize > ent.screenSize) {
+		ent.pass = m_pass;
+		ent.screenSize = screenSize;
+		// the smallest level that still has a texel per pixel
+		int level = 0;
+		for (float texels = (float)((ent.width > ent.height) ? ent.width : ent.height);
+					level < (int)ent.levels - 1 && (texels / 2) >= screenSize; texels /= 2) {
+			level++;
+		}
+		ent.wanted = level;
+	}
+}
+
+// The texture was unloaded or removed. Forget it. If it's loaded again it
+// starts over with the small levels.
+void OLTextureStreamer::NoteTextureUnloaded(const Ogre::String& texName) {
+	if (!m_enabled) return;
+	LGLOCK_ALOCK streamLock;
+	streamLock.Lock(m_streamLock);
+	StreamEntryHashMap::iterator intr = m_textures.find(texName);
+	if (intr != m_textures.end()) {
+		SetResident(intr->second, -1);
+		m_textures.erase(intr);
+	}
+}
+
+static bool StreamCandidateBigger(const std::pair<float, Ogre::String>& aa, const std::pair<float, Ogre::String>& bb) {
+	return aa.first > bb.first;
+}
+
+// Between frames, reload a few textures with the levels they should have.
+// If we're over the budget, shed levels from the textures smallest on the
+// screen. Otherwise add levels to the textures biggest on the screen as long as
+// they fit.
+bool OLTextureStreamer::frameEnded(const Ogre::FrameEvent&) {
+	if (!m_enabled) return true;
+	std::vector<std::pair<float, Ogre::String> > candidates;
+	std::list<Ogre::String> reloads;
+	LGLOCK_ALOCK streamLock;
+	streamLock.Lock(m_streamLock);
+	size_t projected = m_residentBytes;
+	StreamEntryHashMap::iterator intr;
+	if (m_residentBytes > m_budget) {
+		for (intr = m_textures.begin(); intr != m_textures.end(); intr++) {
+			StreamEntry& ent = intr->second;
+			if (ent.resident >= 0 && ent.resident < (int)ent.levels - 1) {
+				candidates.push_back(std::pair<float, Ogre::String>(
+						(ent.pass == m_pass) ? ent.screenSize : 0.0f, intr->first));
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+		for (size_t ii = 0; ii < candidates.size() && (int)reloads.size() < m_reloadsPerFrame && projected > m_budget; ii++) {
+			StreamEntry& ent = m_textures[candidates[ii].second];
+			ent.wanted = ent.resident + 1;
+			projected -= LevelBytes(ent, ent.resident) - LevelBytes(ent, ent.wanted);
+			ent.reloading = true;
+			reloads.push_back(candidates[ii].second);
+		}
+	}
+	else {
+		for (intr = m_textures.begin(); intr != m_textures.end(); intr++) {
+			StreamEntry& ent = intr->second;
+			if (ent.resident >= 0 && ent.pass == m_pass && ent.wanted < ent.resident) {
+				candidates.push_back(std::pair<float, Ogre::String>(ent.screenSize, intr->first));
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), StreamCandidateBigger);
+		for (size_t ii = 0; ii < candidates.size() && (int)reloads.size() < m_reloadsPerFrame; ii++) {
+			StreamEntry& ent = m_textures[candidates[ii].second];
+			size_t more = LevelBytes(ent, ent.wanted) - LevelBytes(ent, ent.resident);
+			if ((projected + more) > m_budget) continue;
+			projected += more;
+			ent.reloading = true;
+			reloads.push_back(candidates[ii].second);
+		}
+	}
+	streamLock.Unlock();
+
+	std::list<Ogre::String>::iterator li;
+	for (li = reloads.begin(); li != reloads.end(); li++) {
+		Ogre::TexturePtr tex = (Ogre::TexturePtr)Ogre::TextureManager::getSingleton().getByName(*li);
+		try {
+			if (!tex.isNull() && tex->isLoaded()) {
+				tex->reload();
+			}
+		}
+		catch (Ogre::Exception& e) {
+			LG::Log("OLTextureStreamer::frameEnded: failed reloading %s: %s", li->c_str(), e.getDescription().c_str());
+		}
+	}
+	if (!reloads.empty()) {
+		streamLock.Lock(m_streamLock);
+		for (li = reloads.begin(); li != reloads.end(); li++) {
+			intr = m_textures.find(*li);
+			if (intr != m_textures.end()) {
+				intr->second.reloading = false;
+			}
+		}
+		streamLock.Unlock();
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,96 @@
+/* Copyright (c) Robert Adams
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * The name of the copyright holder may not be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE DEVELOPERS ``AS IS'' AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE CONTRIBUTORS BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#pragma once
+
+#include "LGOCommon.h"
+#include "LGLocking.h"
+#include "SingletonInstance.h"
+
+namespace LG {
+
+// Progressive loading of the predecoded textures (see OLTextureDecoder).
+// When a texture is first loaded only its small mip levels are put in the
+// texture. The visibility pass reports how big each texture is on the screen
+// and, between frames, the textures that are seen bigger than their resident
+// top level are reloaded with more levels, biggest on the screen first.
+// When the textures add up to more than the budget, the ones that are smallest
+// on the screen (or not seen at all) are reloaded with fewer levels.
+// Any load we didn't ask for (first use, reload after a refresh or cull)
+// starts again with the small levels.
+class OLTextureStreamer : public Ogre::FrameListener, public SingletonInstance {
+public:
+	OLTextureStreamer();
+	~OLTextureStreamer();
+
+	static OLTextureStreamer* Instance() { 
+		if (LG::OLTextureStreamer::m_instance == NULL) {
+			LG::OLTextureStreamer::m_instance = new OLTextureStreamer();
+		}
+		return LG::OLTextureStreamer::m_instance; 
+	}
+
+	// SingletonInstance.Shutdown();
+	void Shutdown();
+
+	bool IsEnabled() { return m_enabled; }
+
+	// Called by the texture loader. Returns the mip level to use as the top of the texture.
+	size_t LevelToLoad(const Ogre::String&, size_t, size_t, size_t);
+
+	// Called by the visibility pass
+	void StartVisibilityPass();
+	void NoteEntityVisible(Ogre::Entity*, float);
+	void NoteTextureUnloaded(const Ogre::String&);
+
+	// Ogre::FrameListener
+	bool frameEnded(const Ogre::FrameEvent&);
+
+private:
+	static OLTextureStreamer* m_instance;
+
+	bool m_enabled;
+	size_t m_initialSize;		// first loads have a top level no bigger than this
+	int m_reloadsPerFrame;
+	size_t m_budget;			// bytes of texture we'd like to stay under
+
+	typedef struct {
+		size_t width;			// size of level zero
+		size_t height;
+		size_t levels;
+		int resident;			// top level in the texture. -1 if not loaded.
+		int wanted;				// top level the screen size calls for
+		float screenSize;		// biggest on screen size seen in the last visibility pass
+		unsigned long pass;		// the visibility pass that last saw it
+		bool reloading;			// we asked for this load
+	} StreamEntry;
+	typedef std::map<Ogre::String, StreamEntry> StreamEntryHashMap;
+	StreamEntryHashMap m_textures;
+	size_t m_residentBytes;
+	unsigned long m_pass;
+	LGLOCK_MUTEX m_streamLock;
+
+	void NoteTextureUse(const Ogre::String&, float);
+	size_t LevelBytes(const StreamEntry&, int);
+	void SetResident(StreamEntry&, int);
+};
+}
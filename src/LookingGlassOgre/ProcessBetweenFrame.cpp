@@ -31,6 +31,8 @@
 #include "OLMaterialTracker.h"
 #include "AnimTracker.h"
 #include "RegionTracker.h"
+#include "LGStats.h"
+#include "LGTrace.h"
 
 namespace LG {
 
@@ -48,6 +50,7 @@ public:
 		this->priority = prio;
 		this->cost = 40;
 		this->type = "RefreshResource";
+		this->statHist = LG::HistBFRefreshResource;
 		this->uniq = uni + "/RefreshResource";
 		this->matName = Ogre::String(resourceName);
 		this->rType = rTyp;
@@ -70,6 +73,7 @@ public:
 		this->priority = prio;
 		this->cost = 20;
 		this->type = "RemoveSceneNode";
+		this->statHist = LG::HistBFRemoveSceneNode;
 		this->uniq = uni + "/RemoveSceneNode";
 		this->sNodeName = Ogre::String(sNodeN);
 	}
@@ -95,6 +99,7 @@ public:
 		// this->priority = prio - fmod(prio, (float)100.0);	// EXPERIMENTAL. Group material ops
 		this->cost = 0;
 		this->type = "CreateMaterialResource";
+		this->statHist = LG::HistBFCreateMaterialResource;
 		this->uniq = uni + "/CreateMaterialResource";
 		this->matName = Ogre::String(mName);
 		this->texName = Ogre::String(tName);
@@ -141,6 +146,7 @@ public:
 		// this->priority = prio - fmod(prio, (float)100.0);	// EXPERIMENTAL. Group material ops
 		this->cost = 0;
 		this->type = "CreateMaterialResource7";
+		this->statHist = LG::HistBFCreateMaterialResource;
 		this->uniq = uni + "/CreateMaterialResource7";
 		if (matName1p != 0) {
 			this->matName1 = Ogre::String(matName1p);
@@ -185,20 +191,10 @@ public:
 		free((void*)this->matParams);
 	}
 	void Process() {
-		int stride = (int)this->matParams[0];
-		LG::OLMaterialTracker::Instance()->CreateMaterialResource2(this->matName1.c_str(), this->textureName1.c_str(), &(this->matParams[1 + stride * 0]));
-		if (!this->matName2.empty())
-			LG::OLMaterialTracker::Instance()->CreateMaterialResource2(this->matName2.c_str(), this->textureName2.c_str(), &(this->matParams[1 + stride * 1]));
-		if (!this->matName3.empty())
-			LG::OLMaterialTracker::Instance()->CreateMaterialResource2(this->matName3.c_str(), this->textureName3.c_str(), &(this->matParams[1 + stride * 2]));
-		if (!this->matName4.empty())
-			LG::OLMaterialTracker::Instance()->CreateMaterialResource2(this->matName4.c_str(), this->textureName4.c_str(), &(this->matParams[1 + stride * 3]));
-		if (!this->matName5.empty())
-			LG::OLMaterialTracker::Instance()->CreateMaterialResource2(this->matName5.c_str(), this->textureName5.c_str(), &(this->matParams[1 + stride * 4]));
-		if (!this->matName6.empty())
-			LG::OLMaterialTracker::Instance()->CreateMaterialResource2(this->matName6.c_str(), this->textureName6.c_str(), &(this->matParams[1 + stride * 5]));
-		if (!this->matName7.empty())
-			LG::OLMaterialTracker::Instance()->CreateMaterialResource2(this->matName7.c_str(), this->textureName7.c_str(), &(this->matParams[1 + stride * 6]));
+		Ogre::String matNames[7] = { matName1, matName2, matName3, matName4, matName5, matName6, matName7 };
+		Ogre::String texNames[7] = { textureName1, textureName2, textureName3, textureName4,
+									textureName5, textureName6, textureName7 };
+		LG::OLMaterialTracker::Instance()->CreateMaterialResource7(matNames, texNames, this->matParams);
 	}
 };
 
@@ -221,6 +217,7 @@ public:
 		this->origPriority = prio;
 		this->cost = 100;
 		this->type = "CreateMeshResource";
+		this->statHist = LG::HistBFCreateMeshResource;
 		this->uniq = uni + "/CreateMeshResource";
 		this->meshName = Ogre::String(mName);
 		this->contextSceneNodeName = Ogre::String(contextSN);
@@ -240,7 +237,7 @@ public:
 		memcpy(this->faceCounts, faceC, ((int)*faceC) * sizeof(int));
 		this->faceVertices = (float*)malloc(((size_t)*faceV) * sizeof(float));
 		memcpy(this->faceVertices, faceV, ((int)*faceV) * sizeof(float));
-		LG::Log("ProcessBetweenFrame::CreateMeshResourceQc: queuing %s", mName);
+		LG::LogDetail("ProcessBetweenFrame::CreateMeshResourceQc: queuing %s", mName);
 	}
 	~CreateMeshResourceQc(void) {
 		this->uniq.clear();
@@ -302,6 +299,7 @@ public:
 		this->origPriority = prio;
 		this->cost = 10;
 		this->type = "CreateMeshSceneNode";
+		this->statHist = LG::HistBFCreateMeshSceneNode;
 		this->uniq = uni + "/CreateMeshSceneNode";
 		this->sceneMgr = sceneMgr;
 		this->sceneNodeName = Ogre::String(sceneNodeName);
@@ -330,6 +328,10 @@ public:
 		LG::RendererOgre::Instance()->AddEntity(this->sceneMgr, node, this->entityName.c_str(), this->meshName.c_str());
 	}
 
+	bool IsInArea(Ogre::SceneNode* regionNode, const Ogre::Vector3& loc, float radius) {
+		return (this->parentNode == regionNode)
+			&& (loc.squaredDistance(Ogre::Vector3(this->px, this->py, this->pz)) < (radius * radius));
+	}
 	void RecalculatePriority() {
 		Ogre::Vector3 ourLoc = Ogre::Vector3(this->px, this->py, this->pz);
 		// this->priority = ourLoc.distance(LG::RendererOgre::Instance()->m_camera->getPosition());
@@ -370,6 +372,7 @@ public:
 		this->priority = prio;
 		this->cost = 3;
 		this->type = "UpdateSceneNode";
+		this->statHist = LG::HistBFUpdateSceneNode;
 		this->uniq = uni + "/UpdateSceneNode";
 		this->entName = Ogre::String(entName);
 		this->setPosition = setPosition;
@@ -555,6 +558,33 @@ public:
 	}
 };
 
+// ====================================================================
+// Build the low rez proxy for a region. Each Process() does one step and requeues
+// itself if there is more to do. Queued on the idle queue.
+class BuildRegionProxyQc : public GenericQc {
+public:
+	Ogre::String regionName;
+	RegionRezCode LODLevel;
+	BuildRegionProxyQc(float prio, const char* rName, const RegionRezCode lod) {
+		this->priority = prio;
+		this->cost = 50;
+		this->type = "BuildRegionProxy";
+		this->regionName = Ogre::String(rName);
+		this->LODLevel = lod;
+		this->uniq = this->regionName + "/BuildRegionProxy/" + Ogre::StringConverter::toString((int)lod);
+	}
+	~BuildRegionProxyQc(void) {
+		this->uniq.clear();
+		this->regionName.clear();
+	}
+	void Process() {
+		Region* regn = LG::RegionTracker::Instance()->FindRegion(this->regionName);
+		if (regn != NULL && regn->BuildProxyStep(this->LODLevel)) {
+			LG::ProcessBetweenFrame::Instance()->BuildRegionProxy(this->priority, this->regionName.c_str(), this->LODLevel);
+		}
+	}
+};
+
 // ====================================================================
 // Queue of work to do between frames.
 // To add a between frame operation, you write a subclass of GenericQc like those
@@ -574,6 +604,13 @@ ProcessBetweenFrame::ProcessBetweenFrame() {
 
 	m_workItemMutex = LGLOCK_ALLOCATE_MUTEX("ProcessBetweenFrames");
 	m_modified = false;
+	int queueSize = LG::GetParameterInt("Renderer.Ogre.BetweenFrame.QueueSize");
+	m_incoming = new LGRingQueue<IncomingWork>(queueSize > 0 ? queueSize : 4096);
+	m_overflowing = 0;
+	for (int ii = 0; ii < EnqueueLatencyBuckets; ii++) {
+		m_enqueueLatency[ii] = 0;
+	}
+	m_latencyFrames = 0;
 	// link into the renderer.
 	if (m_shouldUseProcessingThread) {
 		m_processingThread = LGLOCK_ALLOCATE_THREAD(&ProcessThreadRoutine);
@@ -586,6 +623,7 @@ ProcessBetweenFrame::ProcessBetweenFrame() {
 
 ProcessBetweenFrame::~ProcessBetweenFrame() {
 	LGLOCK_RELEASE_MUTEX(m_workItemMutex);
+	delete m_incoming;
 	if (!m_shouldUseProcessingThread) {
 		LG::GetOgreRoot()->removeFrameListener(this);
 	}
@@ -600,30 +638,24 @@ void ProcessBetweenFrame::Shutdown() {
 // ====================================================================
 // refresh a resource
 void ProcessBetweenFrame::RefreshResource(float priority, char* resourceName, int rType) {
-	LGLOCK_LOCK(m_workItemMutex);
 	RefreshResourceQc* rrq = new RefreshResourceQc(priority, resourceName, resourceName, rType);
-	QueueWork((GenericQc*)rrq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)rrq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 	LG::IncStat(LG::StatBetweenFrameRefreshResource);
 }
 
 // remove scene node
 void ProcessBetweenFrame::RemoveSceneNode(float priority, char* sceneNodeName) {
-	LGLOCK_LOCK(m_workItemMutex);
 	RemoveSceneNodeQc* rsnq = new RemoveSceneNodeQc(priority, sceneNodeName, sceneNodeName);
-	QueueWork((GenericQc*)rsnq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)rsnq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 	LG::IncStat(LG::StatBetweenFrameRemoveSceneNode);
 }
 
 void ProcessBetweenFrame::CreateMaterialResource2(float priority, 
 			  const char* matName, const char* texName, const float* parms) {
-	LGLOCK_LOCK(m_workItemMutex);
 	CreateMaterialResourceQc* cmrq = new CreateMaterialResourceQc(priority, matName, matName, texName, parms);
-	QueueWork((GenericQc*)cmrq, &m_betweenFrameMaterialWork);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)cmrq, &m_betweenFrameMaterialWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 	LG::IncStat(LG::StatBetweenFrameCreateMaterialResource);
 }
@@ -635,13 +667,11 @@ void ProcessBetweenFrame::CreateMaterialResource7(float priority, const char* un
 			char* textureName4, char* textureName5, char* textureName6, 
 			char* textureName7,
 			const float* parms) {
-	LGLOCK_LOCK(m_workItemMutex);
 	CreateMaterialResource7Qc* cmr7q = new CreateMaterialResource7Qc(priority, uniq, 
 			matName1, matName2, matName3, matName4, matName5, matName6, matName7,
 			textureName1, textureName2, textureName3, textureName4, textureName5, textureName6, textureName7,
 			parms);
-	QueueWork((GenericQc*)cmr7q, &m_betweenFrameMaterialWork);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)cmr7q, &m_betweenFrameMaterialWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 	LG::IncStat(LG::StatBetweenFrameCreateMaterialResource);
 }
@@ -649,10 +679,8 @@ void ProcessBetweenFrame::CreateMaterialResource7(float priority, const char* un
 void ProcessBetweenFrame::CreateMeshResource(float priority, 
 				 const char* meshName, const char* contextSceneNode,
 				 const int* faceCounts, const float* faceVertices) {
-	LGLOCK_LOCK(m_workItemMutex);
 	CreateMeshResourceQc* cmrq = new CreateMeshResourceQc(priority, meshName, meshName, contextSceneNode, faceCounts, faceVertices);
-	QueueWork((GenericQc*)cmrq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)cmrq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 	LG::IncStat(LG::StatBetweenFrameCreateMeshResource);
 }
@@ -667,7 +695,6 @@ void ProcessBetweenFrame::CreateMeshSceneNode(float priority,
 					float px, float py, float pz,
 					float sx, float sy, float sz,
 					float ow, float ox, float oy, float oz) {
-	LGLOCK_LOCK(m_workItemMutex);
 	CreateMeshSceneNodeQc* csnq = new CreateMeshSceneNodeQc(priority, sceneNodeName, 
 					sceneMgr, 
 					sceneNodeName,
@@ -678,8 +705,7 @@ void ProcessBetweenFrame::CreateMeshSceneNode(float priority,
 					px, py, pz,
 					sx, sy, sz,
 					ow, ox, oy, oz);
-	QueueWork((GenericQc*)csnq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)csnq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 	LG::IncStat(LG::StatBetweenFrameCreateMeshSceneNode);
 }
@@ -688,75 +714,190 @@ void ProcessBetweenFrame::UpdateSceneNode(float priority, char* entName,
 					bool setPosition, float px, float py, float pz, float pd,
 					bool setScale, float sx, float sy, float sz, float sd,
 					bool setRotation, float ow, float ox, float oy, float oz, float od) {
-	LGLOCK_LOCK(m_workItemMutex);
 	UpdateSceneNodeQc* usnq = new UpdateSceneNodeQc(priority, entName,
 					entName,
 					setPosition, px, py, pz, pd,
 					setScale, sx, sy, sz, sd,
 					setRotation, ow, ox, oy, oz, od);
-	QueueWork((GenericQc*)usnq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)usnq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 	LG::IncStat(LG::StatBetweenFrameUpdateSceneNode);
 }
 
 void ProcessBetweenFrame::UpdateAnimation(float prio, char * sceneNodeName, float X, float Y, float Z, float rate){
-	LGLOCK_LOCK(m_workItemMutex);
 	UpdateAnimationQc* uaq = new UpdateAnimationQc(prio, Ogre::String(sceneNodeName), sceneNodeName, X, Y, Z, rate);
-	QueueWork((GenericQc*)uaq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)uaq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 }
 void ProcessBetweenFrame::UpdateCamera(double px, double py, double pz,
 					float ow, float ox, float oy, float oz,
 					float farClipP, float nearClipP, float aspectP) {
-	LGLOCK_LOCK(m_workItemMutex);
 	UpdateCameraQc* ucq = new UpdateCameraQc(0.0, Ogre::String(""), px, py, pz, ow, ox, oy, oz, farClipP, nearClipP, aspectP);
-	QueueWork((GenericQc*)ucq, &m_betweenFrameCameraWork);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)ucq, &m_betweenFrameCameraWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 }
 
 void ProcessBetweenFrame::AddRegion(float priority, const char* rn,
 					const double gx, const double gy, const double gz, 
 					const float sx, const float sy, const float wh) {
-	LGLOCK_LOCK(m_workItemMutex);
 	AddRegionQc* arq = new AddRegionQc(priority, rn, gx, gy, gz, sx, sy, wh);
-	QueueWork((GenericQc*)arq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)arq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 }
 
 void ProcessBetweenFrame::UpdateTerrain(float priority, const char* rn, 
 										const int w, const int l, const float* ht) {
-	LGLOCK_LOCK(m_workItemMutex);
 	UpdateTerrainQc* utq = new UpdateTerrainQc(priority, rn, w, l, ht);
-	QueueWork((GenericQc*)utq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)utq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 }
 
 void ProcessBetweenFrame::SetFocusRegion(float priority, const char* rn) {
-	LGLOCK_LOCK(m_workItemMutex);
 	SetFocusRegionQc* sfrq = new SetFocusRegionQc(priority, rn);
-	QueueWork((GenericQc*)sfrq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)sfrq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 }
 
 void ProcessBetweenFrame::SetRegionDetail(float priority, const char* rn, const RegionRezCode rc) {
-	LGLOCK_LOCK(m_workItemMutex);
 	SetRegionDetailQc* srdq = new SetRegionDetailQc(priority, rn, rc);
-	QueueWork((GenericQc*)srdq);
-	LGLOCK_UNLOCK(m_workItemMutex);
+	Enqueue((GenericQc*)srdq, &m_betweenFrameWork);
 	LG::IncStat(LG::StatBetweenFrameWorkItems);
 }
 
+void ProcessBetweenFrame::BuildRegionProxy(float priority, const char* rn, const RegionRezCode rc) {
+	BuildRegionProxyQc* brpq = new BuildRegionProxyQc(priority, rn, rc);
+	Enqueue((GenericQc*)brpq, &m_betweenFrameIdleWork);
+}
+
+// ====================================================================
+// Queue work from any thread. It goes into the ring which the frame thread
+// empties into the work lists. If the ring is full, the work goes on the
+// overflow list (under the lock). Once something is on the overflow list,
+// everything goes there until the frame thread empties it so the work stays
+// in order.
+void ProcessBetweenFrame::Enqueue(GenericQc* wi, std::list<GenericQc*>* queue) {
+	Ogre::uint64 startTime = LGLOCK_MICROSECONDS();
+	IncomingWork iw;
+	iw.work = wi;
+	iw.queue = queue;
+	if (LGLOCK_ATOMIC_GET(m_overflowing) != 0 || !m_incoming->Push(iw)) {
+		LGLOCK_LOCK(m_workItemMutex);
+		m_overflow.push_back(iw);
+		LGLOCK_ATOMIC_SET(m_overflowing, 1);
+		LGLOCK_UNLOCK(m_workItemMutex);
+		LG::IncStat(LG::StatBetweenFrameOverflows);
+	}
+	// count the time in power of two buckets of microseconds
+	Ogre::uint64 elapsed = LGLOCK_MICROSECONDS() - startTime;
+	int bucket = 0;
+	while (elapsed > 0 && bucket < (EnqueueLatencyBuckets - 1)) {
+		elapsed >>= 1;
+		bucket++;
+	}
+	LGLOCK_ATOMIC_INC(m_enqueueLatency[bucket]);
+}
+
+// Frame thread. Move the queued work into the work lists.
+void ProcessBetweenFrame::DrainIncoming() {
+	IncomingWork iw;
+	while (m_incoming->Pop(iw)) {
+		QueueWork(iw.work, iw.queue);
+	}
+	if (LGLOCK_ATOMIC_GET(m_overflowing) != 0) {
+		std::list<IncomingWork> overflow;
+		LGLOCK_LOCK(m_workItemMutex);
+		// what made it into the ring before the overflow started goes first
+		while (m_incoming->Pop(iw)) {
+			QueueWork(iw.work, iw.queue);
+		}
+		overflow.swap(m_overflow);
+		LGLOCK_ATOMIC_SET(m_overflowing, 0);
+		LGLOCK_UNLOCK(m_workItemMutex);
+		std::list<IncomingWork>::iterator oi;
+		for (oi = overflow.begin(); oi != overflow.end(); oi++) {
+			QueueWork(oi->work, oi->queue);
+		}
+	}
+}
+
+// Every so often, set the stat to the 99th percentile of the time to enqueue
+// since the last time. It's the top of the bucket so it's at most twice too big.
+void ProcessBetweenFrame::ReportEnqueueLatency() {
+	int counts[EnqueueLatencyBuckets];
+	int total = 0;
+	for (int ii = 0; ii < EnqueueLatencyBuckets; ii++) {
+		counts[ii] = (int)LGLOCK_ATOMIC_GET(m_enqueueLatency[ii]);
+		LGLOCK_ATOMIC_ADD(m_enqueueLatency[ii], -counts[ii]);
+		total += counts[ii];
+	}
+	if (total == 0) {
+		return;
+	}
+	int threshold = total - total / 100;
+	int seen = 0;
+	for (int ii = 0; ii < EnqueueLatencyBuckets; ii++) {
+		seen += counts[ii];
+		if (seen >= threshold) {
+			LG::SetStat(LG::StatBetweenFrameEnqueueP99Us, 1 << ii);
+			break;
+		}
+	}
+}
+
+// Synthetic load for measuring the enqueue time. Some threads each queue a
+// number of work items that do nothing.
+class LoadTestQc : public GenericQc {
+public:
+	LoadTestQc() {
+		this->priority = 100;
+		this->cost = 0;
+		this->type = "LoadTest";
+	}
+	void Process() { }
+};
+void ProcessBetweenFrame::LoadTestRoutine(int items) {
+	for (int ii = 0; ii < items; ii++) {
+		LG::ProcessBetweenFrame::Instance()->Enqueue(new LoadTestQc(), 
+					&LG::ProcessBetweenFrame::Instance()->m_betweenFrameWork);
+	}
+}
+void ProcessBetweenFrame::LoadTest(int threads, int items) {
+	LG::Log("ProcessBetweenFrame::LoadTest: %d threads of %d items", threads, items);
+	for (int ii = 0; ii < threads; ii++) {
+		LGLOCK_THREAD* loader = new LGLOCK_THREAD(&LoadTestRoutine, items);
+		loader->detach();
+		delete loader;
+	}
+}
+
+// ====================================================================
+// Move the queued work that is near 'loc' in the region 'regionNode' to the front of
+// the queue. The newest work is still in the ring so that is moved into the lists
+// first. The meshes are loaded when the work makes the entities (AddEntity).
+// Returns the number of work items moved.
+// BETWEEN FRAME OPERATION
+int ProcessBetweenFrame::PrioritizeArea(Ogre::SceneNode* regionNode, const Ogre::Vector3& loc, 
+										float radius, int maxItems) {
+	DrainIncoming();
+	std::list<GenericQc*> inArea;
+	std::list<GenericQc*>::iterator li = m_betweenFrameWork.begin();
+	while (li != m_betweenFrameWork.end() && (int)inArea.size() < maxItems) {
+		std::list<GenericQc*>::iterator here = li++;
+		if ((*here)->IsInArea(regionNode, loc, radius)) {
+			inArea.splice(inArea.end(), m_betweenFrameWork, here);
+		}
+	}
+	int moved = (int)inArea.size();
+	m_betweenFrameWork.splice(m_betweenFrameWork.begin(), inArea);
+	return moved;
+}
+
 // ====================================================================
 // we're between frames, on our own thread so we can do the work without locking
 int milliSecondsToProcess;
 bool ProcessBetweenFrame::frameEnded(const Ogre::FrameEvent& evt) {
 	LG::StatIn(LG::InOutProcessBetweenFrames);
+	LGTRACE_SCOPE("ProcessBetweenFrame");
 	//current cost is number of milliseconds to do the processing
 	/*
 	if (evt.timeSinceLastFrame > 0.25 || m_betweenFrameWork.size() > 4000) {
@@ -770,6 +911,10 @@ bool ProcessBetweenFrame::frameEnded(const Ogre::FrameEvent& evt) {
 	*/
 	milliSecondsToProcess = 500;
 	ProcessWorkItems(milliSecondsToProcess);
+	if (++m_latencyFrames >= 100) {
+		m_latencyFrames = 0;
+		ReportEnqueueLatency();
+	}
 	LG::StatOut(LG::InOutProcessBetweenFrames);
 	return true;
 }
@@ -803,24 +948,34 @@ void ProcessBetweenFrame::QueueWork(GenericQc* wi, std::list<GenericQc*>*queue)
 	// Check to see if uniq is specified and remove any duplicates
 	if (!wi->uniq.empty()) {
 		// There will be duplicate requests for things. If we already have a request, delete the old
-		std::list<GenericQc*>::iterator li;
-		for (li = queue->begin(); li != queue->end(); li++) {
-			if (!(*li)->uniq.empty()) {
-				if (wi->uniq == (*li)->uniq) {
-					queue->erase(li);
-					LG::IncStat(LG::StatBetweenFrameDiscardedDups);
-					break;
-				}
-			}
+		UniqKey key = MakeUniqKey(queue, wi);
+		UniqHashMap::iterator ui = m_uniqIndex.find(key);
+		if (ui != m_uniqIndex.end()) {
+			queue->erase(ui->second);
+			LG::IncStat(LG::StatBetweenFrameDiscardedDups);
 		}
+		queue->push_back(wi);
+		m_uniqIndex[key] = --queue->end();
+	}
+	else {
+		queue->push_back(wi);
 	}
-	queue->push_back(wi);
 	m_modified = true;
 }
 
+// Take the first work item off a list. It's the one the index has for its uniq.
+GenericQc* ProcessBetweenFrame::PopWork(std::list<GenericQc*>* queue) {
+	GenericQc* wi = queue->front();
+	queue->pop_front();
+	if (!wi->uniq.empty()) {
+		m_uniqIndex.erase(MakeUniqKey(queue, wi));
+	}
+	return wi;
+}
+
 // return true if there is still work to do
 bool ProcessBetweenFrame::HasWorkItems() {
-	return !m_betweenFrameWork.empty();
+	return !m_betweenFrameWork.empty() || !m_incoming->IsEmpty() || LGLOCK_ATOMIC_GET(m_overflowing) != 0;
 }
 
 
@@ -834,8 +989,9 @@ void ProcessBetweenFrame::ProcessWorkItems(int millisToProcess) {
 	unsigned long startTime = betweenFrameTimeKeeper->getMilliseconds();
 	unsigned long endTime1 = startTime + millisToProcess/2;
 	unsigned long endTime2 = startTime + millisToProcess;
-	LGLOCK_ALOCK workItemLock;	// lock that will be released when exiting this routine
-	workItemLock.Mutex(m_workItemMutex);
+	// the work lists are only used by the frame thread. Other threads queue
+	// work through the ring.
+	DrainIncoming();
 	// This sort is intended to put the highest priority (ones with lowest numbers) at
 	//   the front of the list for processing first.
 	if (m_modified) {
@@ -860,12 +1016,9 @@ void ProcessBetweenFrame::ProcessWorkItems(int millisToProcess) {
 	while (!m_betweenFrameCameraWork.empty()) {
 		LG::StatIn(LG::InOutPBFCamera);
 		GenericQc* workCameraGeneric = NULL;
-		workItemLock.Lock();
 		if (!m_betweenFrameCameraWork.empty()) {
-			workCameraGeneric = (GenericQc*)m_betweenFrameCameraWork.front();
-			m_betweenFrameCameraWork.pop_front();
+			workCameraGeneric = PopWork(&m_betweenFrameCameraWork);
 		}
-		workItemLock.Unlock();
 		if (workCameraGeneric != NULL) {
 			ProcessOneWorkItem(workCameraGeneric, loopCost, millisToProcess);
 			LG::IncStat(LG::StatBetweenFrameTotalProcessed);
@@ -875,12 +1028,9 @@ void ProcessBetweenFrame::ProcessWorkItems(int millisToProcess) {
 	while (!m_betweenFrameMaterialWork.empty() && (betweenFrameTimeKeeper->getMilliseconds() < endTime1) ) {
 		LG::StatIn(LG::InOutPBFMaterial);
 		GenericQc* workMaterialGeneric = NULL;
-		workItemLock.Lock();
 		if (!m_betweenFrameMaterialWork.empty()) {
-			workMaterialGeneric = (GenericQc*)m_betweenFrameMaterialWork.front();
-			m_betweenFrameMaterialWork.pop_front();
+			workMaterialGeneric = PopWork(&m_betweenFrameMaterialWork);
 		}
-		workItemLock.Unlock();
 		if (workMaterialGeneric != NULL) {
 			ProcessOneWorkItem(workMaterialGeneric, loopCost, millisToProcess);
 			LG::IncStat(LG::StatBetweenFrameTotalProcessed);
@@ -894,20 +1044,30 @@ void ProcessBetweenFrame::ProcessWorkItems(int millisToProcess) {
 	while (!m_betweenFrameWork.empty() && (betweenFrameTimeKeeper->getMilliseconds() < endTime2) ) {
 		LG::StatIn(LG::InOutPBFWorkItems);
 		GenericQc* workGeneric = NULL;
-		workItemLock.Lock();
 		if (!m_betweenFrameWork.empty()) {
-			workGeneric = (GenericQc*)m_betweenFrameWork.front();
-			m_betweenFrameWork.pop_front();
+			workGeneric = PopWork(&m_betweenFrameWork);
 			LG::SetStat(LG::StatBetweenFrameWorkItems, m_betweenFrameWork.size());
 			loopCost -= workGeneric->cost;
 		}
-		workItemLock.Unlock();
 		if (workGeneric != NULL) {
 			ProcessOneWorkItem(workGeneric, loopCost, millisToProcess);
 			LG::IncStat(LG::StatBetweenFrameTotalProcessed);
 		}
 		LG::StatOut(LG::InOutPBFWorkItems);
 	}
+	// If nothing else is waiting, do one of the background items. These are
+	// expensive (render to texture, etc) so only one per frame.
+	// Work still in the ring or overflow list counts as waiting.
+	if (!HasWorkItems() && !m_betweenFrameIdleWork.empty()) {
+		GenericQc* workIdleGeneric = NULL;
+		if (!m_betweenFrameIdleWork.empty()) {
+			workIdleGeneric = PopWork(&m_betweenFrameIdleWork);
+		}
+		if (workIdleGeneric != NULL) {
+			ProcessOneWorkItem(workIdleGeneric, loopCost, millisToProcess);
+			LG::IncStat(LG::StatBetweenFrameTotalProcessed);
+		}
+	}
 	return;
 }
 
@@ -916,6 +1076,8 @@ void ProcessBetweenFrame::ProcessOneWorkItem(GenericQc* workGeneric, int loopCos
 	//1 unsigned long checkTimeBegin = betweenFrameTimeKeeper->getMicroseconds();
 	//1 LG::Log("PBF: About to do: %s, %s", workGeneric->type.c_str(), workGeneric->uniq.c_str());
 	try {
+		LG::StatTimer workTimer(workGeneric->statHist);
+		LGTRACE_SCOPE(workGeneric->type.c_str());
 		workGeneric->Process();
 	}
 	catch (...) {
@@ -26,6 +26,7 @@
 #include "LookingGlassOgre.h"
 #include "LGLocking.h"
 #include "SingletonInstance.h"
+#include "LGRingQueue.h"
 
 namespace LG {
 
@@ -38,11 +39,15 @@ public:
 	int cost;
 	Ogre::String type;
 	Ogre::String uniq;
+	int statHist;		// histogram the processing time goes in
 	virtual void Process() {};
 	virtual void RecalculatePriority() {};
+	// for prefetching: is this work for the area around the passed region location
+	virtual bool IsInArea(Ogre::SceneNode* regionNode, const Ogre::Vector3& loc, float radius) { return false; };
 	GenericQc() {
 		priority = 100;
 		cost = 50;
+		statHist = LG::HistBFOther;
 		uniq.clear();
 	};
 	~GenericQc() {};
@@ -66,6 +71,9 @@ public:
 
 	bool HasWorkItems();
 	void ProcessWorkItems(int);
+	// queue synthetic work from some threads to measure the enqueue time
+	void LoadTest(int, int);
+	int PrioritizeArea(Ogre::SceneNode*, const Ogre::Vector3&, float, int);
 
 	// Ogre::FrameListener
 	bool frameEnded(const Ogre::FrameEvent&);
@@ -104,6 +112,7 @@ public:
 	void UpdateTerrain(float, const char*, const int, const int, const float*);
 	void SetFocusRegion(float, const char*);
 	void SetRegionDetail(float, const char*, const RegionRezCode);
+	void BuildRegionProxy(float, const char*, const RegionRezCode);
 
 	LGLOCK_MUTEX m_workItemMutex;
 	static bool m_keepProcessing;	// true if to keep processing on and on
@@ -115,9 +124,39 @@ private:
 	std::list<GenericQc*> m_betweenFrameWork;
 	std::list<GenericQc*> m_betweenFrameCameraWork;
 	std::list<GenericQc*> m_betweenFrameMaterialWork;
+	std::list<GenericQc*> m_betweenFrameIdleWork;	// done one per frame when nothing else to do
 
 	void ProcessOneWorkItem(GenericQc* wi, int lc, int m);
 	void QueueWork(GenericQc* wi, std::list<GenericQc*>*queue);
+	GenericQc* PopWork(std::list<GenericQc*>*queue);
+	// the queued work with a uniq and where it is in its list. Only work of the
+	// same type in the same list replaces older work so the key is all three.
+	typedef std::pair<std::list<GenericQc*>*, Ogre::String> UniqKey;
+	typedef std::map<UniqKey, std::list<GenericQc*>::iterator> UniqHashMap;
+	UniqHashMap m_uniqIndex;
+	static UniqKey MakeUniqKey(std::list<GenericQc*>* queue, const GenericQc* wi) {
+		return UniqKey(queue, wi->type + "\t" + wi->uniq);
+	}
+
+	// Work is queued by other threads into the ring without a lock. The frame
+	// thread moves it into the lists above. When the ring is full, work goes
+	// on the overflow list under m_workItemMutex.
+	typedef struct {
+		GenericQc* work;
+		std::list<GenericQc*>* queue;
+	} IncomingWork;
+	LGRingQueue<IncomingWork>* m_incoming;
+	std::list<IncomingWork> m_overflow;
+	LGLOCK_ATOMIC_INT m_overflowing;	// non-zero if work is on the overflow list
+	void Enqueue(GenericQc*, std::list<GenericQc*>*);
+	void DrainIncoming();
+
+	// time to enqueue in power of two microsecond buckets
+	static const int EnqueueLatencyBuckets = 24;
+	LGLOCK_ATOMIC_INT m_enqueueLatency[EnqueueLatencyBuckets];
+	int m_latencyFrames;
+	void ReportEnqueueLatency();
+	static void LoadTestRoutine(int);
 
 	bool m_shouldUseProcessingThread;
 	LGLOCK_THREAD m_processingThread;
@@ -23,9 +23,18 @@
 // #include "StdAfx.h"
 #include "Region.h"
 #include "RendererOgre.h"
+#include "ProcessBetweenFrame.h"
+#include "LGParams.h"
 
 namespace LG {
 
+// The proxy texture is a picture of the terrain only. The prims come and go and
+// are hidden by the visibility calculation so a picture of them would be stale
+// or have holes. The terrain is in its own render queue group and the bake
+// only renders that group.
+static const char* ProxyBakeSequenceName = "LGRegionProxyBake";
+static const Ogre::uint8 ProxyBakeRenderQueue = Ogre::RENDER_QUEUE_WORLD_GEOMETRY_1;
+
 Region::Region() {
 		this->TerrainSceneNode = 0;
 		this->OceanSceneNode = 0;
@@ -36,22 +45,73 @@ Region::Region() {
 		this->CurrentRez = RegionRezCodeHigh;
 		this->m_focusRegion = false;
 		this->OceanHeight = 0.0;
+		this->SizeX = 256.0;
+		this->SizeY = 256.0;
+		this->m_heightMap = NULL;
+		this->m_hmWidth = 0;
+		this->m_hmLength = 0;
+		this->m_heightMapHash = 0;
+		this->m_wantedRez = RegionRezCodeHigh;
+		for (int ii = 0; ii < RegionRezCodeMAX; ii++) {
+			this->m_proxyStep[ii] = 0;
+		}
 }
 
 Region::~Region() {
+	// the proxies are ours. The full detail scene nodes belong to whoever added them.
+	if (LG::RendererOgre::Instance()->m_sceneMgr != NULL) {
+		DestroyProxy(RegionRezCodeLow);
+		DestroyProxy(RegionRezCodeVeryLow);
+	}
+	if (this->m_heightMap != NULL) {
+		free(this->m_heightMap);
+		this->m_heightMap = NULL;
+	}
 }
 
 void Region::ReleaseRegion() {
 }
+// Change the level of detail the region is displayed at. The low rez levels are
+// proxies (a coarse terrain mesh with a baked top down texture) that take the place
+// of the region's whole tree of entities. If the proxy doesn't exist yet, it's built
+// on idle frames and we switch to it when it's complete.
+// BETWEEN FRAME OPERATION
 void Region::ChangeRez(RegionRezCode newRez) {
-	if (newRez != this->CurrentRez) {
-		if (this->Resolutions[newRez] != 0) {
-			// do anything to release the region
+	static LG::LGParam proxyEnable("Renderer.Ogre.Region.Proxy.Enable");
+	this->m_wantedRez = newRez;
+	if (newRez == this->CurrentRez) {
+		return;
+	}
+	if (this->Resolutions[newRez] == 0) {
+		if ((newRez == RegionRezCodeLow || newRez == RegionRezCodeVeryLow)
+					&& proxyEnable.Bool()) {
+			LG::ProcessBetweenFrame::Instance()->BuildRegionProxy(100, this->Name.c_str(), newRez);
 		}
-		this->CurrentRez = newRez;
-		// set proper local coordinates for this new scene node
-		this->Resolutions[newRez]->setPosition(this->LocalX, this->LocalY, this->LocalZ);
+		else {
+			LG::Log("Region::ChangeRez: no scene node for rez %d of %s. Not changing.", 
+							(int)newRez, this->Name.c_str());
+		}
+		return;
 	}
+	DisconnectOldRezAndConnectNew(newRez, this->Resolutions[newRez]);
+}
+
+// Take the current rez's scene node out of the scene graph and put the new one in.
+// Only one of the resolutions is hung off the root at a time so Ogre (and the
+// visibility calculation) only walk the one being displayed.
+void Region::DisconnectOldRezAndConnectNew(RegionRezCode newRez, Ogre::SceneNode* newNode) {
+	Ogre::SceneNode* rootNode = LG::RendererOgre::Instance()->m_sceneMgr->getRootSceneNode();
+	Ogre::SceneNode* oldNode = this->CurrentSceneNode();
+	if (oldNode != NULL && oldNode != newNode && oldNode->getParentSceneNode() == rootNode) {
+		rootNode->removeChild(oldNode);
+	}
+	if (newNode->getParentSceneNode() == NULL) {
+		rootNode->addChild(newNode);
+	}
+	this->CurrentRez = newRez;
+	// set proper local coordinates for this new scene node
+	newNode->setPosition(this->LocalX, this->LocalY, this->LocalZ);
+	LG::Log("Region::DisconnectOldRezAndConnectNew: %s now at rez %d", this->Name.c_str(), (int)newRez);
 }
 
 void Region::AddRegionSceneNode(Ogre::SceneNode* nod, RegionRezCode rez) {
@@ -91,6 +151,8 @@ void Region::Init( double globalX, double globalY, double globalZ, float sizeX,
 	this->LocalX = (float)globalX;
 	this->LocalY = (float)globalY;
 	this->LocalZ = (float)globalZ;
+	this->SizeX = sizeX;
+	this->SizeY = sizeY;
 	// create scene Node
 	Ogre::Quaternion orient = Ogre::Quaternion(Ogre::Radian(-3.14159265f/2.0f), Ogre::Vector3(1.0f, 0.0f, 0.0f));
 	Ogre::SceneNode* regionNode = LG::RendererOgre::Instance()->CreateSceneNode(this->Name.c_str(), 
@@ -120,7 +182,8 @@ Ogre::SceneNode* Region::CreateOcean(Ogre::SceneNode* regionNode,
 					*oceanPlane, width, length,
 					2, 2, true,
 					2, 2.0, 2.0, Ogre::Vector3::UNIT_Y);
-	Ogre::String oceanMaterialName = LG::GetParameter("Renderer.Ogre.OceanMaterialName");
+	static LG::LGParam oceanMaterial("Renderer.Ogre.OceanMaterialName");
+	Ogre::String oceanMaterialName = oceanMaterial.Str();
 	LG::Log("Region::CreateOcean: r=%s, h=%f, n=%s, m=%s", 
 		regionNode->getName().c_str(), waterHeight, waterName.c_str(), oceanMaterialName.c_str());
 	oceanMesh->getSubMesh(0)->setMaterialName(oceanMaterialName);
@@ -180,6 +243,7 @@ void Region::UpdateTerrain(const int hmWidth, const int hmLength, const float* h
 		mob->setDynamic(true);
 		mob->setCastShadows(true);
 		mob->setVisible(true);
+		mob->setRenderQueueGroup(ProxyBakeRenderQueue);
 		node->attachObject(mob);
 		// m_visCalc->RecalculateVisibility();
 	}
@@ -192,7 +256,8 @@ void Region::UpdateTerrain(const int hmWidth, const int hmLength, const float* h
 
 	if (mo->getNumSections() == 0) {
 		// if first time
-		mo->begin(LG::GetParameter("Renderer.Ogre.DefaultTerrainMaterial"));
+		static LG::LGParam terrainMaterial("Renderer.Ogre.DefaultTerrainMaterial");
+		mo->begin(terrainMaterial.Str());
 	}
 	else {
 		mo->beginUpdate(0);					// we've been here before
@@ -219,7 +284,277 @@ void Region::UpdateTerrain(const int hmWidth, const int hmLength, const float* h
 
 	mo->end();
 
+	// Remember the heightmap for building the proxies. Any proxies we have are now stale.
+	if (this->m_heightMap != NULL) {
+		free(this->m_heightMap);
+	}
+	this->m_hmWidth = hmWidth;
+	this->m_hmLength = hmLength;
+	this->m_heightMap = (float*)malloc(hmWidth * hmLength * sizeof(float));
+	memcpy(this->m_heightMap, hm, hmWidth * hmLength * sizeof(float));
+	// simple FNV hash of the heights. Used to key the proxy texture cache files.
+	unsigned long hash = 2166136261UL;
+	const unsigned char* hmBytes = (const unsigned char*)hm;
+	for (int ii = 0; ii < (int)(hmWidth * hmLength * sizeof(float)); ii++) {
+		hash = (hash ^ hmBytes[ii]) * 16777619UL;
+	}
+	this->m_heightMapHash = hash & 0xffffffffUL;
+
+	if (this->CurrentRez == RegionRezCodeLow || this->CurrentRez == RegionRezCodeVeryLow) {
+		DisconnectOldRezAndConnectNew(RegionRezCodeHigh, this->Resolutions[RegionRezCodeHigh]);
+	}
+	DestroyProxy(RegionRezCodeLow);
+	DestroyProxy(RegionRezCodeVeryLow);
+	if (this->m_wantedRez != this->CurrentRez) {
+		ChangeRez(this->m_wantedRez);
+	}
+
 	return;
 }
 
+// ====================================================================
+// Region proxies.
+// A distant region is displayed as a coarse terrain mesh textured with a top down
+// picture of the full detail region's terrain. The picture is made with an off
+// screen render and is saved in the cache directory so it's only rendered once
+// for any particular terrain.
+// The building is done in steps (bake the texture, build the mesh, swap it in) with
+// each step done on an idle frame by ProcessBetweenFrame.
+
+Ogre::String Region::ProxyName(const char* kind, RegionRezCode rez) {
+	return this->Name + "/Proxy" + kind + "/" + Ogre::StringConverter::toString((int)rez);
+}
+
+// Do the next step of building the proxy for the passed rez.
+// Returns 'true' if there are more steps to do.
+// BETWEEN FRAME OPERATION
+bool Region::BuildProxyStep(RegionRezCode rez) {
+	if (this->m_heightMap == NULL) {
+		LG::Log("Region::BuildProxyStep: no terrain yet for %s. Not building proxy.", this->Name.c_str());
+		this->m_proxyStep[rez] = 0;
+		return false;
+	}
+	if (this->Resolutions[rez] != 0) {
+		// already built. Just make sure it's displayed if wanted.
+		this->m_proxyStep[rez] = 2;
+	}
+	switch (this->m_proxyStep[rez]) {
+		case 0:
+			if (!BakeProxyTexture(rez)) {
+				this->m_proxyStep[rez] = 0;
+				return false;
+			}
+			break;
+		case 1:
+			CreateProxySceneNode(rez);
+			break;
+		default:
+			// the rez could have changed while we were building
+			if (this->m_wantedRez == rez && this->CurrentRez != rez) {
+				DisconnectOldRezAndConnectNew(rez, this->Resolutions[rez]);
+			}
+			return false;
+	}
+	this->m_proxyStep[rez]++;
+	return true;
+}
+
+// Create the top down texture for the proxy. If it's in the cache, read it in,
+// otherwise point an orthographic camera at the full detail region's terrain and
+// render into a texture. Returns 'false' if the texture could not be made.
+bool Region::BakeProxyTexture(RegionRezCode rez) {
+	int texSize = LG::GetParameterInt("Renderer.Ogre.Region.Proxy.TextureSize");
+	if (texSize <= 0) texSize = 256;
+	if (rez == RegionRezCodeVeryLow) texSize = texSize / 2;
+
+	Ogre::String texName = ProxyName("Texture", rez);
+	Ogre::String cacheFilename = LG::RendererOgre::Instance()->EntityNameToFilename(
+				"Regions/" + this->Name + "/ProxyTerrain" + Ogre::StringConverter::toString((int)rez)
+						+ "-" + Ogre::StringConverter::toString(texSize)
+						+ "-" + Ogre::StringConverter::toString(this->m_heightMapHash), ".png");
+	Ogre::TextureManager::getSingleton().remove(texName);
+
+	// if it's been baked before, just read it in
+	std::ifstream cacheFile(cacheFilename.c_str(), std::ios::in | std::ios::binary);
+	if (cacheFile.is_open()) {
+		try {
+			Ogre::DataStreamPtr stream(OGRE_NEW Ogre::FileStreamDataStream(cacheFilename, &cacheFile, false));
+			Ogre::Image img;
+			img.load(stream, "png");
+			Ogre::TextureManager::getSingleton().loadImage(texName, OLResourceGroupName, img);
+			LG::Log("Region::BakeProxyTexture: read cached proxy %s", cacheFilename.c_str());
+			return true;
+		}
+		catch (Ogre::Exception& e) {
+			LG::Log("Region::BakeProxyTexture: failed reading cached proxy %s: %s", 
+							cacheFilename.c_str(), e.getDescription().c_str());
+		}
+	}
+
+	Ogre::SceneNode* regionNode = this->Resolutions[RegionRezCodeHigh];
+	if (regionNode == NULL) {
+		LG::Log("Region::BakeProxyTexture: no full detail region for %s", this->Name.c_str());
+		return false;
+	}
+	Ogre::SceneManager* sceneMgr = LG::RendererOgre::Instance()->m_sceneMgr;
+	// The full detail region has to be in the scene to take its picture. If another
+	// rez is displayed, hang it on just for the bake. Only its terrain is rendered.
+	bool attached = false;
+	if (regionNode->getParentSceneNode() == NULL) {
+		sceneMgr->getRootSceneNode()->addChild(regionNode);
+		regionNode->setPosition(this->LocalX, this->LocalY, this->LocalZ);
+		attached = true;
+	}
+	Ogre::TexturePtr tex = Ogre::TextureManager::getSingleton().createManual(texName, OLResourceGroupName,
+				Ogre::TEX_TYPE_2D, texSize, texSize, 0, Ogre::PF_R8G8B8, Ogre::TU_RENDERTARGET);
+	Ogre::RenderTarget* rtt = tex->getBuffer()->getRenderTarget();
+	rtt->setAutoUpdated(false);
+
+	// The region is rotated so its Z (height) is world Y. Look straight down at the
+	// center of the region with the region's +X to the right and +Y at the top.
+	Ogre::Vector3 center = regionNode->convertLocalToWorldPosition(
+				Ogre::Vector3(this->SizeX / 2.0f, this->SizeY / 2.0f, 0.0f));
+	Ogre::Camera* cam = sceneMgr->createCamera(ProxyName("Camera", rez));
+	cam->setProjectionType(Ogre::PT_ORTHOGRAPHIC);
+	cam->setOrthoWindow(this->SizeX, this->SizeY);
+	cam->setNearClipDistance(1.0f);
+	cam->setFarClipDistance(4000.0f);
+	cam->setPosition(center + Ogre::Vector3(0.0f, 2000.0f, 0.0f));
+	cam->setOrientation(Ogre::Quaternion(Ogre::Vector3::UNIT_X, Ogre::Vector3::NEGATIVE_UNIT_Z, Ogre::Vector3::UNIT_Y));
+
+	Ogre::Viewport* vp = rtt->addViewport(cam);
+	vp->setClearEveryFrame(true);
+	vp->setBackgroundColour(Ogre::ColourValue::Black);
+	vp->setOverlaysEnabled(false);
+	vp->setSkiesEnabled(false);
+	vp->setShadowsEnabled(false);
+	vp->setRenderQueueInvocationSequenceName(ProxyBakeSequence());
+	rtt->update();
+	if (attached) {
+		sceneMgr->getRootSceneNode()->removeChild(regionNode);
+	}
+	LG::Log("Region::BakeProxyTexture: baked proxy %s", texName.c_str());
+
+	try {
+		LG::RendererOgre::Instance()->CreateParentDirectory(cacheFilename);
+		rtt->writeContentsToFile(cacheFilename);
+	}
+	catch (Ogre::Exception& e) {
+		LG::Log("Region::BakeProxyTexture: failed writing proxy cache %s: %s", 
+						cacheFilename.c_str(), e.getDescription().c_str());
+	}
+	rtt->removeAllViewports();
+	sceneMgr->destroyCamera(cam);
+	return true;
+}
+
+// The render queue sequence for baking: just the terrain
+Ogre::String Region::ProxyBakeSequence() {
+	Ogre::Root* root = LG::GetOgreRoot();
+	Ogre::RenderQueueInvocationSequence* seq = NULL;
+	try {
+		seq = root->getRenderQueueInvocationSequence(ProxyBakeSequenceName);
+	}
+	catch (Ogre::Exception&) {
+		seq = NULL;
+	}
+	if (seq == NULL) {
+		seq = root->createRenderQueueInvocationSequence(ProxyBakeSequenceName);
+		seq->add(ProxyBakeRenderQueue, "Terrain");
+	}
+	return ProxyBakeSequenceName;
+}
+
+// Build the coarse terrain mesh for the proxy, texture it with the baked texture and
+// add the water. The resulting scene node is not connected to the scene graph until
+// ChangeRez swaps it for the full detail region.
+void Region::CreateProxySceneNode(RegionRezCode rez) {
+	Ogre::SceneManager* sceneMgr = LG::RendererOgre::Instance()->m_sceneMgr;
+	Ogre::SceneNode* regionNode = this->Resolutions[RegionRezCodeHigh];
+
+	Ogre::MaterialPtr mat = Ogre::MaterialManager::getSingleton().createOrRetrieve(
+				ProxyName("Material", rez), OLResourceGroupName).first;
+	mat->unload();
+	Ogre::Technique* tech = mat->getTechnique(0);
+	Ogre::Pass* pass = tech->getPass(0);
+	pass->removeAllTextureUnitStates();
+	pass->createTextureUnitState(ProxyName("Texture", rez));
+	// the colors were lit when baked
+	pass->setLightingEnabled(false);
+
+	// number of vertices along each side of the proxy terrain
+	int samples = (rez == RegionRezCodeVeryLow) ? 9 : 17;
+	float stepX = (float)(this->m_hmWidth - 1) / (float)(samples - 1);
+	float stepY = (float)(this->m_hmLength - 1) / (float)(samples - 1);
+
+	Ogre::ManualObject* mo = sceneMgr->createManualObject(ProxyName("Terrain", rez));
+	mo->setCastShadows(false);
+	mo->estimateVertexCount(samples * samples);
+	mo->estimateIndexCount(samples * samples * 6);
+	mo->begin(mat->getName());
+	for (int sx = 0; sx < samples; sx++) {
+		for (int sy = 0; sy < samples; sy++) {
+			int hx = (int)((float)sx * stepX + 0.5f);
+			int hy = (int)((float)sy * stepY + 0.5f);
+			mo->position((Ogre::Real)hx, (Ogre::Real)hy, 
+							this->m_heightMap[hx * this->m_hmLength + hy]);
+			// the baked picture has region +Y at the top of the texture
+			mo->textureCoord((float)sx / (float)(samples - 1), 1.0f - (float)sy / (float)(samples - 1));
+			mo->normal(0.0, 1.0, 0.0);
+		}
+	}
+	for (int px = 0; px < samples-1; px++) {
+		for (int py = 0; py < samples-1; py++) {
+			mo->quad(px      + py       * samples,
+					 px      + (py + 1) * samples,
+					(px + 1) + (py + 1) * samples,
+					(px + 1) + py       * samples
+					 );
+		}
+	}
+	mo->end();
+
+	Ogre::SceneNode* proxyNode = sceneMgr->createSceneNode(ProxyName("SceneNode", rez));
+	proxyNode->setOrientation(regionNode->getOrientation());
+	proxyNode->setInheritScale(false);
+	proxyNode->attachObject(mo);
+
+	// same water as the full region
+	if (this->OceanSceneNode != NULL && this->OceanSceneNode->numAttachedObjects() > 0) {
+		Ogre::Entity* water = (Ogre::Entity*)this->OceanSceneNode->getAttachedObject(0);
+		Ogre::Entity* proxyWater = sceneMgr->createEntity(ProxyName("Water", rez), water->getMesh()->getName());
+		proxyWater->setCastShadows(false);
+		Ogre::SceneNode* waterNode = proxyNode->createChildSceneNode(ProxyName("WaterSceneNode", rez));
+		waterNode->setPosition(this->OceanSceneNode->getPosition());
+		waterNode->attachObject(proxyWater);
+	}
+
+	this->AddRegionSceneNode(proxyNode, rez);
+	LG::Log("Region::CreateProxySceneNode: created proxy for %s at rez %d", this->Name.c_str(), (int)rez);
+}
+
+// Get rid of a proxy and all its Ogre resources. Destroying the scene node takes it
+// out of the scene graph if it's displayed.
+void Region::DestroyProxy(RegionRezCode rez) {
+	this->m_proxyStep[rez] = 0;
+	Ogre::SceneNode* proxyNode = this->Resolutions[rez];
+	Ogre::SceneManager* sceneMgr = LG::RendererOgre::Instance()->m_sceneMgr;
+	this->Resolutions[rez] = 0;
+	if (proxyNode != NULL) {
+		if (sceneMgr->hasSceneNode(ProxyName("WaterSceneNode", rez))) {
+			sceneMgr->destroySceneNode(ProxyName("WaterSceneNode", rez));
+		}
+		if (sceneMgr->hasEntity(ProxyName("Water", rez))) {
+			sceneMgr->destroyEntity(ProxyName("Water", rez));
+		}
+		if (sceneMgr->hasManualObject(ProxyName("Terrain", rez))) {
+			sceneMgr->destroyManualObject(ProxyName("Terrain", rez));
+		}
+		sceneMgr->destroySceneNode(proxyNode);
+	}
+	// the texture could be baked before the scene node is made
+	Ogre::TextureManager::getSingleton().remove(ProxyName("Texture", rez));
+	Ogre::MaterialManager::getSingleton().remove(ProxyName("Material", rez));
+}
+
 }
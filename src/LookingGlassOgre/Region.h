@@ -44,6 +44,9 @@ namespace LG {
 		void UpdateTerrain(const int, const int, const float*);
 		void CalculateLocal(double X, double Y, double Z);
 
+		// Low rez proxies for distant regions. Built a step at a time on idle frames.
+		bool BuildProxyStep(RegionRezCode);
+
 		double GlobalX;
 		double GlobalY;
 		double GlobalZ;
@@ -53,6 +56,8 @@ namespace LG {
 		float LocalZ;
 
 		float OceanHeight;
+		float SizeX;
+		float SizeY;
 
 		RegionRezCode CurrentRez;
 		Ogre::SceneNode* Resolutions[RegionRezCodeMAX];
@@ -69,8 +74,24 @@ namespace LG {
 
 		bool m_focusRegion;
 
+		// copy of the last terrain heightmap. Used to build the low rez proxies.
+		float* m_heightMap;
+		int m_hmWidth;
+		int m_hmLength;
+		unsigned long m_heightMapHash;
+
+		// the rez that has been asked for but whose proxy is still being built
+		RegionRezCode m_wantedRez;
+		int m_proxyStep[RegionRezCodeMAX];
+
 		void DisconnectOldRezAndConnectNew(RegionRezCode, Ogre::SceneNode*);
 
+		Ogre::String ProxyName(const char*, RegionRezCode);
+		bool BakeProxyTexture(RegionRezCode);
+		Ogre::String ProxyBakeSequence();
+		void CreateProxySceneNode(RegionRezCode);
+		void DestroyProxy(RegionRezCode);
+
 		Ogre::SceneNode* CreateOcean(Ogre::SceneNode* , const float, const float, const float, Ogre::String);
 		Ogre::SceneNode* CreateTerrain(Ogre::SceneNode* , const float, const float, Ogre::String);
 };
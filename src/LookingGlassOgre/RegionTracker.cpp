@@ -24,6 +24,7 @@
 #include "RendererOgre.h"
 #include "Region.h"
 #include "RegionTracker.h"
+#include "ProcessBetweenFrame.h"
 
 namespace LG {
 
@@ -31,6 +32,14 @@ RegionTracker* RegionTracker::m_instance = NULL;
 
 RegionTracker::RegionTracker() {
 	m_focusRegion = NULL;
+	m_originSet = false;
+	m_originX = m_originY = m_originZ = 0.0;
+	m_rebaseDistance = (double)LG::GetParameterFloat("Renderer.Ogre.Region.RebaseDistance");
+	m_prefetchSeconds = LG::GetParameterFloat("Renderer.Ogre.Prefetch.Seconds");
+	m_prefetchRadius = LG::GetParameterFloat("Renderer.Ogre.Prefetch.Radius");
+	m_prefetchMaxItems = LG::GetParameterInt("Renderer.Ogre.Prefetch.MaxItems");
+	m_lastPrefetch = 0;
+	m_prefetchTimeKeeper = new Ogre::Timer();
 }
 RegionTracker::~RegionTracker() {
 }
@@ -54,7 +63,10 @@ void RegionTracker::AddRegion(const char* regionSceneName,
 	regn->Name = regionSceneNodeName;
 	m_regions.insert(std::pair<Ogre::String, Region*>(regionSceneNodeName, regn));
 	regn->Init(globalX, globalY, globalZ, sizeX, sizeY, waterHeight);
-	RecalculateLocalCoords();
+	// only the new region needs to be placed relative to the origin
+	if (m_originSet) {
+		regn->CalculateLocal(m_originX, m_originY, m_originZ);
+	}
 }
 
 Region* RegionTracker::FindRegion(Ogre::String nam) {
@@ -85,7 +97,9 @@ void RegionTracker::UpdateTerrain(const char* regnName, const int width, const i
 	}
 }
 
-// Set a focus region and update all region's local coords relative to the focus region
+// Set a focus region. If the focus region is far from the current origin, the origin
+// is moved to the focus region and all the region's local coords are recalculated.
+// Crossing into a nearby region doesn't touch the scene graph at all.
 // BETWEEN FRAME OPERATION
 void RegionTracker::SetFocusRegion(Ogre::String regionName) {
 	LG::Log("RegionTracker::SetFocusRegion: %s", regionName.c_str());
@@ -97,39 +111,53 @@ void RegionTracker::SetFocusRegion(Ogre::String regionName) {
 	if (regn != NULL) {
 		m_focusRegion = regn;
 		regn->SetFocusRegion(true);
-		RecalculateLocalCoords();
+		double dX = regn->GlobalX - m_originX;
+		double dY = regn->GlobalY - m_originY;
+		double dZ = regn->GlobalZ - m_originZ;
+		if (!m_originSet || (dX*dX + dY*dY + dZ*dZ) > (m_rebaseDistance * m_rebaseDistance)) {
+			LG::Log("RegionTracker::SetFocusRegion: rebasing origin to %s", regionName.c_str());
+			if (m_originSet && LG::RendererOgre::Instance()->m_camera != NULL) {
+				LG::RendererOgre::Instance()->m_camera->RebaseOrigin(
+							Ogre::Vector3((Ogre::Real)dX, (Ogre::Real)dY, (Ogre::Real)dZ));
+			}
+			m_originX = regn->GlobalX;
+			m_originY = regn->GlobalY;
+			m_originZ = regn->GlobalZ;
+			m_originSet = true;
+			RecalculateLocalCoords();
+		}
 	}
 }
 
-// recalcualate the local coords based on the focus region
+// recalcualate the local coords based on the origin.
+// Each region's scene node is the one parent transform for everything in the region
+// so setting its position is enough. Ogre marks the region's subtree as changed;
+// no need to dirty the whole scene graph from the root.
 // BETWEEN FRAME OPERATION
 void RegionTracker::RecalculateLocalCoords() {
-	Region* regn = GetFocusRegion();
-	if (regn != NULL) {
+	if (m_originSet) {
 		for (RegionHashMap::iterator intr = m_regions.begin(); intr != m_regions.end(); intr++) {
 			Region* otherRegn = intr->second;
-			otherRegn->CalculateLocal(regn->GlobalX, regn->GlobalY, regn->GlobalZ);
+			otherRegn->CalculateLocal(m_originX, m_originY, m_originZ);
 		}
 	}
-	// Do I have to update all the scene nodes to tell them that stuff has changed?
-	LG::RendererOgre::Instance()->m_sceneMgr->getRootSceneNode()->needUpdate();
 }
 
-// Focusing a region causes the coordinate system to be zeroed to that point. Since the camera
-// operates in global coordinates, it must be offset for the focus region.
+// The coordinate system is zeroed at the origin (the focus region when it was last
+// rebased). Since the camera operates in global coordinates, it must be offset.
 Ogre::Vector3 RegionTracker::PositionForFocusRegion(Ogre::Vector3 pos) {
 	return PositionCameraForFocusRegion(pos.x, pos.y, pos.z);
 }
 
-// Focusing a region causes the coordinate system to be zeroed to that point. Since the camera
-// operates in global coordinates, it must be offset for the focus region.
+// The coordinate system is zeroed at the origin (the focus region when it was last
+// rebased). Since the camera operates in global coordinates, it must be offset.
+// The subtraction is done in doubles so only the small result is a float.
 Ogre::Vector3 RegionTracker::PositionCameraForFocusRegion(double px, double py, double pz) {
-	Region* fRegion = GetFocusRegion();
 	Ogre::Vector3 newPos;
-	if (fRegion != NULL) {
-		newPos.x = (Ogre::Real)(px - fRegion->GlobalX);
-		newPos.y = (Ogre::Real)(py - fRegion->GlobalY);
-		newPos.z = (Ogre::Real)(pz - fRegion->GlobalZ);
+	if (m_originSet) {
+		newPos.x = (Ogre::Real)(px - m_originX);
+		newPos.y = (Ogre::Real)(py - m_originY);
+		newPos.z = (Ogre::Real)(pz - m_originZ);
 	}
 	else {
 		// if no focus region, just return what they passed
@@ -146,6 +174,44 @@ Region* RegionTracker::GetFocusRegion() {
 	return m_focusRegion;
 }
 
+// Use the camera's motion to guess where it will be in a few seconds. If that's in
+// one of our regions, move the queued work for that area to the front of the queue
+// and start loading its meshes so crossing into a region doesn't find it empty.
+// Called on camera updates so it throttles itself.
+// BETWEEN FRAME OPERATION
+void RegionTracker::PredictAndPrefetch() {
+	if (m_prefetchSeconds <= 0.0f) {
+		return;
+	}
+	unsigned long now = m_prefetchTimeKeeper->getMilliseconds();
+	if (now < (m_lastPrefetch + 500)) {
+		return;
+	}
+	m_lastPrefetch = now;
+	LGCamera* cam = LG::RendererOgre::Instance()->m_camera;
+	if (cam == NULL || cam->getSpeed() < 1.0f) {
+		// not going anywhere so the normal ordering is fine
+		return;
+	}
+	Ogre::Vector3 predicted = cam->PredictPosition(m_prefetchSeconds);
+	for (RegionHashMap::iterator intr = m_regions.begin(); intr != m_regions.end(); intr++) {
+		Region* regn = intr->second;
+		Ogre::SceneNode* regionNode = regn->Resolutions[RegionRezCodeHigh];
+		if (regionNode == NULL) continue;
+		// convert to region coordinates (<x, y, height>) which is what the queued work uses
+		Ogre::Vector3 regionLoc = regionNode->convertWorldToLocalPosition(predicted);
+		if (regionLoc.x >= 0.0f && regionLoc.x < regn->SizeX && regionLoc.y >= 0.0f && regionLoc.y < regn->SizeY) {
+			int moved = LG::ProcessBetweenFrame::Instance()->PrioritizeArea(regionNode, regionLoc, 
+								m_prefetchRadius, m_prefetchMaxItems);
+			if (moved > 0) {
+				LG::Log("RegionTracker::PredictAndPrefetch: prioritized %d items in %s around <%f,%f,%f>",
+							moved, regn->Name.c_str(), (double)regionLoc.x, (double)regionLoc.y, (double)regionLoc.z);
+			}
+			break;
+		}
+	}
+}
+
 void RegionTracker::SetRegionDetail(Ogre::String regionName, const RegionRezCode LODLevel) {
 	Region* regn = FindRegion(regionName);
 	if (regn != NULL) {
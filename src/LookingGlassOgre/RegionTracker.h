@@ -54,6 +54,8 @@ public:
 	Ogre::Vector3 PositionForFocusRegion(Ogre::Vector3 pos);
 	Ogre::Vector3 PositionCameraForFocusRegion(double px, double py, double pz);
 
+	void PredictAndPrefetch();
+
 private:
 	static RegionTracker* m_instance;
 
@@ -62,5 +64,20 @@ private:
 	Region* m_focusRegion;
 	void RecalculateLocalCoords();
 
+	// The global coordinates of the Ogre origin. Only moved when the focus region
+	// gets far enough away that float precision becomes a problem.
+	bool m_originSet;
+	double m_originX;
+	double m_originY;
+	double m_originZ;
+	double m_rebaseDistance;
+
+	// prefetching of the area the camera is heading towards
+	float m_prefetchSeconds;
+	float m_prefetchRadius;
+	int m_prefetchMaxItems;
+	unsigned long m_lastPrefetch;
+	Ogre::Timer* m_prefetchTimeKeeper;
+
 };
 }
\ No newline at end of file
@@ -32,9 +32,17 @@
 #include "LGLocking.h"
 #include "RendererOgre.h"
 #include "LookingGlassOgre.h"
+#include "LGStats.h"
+#include "LGLog.h"
 #include "AnimTracker.h"
+#include "AvatarTracker.h"
 #include "OLArchive.h"
 #include "OLPreloadArchive.h"
+#include "OLPackFile.h"
+#include "OLPlaceholder.h"
+#include "OLTextureDecoder.h"
+#include "OLTextureStreamer.h"
+#include "OLTextureAtlas.h"
 #include "RegionTracker.h"
 #include "ResourceListeners.h"
 #include "ProcessBetweenFrame.h"
@@ -49,6 +57,9 @@
 #include "VisCalcNull.h"
 #include "VisCalcFrustDist.h"
 #include "VisCalcVariable.h"
+#include "LGTrace.h"
+#include "LGReplay.h"
+#include "LGHeadless.h"
 
 namespace LG {
 
@@ -56,6 +67,9 @@ namespace LG {
 
 	RendererOgre::RendererOgre() {
 		m_alreadyOneFrame = 0;
+		m_headless = false;
+		m_lastFrameUs = 0;
+		m_frameStartedUs = 0;
 	}
 
 	RendererOgre::~RendererOgre() {
@@ -90,8 +104,8 @@ namespace LG {
 		unsigned long now = rendererTimeKeeper->getMilliseconds();
 		unsigned long timeStartedLastFrame = rendererTimeKeeper->getMilliseconds();
 
-		while (m_root->renderOneFrame()) {
-			Ogre::WindowEventUtilities::messagePump();
+		while (renderFrame()) {
+			if (!m_headless) Ogre::WindowEventUtilities::messagePump();
 			now = rendererTimeKeeper->getMilliseconds();
 			/*
 			int remaining = msPerFrame - ((int)(now - timeStartedLastFrame));
@@ -110,6 +124,7 @@ namespace LG {
 			if (totalMSForLastFrame < 0) totalMSForLastFrame = 1;
 			LG::SetStat(LG::StatFramesPerSecond, 1000000/totalMSForLastFrame);
 			timeStartedLastFrame = rendererTimeKeeper->getMilliseconds();
+			RecordFrameTime();
 		}
 		LG::Log("RendererOgre::renderingThread: Completed rendering");
 		destroyScene();
@@ -134,7 +149,7 @@ namespace LG {
 			// LGLOCK_LOCK(m_sceneGraphLock);
 			if (++m_alreadyOneFrame > 1) return ret;
 			try {
-				ret = m_root->renderOneFrame();
+				ret = renderFrame();
 			}
 			catch (Ogre::Exception e) {
 				LG::Log("RendererOgre::renderOneFrame: m_root->renderOneFrame() threw: %s", e.getFullDescription().c_str());
@@ -176,6 +191,7 @@ namespace LG {
 			LG::SetStat(LG::StatLastFrameMs, totalMSForLastFrame);
 			LG::SetStat(LG::StatFramesPerSecond, 1000000/totalMSForLastFrame);
 			m_lastFrameTime = rendererTimeKeeper->getMilliseconds();
+			RecordFrameTime();
 
 			if (!ret) {
 				// if renderOneFrame returns false, it means we're going down
@@ -188,6 +204,31 @@ namespace LG {
 		return ret;
 	}
 
+	bool RendererOgre::renderFrame() {
+		if (!m_headless) {
+			return m_root->renderOneFrame();
+		}
+		// Root::renderOneFrame less the render targets. The scene graph is still
+		// updated since that is part of the frame's cost.
+		if (!m_root->_fireFrameStarted()) return false;
+		{
+			LGTRACE_SCOPE("HeadlessSceneGraph");
+			if (m_camera != NULL) m_sceneMgr->_updateSceneGraph(m_camera->Cam);
+		}
+		if (!m_root->_fireFrameRenderingQueued()) return false;
+		return m_root->_fireFrameEnded();
+	}
+
+	// the frame time histogram is in microseconds so it shows the jitter
+	void RendererOgre::RecordFrameTime() {
+		Ogre::uint64 nowUs = LGLOCK_MICROSECONDS();
+		if (m_lastFrameUs != 0) {
+			LG::StatTime(LG::HistFrameTime, nowUs - m_lastFrameUs);
+			LG::TraceFrameTime(nowUs - m_lastFrameUs);
+		}
+		m_lastFrameUs = nowUs;
+	}
+
 	// Update the camera position given an location and a direction
 	void RendererOgre::updateCamera(double px, double py, double pz, 
 				float dw, float dx, float dy, float dz,
@@ -204,6 +245,12 @@ namespace LG {
 	void RendererOgre::initialize() {
 		LG::Log("RendererOgre::initialize: ");
 
+		LG::LogInitialize();
+		LGLOCK_PROFILE(LG::GetParameterBool("Renderer.Ogre.LockProfile"));
+		LG::TraceInitialize();
+		LGTRACE_THREAD("Render");
+		LG::ReplayInitialize();
+		m_headless = LG::GetParameterBool("Renderer.Ogre.Headless");
 		m_sceneGraphLock = LGLOCK_ALLOCATE_MUTEX("sceneGraph");
 
 		m_cacheDir = LG::GetParameter("Renderer.Ogre.CacheDir");
@@ -258,12 +305,25 @@ namespace LG {
 
 	void RendererOgre::destroyScene() {
 		// TODO: write something here
+		LG::AnimTracker::Instance()->Shutdown();
+		LG::AvatarTracker::Instance()->Shutdown();
+		LG::OLTextureAtlas::Instance()->Shutdown();
+		LG::OLTextureStreamer::Instance()->Shutdown();
+		LG::OLTextureDecoder::Instance()->Shutdown();
+		LG::OLPlaceholder::Instance()->Shutdown();
+		LG::OLMaterialTracker::Instance()->Shutdown();
+		LG::OLPackFile::Instance()->Shutdown();
+		LG::TraceShutdown();
+		LG::ReplayShutdown();
+		// last so the shutdown messages get out
+		LG::LogShutdown();
 		return;
 	}
 
 	// Load all the resource locations from the resource configuration file
 	void RendererOgre::loadOgreResources(const char* resourceFile) {
 		LG::Log("RendererOgre::loadOgreResources: ");
+		if (resourceFile == NULL || strlen(resourceFile) == 0) return;
 		Ogre::String secName, typeName, archName;
 		Ogre::ConfigFile cf;
 		cf.load(resourceFile);
@@ -295,6 +355,12 @@ namespace LG {
 		LG::OLMeshTracker::Instance();
 		LG::RegionTracker::Instance();
 		LG::AnimTracker::Instance();
+		LG::AvatarTracker::Instance();
+		LG::OLPackFile::Instance();
+		LG::OLPlaceholder::Instance();
+		LG::OLTextureDecoder::Instance();
+		LG::OLTextureStreamer::Instance();
+		LG::OLTextureAtlas::Instance();
 		while (!LGLOCK_THREADS_AREINITIALIZED) {
 			// wait for any initializing threads to do their thing before doing post...
 			LGLOCK_SLEEP(1);
@@ -322,6 +388,12 @@ namespace LG {
 
 	void RendererOgre::configureOgreRenderSystem() {
 		LG::Log("RendererOgre::configureOgreRenderSystem:");
+		if (m_headless) {
+			LG::Log("RendererOgre::configureOgreRenderSystem: headless. Stub render system and no window.");
+			LG::HeadlessInitialize(m_root);
+			m_window = NULL;
+			return;
+		}
 		Ogre::String rsystem = LG::GetParameter("Renderer.Ogre.Renderer");
 		Ogre::RenderSystem* rs = m_root->getRenderSystemByName(rsystem);
 		if (rs == NULL) {
@@ -376,6 +448,10 @@ namespace LG {
 			MaterialAmbientColor = LG::GetParameterColor("Renderer.Ogre.Ambient.Material");
 			m_sceneMgr->setAmbientLight(SceneAmbientColor);
 			m_sceneMgr->setCameraRelativeRendering(true);
+			if (LG::OLMaterialTracker::Instance()->UseUberShader()) {
+				// the prim shader gets the face values from the renderables
+				m_sceneMgr->addRenderObjectListener(LG::OLMaterialTracker::Instance());
+			}
 			const char* shadowName = LG::GetParameter("Renderer.Ogre.ShadowTechnique");
 			if (strlen(shadowName) == 0 || stricmp(shadowName, "none") == 0) {
 				this->Shadow = new ShadowBase();
@@ -406,6 +482,12 @@ namespace LG {
 
 	void RendererOgre::createViewport() {
 		LG::Log("RendererOgre::createViewport");
+		if (m_window == NULL) {
+			// headless. The visibility code does without a viewport.
+			m_viewport = NULL;
+			m_camera->Cam->setAspectRatio(4.0f / 3.0f);
+			return;
+		}
 		m_viewport = m_window->addViewport(m_camera->Cam);
 		m_viewport->setBackgroundColour(Ogre::ColourValue(0.0f, 0.0f, 0.25f));
 		m_camera->Cam->setAspectRatio((float)m_viewport->getActualWidth() / (float)m_viewport->getActualHeight());
@@ -460,6 +542,8 @@ namespace LG {
 	// ========== Ogre::FrameListener
 	bool RendererOgre::frameStarted(const Ogre::FrameEvent& evt) {
 		LG::StatIn(LG::InOutRendererOgreStarted);
+		LGTRACE_SCOPE("RendererOgre.frameStarted");
+		if (LG::traceEnabled) m_frameStartedUs = LGLOCK_MICROSECONDS();
 		if (m_camera) m_camera->AdvanceCamera(evt);
 		LG::StatOut(LG::InOutRendererOgreStarted);
 		return true;
@@ -472,7 +556,15 @@ namespace LG {
 	int betweenFrameCounter = 0;
 	bool RendererOgre::frameEnded(const Ogre::FrameEvent& evt) {
 		LG::StatIn(LG::InOutRendererOgre);
-		if (m_window->isClosed()) return false;	// if you close the window we leave
+		if (LG::traceEnabled && m_frameStartedUs != 0) {
+			// the frame listeners' frameStarted plus Ogre culling and rendering
+			LG::TraceRecord("Frame", m_frameStartedUs, LGLOCK_MICROSECONDS() - m_frameStartedUs);
+		}
+		LGTRACE_SCOPE("RendererOgre.frameEnded");
+		if (m_window != NULL && m_window->isClosed()) return false;	// if you close the window we leave
+		if (LG::replayRecording) {
+			LG::ReplayRecord frameMark(LG::ReplayFrame);
+		}
 		LG::IncStat(LG::StatTotalFrames);
 		betweenFrameCounter++;
 		if (LG::betweenFramesCallback != NULL) {
@@ -480,6 +572,7 @@ namespace LG {
 			try {
 				if ((betweenFrameCounter % 50) == 0) {
 					LG::StatOut(LG::InOutRendererOgre);
+					LGTRACE_SCOPE("ManagedBetweenFrames");
 					return (*LG::betweenFramesCallback)();
 				}
 			}
@@ -499,6 +592,8 @@ namespace LG {
 							const char* entName, const char* meshNam) {
 		// LG::Log("RendererOgre::AddEntity: declare %s, t=%s, g=%s", meshNam, "Mesh", OLResourceGroupName);
 		Ogre::String meshName = Ogre::String(meshNam);
+		// if we don't have the mesh yet, it starts out as a placeholder
+		LG::OLPlaceholder::Instance()->DeclareMesh(meshName);
 		Ogre::ResourceGroupManager::getSingleton().declareResource(meshName,
 								"Mesh", OLResourceGroupName
 								);
@@ -517,6 +612,7 @@ namespace LG {
 			Shadow->AddCasterShadow(ent);
 			// Shadow->AddReceiverShadow(ent);
 			sceneNode->attachObject(ent);
+			LG::AvatarTracker::Instance()->EntityCreated((Ogre::Entity*)ent);
 			m_visCalc->RecalculateVisibility();
 		}
 		catch (Ogre::Exception e) {
@@ -593,7 +689,7 @@ namespace LG {
 					bool updatePosition, float px, float py, float pz, float pduration,
 					bool updateScale, float sx, float sy, float sz, float sduration,
 					bool updateRotation, float ow, float ox, float oy, float oz, float oduration) {
-		LG::Log("RendererOgre::UpdateSceneNode: update %s", entName);
+		LG::LogDetail("RendererOgre::UpdateSceneNode: update %s", entName);
 		if (m_sceneMgr->hasSceneNode(entName)) {
 			Ogre::SceneNode* sceneNode = m_sceneMgr->getSceneNode(entName);
 			if (updatePosition) {
@@ -602,7 +698,7 @@ namespace LG {
 				LG::AnimTracker::Instance()->MoveToPosition(Ogre::String(entName), Ogre::Vector3(px, py, pz), pduration);
 			}
 			if (updateScale) {
-				LG::Log("UpdateSceneNode: SCALE: <%f, %f, %f> %s", sx, sy, sz, entName);
+				LG::LogDetail("UpdateSceneNode: SCALE: <%f, %f, %f> %s", sx, sy, sz, entName);
 				sceneNode->setScale(sx, sy, sz);
 			}
 			if (updateRotation) {
@@ -647,6 +743,7 @@ namespace LG {
 		for (int ii=snode->numAttachedObjects()-1; ii>=0; ii--) {
 			Ogre::MovableObject* nodeObject = snode->getAttachedObject(ii);
 			snode->detachObject(ii);
+			LG::AvatarTracker::Instance()->EntityDestroyed(nodeObject);
 			m_sceneMgr->destroyMovableObject(nodeObject);
 		}
 		m_sceneMgr->destroySceneNode(snode);
@@ -657,6 +754,7 @@ namespace LG {
 	// same spot as the resource looker-upper will look to find it when the mesh is reloaded.
 	// BETWEEN FRAME OPERATION
 	void RendererOgre::CreateMeshResource(const char* eName, const int faceCounts[], const float faceVertices[]) {
+		LG::StatTimer buildTimer(LG::HistMeshBuild);
 		Ogre::String entName = Ogre::String(eName);
 		Ogre::String manualObjectName = "MO/" + entName;
 		Ogre::String baseMaterialName = entName;
@@ -670,37 +768,89 @@ namespace LG {
 		// Ogre::ManualObject* mo = new Ogre::ManualObject(manualObjectName);
 		LG::Log("RendererOgre::CreateMeshResource: Creating mo. f = %d, %s", faces, manualObjectName.c_str());
 
-		int iface, iv;
+		int iface, jface, iv;
 		const float* fVf;
-		Ogre::String materialName;
+		// Faces with textures in the atlas get the atlas material and their texture
+		// coordinates moved into the texture's spot on the atlas page.
+		std::vector<Ogre::String> faceNames(faces);
+		std::vector<Ogre::String> faceMaterials(faces);
+		std::vector<Ogre::String> faceValues(faces);
+		std::vector<LG::OLTextureAtlas::AtlasRect> faceRects(faces);
+		std::vector<bool> faceInAtlas(faces, false);
+		// the faces it was built with before don't count any more
+		LG::OLMaterialTracker::Instance()->NoteMeshUnloaded(entName);
 		for (iface = 0; iface < faces; iface++) {
-			materialName = PrecomputedMaterialName(baseMaterialName, iface);
-			mo->begin(materialName);
-			fVf = fV + fC[0];
-			const float* vColor = fVf;
-			fVf += 4;
-			// LG::Log("RendererOgre::CreateMeshResource: F%d: vertices %d, %d, %d", iface, fC[0], fC[1], fC[2]);
-			for (iv=0; iv < fC[1]; iv++) {
-				// LG::Log("RendererOgre::CreateMeshResource: %f, %f, %f, %f, %f", fVf[0], fVf[1], fVf[2], fVf[3], fVf[4] );
-				mo->position(fVf[0], fVf[1], fVf[2]);
-				mo->colour(vColor[0], vColor[1], vColor[2], vColor[3]);
-				mo->textureCoord(fVf[3], fVf[4]);
-				mo->normal(fVf[5], fVf[6], fVf[7]);
-				fVf += fC[2];
+			const int* fCf = fC + iface * 6;
+			faceNames[iface] = PrecomputedMaterialName(baseMaterialName, iface);
+			faceMaterials[iface] = faceNames[iface];
+			faceValues[iface] = LG::OLMaterialTracker::Instance()->FaceValuesKey(faceNames[iface]);
+			Ogre::String atlasMaterialName;
+			if (LG::OLTextureAtlas::Instance()->MapFace(entName, faceMaterials[iface], 
+							fV + fCf[0] + 4, fCf[1], fCf[2], &atlasMaterialName, &faceRects[iface])) {
+				faceMaterials[iface] = atlasMaterialName;
+				faceInAtlas[iface] = true;
 			}
-			fC += 3;
-			fVf = fV + fC[0];
-			// LG::Log("RendererOgre::CreateMeshResource: F%d: indices %d, %d, %d", iface, fC[0], fC[1], fC[2]);
-			for (iv=0; iv < fC[1]; iv += 3) {
-				// LG::Log("RendererOgre::CreateMeshResource: %f, %f, %f", fVf[0], fVf[1], fVf[2]);
-				mo->triangle((Ogre::uint32)fVf[0], (Ogre::uint32)fVf[1], (Ogre::uint32)fVf[2]);
-				// mo->index((Ogre::uint32)fVf[0]);
-				// mo->index((Ogre::uint32)fVf[1]);
-				// mo->index((Ogre::uint32)fVf[2]);
-				fVf += fC[2];
+			else {
+				// faces with the same definition share one material
+				faceMaterials[iface] = LG::OLMaterialTracker::Instance()->CanonicalMaterialName(entName, faceMaterials[iface]);
+			}
+		}
+		// Faces that end up with the same material go into one section so they're one batch.
+		// With the prim shader, they also need the same face values. Each section is
+		// named for its first face so the renderable can find the values.
+		std::vector<bool> faceDone(faces, false);
+		std::vector<Ogre::String> sectionNames;
+		for (iface = 0; iface < faces; iface++) {
+			if (faceDone[iface]) continue;
+			mo->begin(faceMaterials[iface]);
+			sectionNames.push_back(faceNames[iface]);
+			std::vector<Ogre::String> sectionFaces;
+			Ogre::uint32 vertBase = 0;
+			for (jface = iface; jface < faces; jface++) {
+				if (faceDone[jface] || faceMaterials[jface] != faceMaterials[iface]
+							|| faceValues[jface] != faceValues[iface]) continue;
+				faceDone[jface] = true;
+				sectionFaces.push_back(faceNames[jface]);
+				const int* fCf = fC + jface * 6;
+				const LG::OLTextureAtlas::AtlasRect& rect = faceRects[jface];
+				fVf = fV + fCf[0];
+				const float* vColor = fVf;
+				fVf += 4;
+				// LG::Log("RendererOgre::CreateMeshResource: F%d: vertices %d, %d, %d", jface, fCf[0], fCf[1], fCf[2]);
+				for (iv=0; iv < fCf[1]; iv++) {
+					// LG::Log("RendererOgre::CreateMeshResource: %f, %f, %f, %f, %f", fVf[0], fVf[1], fVf[2], fVf[3], fVf[4] );
+					mo->position(fVf[0], fVf[1], fVf[2]);
+					mo->colour(vColor[0], vColor[1], vColor[2], vColor[3]);
+					if (faceInAtlas[jface]) {
+						mo->textureCoord(rect.u0 + Ogre::Math::Clamp(fVf[3], 0.0f, 1.0f) * rect.su,
+										rect.v0 + Ogre::Math::Clamp(fVf[4], 0.0f, 1.0f) * rect.sv);
+					}
+					else {
+						mo->textureCoord(fVf[3], fVf[4]);
+					}
+					mo->normal(fVf[5], fVf[6], fVf[7]);
+					fVf += fCf[2];
+				}
+				fVf = fV + fCf[3];
+				// LG::Log("RendererOgre::CreateMeshResource: F%d: indices %d, %d, %d", jface, fCf[3], fCf[4], fCf[5]);
+				for (iv=0; iv < fCf[4]; iv += 3) {
+					// LG::Log("RendererOgre::CreateMeshResource: %f, %f, %f", fVf[0], fVf[1], fVf[2]);
+					mo->triangle(vertBase + (Ogre::uint32)fVf[0], vertBase + (Ogre::uint32)fVf[1], 
+								vertBase + (Ogre::uint32)fVf[2]);
+					// mo->index((Ogre::uint32)fVf[0]);
+					// mo->index((Ogre::uint32)fVf[1]);
+					// mo->index((Ogre::uint32)fVf[2]);
+					fVf += fCf[5];
+				}
+				vertBase += fCf[1];
+			}
+			if (mo->end() == NULL) {
+				// empty sections are dropped
+				sectionNames.pop_back();
+			}
+			else if (sectionFaces.size() > 1 && !faceInAtlas[iface]) {
+				LG::OLMaterialTracker::Instance()->NoteMergedFaces(sectionFaces);
 			}
-			fC += 3;
-			mo->end();
 		}
 
 		LG::Log("RendererOgre::CreateMeshResource: converting to mesh: %s", entName.c_str());
@@ -712,6 +862,9 @@ namespace LG {
 				LG::OLMeshTracker::Instance()->UpdateSceneNodesForMesh(entName);
 			} 
 			Ogre::MeshPtr mesh = mo->convertToMesh(entName , OLResourceGroupName);
+			for (size_t isect = 0; isect < sectionNames.size() && isect < mesh->getNumSubMeshes(); isect++) {
+				mesh->nameSubMesh(sectionNames[isect], (Ogre::ushort)isect);
+			}
 			mo->clear();
 			m_sceneMgr->destroyManualObject(mo);
 			mo = 0;
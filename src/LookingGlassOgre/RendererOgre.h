@@ -138,12 +138,20 @@ private:
 	LGLOCK_MUTEX m_sceneGraphLock;
 	int m_alreadyOneFrame;
 
+	// Headless: a stub render system and no window or GPU (see LGHeadless.h). The
+	// frame listeners are still called each frame but nothing is drawn.
+	bool m_headless;
+	bool renderFrame();
+
 	Ogre::String m_cacheDir; 
 	Ogre::String m_preloadedDir; 
 	bool m_serializeMeshes;
 	Ogre::String PrecomputedMaterialName(Ogre::String, int);
 
 	unsigned long m_lastFrameTime;
+	Ogre::uint64 m_lastFrameUs;
+	Ogre::uint64 m_frameStartedUs;
+	void RecordFrameTime();
 
 	Ogre::Quaternion m_desiredCameraOrientation;
 	float m_desiredCameraOrientationProgress;
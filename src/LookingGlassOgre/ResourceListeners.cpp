@@ -24,6 +24,7 @@
 #include "LookingGlassOgre.h"
 #include "RendererOgre.h"
 #include "ResourceListeners.h"
+#include "AvatarTracker.h"
 
 namespace LG {
 OLResourceLoadingListener::OLResourceLoadingListener() {
@@ -76,7 +77,8 @@ void OLMeshSerializerListener::processMaterialName(Ogre::Mesh* mesh, Ogre::Strin
 	}
 }
 void OLMeshSerializerListener::processSkeletonName(Ogre::Mesh *mesh, Ogre::String *name) {
-	LG::Log("ResourceListeners::processSkeletonName: %s -> %s", mesh->getName().c_str(), name->c_str());
+	// LG::Log("ResourceListeners::processSkeletonName: %s -> %s", mesh->getName().c_str(), name->c_str());
+	LG::AvatarTracker::Instance()->SkeletonReferenced(mesh, name);
 }
 
 // ==========================================================================
@@ -24,6 +24,7 @@
 #include "SkyBoxSkyX.h"
 #include "RegionTracker.h"
 #include "RendererOgre.h"
+#include "LGTrace.h"
 
 namespace LG {
 
@@ -117,6 +118,7 @@ void SkyBoxSkyX::AddSkyPass(Ogre::MaterialPtr matP) {
 int sunPositionThrottle = 10;
 bool SkyBoxSkyX::frameStarted(const Ogre::FrameEvent &e) {
 	LG::StatIn(LG::InOutSkyBoxSkyX);
+	LGTRACE_SCOPE("SkyBoxSkyX");
 
 // bool SkyBoxSkyX::frameRenderingQueued(const Ogre::FrameEvent &e) {
 	try {
@@ -27,6 +27,10 @@
 #include "OLMeshTracker.h"
 #include "RegionTracker.h"
 #include "Region.h"
+#include "OLTextureStreamer.h"
+#include "LGStats.h"
+#include "LGTrace.h"
+#include "LGParams.h"
 
 namespace LG { 
 	
@@ -37,6 +41,15 @@ VisCalcFrustDist::~VisCalcFrustDist() {
 }
 
 void VisCalcFrustDist::Initialize() {
+	ReadParameters();
+	m_parametersChanged = false;
+	// the distances can be tuned while running
+	LG::ParamAddListener("Renderer.Ogre.Visibility.", &VisCalcFrustDist::ParametersChanged, this);
+	m_pixelsPerUnitAngle = 0.0;
+	return;
+}
+
+void VisCalcFrustDist::ReadParameters() {
 	// visibility culling parameters
 	m_shouldCullMeshes = LG::GetParameterBool("Renderer.Ogre.Visibility.Cull.Meshes");
 	m_shouldCullTextures = LG::GetParameterBool("Renderer.Ogre.Visibility.Cull.Textures");
@@ -56,7 +69,12 @@ void VisCalcFrustDist::Initialize() {
 					m_shouldCullByDistance ? "true" : "false"
 	);
 	m_meshesReloadedPerFrame = LG::GetParameterInt("Renderer.Ogre.Visibility.MeshesReloadedPerFrame");
-	return;
+}
+
+// Called on whatever thread changed the parameter. Just note it and let the
+// between frame code pick up the new values.
+void VisCalcFrustDist::ParametersChanged(int key, void* obj) {
+	((VisCalcFrustDist*)obj)->m_parametersChanged = true;
 }
 
 void VisCalcFrustDist::Start() {
@@ -75,7 +93,13 @@ void VisCalcFrustDist::RecalculateVisibility() {
 // we're between frames, on our own thread so we can do the work without locking
 bool VisCalcFrustDist::frameEnded(const Ogre::FrameEvent& evt) {
 	LG::StatIn(LG::InOutVisCalcFrustDist);
+	LGTRACE_SCOPE("VisCalcFrustDist");
 	try {
+		if (m_parametersChanged) {
+			m_parametersChanged = false;
+			ReadParameters();
+			m_recalculateVisibility = true;
+		}
 		if (m_recalculateVisibility) {
 			calculateEntityVisibility();
 		}
@@ -104,8 +128,19 @@ int visInvisToInvis;
 void VisCalcFrustDist::calculateEntityVisibility() {
 	if ((!m_recalculateVisibility) || ((!m_shouldCullByDistance) && (!m_shouldCullByFrustrum))) return;
 	m_recalculateVisibility = false;
+	LG::StatTimer passTimer(LG::HistVisibilityPass);
 	visRegions = visChildren = visEntities = visNodes = 0;
 	visVisToVis = visVisToInvis = visInvisToVis = visInvisToInvis = 0;
+	LG::OLTextureStreamer::Instance()->StartVisibilityPass();
+	// for converting entity size and distance into pixels on the screen
+	m_pixelsPerUnitAngle = 0.0;
+	LG::LGCamera* cam = LG::RendererOgre::Instance()->m_camera;
+	if (cam != NULL && LG::RendererOgre::Instance()->m_viewport != NULL) {
+		float halfTan = Ogre::Math::Tan(cam->Cam->getFOVy() / 2);
+		if (halfTan > 0.0) {
+			m_pixelsPerUnitAngle = (float)LG::RendererOgre::Instance()->m_viewport->getActualHeight() / (2 * halfTan);
+		}
+	}
 	/*
 	Ogre::SceneNode* nodeRoot = LG::RendererOgre::Instance()->m_sceneMgr->getRootSceneNode();
 	if (nodeRoot == NULL) return;
@@ -172,6 +207,12 @@ void VisCalcFrustDist::calculateEntityVisibility(Ogre::Node* regionNode, Ogre::N
 				// computation if it should be visible
 				// Note: this call is overridden by derived classes that do fancier visibility rules
 				bool shouldBeVisible = this->CalculateVisibilityImpl(LG::RendererOgre::Instance()->m_camera, snodeEntity, snodeDistance);
+				if (shouldBeVisible && m_pixelsPerUnitAngle > 0.0) {
+					// tell the texture streamer how big it is on the screen this pass
+					float dist = (snodeDistance > 0.1) ? snodeDistance : 0.1;
+					LG::OLTextureStreamer::Instance()->NoteEntityVisible(snodeEntity,
+							snodeEntity->getBoundingRadius() * 2 / dist * m_pixelsPerUnitAngle);
+				}
 				if (snodeEntity->isVisible()) {
 					// we currently think this object is visible. make sure it should stay that way
 					if (shouldBeVisible) {
@@ -337,6 +378,7 @@ void VisCalcFrustDist::unloadTheMesh(Ogre::MeshPtr meshP) {
 							if (!texP.isNull()) {
 								// if (texP.useCount() <= 1) {
 									texP->unload();
+									LG::OLTextureStreamer::Instance()->NoteTextureUnloaded(texName);
 									LG::IncStat(LG::StatCullTexturesUnloaded);
 									// LG::Log("unloadTheMesh: unloading texture %s", texName.c_str());
 								// }
@@ -54,6 +54,10 @@ protected:
 	bool calculateScaleVisibility(float, float);
 	void SetVis(Ogre::Entity*);
 
+	void ReadParameters();
+	static void ParametersChanged(int, void*);
+	volatile bool m_parametersChanged;			// a visibility parameter changed. Read them between frames.
+
 	void processEntityVisibility();
 	// void queueMeshLoad(Ogre::Entity*, Ogre::MeshPtr);
 	void queueMeshUnload(Ogre::MeshPtr);
@@ -66,6 +70,7 @@ protected:
 	float m_visibilityScaleOnlyLargeAfter;	// after this distance, only large things visible
 	float m_visibilityScaleMinDistance;		// always visible is this close
 	float m_visibilityScaleLargeSize;		// what is large enough to see at a distance
+	float m_pixelsPerUnitAngle;				// screen pixels for a unit size at unit distance
 	bool m_recalculateVisibility;			// set to TRUE if visibility should be recalcuated
 
 	int m_meshesReloadedPerFrame;			// number of meshes to reload per frame